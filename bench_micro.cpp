@@ -0,0 +1,535 @@
+#include "../include/hft_server.hpp"
+#include "../include/interceptors.hpp"
+#include "../include/services.hpp"
+#include "../include/static_pipeline.hpp"
+#include "../include/lock_free_queue.hpp"
+#include "../include/latency_histogram.hpp"
+#include "../include/async_logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Single-threaded microbenchmarks for the components on the request hot path,
+// timed with the CPU's cycle counter and free of network noise. Each benchmark
+// runs in batches; the median batch is checked against a fixed ceiling and,
+// with --baseline, against an earlier run, so a regression of a couple of
+// hundred nanoseconds in one component fails the run.
+
+// TSC on x86; elsewhere monotonic nanoseconds, which calibrate to 1 cycle/ns
+static inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int core;
+    return __rdtscp(&core);
+#else
+    return monotonicNanos();
+#endif
+}
+
+static double calibrateCyclesPerNano() {
+    uint64_t startNs = monotonicNanos();
+    uint64_t startCycles = readCycles();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    uint64_t cycles = readCycles() - startCycles;
+    uint64_t nanos = monotonicNanos() - startNs;
+    return nanos ? static_cast<double>(cycles) / nanos : 1.0;
+}
+
+// Keeps a result alive so the compiler can't drop the work that produced it
+template<typename T>
+static inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct MicroBenchmark {
+    std::string name;
+    double ceilingNs;   // Median ns per operation above which the run fails
+    // Performs `iterations` operations and returns the cycles they took
+    std::function<uint64_t(size_t iterations)> run;
+};
+
+struct MicroOptions {
+    size_t iterations = 10000;   // Operations per batch
+    size_t batches = 25;
+    std::string filter;
+    std::string baselinePath;
+    std::string savePath;
+    // A result regresses when it exceeds its baseline by both of these
+    double toleranceNs = 50;
+    double tolerancePercent = 10;
+    bool list = false;
+};
+
+static const char* const BENCH_REQUEST = "TOKEN:secret123 ECHO hello";
+
+static void expectPrefix(const std::string& name, StringView response, const char* prefix) {
+    if (!startsWith(response, prefix)) {
+        throw std::runtime_error(name + " answered \"" + std::string(response.data(), response.size()) +
+                                 "\", expected \"" + prefix + "...\"");
+    }
+}
+
+// Services and files shared by the benchmarks; the files live in a scratch
+// directory removed on exit
+class MicroFixtures {
+private:
+    std::string directory;
+    std::vector<std::string> files;
+
+public:
+    std::shared_ptr<FileCache> cache;
+
+    MicroFixtures() : cache(std::make_shared<FileCache>()) {
+        char pattern[] = "/tmp/bench_micro.XXXXXX";
+        if (!mkdtemp(pattern)) {
+            throw std::runtime_error("Failed to create scratch directory");
+        }
+        directory = pattern;
+    }
+
+    ~MicroFixtures() {
+        for (const std::string& file : files) {
+            unlink(file.c_str());
+        }
+        rmdir(directory.c_str());
+    }
+
+    std::string createFile(const std::string& name, size_t size) {
+        std::string path = directory + "/" + name;
+        std::ofstream out(path, std::ios::binary);
+        out << std::string(size, 'x');
+        if (!out) {
+            throw std::runtime_error("Failed to write " + path);
+        }
+        files.push_back(path);
+        return path;
+    }
+};
+
+static void addQueueBenchmarks(std::vector<MicroBenchmark>& benchmarks) {
+    // HFTRequest is what the executors queue, inline payload and all
+    size_t length = strlen(BENCH_REQUEST);
+
+    benchmarks.push_back({"queue/enqueue", 250, [length](size_t iterations) {
+        LockFreeQueue<HFTRequest> queue(iterations);
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            keep(queue.enqueue(HFTRequest(3, 1, static_cast<uint32_t>(i), BENCH_REQUEST, length, 0, 0)));
+        }
+        return readCycles() - start;
+    }});
+
+    benchmarks.push_back({"queue/dequeue", 250, [length](size_t iterations) {
+        LockFreeQueue<HFTRequest> queue(iterations);
+        for (size_t i = 0; i < iterations; ++i) {
+            queue.enqueue(HFTRequest(3, 1, static_cast<uint32_t>(i), BENCH_REQUEST, length, 0, 0));
+        }
+        HFTRequest item;
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            keep(queue.dequeue(item));
+        }
+        return readCycles() - start;
+    }});
+
+    std::shared_ptr<LockFreeQueue<HFTRequest>> ring = std::make_shared<LockFreeQueue<HFTRequest>>(1024);
+    benchmarks.push_back({"queue/roundtrip", 400, [ring, length](size_t iterations) {
+        HFTRequest item;
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            ring->enqueue(HFTRequest(3, 1, static_cast<uint32_t>(i), BENCH_REQUEST, length, 0, 0));
+            keep(ring->dequeue(item));
+        }
+        return readCycles() - start;
+    }});
+}
+
+static void addAuthBenchmark(std::vector<MicroBenchmark>& benchmarks, const std::string& name,
+                             double ceilingNs, std::shared_ptr<AuthenticationInterceptor> auth,
+                             const std::string& request, bool accepted) {
+    std::shared_ptr<std::string> text = std::make_shared<std::string>(request);
+    RequestContext check(StringView(*text), 0);
+    if (auth->preProcess(StringView(*text), check) != accepted) {
+        throw std::runtime_error(name + " gave the wrong verdict");
+    }
+
+    benchmarks.push_back({name, ceilingNs, [auth, text](size_t iterations) {
+        StringView view(*text);
+        RequestContext context(view, 0);
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            keep(auth->preProcess(view, context));
+        }
+        return readCycles() - start;
+    }});
+}
+
+static void addAuthBenchmarks(std::vector<MicroBenchmark>& benchmarks) {
+    std::shared_ptr<AuthenticationInterceptor> single = std::make_shared<AuthenticationInterceptor>("secret123");
+    addAuthBenchmark(benchmarks, "auth/accept", 250, single, BENCH_REQUEST, true);
+    addAuthBenchmark(benchmarks, "auth/reject", 250, single, "TOKEN:secret124 ECHO hello", false);
+
+    // Every lookup compares against every token, so cost grows with the set
+    std::vector<std::string> tokens;
+    for (int i = 0; i < 7; ++i) {
+        tokens.push_back("rotated-token-" + std::to_string(i));
+    }
+    tokens.push_back("secret123");
+    addAuthBenchmark(benchmarks, "auth/accept_8_tokens", 1500,
+                     std::make_shared<AuthenticationInterceptor>(tokens), BENCH_REQUEST, true);
+}
+
+// What the server does with a request once it has been read: admission, then
+// HFTServer::runPipeline() into the thread's response buffer
+struct PipelineSetup {
+    InterceptorChain chain;
+    ServiceRegistry services;
+    std::unique_ptr<IRequestPipeline> pipeline;
+    std::shared_ptr<ResponseCache> responses;
+    HFTHandlers handlers;
+    std::unique_ptr<HFTResponseBuffer> buffer;
+
+    PipelineSetup() : handlers{nullptr, &chain, &services, nullptr}, buffer(new HFTResponseBuffer()) {}
+
+    void runOnce(StringView request) {
+        if (!handlers.admit(request)) {
+            return;
+        }
+        RequestContext context(request, monotonicNanos());
+        ResponseWriter response(buffer->data, sizeof(buffer->data), &buffer->spill);
+        HFTServer::runPipeline(handlers, request, response, context);
+        keep(response.size());
+    }
+
+    std::string answer(StringView request) {
+        if (!handlers.admit(request)) {
+            return "ERROR: Not admitted";
+        }
+        RequestContext context(request, monotonicNanos());
+        ResponseWriter response(buffer->data, sizeof(buffer->data), &buffer->spill);
+        HFTServer::runPipeline(handlers, request, response, context);
+        return std::string(response.data(), response.size());
+    }
+};
+
+static void addPipelineBenchmark(std::vector<MicroBenchmark>& benchmarks, const std::string& name, double ceilingNs,
+                                 std::shared_ptr<PipelineSetup> setup) {
+    expectPrefix(name, setup->answer(BENCH_REQUEST), "ECHO: hello");
+    benchmarks.push_back({name, ceilingNs, [setup](size_t iterations) {
+        StringView request(BENCH_REQUEST);
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            setup->runOnce(request);
+        }
+        return readCycles() - start;
+    }});
+}
+
+static void addPipelineBenchmarks(std::vector<MicroBenchmark>& benchmarks, MicroFixtures& fixtures) {
+    // Every subset of the interceptors hft_server can be configured with; the
+    // rate limit is high enough never to refuse
+    static const char* const names[] = {"auth", "ratelimit", "validation", "logging"};
+    for (int mask = 0; mask < 16; ++mask) {
+        std::shared_ptr<PipelineSetup> setup = std::make_shared<PipelineSetup>();
+        std::string name = "pipeline/";
+        for (int i = 0; i < 4; ++i) {
+            if (!(mask & (1 << i))) continue;
+            if (name.size() > 9) name += "+";
+            name += names[i];
+        }
+        if (mask == 0) name += "none";
+
+        std::unique_ptr<AuthenticationInterceptor> auth(new AuthenticationInterceptor("secret123"));
+        std::shared_ptr<AuthTokenStore> validTokens = auth->tokenStore();
+        if (mask & 1) setup->chain.add(std::move(auth));
+        if (mask & 2) setup->chain.add(std::unique_ptr<IInterceptor>(new RateLimitingInterceptor(1000000000000ULL, 0, validTokens)));
+        if (mask & 4) setup->chain.add(std::unique_ptr<IInterceptor>(new ValidationInterceptor()));
+        if (mask & 8) setup->chain.add(std::unique_ptr<IInterceptor>(new LoggingInterceptor()));
+        setup->services.add(std::unique_ptr<IService>(new EchoService()));
+        setup->services.add(std::unique_ptr<IService>(new CalculatorService()));
+        setup->services.add(std::unique_ptr<IService>(new FileService(fixtures.cache)));
+        addPipelineBenchmark(benchmarks, name, 2000, setup);
+    }
+
+    // hft_server --static with a rate limit: the same stages, compiled together
+    std::shared_ptr<PipelineSetup> compiled = std::make_shared<PipelineSetup>();
+    AuthenticationInterceptor auth("secret123");
+    compiled->pipeline.reset(new StaticPipeline<AuthenticationInterceptor, RateLimitingInterceptor,
+                                                EchoService, CalculatorService, FileService>(
+        auth, RateLimitingInterceptor(1000000000000ULL, 0, auth.tokenStore()),
+        EchoService(), CalculatorService(), FileService(fixtures.cache)));
+    compiled->handlers.pipeline = compiled->pipeline.get();
+    addPipelineBenchmark(benchmarks, "pipeline/static_auth+ratelimit", 2000, compiled);
+
+    // hft_server --cache ECHO: every iteration after the first is a hit
+    std::shared_ptr<PipelineSetup> cached = std::make_shared<PipelineSetup>();
+    cached->chain.add(std::unique_ptr<IInterceptor>(new AuthenticationInterceptor("secret123")));
+    cached->services.add(std::unique_ptr<IService>(new EchoService()));
+    cached->responses = std::make_shared<ResponseCache>();
+    cached->responses->cacheCommand("ECHO", 0);
+    cached->handlers.cache = cached->responses.get();
+    addPipelineBenchmark(benchmarks, "pipeline/auth+cache_hit", 2000, cached);
+}
+
+// Requests parsed up front and processed round-robin by one service
+struct CommandSetup {
+    std::unique_ptr<IService> service;
+    std::vector<std::string> requests;
+    std::vector<Command> commands;
+    std::unique_ptr<HFTResponseBuffer> buffer;
+    bool fileTail;
+
+    CommandSetup(IService* owned, const std::vector<std::string>& texts, bool allowFileTail)
+        : service(owned), requests(texts), buffer(new HFTResponseBuffer()), fileTail(allowFileTail) {
+        commands.resize(requests.size());
+        for (size_t i = 0; i < requests.size(); ++i) {
+            parseCommand(StringView(requests[i]), commands[i]);
+        }
+    }
+
+    std::string answer(size_t index) {
+        ResponseWriter response(buffer->data, sizeof(buffer->data), &buffer->spill);
+        if (fileTail) response.allowFileTail();
+        service->processCommand(commands[index], response);
+        return std::string(response.data(), response.size());
+    }
+};
+
+static void addCommandBenchmark(std::vector<MicroBenchmark>& benchmarks, const std::string& name, double ceilingNs,
+                                std::shared_ptr<CommandSetup> setup, const char* expected) {
+    expectPrefix(name, setup->answer(0), expected);
+    benchmarks.push_back({name, ceilingNs, [setup](size_t iterations) {
+        size_t count = setup->commands.size();
+        size_t next = 0;
+        uint64_t start = readCycles();
+        for (size_t i = 0; i < iterations; ++i) {
+            ResponseWriter response(setup->buffer->data, sizeof(setup->buffer->data), &setup->buffer->spill);
+            if (setup->fileTail) response.allowFileTail();
+            setup->service->processCommand(setup->commands[next], response);
+            keep(response.size());
+            if (++next == count) next = 0;
+        }
+        return readCycles() - start;
+    }});
+}
+
+static void addCalculatorBenchmarks(std::vector<MicroBenchmark>& benchmarks) {
+    addCommandBenchmark(benchmarks, "calculator/cached", 4000,
+                        std::make_shared<CommandSetup>(new CalculatorService(), std::vector<std::string>{"CAL 2+3*4"}, false),
+                        "RESULT: 14");
+
+    // One shape, new literals each time: still a cache hit
+    std::vector<std::string> literals;
+    for (int i = 0; i < 64; ++i) {
+        literals.push_back("CAL (" + std::to_string(i) + ".5+3)*(2-" + std::to_string(i % 7) + ")/4");
+    }
+    addCommandBenchmark(benchmarks, "calculator/literals", 5000,
+                        std::make_shared<CommandSetup>(new CalculatorService(), literals, false), "RESULT: ");
+
+    // More shapes than the cache holds, so nearly every request compiles
+    std::vector<std::string> shapes;
+    for (int i = 0; i < CALC_CACHE_CAPACITY * 4; ++i) {
+        std::string request = "CAL 1";
+        for (int bit = 0; bit < 12; ++bit) {
+            request += (i & (1 << bit)) ? "*2" : "+1";
+        }
+        shapes.push_back(request);
+    }
+    addCommandBenchmark(benchmarks, "calculator/compile", 20000,
+                        std::make_shared<CommandSetup>(new CalculatorService(), shapes, false), "RESULT: ");
+}
+
+static void addFileBenchmarks(std::vector<MicroBenchmark>& benchmarks, MicroFixtures& fixtures) {
+    // Cached reads: small and page-sized replies are copied; large ones end
+    // in a sendfile() region, as hft_server's writers allow
+    std::string small = fixtures.createFile("small.txt", 64);
+    std::string page = fixtures.createFile("page.txt", 4096);
+    std::string large = fixtures.createFile("large.bin", 64 * 1024);
+
+    addCommandBenchmark(benchmarks, "file/read_64b", 6000,
+                        std::make_shared<CommandSetup>(new FileService(fixtures.cache),
+                                                       std::vector<std::string>{"READ " + small}, true),
+                        "FILE_CONTENT: ");
+    addCommandBenchmark(benchmarks, "file/read_4k", 6000,
+                        std::make_shared<CommandSetup>(new FileService(fixtures.cache),
+                                                       std::vector<std::string>{"READ " + page}, true),
+                        "FILE_CONTENT: ");
+    addCommandBenchmark(benchmarks, "file/read_64k_sendfile", 6000,
+                        std::make_shared<CommandSetup>(new FileService(fixtures.cache),
+                                                       std::vector<std::string>{"READ " + large}, true),
+                        "FILE_CONTENT: ");
+    addCommandBenchmark(benchmarks, "file/read_missing", 12000,
+                        std::make_shared<CommandSetup>(new FileService(fixtures.cache),
+                                                       std::vector<std::string>{"READ " + small + ".missing"}, true),
+                        "ERROR: Could not open file");
+}
+
+// Baselines are "<name> <median ns>" lines written by --save
+static std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Failed to open baseline " + path);
+    }
+    std::string name;
+    double nanos;
+    while (in >> name >> nanos) {
+        baseline[name] = nanos;
+    }
+    return baseline;
+}
+
+static int runBenchmarks(const std::vector<MicroBenchmark>& benchmarks, const MicroOptions& options) {
+    std::map<std::string, double> baseline;
+    if (!options.baselinePath.empty()) {
+        baseline = loadBaseline(options.baselinePath);
+    }
+    std::ofstream save;
+    if (!options.savePath.empty()) {
+        save.open(options.savePath);
+        if (!save) {
+            throw std::runtime_error("Failed to open " + options.savePath);
+        }
+    }
+
+    double cyclesPerNano = calibrateCyclesPerNano();
+    std::cout << "Cycle counter: " << std::fixed << std::setprecision(3) << cyclesPerNano << " cycles/ns, "
+              << options.batches << " batches of " << options.iterations << " operations" << std::endl;
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right << std::setw(12) << "median ns"
+              << std::setw(12) << "min ns" << std::setw(14) << "cycles/op" << std::setw(12) << "limit ns"
+              << "  status" << std::endl;
+
+    int failures = 0;
+    std::vector<double> perOp(options.batches);
+    for (const MicroBenchmark& benchmark : benchmarks) {
+        if (benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+        benchmark.run(options.iterations); // Warm caches, branch predictors and lazily built state
+        for (size_t batch = 0; batch < options.batches; ++batch) {
+            perOp[batch] = static_cast<double>(benchmark.run(options.iterations)) / options.iterations;
+        }
+        std::sort(perOp.begin(), perOp.end());
+        double medianCycles = perOp[perOp.size() / 2];
+        double medianNs = medianCycles / cyclesPerNano;
+        double minNs = perOp.front() / cyclesPerNano;
+
+        // The fixed ceiling catches gross regressions; a baseline, tighter ones
+        double limitNs = benchmark.ceilingNs;
+        auto previous = baseline.find(benchmark.name);
+        if (previous != baseline.end()) {
+            double slack = std::max(options.toleranceNs, previous->second * options.tolerancePercent / 100);
+            limitNs = std::min(limitNs, previous->second + slack);
+        }
+        bool passed = medianNs <= limitNs;
+        if (!passed) failures++;
+
+        std::cout << std::left << std::setw(44) << benchmark.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << medianNs << std::setw(12) << minNs << std::setw(14) << medianCycles
+                  << std::setw(12) << limitNs << "  " << (passed ? "ok" : "REGRESSED") << std::endl;
+        if (save) {
+            save << benchmark.name << " " << medianNs << "\n";
+        }
+    }
+
+    if (failures > 0) {
+        std::cout << failures << " benchmark(s) over their limit" << std::endl;
+        return 1;
+    }
+    std::cout << "All benchmarks within their limits" << std::endl;
+    return 0;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options]" << std::endl;
+    std::cerr << "  --filter <text>         Only run benchmarks whose name contains <text>" << std::endl;
+    std::cerr << "  --iterations <n>        Operations per batch (default 10000)" << std::endl;
+    std::cerr << "  --batches <n>           Batches per benchmark; the median is reported (default 25)" << std::endl;
+    std::cerr << "  --baseline <path>       Fail benchmarks that got slower than in this saved run" << std::endl;
+    std::cerr << "  --save <path>           Save this run's medians as a baseline" << std::endl;
+    std::cerr << "  --tolerance-ns <ns>     Slowdown over the baseline still accepted (default 50)" << std::endl;
+    std::cerr << "  --tolerance-pct <pct>   Same, relative; the larger of the two applies (default 10)" << std::endl;
+    std::cerr << "  --list                  List the benchmarks and their ceilings" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    MicroOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            options.list = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--iterations") {
+            options.iterations = static_cast<size_t>(std::stoul(value));
+        } else if (arg == "--batches") {
+            options.batches = static_cast<size_t>(std::stoul(value));
+        } else if (arg == "--baseline") {
+            options.baselinePath = value;
+        } else if (arg == "--save") {
+            options.savePath = value;
+        } else if (arg == "--tolerance-ns") {
+            options.toleranceNs = std::stod(value);
+        } else if (arg == "--tolerance-pct") {
+            options.tolerancePercent = std::stod(value);
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.iterations == 0 || options.batches == 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // LoggingInterceptor's lines would swamp the results
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0) {
+        AsyncLogger::getInstance().setOutput(devNull);
+    }
+
+    try {
+        MicroFixtures fixtures;
+        std::vector<MicroBenchmark> benchmarks;
+        addQueueBenchmarks(benchmarks);
+        addAuthBenchmarks(benchmarks);
+        addPipelineBenchmarks(benchmarks, fixtures);
+        addCalculatorBenchmarks(benchmarks);
+        addFileBenchmarks(benchmarks, fixtures);
+
+        if (options.list) {
+            for (const MicroBenchmark& benchmark : benchmarks) {
+                std::cout << std::left << std::setw(44) << benchmark.name << " ceiling " << benchmark.ceilingNs
+                          << " ns" << std::endl;
+            }
+            return 0;
+        }
+        return runBenchmarks(benchmarks, options);
+    } catch (const std::exception& e) {
+        std::cerr << "bench_micro: " << e.what() << std::endl;
+        return 1;
+    }
+}
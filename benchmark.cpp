@@ -6,6 +6,7 @@
 #include <chrono>
 #include <atomic>
 #include <iomanip>
+#include <algorithm>
 #include <sstream>
 #include <random>
 #include <mutex>
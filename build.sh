@@ -12,42 +12,84 @@ fi
 # Create build directories
 mkdir -p bin obj
 
+# TLS for hft_server and the client needs the OpenSSL headers and libraries
+TLS_FLAGS=""
+TLS_LIBS=""
+if [ -f /usr/include/openssl/ssl.h ]; then
+    TLS_FLAGS="-DHFT_HAVE_OPENSSL"
+    TLS_LIBS="-lssl -lcrypto"
+fi
+
 echo "Compiling server..."
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/server.cpp -o obj/server.o
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/services.cpp -o obj/services.o
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/interceptors.cpp -o obj/interceptors.o
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/server_main.cpp -o obj/server_main.o
-g++ obj/server.o obj/services.o obj/interceptors.o obj/server_main.o -o bin/server -pthread
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/server.cpp -o obj/server.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/protocol.cpp -o obj/protocol.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/services.cpp -o obj/services.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/response_cache.cpp -o obj/response_cache.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/file_cache.cpp -o obj/file_cache.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/file_upload.cpp -o obj/file_upload.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/expression.cpp -o obj/expression.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/service_registry.cpp -o obj/service_registry.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/interceptors.cpp -o obj/interceptors.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/interceptor_chain.cpp -o obj/interceptor_chain.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/async_logger.cpp -o obj/async_logger.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/server_main.cpp -o obj/server_main.o
+g++ obj/server.o obj/protocol.o obj/services.o obj/response_cache.o obj/file_cache.o obj/file_upload.o obj/expression.o obj/service_registry.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/server_main.o -o bin/server -pthread
 
 echo "Compiling client..."
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/client.cpp -o obj/client.o
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c src/client_main.cpp -o obj/client_main.o
-g++ obj/client.o obj/interceptors.o obj/client_main.o -o bin/client -pthread
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/client.cpp -o obj/client.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude $TLS_FLAGS -c src/tls.cpp -o obj/tls.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/async_client.cpp -o obj/async_client.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/client_pool.cpp -o obj/client_pool.o
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c src/client_main.cpp -o obj/client_main.o
+g++ obj/client.o obj/protocol.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/client_main.o obj/tls.o -o bin/client -pthread $TLS_LIBS
 
 echo "Compiling benchmark..."
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c benchmark.cpp -o obj/benchmark.o
-g++ obj/client.o obj/interceptors.o obj/benchmark.o -o bin/benchmark -pthread
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c benchmark.cpp -o obj/benchmark.o
+g++ obj/client.o obj/protocol.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/benchmark.o obj/tls.o -o bin/benchmark -pthread $TLS_LIBS
 
 echo "Compiling simple benchmark..."
-g++ -std=c++11 -Wall -Wextra -O2 -Iinclude -c simple_benchmark.cpp -o obj/simple_benchmark.o
-g++ obj/client.o obj/interceptors.o obj/simple_benchmark.o -o bin/simple_benchmark -pthread
+g++ -std=c++17 -Wall -Wextra -O2 -Iinclude -c simple_benchmark.cpp -o obj/simple_benchmark.o
+g++ obj/client.o obj/protocol.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/simple_benchmark.o obj/tls.o -o bin/simple_benchmark -pthread $TLS_LIBS
 
 echo "Compiling HFT server..."
-g++ -std=c++11 -Wall -Wextra -O3 -Iinclude -c src/hft_server.cpp -o obj/hft_server.o
-g++ -std=c++11 -Wall -Wextra -O3 -Iinclude -c src/hft_server_main.cpp -o obj/hft_server_main.o
-g++ obj/hft_server.o obj/services.o obj/interceptors.o obj/hft_server_main.o -o bin/hft_server -pthread
+# The io_uring engine only needs the kernel UAPI header, not liburing
+URING_FLAGS=""
+if [ -f /usr/include/linux/io_uring.h ]; then
+    URING_FLAGS="-DHFT_HAVE_IO_URING"
+fi
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude $URING_FLAGS -c src/io_uring.cpp -o obj/io_uring.o
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude -c src/metrics_endpoint.cpp -o obj/metrics_endpoint.o
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude -c src/socket_handoff.cpp -o obj/socket_handoff.o
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude -c src/cpu_affinity.cpp -o obj/cpu_affinity.o
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude $URING_FLAGS -c src/hft_server.cpp -o obj/hft_server.o
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude $URING_FLAGS -c src/hft_server_main.cpp -o obj/hft_server_main.o
+g++ obj/hft_server.o obj/io_uring.o obj/metrics_endpoint.o obj/socket_handoff.o obj/cpu_affinity.o obj/protocol.o obj/services.o obj/response_cache.o obj/file_cache.o obj/file_upload.o obj/expression.o obj/service_registry.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/hft_server_main.o obj/tls.o -o bin/hft_server -pthread $TLS_LIBS
 
 echo "Compiling HFT benchmark..."
-g++ -std=c++11 -Wall -Wextra -O3 -Iinclude -c hft_benchmark.cpp -o obj/hft_benchmark.o
-g++ obj/client.o obj/interceptors.o obj/hft_benchmark.o -o bin/hft_benchmark -pthread
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude -c hft_benchmark.cpp -o obj/hft_benchmark.o
+g++ obj/client.o obj/async_client.o obj/client_pool.o obj/protocol.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/hft_benchmark.o obj/tls.o -o bin/hft_benchmark -pthread $TLS_LIBS
+
+echo "Compiling load generator..."
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude -c load_generator.cpp -o obj/load_generator.o
+g++ obj/async_client.o obj/protocol.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/load_generator.o -o bin/load_generator -pthread
+
+echo "Compiling microbenchmarks..."
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude $URING_FLAGS -c bench_micro.cpp -o obj/bench_micro.o
+g++ obj/bench_micro.o obj/hft_server.o obj/io_uring.o obj/metrics_endpoint.o obj/socket_handoff.o obj/cpu_affinity.o obj/protocol.o obj/services.o obj/response_cache.o obj/file_cache.o obj/file_upload.o obj/expression.o obj/service_registry.o obj/interceptors.o obj/interceptor_chain.o obj/async_logger.o obj/tls.o -o bin/bench_micro -pthread $TLS_LIBS
+
+echo "Compiling queue benchmark..."
+g++ -std=c++17 -Wall -Wextra -O3 -Iinclude queue_benchmark.cpp -o bin/queue_benchmark -pthread
 
 echo "Build completed successfully!"
 echo ""
 echo "Usage:"
 echo "  ./bin/server [port]                    - Start server (default port: 8080)"
 echo "  ./bin/client [ip] [port] [--interactive] - Start client"
+echo "  ./bin/client [ip] [port] --tls-ca FILE   - Start client over TLS"
 echo "  ./bin/benchmark [ip] [port]            - Run comprehensive performance benchmarks"
 echo "  ./bin/simple_benchmark [ip] [port]     - Run simple performance benchmarks"
+echo "  ./bin/queue_benchmark [items] [capacity] - Run request queue microbenchmark"
+echo "  ./bin/bench_micro [--baseline file]    - Run hot-path microbenchmarks"
 echo ""
 echo "Examples:"
 echo "  ./bin/server 8080                      - Start server on port 8080"
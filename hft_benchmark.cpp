@@ -1,4 +1,6 @@
 #include "../include/client.hpp"
+#include "../include/async_client.hpp"
+#include "../include/client_pool.hpp"
 #include "../include/interceptors.hpp"
 #include <iostream>
 #include <vector>
@@ -9,11 +11,14 @@
 #include <random>
 #include <algorithm>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
 
 class HFTBenchmark {
 private:
     std::string serverIp;
     int serverPort;
+    std::string configLabel;
     std::atomic<uint64_t> totalRequests{0};
     std::atomic<uint64_t> totalLatency{0};
     std::atomic<uint64_t> failedRequests{0};
@@ -21,7 +26,8 @@ private:
     std::mutex latenciesMutex;
 
 public:
-    HFTBenchmark(const std::string& ip, int port) : serverIp(ip), serverPort(port) {}
+    HFTBenchmark(const std::string& ip, int port, const std::string& label = "")
+        : serverIp(ip), serverPort(port), configLabel(label) {}
 
     void runLatencyTest(int numRequests) {
         std::cout << "\n=== HFT Latency Test ===" << std::endl;
@@ -119,6 +125,126 @@ public:
         printHFTStressResults(totalTime);
     }
 
+    // Keeps `window` requests in flight on one connection: each reply sends
+    // the next request, so the rate is bounded by the server, not the RTT
+    void runPipelinedTest(int numRequests, int window) {
+        std::cout << "\n=== HFT Pipelined Test ===" << std::endl;
+        std::cout << "Testing " << numRequests << " requests, " << window << " in flight on one connection..." << std::endl;
+        
+        AsyncSocketClient client(serverIp, serverPort);
+        if (!client.connect()) {
+            std::cerr << "Failed to connect for pipelined test" << std::endl;
+            return;
+        }
+        
+        totalRequests = 0;
+        totalLatency = 0;
+        failedRequests = 0;
+        
+        std::atomic<int> sent{0};
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+        std::function<void()> sendNext = [&]() {
+            int i = sent++;
+            if (i >= numRequests) return;
+            auto requestStart = std::chrono::high_resolution_clock::now();
+            client.sendRequest("TOKEN:secret123 ECHO HFT_" + std::to_string(i),
+                [&, requestStart](const std::string& response) {
+                    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::high_resolution_clock::now() - requestStart).count();
+                    totalLatency += latency;
+                    if (response.find("ECHO:") == std::string::npos) {
+                        failedRequests++;
+                    }
+                    if (++totalRequests == static_cast<uint64_t>(numRequests) || !client.isConnected()) {
+                        std::lock_guard<std::mutex> lock(doneMutex);
+                        doneCondition.notify_all();
+                        return;
+                    }
+                    sendNext();
+                });
+        };
+        
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < window; ++i) {
+            sendNext();
+        }
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCondition.wait(lock, [&] {
+                return totalRequests.load() >= static_cast<uint64_t>(numRequests) ||
+                       (!client.isConnected() && client.inFlight() == 0);
+            });
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+        
+        client.disconnect();
+        printHFTThroughputResults(numRequests, totalTime, 1);
+    }
+
+    // Same as the pipelined test, spread over a SocketClientPool with
+    // `connectionsPerEndpoint` connections to each endpoint
+    void runPoolTest(int numRequests, int window, const std::vector<PoolEndpoint>& endpoints,
+                     size_t connectionsPerEndpoint) {
+        std::cout << "\n=== HFT Connection Pool Test ===" << std::endl;
+        std::cout << "Testing " << numRequests << " requests, " << window << " in flight over "
+                  << endpoints.size() << " endpoint(s) x " << connectionsPerEndpoint << " connections..." << std::endl;
+        
+        SocketClientPool pool(endpoints, connectionsPerEndpoint);
+        if (pool.start() == 0) {
+            std::cerr << "Failed to connect for pool test" << std::endl;
+            return;
+        }
+        
+        totalRequests = 0;
+        totalLatency = 0;
+        failedRequests = 0;
+        
+        std::atomic<int> sent{0};
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+        std::function<void()> sendNext = [&]() {
+            int i = sent++;
+            if (i >= numRequests) return;
+            auto requestStart = std::chrono::high_resolution_clock::now();
+            pool.sendRequest("TOKEN:secret123 ECHO HFT_" + std::to_string(i),
+                [&, requestStart](const std::string& response) {
+                    auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::high_resolution_clock::now() - requestStart).count();
+                    totalLatency += latency;
+                    bool failed = response.find("ECHO:") == std::string::npos;
+                    if (failed) {
+                        failedRequests++;
+                    }
+                    // A request the pool couldn't place fails at once; stop
+                    // rather than recurse through the rest of them
+                    if (++totalRequests == static_cast<uint64_t>(numRequests) || pool.healthyConnections() == 0) {
+                        std::lock_guard<std::mutex> lock(doneMutex);
+                        doneCondition.notify_all();
+                        return;
+                    }
+                    sendNext();
+                });
+        };
+        
+        auto startTime = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < window; ++i) {
+            sendNext();
+        }
+        {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            doneCondition.wait(lock, [&] {
+                return totalRequests.load() >= static_cast<uint64_t>(numRequests) || pool.healthyConnections() == 0;
+            });
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        auto totalTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
+        
+        pool.stop();
+        printHFTThroughputResults(numRequests, totalTime, 1);
+    }
+
     void runMicrosecondTest(int numRequests) {
         std::cout << "\n=== HFT Microsecond Precision Test ===" << std::endl;
         std::cout << "Testing " << numRequests << " requests with microsecond precision..." << std::endl;
@@ -149,6 +275,10 @@ public:
     }
 
 private:
+    std::string labelSuffix() const {
+        return configLabel.empty() ? "" : " [" + configLabel + "]";
+    }
+
     void hftWorker(int numRequests, int threadId) {
         SocketClient client(serverIp, serverPort);
         if (!client.connect()) {
@@ -236,7 +366,7 @@ private:
         uint64_t p999Latency = latencies[static_cast<size_t>(latencies.size() * 0.999)];
         
         std::cout << std::fixed << std::setprecision(2);
-        std::cout << "HFT Latency Results (nanoseconds):" << std::endl;
+        std::cout << "HFT Latency Results (nanoseconds)" << labelSuffix() << ":" << std::endl;
         std::cout << "  Total Time: " << totalTime << " μs" << std::endl;
         std::cout << "  Requests: " << numRequests << std::endl;
         std::cout << "  Success Rate: " << ((numRequests - failedRequests) * 100.0 / numRequests) << "%" << std::endl;
@@ -291,7 +421,7 @@ private:
         uint64_t p99Latency = sorted[static_cast<size_t>(sorted.size() * 0.99)];
         
         std::cout << std::fixed << std::setprecision(2);
-        std::cout << "Microsecond Precision Results:" << std::endl;
+        std::cout << "Microsecond Precision Results" << labelSuffix() << ":" << std::endl;
         std::cout << "  Requests: " << microLatencies.size() << std::endl;
         std::cout << "  Min Latency: " << minLatency << " μs" << std::endl;
         std::cout << "  Max Latency: " << maxLatency << " μs" << std::endl;
@@ -308,19 +438,35 @@ int main(int argc, char* argv[]) {
     
     if (argc > 1) serverIp = argv[1];
     if (argc > 2) serverPort = std::stoi(argv[2]);
+    // Optional label describing the server setup, e.g. "wait=spin"
+    std::string label = argc > 3 ? argv[3] : "";
+    // Optional comma-separated ip:port list the pool test spreads load over
+    std::vector<PoolEndpoint> endpoints;
+    if (argc > 4 && !PoolEndpoint::parseList(argv[4], endpoints)) {
+        std::cerr << "Invalid endpoint list: " << argv[4] << std::endl;
+        return 1;
+    }
+    if (endpoints.empty()) {
+        endpoints.push_back(PoolEndpoint(serverIp, serverPort));
+    }
     
     std::cout << "HFT Socket Server/Client Benchmark Tool" << std::endl;
     std::cout << "=======================================" << std::endl;
     std::cout << "Server: " << serverIp << ":" << serverPort << std::endl;
+    if (!label.empty()) {
+        std::cout << "Server Config: " << label << std::endl;
+    }
     std::cout << "Starting HFT benchmark tests..." << std::endl;
     
-    HFTBenchmark benchmark(serverIp, serverPort);
+    HFTBenchmark benchmark(serverIp, serverPort, label);
     
     // Run HFT-specific benchmark tests
     benchmark.runLatencyTest(10000);           // 10K requests for latency
     benchmark.runThroughputTest(100000, 16);   // 100K requests with 16 threads
     benchmark.runStressTest(30, 10000);        // 30 seconds at 10K req/sec
     benchmark.runMicrosecondTest(5000);        // 5K requests with μs precision
+    benchmark.runPipelinedTest(100000, 256);   // 100K requests, 256 in flight on one connection
+    benchmark.runPoolTest(100000, 256, endpoints, 4);  // Same, balanced over 4 connections per endpoint
     
     std::cout << "\n=== HFT Benchmark Complete ===" << std::endl;
     
@@ -3,6 +3,11 @@
 echo "HFT Socket Server/Client Benchmark"
 echo "=================================="
 
+# Wait strategies to compare, e.g. HFT_WAIT_STRATEGIES="spin hybrid block" ./hft_benchmark.sh
+WAIT_STRATEGIES=${HFT_WAIT_STRATEGIES:-hybrid}
+# I/O engines to compare, e.g. HFT_ENGINES="epoll io_uring" ./hft_benchmark.sh
+ENGINES=${HFT_ENGINES:-epoll}
+
 # Kill any existing server processes
 echo "Stopping any existing servers..."
 pkill -f "hft_server" 2>/dev/null
@@ -13,29 +18,33 @@ sleep 2
 echo "Creating test file..."
 echo "This is a test file for HFT benchmarking" > test.txt
 
-# Start HFT server in background
-echo "Starting HFT server..."
-./bin/hft_server 8080 &
-HFT_SERVER_PID=$!
+for ENGINE in $ENGINES; do
+for WAIT in $WAIT_STRATEGIES; do
+    # Start HFT server in background
+    echo "Starting HFT server (engine: $ENGINE, wait strategy: $WAIT)..."
+    ./bin/hft_server 8080 --engine $ENGINE --wait $WAIT &
+    HFT_SERVER_PID=$!
 
-# Wait for server to start
-sleep 3
+    # Wait for server to start
+    sleep 3
 
-# Check if server started successfully
-if ! kill -0 $HFT_SERVER_PID 2>/dev/null; then
-    echo "Error: HFT server failed to start"
-    exit 1
-fi
+    # Check if server started successfully
+    if ! kill -0 $HFT_SERVER_PID 2>/dev/null; then
+        echo "Error: HFT server failed to start"
+        exit 1
+    fi
 
-echo "HFT server started with PID: $HFT_SERVER_PID"
+    echo "HFT server started with PID: $HFT_SERVER_PID"
 
-# Run HFT benchmark
-echo "Running HFT benchmark..."
-./bin/hft_benchmark 127.0.0.1 8080
+    # Run HFT benchmark
+    echo "Running HFT benchmark..."
+    ./bin/hft_benchmark 127.0.0.1 8080 "engine=$ENGINE wait=$WAIT"
 
-# Stop server
-echo "Stopping HFT server..."
-kill $HFT_SERVER_PID 2>/dev/null
-wait $HFT_SERVER_PID 2>/dev/null
+    # Stop server
+    echo "Stopping HFT server..."
+    kill $HFT_SERVER_PID 2>/dev/null
+    wait $HFT_SERVER_PID 2>/dev/null
+done
+done
 
-echo "HFT benchmark completed!" 
\ No newline at end of file
+echo "HFT benchmark completed!"
@@ -0,0 +1,122 @@
+#pragma once
+#include "interfaces.hpp"
+#include "protocol.hpp"
+#include "interceptor_chain.hpp"
+#include "latency_histogram.hpp"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <stdint.h>
+
+// Requests one AsyncSocketClient keeps outstanding by default
+#define ASYNC_CLIENT_MAX_IN_FLIGHT 65536
+
+// Client that pipelines requests on one connection. Each request is framed
+// with its own requestId and written at once; an event loop thread reads the
+// replies in whatever order they arrive and completes the request whose id
+// each one echoes, so throughput is bounded by the link and the server, not
+// by the round trip.
+//
+// With setRequestTimeout(), a request not answered in time fails with
+// "ERROR: Request timed out" and frees its in-flight slot; a reply that
+// turns up later is dropped.
+//
+// Safe to call from any number of threads. Completion callbacks run on the
+// event loop thread and must not block; they may submit further requests.
+// Interceptors run under a lock shared by the pre- and post-processing of
+// every request, so they need no thread safety of their own.
+class AsyncSocketClient {
+public:
+    // Receives the response, or an "ERROR: ..." message if the request
+    // failed locally, timed out, or the connection was lost before it was answered
+    typedef std::function<void(const std::string& response)> Callback;
+
+private:
+    struct Pending {
+        Callback callback;
+        std::string request;  // Kept for postProcess(); empty without interceptors
+        uint64_t deadline;    // monotonicNanos(); 0 without a timeout
+    };
+
+    struct Deadline {
+        uint64_t at;
+        uint32_t requestId;
+    };
+
+    std::string serverIp;
+    int serverPort;
+    int clientSocket;
+    int epollFd;
+    int wakeFd;               // eventfd that asks the loop to watch for EPOLLOUT or stop
+    std::thread loop;
+    std::atomic<bool> connected;
+    std::atomic<bool> stopping;
+    size_t maxInFlight;
+
+    std::mutex interceptorMutex;
+    InterceptorChain interceptors;
+
+    // Requests sent or queued, by requestId
+    std::mutex pendingMutex;
+    std::unordered_map<uint32_t, Pending> pending;
+    uint32_t nextRequestId;
+    // Every request gets the same timeout, so submission order is deadline
+    // order and the loop only ever looks at the front. Entries for requests
+    // already answered are skipped when they come due.
+    std::deque<Deadline> deadlines;
+    uint64_t requestTimeoutNanos;
+
+    // Framed requests the socket hasn't taken yet; written by whichever
+    // thread finds room, the submitter first and the loop on EPOLLOUT
+    std::mutex sendMutex;
+    std::string outgoing;
+    size_t outgoingSent;
+    bool watchingWritable;   // Loop thread only
+
+    ReceiveBuffer receiveBuffer;
+
+    void eventLoop();
+    // Sends what it can of `outgoing` without blocking; false on a socket error
+    bool flushLocked();
+    void readResponses();
+    void complete(uint32_t requestId, const char* payload, size_t length);
+    void failAll(const std::string& error);
+    // epoll_wait() timeout until the earliest deadline, -1 if there is none
+    int nextTimeoutMillis();
+    void expireRequests();
+
+public:
+    AsyncSocketClient(const std::string& ip, int port, size_t inFlightLimit = ASYNC_CLIENT_MAX_IN_FLIGHT);
+    ~AsyncSocketClient();
+    AsyncSocketClient(const AsyncSocketClient&) = delete;
+    AsyncSocketClient& operator=(const AsyncSocketClient&) = delete;
+
+    // Connects and starts the event loop
+    bool connect();
+    // Stops the loop and fails every outstanding request
+    void disconnect();
+    bool isConnected() const { return connected.load(std::memory_order_acquire); }
+
+    // Sends `request` and calls `callback` with the reply. Returns false, having
+    // already called `callback` with the error, if it couldn't be sent: not
+    // connected, rejected by an interceptor, or the in-flight limit reached.
+    bool sendRequest(const std::string& request, Callback callback);
+    std::future<std::string> sendRequest(const std::string& request);
+    // Same as the callback form, except that a request that can't be sent
+    // leaves `callback` untouched and sets `error` instead of calling it
+    bool trySendRequest(const std::string& request, Callback& callback, const char*& error);
+
+    size_t inFlight();
+
+    // Fails requests that get no reply within `milliseconds`; 0 (the default)
+    // waits forever. Set before connect().
+    void setRequestTimeout(uint32_t milliseconds) { requestTimeoutNanos = milliseconds * 1000000ULL; }
+
+    // Add before connect(); the chain is not locked against additions
+    void addInterceptor(std::unique_ptr<IInterceptor> interceptor);
+};
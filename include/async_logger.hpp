@@ -0,0 +1,194 @@
+#pragma once
+#include "string_view.hpp"
+#include "latency_histogram.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+// Log levels; anything below HFT_LOG_LEVEL is compiled out entirely
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef HFT_LOG_LEVEL
+#define HFT_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Records per thread ring and bytes per record (arguments are truncated to fit)
+#define LOG_RING_SIZE 512
+#define LOG_RECORD_SIZE 256
+// How long the drain thread sleeps when every ring is empty
+#define LOG_DRAIN_IDLE_MICROS 1000
+
+// `format` must be a string literal; each {} is replaced by the next argument
+#define HFT_LOG(level, ...) \
+    do { \
+        if ((level) >= HFT_LOG_LEVEL) AsyncLogger::getInstance().log((level), __VA_ARGS__); \
+    } while (0)
+#define LOG_DEBUG(...) HFT_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) HFT_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) HFT_LOG(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) HFT_LOG(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+enum LogArgType {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING
+};
+
+// One log call, captured in binary: the format pointer plus the raw
+// arguments. Formatting happens later, on the drain thread.
+struct LogRecord {
+    static const size_t ARGS_SIZE = LOG_RECORD_SIZE - 24;
+
+    uint64_t timestamp;  // Wall clock, nanoseconds since the epoch
+    const char* format;
+    uint8_t level;
+    uint8_t argCount;
+    uint16_t used;
+    char args[ARGS_SIZE];
+};
+
+// Single-producer/single-consumer ring owned by one logging thread and read
+// by the drain thread. A full ring drops the record and counts it.
+struct LogRing {
+    LogRecord slots[LOG_RING_SIZE];
+    alignas(64) std::atomic<uint64_t> tail;  // Written by the owning thread
+    alignas(64) std::atomic<uint64_t> head;  // Written by the drain thread
+    alignas(64) SingleWriterCounter dropped;
+
+    LogRing() : tail(0), head(0) {}
+
+    LogRecord* claim() {
+        uint64_t position = tail.load(std::memory_order_relaxed);
+        if (position - head.load(std::memory_order_acquire) >= LOG_RING_SIZE) {
+            return nullptr;
+        }
+        return &slots[position & (LOG_RING_SIZE - 1)];
+    }
+
+    void publish() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+};
+
+// Asynchronous logger. Callers copy their arguments into a per-thread ring
+// and return: no lock, no allocation, no formatting and no syscall on the
+// logging thread. A background thread formats the records and writes them
+// in batches. Lines from one thread stay in order; lines from different
+// threads are interleaved in the order the drain thread reaches them.
+class AsyncLogger {
+private:
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<LogRing>> rings;
+    std::atomic<bool> running;
+    std::thread drainThread;
+    int outputFd;
+    uint64_t reportedDrops;
+
+    AsyncLogger();
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    LogRing& threadRing();
+    void drainLoop();
+    size_t drainOnce(std::string& out);
+    static void formatRecord(const LogRecord& record, std::string& out);
+
+    static void put(LogRecord& record, uint8_t type, const void* data, size_t length) {
+        size_t needed = 1 + length;
+        if (record.used + needed > LogRecord::ARGS_SIZE) return;
+        record.args[record.used] = static_cast<char>(type);
+        memcpy(record.args + record.used + 1, data, length);
+        record.used = static_cast<uint16_t>(record.used + needed);
+        record.argCount++;
+    }
+
+    static void putString(LogRecord& record, const char* data, size_t length) {
+        // Type, 16-bit length, bytes; long strings are cut to what still fits
+        if (static_cast<size_t>(record.used) + 3 > LogRecord::ARGS_SIZE) return;
+        size_t room = LogRecord::ARGS_SIZE - record.used - 3;
+        uint16_t stored = static_cast<uint16_t>(length < room ? length : room);
+        char* out = record.args + record.used;
+        out[0] = static_cast<char>(LOG_ARG_STRING);
+        memcpy(out + 1, &stored, sizeof(stored));
+        memcpy(out + 3, data, stored);
+        record.used = static_cast<uint16_t>(record.used + 3 + stored);
+        record.argCount++;
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    encode(LogRecord& record, T value) {
+        int64_t wide = value;
+        put(record, LOG_ARG_INT, &wide, sizeof(wide));
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+    encode(LogRecord& record, T value) {
+        uint64_t wide = value;
+        put(record, LOG_ARG_UINT, &wide, sizeof(wide));
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    encode(LogRecord& record, T value) {
+        double wide = value;
+        put(record, LOG_ARG_DOUBLE, &wide, sizeof(wide));
+    }
+
+    static void encode(LogRecord& record, const char* value) {
+        if (value) putString(record, value, strlen(value));
+        else putString(record, "(null)", 6);
+    }
+    static void encode(LogRecord& record, const std::string& value) { putString(record, value.data(), value.size()); }
+    static void encode(LogRecord& record, StringView value) { putString(record, value.data(), value.size()); }
+
+    static void encodeAll(LogRecord&) {}
+
+    template<typename First, typename... Rest>
+    static void encodeAll(LogRecord& record, const First& first, const Rest&... rest) {
+        encode(record, first);
+        encodeAll(record, rest...);
+    }
+
+public:
+    // Started on first use and flushed at exit
+    static AsyncLogger& getInstance();
+
+    template<typename... Args>
+    void log(int level, const char* format, const Args&... args) {
+        LogRing& ring = threadRing();
+        LogRecord* record = ring.claim();
+        if (!record) {
+            ring.dropped.add(1);
+            return;
+        }
+        record->timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+        record->format = format;
+        record->level = static_cast<uint8_t>(level);
+        record->argCount = 0;
+        record->used = 0;
+        encodeAll(*record, args...);
+        ring.publish();
+    }
+
+    // Records lost to full rings since start
+    uint64_t droppedCount();
+
+    // Where formatted lines go; stdout by default
+    void setOutput(int fd) { outputFd = fd; }
+
+    // Writes out everything logged so far and stops the drain thread
+    void stop();
+};
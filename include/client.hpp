@@ -1,5 +1,8 @@
 #pragma once
 #include "interfaces.hpp"
+#include "protocol.hpp"
+#include "interceptor_chain.hpp"
+#include "tls.hpp"
 #include <string>
 #include <memory>
 #include <vector>
@@ -13,7 +16,12 @@ private:
     int clientSocket;
     std::string serverIp;
     int serverPort;
-    std::vector<std::unique_ptr<IInterceptor>> interceptors;
+    InterceptorChain interceptors;
+    ReceiveBuffer receiveBuffer;
+    uint32_t nextRequestId;
+    // Set by setTls(): every connection runs a handshake first
+    std::shared_ptr<TlsContext> tls;
+    std::unique_ptr<TlsSession> session;
     
 public:
     SocketClient(const std::string& ip, int port);
@@ -23,4 +31,7 @@ public:
     void disconnect();
     std::string sendRequest(const std::string& request);
     void addInterceptor(std::unique_ptr<IInterceptor> interceptor);
+    // Talks TLS over a TlsContext::createClient() context from the next
+    // connect(); reconnecting resumes the previous session
+    void setTls(std::shared_ptr<TlsContext> context) { tls = std::move(context); }
 }; 
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+#include "async_client.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// How often the pool checks for lost connections, and the backoff between
+// attempts to reconnect one, doubling from the first to the last
+#define POOL_HEALTH_INTERVAL_MS 50
+#define POOL_RECONNECT_MIN_MS 100
+#define POOL_RECONNECT_MAX_MS 5000
+// Consecutive timeouts or "ERROR: Server busy" replies that take a connection
+// out of rotation
+#define POOL_EJECT_AFTER_FAILURES 5
+
+struct PoolEndpoint {
+    std::string ip;
+    int port;
+
+    PoolEndpoint() : port(0) {}
+    PoolEndpoint(const std::string& host, int portNumber) : ip(host), port(portNumber) {}
+
+    // Parses "ip:port"
+    static bool parse(const std::string& text, PoolEndpoint& endpoint);
+    // Parses a comma-separated list of "ip:port"; false if any entry is malformed
+    static bool parseList(const std::string& text, std::vector<PoolEndpoint>& endpoints);
+};
+
+// Pre-connected AsyncSocketClients to a set of servers. Each request goes to
+// the healthy connection with the fewest requests outstanding, so a slow or
+// loaded server gets less work without any feedback from it. A connection
+// that drops is taken out of rotation at once and reconnected in the
+// background with exponential backoff; requests it still had outstanding
+// complete with its "ERROR: Connection closed".
+//
+// A connection that is up but not answering is treated the same way: after
+// POOL_EJECT_AFTER_FAILURES requests in a row time out (see
+// setRequestTimeout()) or come back "ERROR: Server busy", it is closed and
+// reconnected with backoff. The backoff keeps doubling across ejections
+// until the server answers a request again, so a server that stays
+// overloaded is retried less and less often.
+//
+// Safe to call from any number of threads once start() has returned.
+class SocketClientPool {
+public:
+    typedef AsyncSocketClient::Callback Callback;
+
+private:
+    struct Connection {
+        PoolEndpoint endpoint;
+        std::unique_ptr<AsyncSocketClient> client;
+        std::atomic<uint32_t> outstanding;
+        std::atomic<uint32_t> failures;   // Consecutive timeouts and busy replies
+        std::atomic<bool> ejected;        // Out of rotation until the reconnect thread recycles it
+        std::atomic<bool> answered;       // A reply other than a failure since the last reconnect
+        // Reconnect thread only
+        uint64_t retryAt;
+        uint64_t backoff;
+        bool wasConnected;
+        bool probation;                   // Reconnected after an ejection, not yet answered
+
+        Connection()
+            : outstanding(0), failures(0), ejected(false), answered(false), retryAt(0),
+              backoff(POOL_RECONNECT_MIN_MS), wasConnected(false), probation(false) {}
+
+        bool usable() const { return client->isConnected() && !ejected.load(std::memory_order_relaxed); }
+    };
+
+    std::vector<PoolEndpoint> endpoints;
+    std::vector<std::unique_ptr<Connection>> connections;
+    std::atomic<uint64_t> nextStart;   // Rotates where ties are broken
+    std::atomic<uint64_t> reconnects;
+    std::atomic<uint64_t> ejections;
+
+    std::thread healthThread;
+    std::mutex healthMutex;
+    std::condition_variable healthCondition;
+    bool running;
+
+    struct Completion;
+
+    void healthLoop();
+    // Index of the least-loaded connection that is up; connections.size() if none
+    size_t pick();
+    // Closes an ejected connection and schedules its reconnect
+    void eject(Connection& connection, uint64_t now);
+
+public:
+    SocketClientPool(const std::vector<PoolEndpoint>& servers, size_t connectionsPerEndpoint = 1,
+                     size_t inFlightLimit = ASYNC_CLIENT_MAX_IN_FLIGHT);
+    ~SocketClientPool();
+    SocketClientPool(const SocketClientPool&) = delete;
+    SocketClientPool& operator=(const SocketClientPool&) = delete;
+
+    // Connects every connection and starts reconnecting those that failed.
+    // Returns how many are up.
+    size_t start();
+    // Stops reconnecting and closes every connection
+    void stop();
+
+    // Sends through the least-loaded connection, trying the others if it
+    // turns out to be down. Same contract as AsyncSocketClient::sendRequest().
+    bool sendRequest(const std::string& request, Callback callback);
+    std::future<std::string> sendRequest(const std::string& request);
+
+    size_t connectionCount() const { return connections.size(); }
+    size_t healthyConnections() const;
+    uint64_t reconnectCount() const { return reconnects.load(std::memory_order_relaxed); }
+    uint64_t ejectionCount() const { return ejections.load(std::memory_order_relaxed); }
+
+    // Passed to every connection's AsyncSocketClient::setRequestTimeout();
+    // without it only busy replies count towards ejection. Set before start().
+    void setRequestTimeout(uint32_t milliseconds);
+
+    // Gives every connection its own clone; throws if `interceptor` can't be
+    // cloned. Add before start().
+    void addInterceptor(std::unique_ptr<IInterceptor> interceptor);
+};
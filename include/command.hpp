@@ -0,0 +1,49 @@
+#pragma once
+#include "string_view.hpp"
+
+// A request line split into its parts: [TOKEN:<token>] <NAME> [args]
+//
+// `args` is everything after the single space that follows the command name,
+// so payloads keep their own spacing. All fields view the original request.
+struct Command {
+    StringView request;
+    StringView token;
+    StringView name;
+    StringView args;
+};
+
+inline bool isCommandSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Parses the command token once so servers can dispatch on it instead of
+// searching the payload. Returns false when the request has no command.
+inline bool parseCommand(StringView request, Command& command) {
+    command = Command();
+    command.request = request;
+
+    size_t pos = 0;
+    size_t size = request.size();
+    while (pos < size && isCommandSpace(request[pos])) pos++;
+
+    size_t start = pos;
+    while (pos < size && !isCommandSpace(request[pos])) pos++;
+    StringView word = request.substr(start, pos - start);
+
+    if (startsWith(word, "TOKEN:")) {
+        command.token = word.substr(6);
+        while (pos < size && isCommandSpace(request[pos])) pos++;
+        start = pos;
+        while (pos < size && !isCommandSpace(request[pos])) pos++;
+        word = request.substr(start, pos - start);
+    }
+
+    if (word.empty()) {
+        return false;
+    }
+
+    command.name = word;
+    if (pos < size) pos++; // Separator between the name and its arguments
+    command.args = request.substr(pos);
+    return true;
+}
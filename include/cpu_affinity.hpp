@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Parses a core list such as "0-3,8,10-11"; false if it is malformed
+bool parseCpuList(const std::string& text, std::vector<int>& cpus);
+// The reverse, for startup banners
+std::string formatCpuList(const std::vector<int>& cpus);
+
+// NUMA node `cpu` belongs to, from sysfs; -1 when unknown
+int cpuNumaNode(int cpu);
+// Distinct nodes of `cpus`, e.g. "0" or "0,1"; empty when unknown
+std::string numaNodesOf(const std::vector<int>& cpus);
+
+// These apply to the calling thread. They return false when the kernel
+// refuses, e.g. a CPU outside the cgroup or SCHED_FIFO without CAP_SYS_NICE.
+bool pinCurrentThread(int cpu);
+bool setRealtimePriority(int priority);
+// Shown by top -H and ps -L; the kernel keeps 15 characters. A no-op on the
+// main thread, so the process keeps its name.
+void nameCurrentThread(const std::string& name);
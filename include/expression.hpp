@@ -0,0 +1,131 @@
+#pragma once
+#include "string_view.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Longest expression accepted, numeric literals in one, operand stack depth
+// and parenthesis nesting of a compiled expression
+#define CALC_MAX_EXPRESSION 1024
+#define CALC_MAX_CONSTANTS 128
+#define CALC_MAX_STACK 64
+#define CALC_MAX_DEPTH 32
+// Variables an engine can hold, and compiled shapes it keeps
+#define CALC_MAX_VARIABLES 256
+#define CALC_CACHE_CAPACITY 1024
+
+// Named values shared by every thread evaluating expressions. Names are
+// resolved to slots when an expression is compiled, under a mutex; reading
+// and assigning a slot afterwards is a lock-free atomic access.
+class VariableTable {
+private:
+    struct Slot {
+        std::atomic<double> value;
+        std::atomic<bool> defined;
+
+        Slot() : value(0.0), defined(false) {}
+    };
+
+    Slot slots[CALC_MAX_VARIABLES];
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint32_t> index;
+
+public:
+    // Slot for `name`, allocating one on first use; throws when full.
+    // Only assignments allocate, so names that are merely read can't fill it.
+    uint32_t slotFor(StringView name);
+    // False when no assignment has named `name` yet
+    bool find(StringView name, uint32_t& slot);
+    std::string nameOf(uint32_t slot);
+
+    // False while the variable has never been assigned
+    bool get(uint32_t slot, double& value) const {
+        if (!slots[slot].defined.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[slot].value.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    void set(uint32_t slot, double value) {
+        slots[slot].value.store(value, std::memory_order_relaxed);
+        slots[slot].defined.store(true, std::memory_order_release);
+    }
+};
+
+// An expression compiled to stack-machine bytecode. It is compiled from the
+// expression's shape, the text with every numeric literal replaced by '#'
+// and whitespace dropped, so "2.5 * x + 1" and "7 * x + 40" share one
+// program and run with their own literals. Immutable once built.
+//
+// Grammar, loosest binding first:
+//   statement := name '=' sum | sum
+//   sum       := product (('+' | '-') product)*
+//   product   := unary (('*' | '/' | '%') unary)*
+//   unary     := ('-' | '+') unary | power
+//   power     := primary ('^' unary)?
+//   primary   := number | name | function '(' sum (',' sum)* ')' | '(' sum ')'
+// Functions: abs, sqrt, exp, log (one argument), min, max, pow (two).
+class CompiledExpression {
+public:
+    enum Opcode : uint8_t {
+        OP_CONSTANT,   // Push literal `operand`
+        OP_LOAD,       // Push variable slot `operand`
+        OP_STORE,      // Assign the top of the stack to slot `operand`
+        OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MODULO, OP_POWER,
+        OP_NEGATE, OP_ABS, OP_SQRT, OP_EXP, OP_LOG, OP_MIN, OP_MAX
+    };
+
+    struct Instruction {
+        Opcode op;
+        uint32_t operand;
+    };
+
+private:
+    std::string shape;
+    std::vector<Instruction> code;
+    size_t constants;
+
+    CompiledExpression() : constants(0) {}
+    friend class ExpressionCompiler;
+
+public:
+    // Compiles `shape`; throws std::runtime_error on a syntax error
+    static std::shared_ptr<const CompiledExpression> compile(StringView shape, VariableTable& variables);
+
+    StringView getShape() const { return StringView(shape); }
+    size_t constantCount() const { return constants; }
+
+    // Runs the program with `literals` in place of the '#'s of its shape.
+    // Allocates nothing on success; throws std::runtime_error on division by
+    // zero or a variable that was never assigned.
+    double evaluate(const double* literals, VariableTable& variables) const;
+};
+
+// Evaluates expressions, compiling each shape once. The cache and variables
+// are shared by copies of the engine's owner across threads, so hits take a
+// shared lock and a compile only locks out the others to insert.
+class ExpressionEngine {
+private:
+    std::shared_mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const CompiledExpression>> cache;  // By shape hash
+    VariableTable variables;
+
+    std::shared_ptr<const CompiledExpression> lookup(StringView shape, uint64_t hash);
+
+public:
+    ExpressionEngine() {}
+    ExpressionEngine(const ExpressionEngine&) = delete;
+    ExpressionEngine& operator=(const ExpressionEngine&) = delete;
+
+    // Throws std::runtime_error describing what is wrong with `expression`
+    double evaluate(StringView expression);
+
+    size_t cachedShapes();
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include "string_view.hpp"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Default limits: cached files, and bytes mapped across all of them
+#define FILE_CACHE_MAX_FILES 64
+#define FILE_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+// A file mapped read-only, with its descriptor kept open for sendfile(). The
+// mapping stays valid while any reference is held, even after the cache has
+// dropped the file or it was replaced on disk by rename. Truncating a mapped
+// file in place makes reads of the mapping past the new end fault with
+// SIGBUS, so writers should replace files rather than rewrite them, and
+// code that copies the contents should pread() the descriptor instead.
+class MappedFile {
+private:
+    int fd;
+    const char* mapping;
+    size_t length;
+    dev_t device;
+    ino_t inode;
+    struct timespec modified;
+
+    MappedFile() : fd(-1), mapping(nullptr), length(0), device(0), inode(0), modified() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+    ~MappedFile();
+
+    // Opens and maps `path`; returns null and sets `error` on failure
+    static std::shared_ptr<const MappedFile> open(const std::string& path, std::string& error);
+
+    StringView view() const { return StringView(mapping ? mapping : "", length); }
+    size_t size() const { return length; }
+    int descriptor() const { return fd; }
+
+    // Whether `info` (from stat()) still describes the file that was mapped
+    bool matches(const struct stat& info) const;
+};
+
+// LRU cache of mapped files keyed by path. Each lookup stat()s the path and
+// remaps it when its inode, size or mtime changed, so edits are picked up on
+// the next read without a watcher thread. Safe to share between threads.
+class FileCache {
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const MappedFile> file;
+    };
+
+    std::mutex mutex;
+    std::list<Entry> entries;  // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t maxFiles;
+    size_t maxBytes;
+    size_t cachedBytes;
+    uint64_t hits;
+    uint64_t misses;
+
+    void eraseLocked(std::list<Entry>::iterator entry);
+
+public:
+    FileCache(size_t fileLimit = FILE_CACHE_MAX_FILES, size_t byteLimit = FILE_CACHE_MAX_BYTES);
+
+    // Current contents of `path`; returns null and sets `error` if it can't be
+    // opened. Files larger than the byte limit are mapped but not cached.
+    std::shared_ptr<const MappedFile> get(const std::string& path, std::string& error);
+    // Drops `path`, e.g. after writing it
+    void invalidate(const std::string& path);
+
+    uint64_t hitCount();
+    uint64_t missCount();
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include "string_view.hpp"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+// Bytes a writer gathers before handing them to the kernel in one write
+#define UPLOAD_BUFFER_SIZE (256 * 1024)
+// O_DIRECT transfers must start, end and sit in memory on this boundary
+#define UPLOAD_DIRECT_ALIGNMENT 4096
+// Uploads open at once, the largest accepted file, and how long an upload
+// may sit idle before the next WRITE_OPEN discards it
+#define UPLOAD_MAX_OPEN 64
+#define UPLOAD_MAX_SIZE (1024ULL * 1024 * 1024)
+#define UPLOAD_IDLE_TIMEOUT_SECONDS 60
+
+// How written files reach the disk before they replace the target
+//   None   - left to the page cache; fastest, lost if the machine crashes
+//   Data   - fdatasync() before the rename
+//   Direct - O_DIRECT writes that bypass the page cache, then fdatasync();
+//            behaves like Data on filesystems that refuse O_DIRECT
+enum class FileSyncPolicy {
+    None,
+    Data,
+    Direct
+};
+
+inline bool parseSyncPolicy(const std::string& name, FileSyncPolicy& policy) {
+    if (name == "none") { policy = FileSyncPolicy::None; return true; }
+    if (name == "data") { policy = FileSyncPolicy::Data; return true; }
+    if (name == "direct") { policy = FileSyncPolicy::Direct; return true; }
+    return false;
+}
+
+inline const char* syncPolicyName(FileSyncPolicy policy) {
+    switch (policy) {
+        case FileSyncPolicy::None: return "none";
+        case FileSyncPolicy::Data: return "data";
+        case FileSyncPolicy::Direct: return "direct";
+    }
+    return "unknown";
+}
+
+// Writes a new file next to `path` through an aligned buffer, so sequential
+// chunks are coalesced into few large writes, and renames it over `path` on
+// commit(). Each chunk names its offset: pipelined chunks handled by
+// different pool threads may arrive out of order, and each still lands in
+// its place. Not thread-safe; UploadTable serializes access per upload.
+class BufferedFileWriter {
+private:
+    std::string path;
+    std::string temporary;
+    int fd;
+    FileSyncPolicy policy;
+    bool direct;      // O_DIRECT currently set on fd
+    bool failed;
+    char* buffer;
+    size_t buffered;
+    uint64_t bufferOffset;
+    uint64_t contiguous;                  // Every byte before this has arrived
+    uint64_t end;                         // End of the furthest chunk
+    std::map<uint64_t, uint64_t> extents; // Arrived past a gap: start -> end
+
+    bool writeAt(const char* data, size_t length, uint64_t offset);
+    bool setDirect(bool enabled);
+    // Writes out the buffer; `all` includes a trailing partial O_DIRECT block
+    bool flush(bool all);
+
+public:
+    BufferedFileWriter(const std::string& targetPath, FileSyncPolicy syncPolicy);
+    ~BufferedFileWriter();
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+    // False if the temporary file couldn't be created
+    bool isOpen() const { return fd >= 0; }
+
+    bool write(uint64_t offset, StringView data);
+    // Bytes received without a gap from the start of the file
+    uint64_t received() const { return contiguous; }
+    // End of the furthest chunk received; larger than received() while
+    // earlier chunks are still outstanding
+    uint64_t extent() const { return end; }
+
+    // Flushes, syncs per the policy and renames the file into place.
+    // Returns false (removing the temporary) if any write failed.
+    bool commit();
+    // Removes the temporary without touching `path`
+    void discard();
+};
+
+// Open streaming uploads, by handle. Shared by a FileService and its clones;
+// uploads proceed in parallel, chunks of the same upload one at a time.
+class UploadTable {
+private:
+    struct Upload {
+        std::mutex mutex;
+        std::string path;
+        std::unique_ptr<BufferedFileWriter> writer;  // Null once closed
+        std::atomic<uint64_t> lastActive;            // Monotonic seconds
+        
+        Upload() : lastActive(0) {}
+    };
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<Upload>> uploads;
+    uint64_t nextHandle;
+    FileSyncPolicy policy;
+
+    std::shared_ptr<Upload> find(uint64_t handle);
+    void remove(uint64_t handle);
+    void reapIdleLocked(uint64_t now);
+
+public:
+    UploadTable() : nextHandle(1), policy(FileSyncPolicy::None) {}
+
+    void setSyncPolicy(FileSyncPolicy syncPolicy);
+    FileSyncPolicy getSyncPolicy();
+
+    // Starts an upload to `path`; returns 0 and sets `error` on failure
+    uint64_t open(const std::string& path, std::string& error);
+    // Stores `data` at `offset`; `received` is set to the gap-free byte count
+    bool write(uint64_t handle, uint64_t offset, StringView data, uint64_t& received, std::string& error);
+    // Completes the upload once `size` bytes have arrived (or, for size
+    // UINT64_MAX, once there are no gaps) and moves it into place, setting
+    // `written` and the file's `path`. An upload still waiting on chunks
+    // stays open so the close can be retried.
+    bool close(uint64_t handle, uint64_t size, uint64_t& written, std::string& path, std::string& error);
+    bool abort(uint64_t handle);
+};
@@ -1,5 +1,17 @@
 #pragma once
 #include "interfaces.hpp"
+#include "protocol.hpp"
+#include "service_registry.hpp"
+#include "interceptor_chain.hpp"
+#include "lock_free_queue.hpp"
+#include "wait_strategy.hpp"
+#include "latency_histogram.hpp"
+#include "io_uring.hpp"
+#include "metrics_endpoint.hpp"
+#include "response_cache.hpp"
+#include "timer_wheel.hpp"
+#include "socket_handoff.hpp"
+#include "tls.hpp"
 #include <memory>
 #include <vector>
 #include <thread>
@@ -13,81 +25,444 @@
 #include <string.h>
 #include <chrono>
 #include <mutex>
+#include <unordered_map>
 
 // HFT-optimized buffer sizes
 #define HFT_BUFFER_SIZE 4096
 #define HFT_MAX_EVENTS 10000
 #define HFT_THREAD_POOL_SIZE 16
+#define HFT_QUEUE_DEPTH 50000
+#define HFT_BLOCKING_POOL_SIZE 4
+#define HFT_BLOCKING_QUEUE_DEPTH 1024
+#define HFT_INLINE_REQUEST_SIZE 240
+#define HFT_SPILL_RETAIN_SIZE (256 * 1024)
+// io_uring engine: submission queue slots and provided receive buffers per ring
+#define HFT_URING_ENTRIES 4096
+#define HFT_URING_BUFFERS 512
+// Connection table pages, allocated as fds in their range are first used
+#define HFT_CONNECTION_PAGE_SIZE 256
+// Replies a slow reader may leave unread before its connection is dropped
+#define HFT_MAX_OUTBOUND_BYTES (16 * 1024 * 1024)
+// Idle reaper: a 51.2 s wheel of 100 ms ticks; longer timeouts are re-filed
+#define HFT_IDLE_WHEEL_SLOTS 512
+#define HFT_IDLE_WHEEL_TICK (100 * 1000 * 1000ULL)
+// How long a drain waits for queued work and replies by default
+#define HFT_DRAIN_TIMEOUT_MS 5000
 
-// Pre-allocated response buffers for common operations
+// Replies held per thread before they are written in one syscall
+#define HFT_SEND_BATCH 32
+#define HFT_SEND_BATCH_BYTES 65536
+
+// Per-thread response arena. Services serialize straight into `data` through
+// ResponseWriter(data, sizeof(data), &spill) and sends read from it; responses larger than the arena
+// spill into `spill`, whose capacity is kept for the next large response up to
+// HFT_SPILL_RETAIN_SIZE.
 struct HFTResponseBuffer {
     char data[HFT_BUFFER_SIZE];
-    size_t length;
+    std::string spill;
     
-    HFTResponseBuffer() : length(0) {
-        memset(data, 0, HFT_BUFFER_SIZE);
+    // Called after each send; no memset, the writer tracks the valid length
+    void reset() {
+        if (spill.capacity() > HFT_SPILL_RETAIN_SIZE) {
+            std::string().swap(spill);
+        } else {
+            spill.clear();
+        }
     }
+};
+
+// A single framed request waiting for a worker. Payloads up to
+// HFT_INLINE_REQUEST_SIZE bytes are stored in the queue slot itself so the
+// common small request crosses threads without touching the heap.
+struct HFTRequest {
+    int clientSocket;
+    // The connection's generation when the request was read; a reply for an
+    // older one is dropped, since the fd now belongs to someone else
+    uint32_t generation;
+    uint32_t requestId;
+    uint32_t length;
+    // monotonicNanos() when the bytes were read and when they were queued
+    uint64_t receivedAt;
+    uint64_t enqueuedAt;
+    char inlineData[HFT_INLINE_REQUEST_SIZE];
+    std::string overflow;
     
-    void reset() {
-        length = 0;
-        memset(data, 0, HFT_BUFFER_SIZE);
+    HFTRequest() : clientSocket(-1), generation(0), requestId(0), length(0), receivedAt(0), enqueuedAt(0) {}
+    HFTRequest(int sock, uint32_t connectionGeneration, uint32_t id, const char* data, size_t size,
+               uint64_t received, uint64_t enqueued)
+        : clientSocket(sock), generation(connectionGeneration), requestId(id), length(static_cast<uint32_t>(size)),
+          receivedAt(received), enqueuedAt(enqueued) {
+        if (size <= HFT_INLINE_REQUEST_SIZE) {
+            memcpy(inlineData, data, size);
+        } else {
+            overflow.assign(data, size);
+        }
+    }
+    
+    HFTRequest(HFTRequest&& other) : HFTRequest() { *this = std::move(other); }
+    
+    HFTRequest& operator=(HFTRequest&& other) {
+        clientSocket = other.clientSocket;
+        generation = other.generation;
+        requestId = other.requestId;
+        length = other.length;
+        receivedAt = other.receivedAt;
+        enqueuedAt = other.enqueuedAt;
+        if (length <= HFT_INLINE_REQUEST_SIZE) {
+            memcpy(inlineData, other.inlineData, length);
+        } else {
+            overflow.swap(other.overflow);
+        }
+        return *this;
+    }
+    
+    StringView payload() const {
+        return StringView(length <= HFT_INLINE_REQUEST_SIZE ? inlineData : overflow.data(), length);
     }
 };
 
-// Lock-free request queue for HFT
-template<typename T>
-class LockFreeQueue {
-private:
-    struct Node {
-        T data;
-        std::atomic<Node*> next;
-        Node() : next(nullptr) {}
+// How I/O threads learn about and read socket data
+//   Epoll   - readiness notification, then recv() per socket
+//   IoUring - multishot accept and recv completing into provided buffers;
+//             one io_uring_enter per loop iteration (needs HFT_HAVE_IO_URING)
+enum class HFTEngine {
+    Epoll,
+    IoUring
+};
+
+inline bool parseEngine(const std::string& name, HFTEngine& engine) {
+    if (name == "epoll") { engine = HFTEngine::Epoll; return true; }
+    if (name == "io_uring" || name == "uring") { engine = HFTEngine::IoUring; return true; }
+    return false;
+}
+
+inline const char* engineName(HFTEngine engine) {
+    return engine == HFTEngine::IoUring ? "io_uring" : "epoll";
+}
+
+// How HFTServer::requestStop() ends start(), in increasing urgency
+//   Drain     - stop accepting and reading, answer what was read, then close
+//   Immediate - close everything now; queued requests are dropped
+enum class HFTStopMode {
+    None = 0,
+    Drain = 1,
+    Immediate = 2
+};
+
+// Where a request's time goes, from the recv() that read it to its reply
+enum HFTStage {
+    HFT_STAGE_RECEIVE,    // recv() -> queued, or started when run inline
+    HFT_STAGE_QUEUE_WAIT, // queued -> picked up by a pool thread
+    HFT_STAGE_SERVICE,    // interceptors and service
+    HFT_STAGE_SEND,       // reply ready -> written, including time spent batched
+    HFT_STAGE_TOTAL,      // recv() -> reply written
+    HFT_STAGE_COUNT
+};
+
+inline const char* hftStageName(int stage) {
+    static const char* const names[HFT_STAGE_COUNT] = {"recv->enqueue", "queue wait", "service", "send", "total"};
+    return stage >= 0 && stage < HFT_STAGE_COUNT ? names[stage] : "unknown";
+}
+
+// Histograms and counters written only by the thread that owns them. Each
+// thread's block starts on its own cache line, so collecting them never
+// bounces a line another writer is using.
+struct alignas(HFT_CACHE_LINE_SIZE) HFTThreadMetrics {
+    LatencyHistogram stages[HFT_STAGE_COUNT];
+    // Service stage split by the handling service's registration index
+    std::vector<LatencyHistogram> services;
+    // Replies each service answered with "ERROR: ..."
+    std::vector<SingleWriterCounter> serviceErrors;
+    // Requests no service handled: refused by an interceptor or unknown
+    SingleWriterCounter unhandled;
+    
+    // Syscall batching: frames moved per recv() and per vectored write
+    SingleWriterCounter recvCalls;
+    SingleWriterCounter framesReceived;
+    SingleWriterCounter writeCalls;
+    SingleWriterCounter framesSent;
+    SingleWriterCounter bytesReceived;
+    SingleWriterCounter bytesSent;
+    
+    // Connections this thread accepted and closed
+    SingleWriterCounter connectionsOpened;
+    SingleWriterCounter connectionsClosed;
+    // Connections this thread's idle reaper shut down
+    SingleWriterCounter connectionsReaped;
+    // Replies for connections that had closed, failed or been reused
+    SingleWriterCounter repliesDropped;
+    // Replies the socket couldn't take at once, left for the owner to finish
+    SingleWriterCounter writesDeferred;
+    
+    // TLS: accept to handshake done, and how handshakes ended
+    LatencyHistogram tlsHandshake;
+    SingleWriterCounter tlsHandshakes;
+    SingleWriterCounter tlsResumed;
+    SingleWriterCounter tlsHandshakeFailures;
+    // Connections whose records the kernel took over
+    SingleWriterCounter tlsOffloaded;
+    // Estimated bytes records added to replies: one record per 16 KB written
+    SingleWriterCounter tlsRecordOverhead;
+    
+    // Time spent handling requests and events rather than waiting for them,
+    // since `busySince`
+    SingleWriterCounter busyNanos;
+    std::atomic<uint64_t> busySince;
+    // "worker 3", "reactor 0", ...; guarded by HFTServer::metricsMutex
+    std::string name;
+    
+    explicit HFTThreadMetrics(size_t serviceCount)
+        : services(serviceCount), serviceErrors(serviceCount), busySince(monotonicNanos()), name("thread") {}
+};
+
+// All threads' histograms merged on demand by HFTServer::getLatencyReport()
+struct HFTLatencyReport {
+    LatencyHistogram stages[HFT_STAGE_COUNT];
+    std::vector<std::string> serviceNames;
+    std::vector<LatencyHistogram> services;
+    std::vector<uint64_t> serviceErrors;
+    uint64_t unhandled;
+    uint64_t recvCalls;
+    uint64_t framesReceived;
+    uint64_t writeCalls;
+    uint64_t framesSent;
+    uint64_t bytesReceived;
+    uint64_t bytesSent;
+    uint64_t connectionsOpened;
+    uint64_t connectionsClosed;
+    uint64_t connectionsReaped;
+    uint64_t repliesDropped;
+    uint64_t writesDeferred;
+    LatencyHistogram tlsHandshake;
+    uint64_t tlsHandshakes;
+    uint64_t tlsResumed;
+    uint64_t tlsHandshakeFailures;
+    uint64_t tlsOffloaded;
+    uint64_t tlsRecordOverhead;
+    
+    HFTLatencyReport()
+        : unhandled(0), recvCalls(0), framesReceived(0), writeCalls(0), framesSent(0), bytesReceived(0),
+          bytesSent(0), connectionsOpened(0), connectionsClosed(0), connectionsReaped(0), repliesDropped(0),
+          writesDeferred(0), tlsHandshakes(0), tlsResumed(0), tlsHandshakeFailures(0), tlsOffloaded(0),
+          tlsRecordOverhead(0) {}
+};
+
+// A connection as of one generation: what a reply or timer needs to tell
+// whether the fd still belongs to the client it was meant for
+struct HFTConnectionRef {
+    int fd;
+    uint32_t generation;
+    
+    HFTConnectionRef() : fd(-1), generation(0) {}
+    HFTConnectionRef(int socket, uint32_t connectionGeneration) : fd(socket), generation(connectionGeneration) {}
+    bool operator==(const HFTConnectionRef& other) const { return fd == other.fd && generation == other.generation; }
+    bool operator!=(const HFTConnectionRef& other) const { return !(*this == other); }
+};
+
+// Replies one thread has produced for a connection but not yet written.
+// They are flushed with one writev when the thread moves on to another
+// connection, runs out of work, or the batch fills up.
+struct HFTSendBatch {
+    struct Pending {
+        uint64_t receivedAt;
+        uint64_t processedAt;
     };
     
-    std::atomic<Node*> head;
-    std::atomic<Node*> tail;
-    std::vector<std::unique_ptr<Node>> pool;
-    std::atomic<size_t> pool_index{0};
+    HFTConnectionRef client;
+    FrameBatch frames;
+    std::vector<Pending> pending;
+    
+    HFTSendBatch() { pending.reserve(HFT_SEND_BATCH); }
+};
+
+// Reply bytes a connection's socket had no room for, then the file range
+// they end with, if any
+struct HFTOutboundChunk {
+    std::string bytes;
+    size_t sent;
+    FileRegion file;  // offset and length advance as it is sent
+    
+    HFTOutboundChunk() : sent(0) {}
+};
+
+struct HFTLoopState;
+
+// Everything the server knows about one client socket. Only the loop that
+// accepted it (`loop`) reads from it, reaps it and closes it; any thread may
+// write replies to it under `sendMutex`.
+struct HFTConnection {
+    // Guards the fields below it up to `loop`. The owner also reads `open`
+    // and `generation` without it, since only the owner changes them.
+    std::mutex sendMutex;
+    bool open;
+    // Bumped each time the fd is reused for a new client
+    uint32_t generation;
+    // Replies waiting for the socket, oldest first from `outboundHead`
+    std::vector<HFTOutboundChunk> outbound;
+    size_t outboundHead;
+    size_t outboundBytes;
+    // io_uring: a POLLOUT is armed on the owner's ring
+    bool writeArmed;
+    // Set while OpenSSL handles records: during the handshake, and after it
+    // when the kernel couldn't take them over. Null for plaintext and kTLS.
+    std::unique_ptr<TlsSession> tls;
+    // Bytes each TLS record adds; 0 without TLS
+    uint32_t tlsRecordOverhead;
+    
+    HFTLoopState* loop;
+    ReceiveBuffer buffer;
+    // monotonicNanos() of the last read that returned data
+    uint64_t lastActivity;
+    // A write error or an unrecoverable stream; the owner closes it next
+    std::atomic<bool> failed;
+    // Set while a reply is being written or waits in `outbound`, so the
+    // owner's EPOLLOUT handling skips the lock otherwise
+    std::atomic<bool> hasOutbound;
+    // The TLS handshake is still running; set and read by the owner only
+    bool handshaking;
+    
+    HFTConnection()
+        : open(false), generation(0), outboundHead(0), outboundBytes(0), writeArmed(false), tlsRecordOverhead(0),
+          loop(nullptr), buffer(0), lastActivity(0), failed(false), hasOutbound(false), handshaking(false) {}
+};
+
+// Connections indexed by fd. The kernel hands out the lowest free fd, so the
+// table stays dense; pages are allocated on first use and kept until the
+// server goes away, so a lookup never races a free.
+class HFTConnectionTable {
+private:
+    size_t pageCount;
+    std::unique_ptr<std::atomic<HFTConnection*>[]> pages;
+    std::atomic<int> highest;
     
 public:
-    LockFreeQueue(size_t pool_size = 10000) {
-        pool.resize(pool_size);
-        for (auto& node : pool) {
-            node = std::unique_ptr<Node>(new Node());
+    // Sized for RLIMIT_NOFILE
+    HFTConnectionTable();
+    ~HFTConnectionTable();
+    HFTConnectionTable(const HFTConnectionTable&) = delete;
+    HFTConnectionTable& operator=(const HFTConnectionTable&) = delete;
+    
+    // The slot for `fd`, allocating its page; null past the fd limit
+    HFTConnection* acquire(int fd);
+    // The slot for `fd` if its page exists
+    HFTConnection* find(int fd) const {
+        if (fd < 0 || static_cast<size_t>(fd) / HFT_CONNECTION_PAGE_SIZE >= pageCount) {
+            return nullptr;
         }
-        head = tail = pool[0].get();
+        HFTConnection* page = pages[static_cast<size_t>(fd) / HFT_CONNECTION_PAGE_SIZE].load(std::memory_order_acquire);
+        return page ? &page[static_cast<size_t>(fd) % HFT_CONNECTION_PAGE_SIZE] : nullptr;
     }
+    // Highest fd ever acquired, or -1
+    int highestFd() const { return highest.load(std::memory_order_acquire); }
+};
+
+// What each event loop (the classic acceptor or a reactor) keeps about the
+// connections it owns besides the table entries
+struct HFTLoopState {
+    // A client socket passed on by the server this one took over, with the
+    // bytes of the partial frame that server had already read from it
+    struct Adoption {
+        int fd;
+        std::string buffered;
+    };
     
-    bool enqueue(const T& item) {
-        Node* node = get_node();
-        if (!node) return false;
-        
-        node->data = item;
-        node->next = nullptr;
-        
-        Node* old_tail = tail.exchange(node);
-        old_tail->next = node;
-        return true;
-    }
+    // Idle deadlines; re-filed at last activity + timeout when they come due
+    TimerWheel<HFTConnectionRef> idleTimers;
+    // io_uring: connections whose replies wait for POLLOUT to be armed,
+    // pushed by whichever thread left them there
+    std::mutex waitersMutex;
+    std::vector<HFTConnectionRef> writeWaiters;
+    std::atomic<bool> hasWriteWaiters;
+    // Guarded by `waitersMutex`; pushed by the control thread
+    std::vector<Adoption> adoptions;
+    std::atomic<bool> hasAdoptions;
+    // Set by the loop once a drain has made it stop accepting and reading
+    std::atomic<bool> quiesced;
     
-    bool dequeue(T& item) {
-        Node* old_head = head.load();
-        Node* new_head = old_head->next.load();
-        
-        if (!new_head) return false;
-        
-        item = new_head->data;
-        head = new_head;
-        return true;
-    }
+    HFTLoopState()
+        : idleTimers(HFT_IDLE_WHEEL_SLOTS, HFT_IDLE_WHEEL_TICK), hasWriteWaiters(false), hasAdoptions(false),
+          quiesced(false) {}
+};
+
+// What a thread runs requests through: a compiled pipeline when the server
+// was given one, otherwise an interceptor chain and a service registry
+struct HFTHandlers {
+    IRequestPipeline* pipeline;
+    InterceptorChain* chain;
+    ServiceRegistry* services;
+    // Consulted around `services`; pipelines keep their own
+    ResponseCache* cache;
     
-private:
-    Node* get_node() {
-        size_t index = pool_index.fetch_add(1) % pool.size();
-        return pool[index].get();
+    bool admit(StringView request) { return pipeline ? pipeline->admit(request) : chain->admit(request); }
+    ExecutionClass classify(StringView request) const {
+        return pipeline ? pipeline->classify(request) : services->classify(request);
     }
 };
 
+// A bounded request queue and the pool of threads draining it. There is one
+// per queued ExecutionClass so blocking services can't starve the others.
+struct HFTExecutor {
+    const char* name;
+    int threadCount;
+    size_t queueDepth;
+    std::unique_ptr<LockFreeQueue<HFTRequest>> queue;
+    WaitStrategy waitStrategy;
+    std::vector<std::thread> threads;
+    // Each thread's own interceptor clones; null where the chain can't be
+    // cloned and the thread shares the server's prototype instead
+    std::vector<std::unique_ptr<InterceptorChain>> chains;
+    // Each thread's own pipeline clone, when the server runs one
+    std::vector<std::unique_ptr<IRequestPipeline>> pipelines;
+    // Set by a drain: threads exit once the queue is empty and their replies
+    // are written, and `liveThreads` counts those still running
+    std::atomic<bool> draining;
+    std::atomic<int> liveThreads;
+    
+    HFTExecutor(const char* executorName, int threads, size_t depth)
+        : name(executorName), threadCount(threads), queueDepth(depth), draining(false), liveThreads(0) {}
+};
+
+// One shard-per-core reactor. Each shard owns its SO_REUSEPORT listener, epoll
+// instance, connections and private service/interceptor copies, and runs the
+// whole request pipeline inline, so the hot path touches no shared state.
+// Only requests for blocking services leave the shard, for the blocking pool.
+struct HFTReactorShard {
+    int id;
+    int cpu;
+    int listenSocket;
+    int epollFd;
+    std::thread thread;
+    ServiceRegistry services;
+    InterceptorChain interceptors;
+    std::unique_ptr<IRequestPipeline> pipeline;
+    HFTLoopState loop;
+    
+    HFTReactorShard(int shardId, int cpuId)
+        : id(shardId), cpu(cpuId), listenSocket(-1), epollFd(-1) {}
+};
+
+// Where HFTServer's threads run and how they are scheduled. Thread i of a
+// role runs on cpus[i % cpus.size()]; an empty list leaves that role to the
+// scheduler, except reactors, which default to one core each. Threads pin
+// themselves before touching their arena, send batch and metrics, so
+// first-touch allocation puts those on the thread's own NUMA node.
+struct HFTThreadConfig {
+    std::vector<int> acceptorCpus;   // Classic mode's I/O thread; first entry
+    std::vector<int> workerCpus;
+    std::vector<int> blockingCpus;
+    std::vector<int> reactorCpus;
+    // SCHED_FIFO priority (1-99) for the acceptor, workers and reactors; 0
+    // leaves them SCHED_OTHER. The blocking pool never gets it.
+    int realtimePriority;
+    // SO_BUSY_POLL on client sockets, in microseconds; 0 leaves it off
+    int busyPollMicros;
+    // Reactor listeners set SO_INCOMING_CPU to their core, so the kernel
+    // hands each new connection to the reactor on the CPU its packets arrive on
+    bool incomingCpu;
+    
+    HFTThreadConfig() : realtimePriority(0), busyPollMicros(0), incomingCpu(false) {}
+};
+
 // HFT-optimized server
 class HFTServer {
 private:
@@ -97,45 +472,267 @@ private:
     int serverSocket;
     int epollFd;
     std::atomic<bool> running;
-    std::vector<std::thread> workerThreads;
-    std::vector<std::unique_ptr<IService>> services;
-    std::vector<std::unique_ptr<IInterceptor>> interceptors;
-    
-    // HFT optimizations
-    LockFreeQueue<std::pair<int, std::string>> requestQueue;
-    std::vector<HFTResponseBuffer> responseBuffers;
-    std::atomic<size_t> bufferIndex{0};
-    
-    // Performance metrics
-    std::atomic<uint64_t> totalRequests{0};
-    std::atomic<uint64_t> totalLatency{0};
+    ServiceRegistry services;
+    // Prototype chain, used as is by the epoll thread and cloned for workers
+    // and reactors
+    InterceptorChain interceptors;
+    // Replaces `services` and `interceptors` when set; cloned like them
+    std::unique_ptr<IRequestPipeline> pipeline;
+    
+    // HFT optimizations: Worker-class requests go to `workers`, Blocking-class
+    // ones to `blockingPool`; Inline-class requests never leave the I/O thread
+    HFTExecutor workers;
+    HFTExecutor blockingPool;
+    
+    // Every connection of every loop, by fd
+    HFTConnectionTable connectionTable;
+    // The classic acceptor's loop; reactors have their own
+    HFTLoopState acceptorLoop;
+    // Connections with no reads for this long are closed; 0 keeps them open
+    uint64_t idleTimeoutNanos;
+    
+    // Performance metrics: one HFTThreadMetrics per thread that handles
+    // requests, registered on first use
+    mutable std::mutex metricsMutex;
+    std::vector<std::unique_ptr<HFTThreadMetrics>> threadMetrics;
+    std::atomic<uint64_t> rejectedRequests{0};
     std::chrono::high_resolution_clock::time_point startTime;
     
+    // Coalesce replies per connection; off writes every reply on its own
+    bool sendBatching;
+    HFTEngine engine;
+    
+    // Shard-per-core mode; 0 keeps the single epoll loop feeding the worker pool
+    int reactorCount;
+    std::vector<std::unique_ptr<HFTReactorShard>> shards;
+    HFTThreadConfig threadConfig;
+    
+    // Admin listener serving renderMetrics(); off while adminPort is 0
+    std::string adminAddress;
+    int adminPort;
+    std::unique_ptr<MetricsEndpoint> admin;
+    
+    // Cached replies of idempotent commands; null when off
+    std::shared_ptr<ResponseCache> responseCache;
+    // Clients must complete a TLS handshake first; null for plaintext
+    std::shared_ptr<TlsContext> tlsContext;
+    
+    // Shutdown: requestStop() raises `stopRequest` and writes `controlFd`, an
+    // eventfd the control thread waits on, which then drains or stops
+    std::atomic<int> stopRequest;
+    int controlFd;
+    std::thread controlThread;
+    std::atomic<bool> draining;
+    int drainTimeoutMillis;
+    
+    // Hot restart (socket_handoff.hpp). As the old server: successors connect
+    // to `handoffPath`, and `successorChannel` is the one that took over.
+    std::string handoffPath;
+    int handoffListener;
+    int successorChannel;
+    bool handOffConnections;
+    // Set when a drain finished in time, so connections are clean to pass on
+    std::atomic<bool> drainedCleanly;
+    // Loops pass their connections on concurrently as they exit
+    std::mutex handoffMutex;
+    // As the new server: listeners taken over, and where connections follow
+    std::vector<int> inheritedListeners;
+    int predecessorChannel;
+    size_t nextAdoptionLoop;
+    
     HFTServer();
     ~HFTServer();
     HFTServer(const HFTServer&) = delete;
     HFTServer& operator=(const HFTServer&) = delete;
     
-    void setupEpoll();
+    int createListenSocket(int port);
+    // Listener `index` of this server: a taken-over one if there is one left
+    int listenerFor(int port, size_t index);
+    void releaseInheritedListeners(size_t used);
+    int createEpoll(int listenSocket);
+    int acceptClient(int listenSocket, int pollFd, HFTLoopState& loop);
     void acceptConnections();
-    void handleClient(int clientSocket);
-    std::string processRequest(const std::string& request);
-    void workerThread();
-    HFTResponseBuffer* getResponseBuffer();
+    // epoll: reads, writes queued replies and closes on errors or hangups
+    void handleClient(HFTReactorShard* shard, HFTLoopState& loop, int pollFd, int clientSocket, uint32_t events);
+    void handleFrame(HFTReactorShard* shard, const HFTConnectionRef& client, const FrameHeader& header,
+                     const char* payload, uint64_t receivedAt);
+    template<typename FrameHandler>
+    bool drainSocket(int clientSocket, HFTConnection& connection, FrameHandler onFrame);
+    // Claims the table slot for a new client of `loop`; null if it has none
+    HFTConnection* openConnection(HFTLoopState& loop, int clientSocket);
+    // Owner only. `pollFd` is the epoll instance to remove it from, or -1.
+    void closeConnection(int pollFd, int clientSocket, HFTConnection& connection);
+    // Closes every connection `loop` owns as it exits, or passes them to the
+    // successor after a clean drain
+    void closeAll(HFTLoopState& loop);
+    // Claims and fills the slot of a connection from the predecessor; the
+    // caller registers it with its epoll instance or ring
+    HFTConnection* adoptConnection(HFTLoopState& loop, HFTLoopState::Adoption& adoption);
+    void adoptEpoll(HFTLoopState& loop, int pollFd, HFTLoopState::Adoption& adoption);
+    void takeAdoptions(HFTLoopState& loop, std::vector<HFTLoopState::Adoption>& adopted);
+    // Sends an idle connection and its unread bytes to the successor
+    bool passConnection(int clientSocket, HFTConnection& connection);
+    // Runs the handshake as far as the socket allows. Once done the kernel
+    // takes the records over when it can; io_uring loops need it to.
+    TlsStatus continueHandshake(int clientSocket, HFTConnection& connection);
+    // epoll loops: once a drain starts, stops watching the listener and stops reading
+    void quiesceEpoll(HFTLoopState& loop, int pollFd, int listenSocket);
+    // Owner only: shuts down connections idle past the timeout, so the loop
+    // closes them as it would any hangup
+    void reapIdle(HFTLoopState& loop);
+    // Writes what the socket takes now and queues the rest on the connection.
+    // False if the reply was dropped because the connection is gone.
+    bool writeReply(const HFTConnectionRef& client, struct iovec* iov, size_t count, const FileRegion* file);
+    // Writes queued replies until the socket is full; true while some remain
+    bool drainOutbound(HFTConnection& connection, int clientSocket);
+    void sendResponse(const HFTConnectionRef& client, uint16_t opcode, uint32_t requestId, StringView response);
+    // `file`, when set, is sent with sendfile() after `response`, as part of the same frame
+    void queueResponse(HFTSendBatch& batch, const HFTConnectionRef& client, uint32_t requestId, StringView response,
+                       uint64_t receivedAt, uint64_t processedAt, const FileRegion* file = nullptr);
+    void flushResponses(HFTSendBatch& batch, const StringView* trailing = nullptr, uint32_t trailingId = 0,
+                        const FileRegion* trailingFile = nullptr);
+    HFTHandlers handlersFor(HFTReactorShard* shard);
+    size_t serviceCount() const;
+    void execute(HFTHandlers& handlers, const HFTConnectionRef& client, uint32_t requestId, StringView request,
+                 uint64_t receivedAt, uint64_t startedAt);
+    void submit(HFTExecutor& executor, const HFTConnectionRef& client, uint32_t requestId, StringView request,
+                uint64_t receivedAt);
+    HFTExecutor* executorFor(ExecutionClass executionClass);
+    void startExecutor(HFTExecutor& executor);
+    void stopExecutor(HFTExecutor& executor);
+    void startReactors(int port);
+    void reactorLoop(HFTReactorShard* shard);
+    void epollReactorLoop(HFTReactorShard* shard);
+    // io_uring event loop for the classic acceptor (shard == nullptr) or a reactor
+    void uringLoop(int listenSocket, HFTReactorShard* shard);
+    void workerThread(HFTExecutor* executor, int index, HFTHandlers handlers);
+    static HFTResponseBuffer& getResponseBuffer();
+    static HFTSendBatch& getSendBatch();
+    HFTThreadMetrics& getThreadMetrics();
+    // Labels the calling thread's metrics in reports
+    void nameThread(const std::string& name);
+    // Pins, schedules and names the calling thread as thread `index` of a
+    // role, then faults in its per-thread buffers
+    void placeThread(const std::vector<int>& cpus, int index, bool realtime, const std::string& name);
+    void applyBusyPoll(int clientSocket);
+    void startAdmin();
+    void startControl();
+    // The control thread: stop requests, successors and connections passed on
+    void controlLoop();
+    // Stops accepting and reading, then waits for queued requests and their
+    // replies until the drain timeout; true if nothing was cut short
+    bool drain();
+    // Passes the listeners to a successor that connected, then drains
+    bool handOver(int channel);
+    void receiveHandoff();
+    std::vector<HFTLoopState*> eventLoops();
     void setNonBlocking(int sock);
     
 public:
+    // The per-request work every worker and reactor does once a request is
+    // admitted: interceptors, dispatch, post-processing. Returns the index of
+    // the service that handled the request, or ServiceRegistry::npos. Public
+    // so bench_micro can time it without sockets.
+    static size_t runPipeline(HFTHandlers& handlers, StringView request, ResponseWriter& response,
+                              RequestContext& context);
+    
     static HFTServer* getInstance();
+    // Runs the event loop on the calling thread until a stop is requested
     void start(int port);
+    // Closes everything and joins every thread; call after start() returns
     void stop();
+    // Makes start() return, after a drain for HFTStopMode::Drain. A later
+    // request can raise the mode but not lower it. Only touches atomics and
+    // an eventfd, so it is safe to call from a signal handler.
+    void requestStop(HFTStopMode mode);
+    HFTStopMode getStopRequest() const { return static_cast<HFTStopMode>(stopRequest.load()); }
+    // Bound on a drain's wait for queued requests and unsent replies
+    void setDrainTimeout(int millis) { drainTimeoutMillis = millis; }
+    int getDrainTimeout() const { return drainTimeoutMillis; }
+    
+    // Hot restart. A server given a handoff path listens there (owner-only)
+    // for its successor. A new process calls takeOver() with that path before
+    // start(): it receives the old server's listening sockets, so no
+    // connection attempt is refused, and the old one drains and exits. With
+    // `connections` the old server also passes each connection that was idle
+    // when its drain finished, with any partial request it had read; others
+    // are closed. A taken-over listener replaces the one start() would have
+    // bound, one per reactor. takeOver() throws if no server answers and
+    // returns the number of listeners taken.
+    void setHandoffPath(const std::string& path) { handoffPath = path; }
+    size_t takeOver(const std::string& path, bool connections);
     void addService(std::unique_ptr<IService> service);
     void addInterceptor(std::unique_ptr<IInterceptor> interceptor);
     
+    // Run every request through `requestPipeline` (e.g. a StaticPipeline)
+    // instead of the services and interceptors added above, which are then
+    // ignored. Must be called before start(); each worker and reactor thread
+    // gets its own clone.
+    void setPipeline(std::unique_ptr<IRequestPipeline> requestPipeline) { pipeline = std::move(requestPipeline); }
+    
+    // Run `count` independent reactors (one per core) instead of the shared
+    // queue and worker pool. Must be called before start(); services and
+    // interceptors are cloned into every shard.
+    void setReactorCount(int count) { reactorCount = count; }
+    int getReactorCount() const { return reactorCount; }
+    
+    // CPU placement and scheduling of every thread; must be called before start()
+    void setThreadConfig(const HFTThreadConfig& config) { threadConfig = config; }
+    const HFTThreadConfig& getThreadConfig() const { return threadConfig; }
+    
+    // How idle workers and reactors wait for work (spin, hybrid or block).
+    // The blocking pool always parks: its threads are mostly waiting on I/O.
+    void setWaitStrategy(const WaitStrategyConfig& config) { workers.waitStrategy.configure(config); }
+    const WaitStrategyConfig& getWaitStrategy() const { return workers.waitStrategy.getConfig(); }
+    
+    // Pool size and queue depth of the Worker or Blocking execution class.
+    // Must be called before start(); depths are rounded up to a power of two.
+    // Requests that find their class's queue full are refused with
+    // "ERROR: Server busy" instead of waiting behind it.
+    void setExecutorLimits(ExecutionClass executionClass, int threads, size_t queueDepth);
+    
+    // I/O engine for the acceptor or reactors; must be called before start()
+    void setEngine(HFTEngine newEngine) { engine = newEngine; }
+    HFTEngine getEngine() const { return engine; }
+    // Whether this build and kernel can run the io_uring engine
+    static bool ioUringAvailable(std::string& error);
+    
+    // Write replies for the same connection together (default) or one by one
+    void setSendBatching(bool enabled) { sendBatching = enabled; }
+    bool getSendBatching() const { return sendBatching; }
+    
+    // Closes connections that send nothing for this long; 0 keeps them open.
+    // Must be called before start().
+    void setIdleTimeout(int seconds) { idleTimeoutNanos = seconds > 0 ? seconds * 1000000000ULL : 0; }
+    int getIdleTimeout() const { return static_cast<int>(idleTimeoutNanos / 1000000000ULL); }
+    
     // HFT-specific methods
-    uint64_t getTotalRequests() const { return totalRequests.load(); }
-    uint64_t getAverageLatency() const { 
-        auto requests = totalRequests.load();
-        return requests > 0 ? totalLatency.load() / requests : 0;
-    }
+    uint64_t getTotalRequests() const;
+    // Mean service time in microseconds
+    uint64_t getAverageLatency() const;
+    // Per-stage and per-service histograms merged across all threads
+    HFTLatencyReport getLatencyReport() const;
+    // Requests refused because their execution class's queue was full
+    uint64_t getRejectedRequests() const { return rejectedRequests.load(); }
+    // Approximate while traffic is flowing: owning threads aren't paused
     void resetMetrics();
+    
+    // Serve renderMetrics() over HTTP on `address`:`port` while the server
+    // runs, from a thread of its own. Must be called before start().
+    void setAdminEndpoint(const std::string& address, int port) { adminAddress = address; adminPort = port; }
+    // Answer repeats of the commands `cache` opts in from it, skipping their
+    // services; hits on blocking services are answered on the I/O thread.
+    // Must be called before start(). A pipeline given to setPipeline() does
+    // its own caching (StaticPipeline::setResponseCache()) and should get
+    // the same cache, which this still uses to route hits.
+    void setResponseCache(std::shared_ptr<ResponseCache> cache) { responseCache = std::move(cache); }
+    // Serves TLS only, from a TlsContext::createServer() context. Replies
+    // keep using writev() and sendfile() when the kernel holds the keys;
+    // otherwise the epoll engine encrypts in user space and io_uring refuses
+    // to start.
+    void setTls(std::shared_ptr<TlsContext> context) { tlsContext = std::move(context); }
+    // Everything above in the Prometheus text format: per-service request and
+    // error counts, latency percentiles, queue depths, per-thread utilization,
+    // open connections and bytes in and out
+    std::string renderMetrics() const;
 }; 
\ No newline at end of file
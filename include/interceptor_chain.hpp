@@ -0,0 +1,36 @@
+#pragma once
+#include "interfaces.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// A server's interceptors in priority order. The order is settled as
+// interceptors are added, so running the chain never sorts. Servers build
+// one prototype at startup and hand each thread its own clone; per-request
+// state travels in a RequestContext.
+class InterceptorChain {
+private:
+    std::vector<std::unique_ptr<IInterceptor>> interceptors;
+
+public:
+    // Inserts after any interceptor of equal or lower priority
+    void add(std::unique_ptr<IInterceptor> interceptor);
+
+    // Fills `copy` with clones of every interceptor. Returns false (leaving
+    // `copy` empty) if one of them can't be cloned.
+    bool cloneInto(InterceptorChain& copy) const;
+
+    size_t size() const { return interceptors.size(); }
+    bool empty() const { return interceptors.empty(); }
+
+    // Admission checks; false as soon as one interceptor refuses
+    bool admit(StringView request);
+
+    // View path with context, used by servers that read into their own buffers
+    bool preProcess(StringView request, RequestContext& context);
+    void postProcess(StringView request, ResponseWriter& response, RequestContext& context);
+
+    // std::string path, which honours interceptors that rewrite the request
+    bool preProcess(std::string& request);
+    void postProcess(const std::string& request, std::string& response);
+};
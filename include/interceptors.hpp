@@ -1,51 +1,143 @@
 #pragma once
 #include "interfaces.hpp"
+#include "rate_limiter.hpp"
+#include "latency_histogram.hpp"
 #include <string>
 #include <chrono>
 #include <iostream>
-#include <regex>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <stdint.h>
 
+// Longest request ValidationInterceptor accepts, and the allowance for
+// WRITE_CHUNK requests, whose payload is file data
+#define VALIDATION_MAX_REQUEST_SIZE 1000
+#define VALIDATION_MAX_CHUNK_SIZE (512 * 1024)
+
+// Logs each request and how long it took. The view path times requests from
+// RequestContext::startedAt; the std::string path has no context and keeps
+// the start time in a member, so there each thread needs its own clone.
 class LoggingInterceptor : public IInterceptor {
 public:
+    using IInterceptor::preProcess;
+    using IInterceptor::postProcess;
+    
     bool preProcess(std::string& request) override;
     void postProcess(const std::string& request, std::string& response) override;
+    bool preProcess(StringView request, RequestContext& context) override;
+    void postProcess(StringView request, ResponseWriter& response, RequestContext& context) override;
     int getPriority() const override { return 1; }
+    std::unique_ptr<IInterceptor> clone() const override { return std::unique_ptr<IInterceptor>(new LoggingInterceptor(*this)); }
+    
+private:
+    uint64_t startTime = 0;
+};
+
+// Immutable set of accepted tokens. Lookups compare against every token in
+// constant time, so response timing reveals neither which token nor how many
+// leading bytes matched.
+class AuthTokenSet {
+private:
+    std::vector<std::string> tokens;
+    size_t maxLength;
     
+public:
+    explicit AuthTokenSet(const std::vector<std::string>& validTokens);
+    bool contains(StringView token) const;
+};
+
+// Token set shared by an interceptor and all its clones. rotate() publishes a
+// new set and bumps the version; readers keep a per-thread copy of the set and
+// only touch the mutex when the version they cached is stale.
+class AuthTokenStore {
 private:
-    std::chrono::steady_clock::time_point startTime;
+    std::atomic<uint64_t> version;
+    std::mutex mutex;
+    std::shared_ptr<const AuthTokenSet> current;
+    
+public:
+    explicit AuthTokenStore(const std::vector<std::string>& tokens);
+    
+    void rotate(const std::vector<std::string>& tokens);
+    uint64_t currentVersion() const { return version.load(std::memory_order_acquire); }
+    // Returns the set and the version it belongs to
+    std::shared_ptr<const AuthTokenSet> snapshot(uint64_t& snapshotVersion);
+    // The current set through a per-thread cache: a version check per call,
+    // and the mutex and refcount only after a rotation
+    const AuthTokenSet& tokens();
 };
 
 class AuthenticationInterceptor : public IInterceptor {
 private:
-    std::string validToken;
+    std::shared_ptr<AuthTokenStore> store;
+    
+    bool accepts(const Command& command, bool parsed) const;
     
 public:
-    AuthenticationInterceptor(const std::string& token) : validToken(token) {}
+    AuthenticationInterceptor(const std::string& token);
+    AuthenticationInterceptor(const std::vector<std::string>& tokens);
+    
+    // Replaces the accepted tokens without pausing traffic: requests already
+    // being checked finish against the old set, later ones see the new one.
+    // Also applies to clones handed to reactors.
+    void rotateTokens(const std::vector<std::string>& tokens) { store->rotate(tokens); }
+    // For interceptors that need to know which tokens are valid
+    std::shared_ptr<AuthTokenStore> tokenStore() const { return store; }
+    
+    using IInterceptor::preProcess;
+    using IInterceptor::postProcess;
     
     bool preProcess(std::string& request) override;
+    bool preProcess(StringView request, RequestContext& context) override;
     void postProcess(const std::string& request, std::string& response) override;
+    void postProcess(StringView request, ResponseWriter& response, RequestContext& context) override;
     int getPriority() const override { return 0; }
+    std::unique_ptr<IInterceptor> clone() const override { return std::unique_ptr<IInterceptor>(new AuthenticationInterceptor(*this)); }
 };
 
+// Per-client token bucket, applied at admission. Clients are keyed by their
+// TOKEN: value, but only once it is in `tokens`; missing and unknown tokens
+// all share one unauthenticated bucket, so made-up tokens can't spend other
+// clients' budgets. Without a store every request is unauthenticated.
+// Clones share the buckets, so the limit holds across reactors.
 class RateLimitingInterceptor : public IInterceptor {
 private:
-    int maxRequests;
-    int currentRequests;
-    std::chrono::steady_clock::time_point lastReset;
+    std::shared_ptr<TokenBucketLimiter> limiter;
+    std::shared_ptr<AuthTokenStore> tokens;
     
 public:
-    RateLimitingInterceptor(int max) : maxRequests(max), currentRequests(0) {
-        lastReset = std::chrono::steady_clock::now();
-    }
+    // `burst` defaults to one second's worth of requests
+    RateLimitingInterceptor(uint64_t requestsPerSecond, uint64_t burst = 0,
+                            std::shared_ptr<AuthTokenStore> validTokens = std::shared_ptr<AuthTokenStore>())
+        : limiter(std::make_shared<TokenBucketLimiter>(requestsPerSecond, burst ? burst : requestsPerSecond)),
+          tokens(validTokens) {}
+    
+    using IInterceptor::preProcess;
+    using IInterceptor::postProcess;
     
+    bool admit(StringView request) override;
     bool preProcess(std::string& request) override;
+    bool preProcess(StringView request, RequestContext& context) override;
     void postProcess(const std::string& request, std::string& response) override;
+    void postProcess(StringView request, ResponseWriter& response, RequestContext& context) override;
     int getPriority() const override { return 2; }
+    std::unique_ptr<IInterceptor> clone() const override { return std::unique_ptr<IInterceptor>(new RateLimitingInterceptor(*this)); }
 };
 
 class ValidationInterceptor : public IInterceptor {
+private:
+    static bool validate(StringView request, const Command& command, bool parsed);
+    
 public:
+    using IInterceptor::preProcess;
+    using IInterceptor::postProcess;
+    
     bool preProcess(std::string& request) override;
+    bool preProcess(StringView request, RequestContext& context) override;
     void postProcess(const std::string& request, std::string& response) override;
+    void postProcess(StringView request, ResponseWriter& response, RequestContext& context) override;
     int getPriority() const override { return 3; }
+    std::unique_ptr<IInterceptor> clone() const override { return std::unique_ptr<IInterceptor>(new ValidationInterceptor(*this)); }
 }; 
\ No newline at end of file
@@ -1,5 +1,21 @@
 #pragma once
+#include "string_view.hpp"
+#include "response_writer.hpp"
+#include "command.hpp"
 #include <string>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+// Where a server runs a service's requests
+//   Inline   - cheap and never blocks; runs on the I/O thread that read the request
+//   Worker   - CPU-bound work handed to the shared worker pool
+//   Blocking - may block on disk or network; isolated on its own bounded pool
+enum class ExecutionClass {
+    Inline,
+    Worker,
+    Blocking
+};
 
 // Service Layer Interface
 class IService {
@@ -8,6 +24,78 @@ public:
     virtual std::string processRequest(const std::string& request) = 0;
     virtual void initialize() = 0;
     virtual void cleanup() = 0;
+    
+    // Hot-path overload: `request` views the connection's receive buffer and
+    // the reply is written into `response`. Returns false if this service
+    // doesn't handle the request. The default adapts to the std::string API.
+    virtual bool processRequest(StringView request, ResponseWriter& response) {
+        std::string result = processRequest(std::string(request.data(), request.size()));
+        if (result.empty()) {
+            return false;
+        }
+        response.append(result.data(), result.size());
+        return true;
+    }
+    
+    // Command names this service owns. Servers register them in a dispatch
+    // table at addService() time and route matching requests straight to
+    // processCommand(). Services that return none are probed in order for
+    // requests no registered command matches.
+    virtual std::vector<std::string> getCommands() const { return std::vector<std::string>(); }
+    
+    // Handles an already parsed request whose name is one of getCommands()
+    virtual bool processCommand(const Command& command, ResponseWriter& response) {
+        return processRequest(command.request, response);
+    }
+    
+    // Lets servers keep blocking services off the threads serving fast ones
+    virtual ExecutionClass getExecutionClass() const { return ExecutionClass::Worker; }
+    
+    // Returns an independent copy for servers that give each thread its own
+    // instances. Services that can't be copied return nullptr.
+    virtual std::unique_ptr<IService> clone() const { return nullptr; }
+    
+protected:
+    // Implements the std::string entry point for services built on
+    // processCommand(): only requests naming one of our commands are handled
+    std::string processOwnCommand(const std::string& request) {
+        Command command;
+        if (!parseCommand(StringView(request), command)) {
+            return "";
+        }
+        
+        std::vector<std::string> commands = getCommands();
+        bool owned = false;
+        for (const auto& name : commands) {
+            if (command.name == StringView(name)) {
+                owned = true;
+                break;
+            }
+        }
+        
+        char storage[256];
+        ResponseWriter response(storage, sizeof(storage));
+        if (!owned || !processCommand(command, response)) {
+            return "";
+        }
+        return std::string(response.data(), response.size());
+    }
+};
+
+// Per-request state handed through an interceptor chain, so interceptor
+// instances keep nothing request-specific in members and can be shared by
+// every request a thread serves
+struct RequestContext {
+    Command command;       // The request parsed once, before the chain runs
+    bool hasCommand;
+    uint64_t receivedAt;   // Monotonic nanoseconds; 0 when the server doesn't say
+    uint64_t startedAt;    // When the chain started
+    int clientSocket;
+    uint32_t requestId;
+    
+    RequestContext(StringView request, uint64_t started)
+        : hasCommand(parseCommand(request, command)), receivedAt(0), startedAt(started),
+          clientSocket(-1), requestId(0) {}
 };
 
 // Interceptor Interface
@@ -17,4 +105,60 @@ public:
     virtual bool preProcess(std::string& request) = 0;
     virtual void postProcess(const std::string& request, std::string& response) = 0;
     virtual int getPriority() const = 0;
-}; 
\ No newline at end of file
+    
+    // Hot-path overloads working on views, with the request's context. The
+    // defaults adapt to the std::string API on a copy, so request rewrites
+    // made there are not visible to the server; interceptors that rewrite
+    // requests are only honoured by the std::string path.
+    virtual bool preProcess(StringView request, RequestContext& context) {
+        (void)context;
+        std::string copy(request.data(), request.size());
+        return preProcess(copy);
+    }
+    
+    virtual void postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
+        (void)context;
+        // The std::string API sees the whole response, file tail included
+        response.inlineFileTail();
+        std::string result(response.data(), response.size());
+        postProcess(std::string(request.data(), request.size()), result);
+        response.assign(result);
+    }
+    
+    // Admission check servers run on the thread that read the request, before
+    // it is queued or processed. Must be thread-safe and cheap; rejecting here
+    // sheds load before it takes a queue slot or a worker.
+    virtual bool admit(StringView request) {
+        (void)request;
+        return true;
+    }
+    
+    // Returns an independent copy for servers that give each thread its own
+    // instances. Interceptors that can't be copied return nullptr. Copies may
+    // share state that is safe across threads (token sets, rate buckets).
+    virtual std::unique_ptr<IInterceptor> clone() const { return nullptr; }
+};
+// A server's whole request path behind one virtual call: admission,
+// interceptors and dispatch to the owning service. HFTServer can run one in
+// place of the services and interceptors registered with it at runtime; see
+// StaticPipeline for one whose stages are fixed at compile time.
+class IRequestPipeline {
+public:
+    virtual ~IRequestPipeline() = default;
+    
+    // Same contract as IInterceptor::admit()
+    virtual bool admit(StringView request) = 0;
+    // Execution class of the service that would handle `request`
+    virtual ExecutionClass classify(StringView request) const = 0;
+    // Runs `request` through the interceptors and the owning service, writing
+    // the reply into `response`. Returns the index of the service that
+    // handled it, or static_cast<size_t>(-1) if none did.
+    virtual size_t process(StringView request, ResponseWriter& response, RequestContext& context) = 0;
+    
+    // Services are numbered in the order they were declared
+    virtual size_t serviceCount() const = 0;
+    virtual std::string serviceName(size_t index) const = 0;
+    
+    // Independent copy for another thread; copies may share thread-safe state
+    virtual std::unique_ptr<IRequestPipeline> clone() const = 0;
+};
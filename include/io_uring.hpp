@@ -0,0 +1,110 @@
+#pragma once
+#ifdef HFT_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+// Minimal io_uring wrapper over the raw syscalls (no liburing dependency).
+// One instance per thread: submission and completion are not synchronized.
+class IoUring {
+private:
+    int ringFd;
+    unsigned featureFlags;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned* sqArray;
+    unsigned sqEntries;
+    unsigned localTail;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+public:
+    IoUring();
+    ~IoUring();
+
+    // Sets up a ring with `entries` submission slots. Returns false with
+    // `error` filled in when the kernel lacks the features we rely on.
+    bool init(unsigned entries, std::string& error);
+    int fd() const { return ringFd; }
+    bool hasFeature(unsigned feature) const { return (featureFlags & feature) != 0; }
+
+    // Next free submission slot, zeroed; nullptr when the queue is full and
+    // needs submit() first
+    struct io_uring_sqe* getSqe();
+
+    // Submits queued entries and waits for at least `waitFor` completions or
+    // `timeoutMillis` (< 0 waits indefinitely). Returns the io_uring_enter result.
+    int submitAndWait(unsigned waitFor, int timeoutMillis);
+
+    // Calls handler(cqe) for every available completion, then releases them
+    template<typename Handler>
+    unsigned drainCompletions(Handler handler) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail) {
+            handler(cqes[head & cqMask]);
+            head++;
+            count++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    int registerBuffers(unsigned opcode, void* arg, unsigned count);
+};
+
+// Pool of equally sized receive buffers handed to the kernel with
+// IORING_OP_PROVIDE_BUFFERS. Multishot receives pick a buffer from it as data
+// arrives, so idle connections pin no memory; buffers go back with recycle().
+//
+// The registered-ring variant (IORING_REGISTER_PBUF_RING) would save the
+// submission per recycle, but it does not hand out buffers on every kernel we
+// run on, and recycles are batched into the next io_uring_enter anyway.
+class ProvidedBufferPool {
+private:
+    IoUring* ring;
+    char* storage;
+    unsigned count;
+    unsigned bufferSize;
+    uint16_t groupId;
+    uint8_t recycleFlags;
+
+    ProvidedBufferPool(const ProvidedBufferPool&) = delete;
+    ProvidedBufferPool& operator=(const ProvidedBufferPool&) = delete;
+
+    bool provide(uint16_t firstId, unsigned buffers, uint8_t flags, uint64_t userData);
+
+public:
+    ProvidedBufferPool();
+    ~ProvidedBufferPool();
+
+    // Provides all `count` buffers and waits for the kernel to accept them;
+    // must run before anything else is in flight on `owner`
+    bool init(IoUring& owner, uint16_t group, unsigned count, unsigned size, std::string& error);
+
+    uint16_t group() const { return groupId; }
+    const char* buffer(uint16_t id) const { return storage + static_cast<size_t>(id) * bufferSize; }
+
+    // Queues the buffer to be handed back on the next submit. Completions for
+    // recycles carry user_data 0 and only show up on kernels without
+    // IORING_FEAT_CQE_SKIP or when the kernel rejects them.
+    void recycle(uint16_t id);
+};
+#endif
@@ -0,0 +1,151 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdint.h>
+
+// Nanoseconds on the monotonic clock, for stamping requests as they move
+// between threads
+inline uint64_t monotonicNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Event counter with a single writing thread; any thread may read it
+class SingleWriterCounter {
+private:
+    std::atomic<uint64_t> value;
+
+public:
+    SingleWriterCounter() : value(0) {}
+
+    void add(uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    uint64_t load() const { return value.load(std::memory_order_relaxed); }
+    void reset() { value.store(0, std::memory_order_relaxed); }
+};
+
+// HDR-style log-linear latency histogram in nanoseconds. Values below 64ns are
+// counted exactly; above that every power of two is split into 32 linear
+// sub-buckets, so any recorded value is reported within ~3% of its true value
+// from 1ns up to ~36 minutes, in a fixed 9KB table.
+//
+// Each histogram has a single writer: record() uses plain load/store on
+// relaxed atomics, no locked instructions. Any thread may read it
+// concurrently (merge, percentile) and sees a slightly stale but consistent
+// enough view for monitoring.
+class LatencyHistogram {
+public:
+    static const unsigned SUB_BUCKET_BITS = 5;
+    static const uint64_t SUB_BUCKETS = 1ULL << SUB_BUCKET_BITS;
+    static const unsigned MAX_VALUE_BITS = 41;
+    static const uint64_t MAX_VALUE = (1ULL << MAX_VALUE_BITS) - 1;
+    static const size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    std::atomic<uint64_t> counts[BUCKET_COUNT];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maximum;
+
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+public:
+    LatencyHistogram() { reset(); }
+
+    // Copies are snapshots, used to hand merged results to readers
+    LatencyHistogram(const LatencyHistogram& other) {
+        reset();
+        merge(other);
+    }
+
+    LatencyHistogram& operator=(const LatencyHistogram& other) {
+        if (this != &other) {
+            reset();
+            merge(other);
+        }
+        return *this;
+    }
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value > MAX_VALUE) value = MAX_VALUE;
+        if (value < 2 * SUB_BUCKETS) return static_cast<size_t>(value);
+        unsigned shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+        return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+    }
+
+    // Largest value that lands in `index`, so percentiles never under-report
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < 2 * SUB_BUCKETS) return index;
+        unsigned shift = static_cast<unsigned>(index / SUB_BUCKETS) - 1;
+        uint64_t mantissa = index - shift * SUB_BUCKETS;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    // Owning thread only
+    void record(uint64_t nanos) {
+        bump(counts[bucketIndex(nanos)], 1);
+        bump(total, 1);
+        bump(sum, nanos);
+        if (nanos > maximum.load(std::memory_order_relaxed)) {
+            maximum.store(nanos, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds `other` into this histogram; this one must not be shared with a writer
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            uint64_t count = other.counts[i].load(std::memory_order_relaxed);
+            if (count) bump(counts[i], count);
+        }
+        bump(total, other.total.load(std::memory_order_relaxed));
+        bump(sum, other.sum.load(std::memory_order_relaxed));
+        uint64_t otherMax = other.maximum.load(std::memory_order_relaxed);
+        if (otherMax > maximum.load(std::memory_order_relaxed)) {
+            maximum.store(otherMax, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            counts[i].store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        maximum.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+    // Sum of every recorded value
+    uint64_t totalNanos() const { return sum.load(std::memory_order_relaxed); }
+
+    uint64_t mean() const {
+        uint64_t n = count();
+        return n ? sum.load(std::memory_order_relaxed) / n : 0;
+    }
+
+    // Value at or below which `percent` of recorded values fall, e.g. 99.9
+    uint64_t percentile(double percent) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(percent / 100.0 * n + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > n) rank = n;
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t bound = bucketUpperBound(i);
+                uint64_t highest = max();
+                return bound < highest ? bound : highest;
+            }
+        }
+        return max();
+    }
+};
@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <stdint.h>
+
+#define HFT_CACHE_LINE_SIZE 64
+
+// Bounded multi-producer/multi-consumer ring buffer.
+//
+// Every slot carries a sequence number that tells producers and consumers whose
+// turn it is: a slot at position `pos` is free for the producer claiming `pos`
+// when its sequence equals `pos`, and holds data for the consumer claiming
+// `pos` when its sequence equals `pos + 1`. Positions are claimed with a CAS on
+// the shared head/tail counters, so a slot is never handed to two consumers and
+// never overwritten before it has been consumed. enqueue() returns false when
+// the ring is full; callers use that as their backpressure signal.
+template<typename T>
+class LockFreeQueue {
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    // head/tail live on their own cache lines so producers and consumers
+    // don't invalidate each other's counters
+    char padding0[HFT_CACHE_LINE_SIZE];
+    std::atomic<size_t> enqueuePos;
+    char padding1[HFT_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeuePos;
+    char padding2[HFT_CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    static size_t roundUpPowerOfTwo(size_t value) {
+        size_t result = 2;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+public:
+    explicit LockFreeQueue(size_t capacity = 10000)
+        : enqueuePos(0), dequeuePos(0), mask(roundUpPowerOfTwo(capacity) - 1),
+          slots(new Slot[mask + 1]) {
+        for (size_t i = 0; i <= mask; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    bool enqueue(const T& item) {
+        T copy(item);
+        return enqueue(std::move(copy));
+    }
+
+    bool enqueue(T&& item) {
+        Slot* slot;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->data = std::move(item);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool dequeue(T& item) {
+        Slot* slot;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        item = std::move(slot->data);
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Approximate number of queued items; exact only when the queue is quiescent
+    size_t size() const {
+        size_t tail = enqueuePos.load(std::memory_order_relaxed);
+        size_t head = dequeuePos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+};
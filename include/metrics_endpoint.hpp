@@ -0,0 +1,58 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <stdint.h>
+
+// Longest HTTP request head the endpoint reads before answering anyway
+#define METRICS_MAX_REQUEST 4096
+// How long a scraper may take to send its request
+#define METRICS_READ_TIMEOUT_MS 1000
+
+// Builds the Prometheus text exposition format: one header per metric,
+// then its samples
+class MetricsText {
+private:
+    std::string text;
+
+    static void appendLabelValue(std::string& out, const std::string& value);
+
+public:
+    // `type` is "counter", "gauge" or "summary"
+    void header(const char* name, const char* help, const char* type);
+    // Up to two labels, given as name and value; a null name ends the list
+    void sample(const char* name, double value, const char* labelName = nullptr, const std::string& labelValue = "",
+                const char* secondName = nullptr, const std::string& secondValue = "");
+
+    const std::string& str() const { return text; }
+};
+
+// Admin listener on its own thread, away from the request path. Any HTTP
+// request gets the output of `render` as text/plain, so curl and Prometheus
+// scrapers work alike; connections are answered one at a time and closed.
+class MetricsEndpoint {
+public:
+    typedef std::function<std::string()> Renderer;
+
+private:
+    std::string address;
+    int port;
+    Renderer render;
+    int listenSocket;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    void serve();
+    void answer(int clientSocket);
+
+public:
+    MetricsEndpoint(const std::string& bindAddress, int bindPort, Renderer renderer);
+    ~MetricsEndpoint();
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // Binds and starts serving; throws if the address can't be bound
+    void start();
+    void stop();
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// Wire protocol shared by SocketClient, SocketServer and HFTServer.
+//
+// Every message is a fixed 12-byte header followed by `length` payload bytes:
+//
+//   uint32 length | uint16 opcode | uint16 flags | uint32 requestId
+//
+// All header fields are in network byte order. Responses echo the requestId of
+// the request they answer, so a client may pipeline several requests on one
+// connection and match the replies.
+
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAX_PAYLOAD (1024 * 1024)
+// Payloads above this are written from the caller's memory instead of being
+// copied into a FrameBatch
+#define FRAME_BATCH_COPY_LIMIT 4096
+
+enum FrameOpcode : uint16_t {
+    FRAME_OP_REQUEST = 1,
+    FRAME_OP_RESPONSE = 2,
+    FRAME_OP_ERROR = 3
+};
+
+struct FrameHeader {
+    uint32_t length;
+    uint16_t opcode;
+    uint16_t flags;
+    uint32_t requestId;
+
+    FrameHeader() : length(0), opcode(0), flags(0), requestId(0) {}
+    FrameHeader(uint16_t op, uint32_t id, uint32_t len)
+        : length(len), opcode(op), flags(0), requestId(id) {}
+};
+
+void encodeFrameHeader(const FrameHeader& header, char* out);
+void decodeFrameHeader(const char* in, FrameHeader& header);
+
+// Appends a complete frame (header + payload) to `out`.
+void encodeFrame(uint16_t opcode, uint32_t requestId, const char* payload, size_t length, std::string& out);
+
+// Per-connection receive buffer. Bytes are appended at the write end by recv()
+// and complete frames are pulled from the read end. Consumed space is reclaimed
+// by sliding the unread tail to the front, so every frame handed out is
+// contiguous and can be processed in place.
+class ReceiveBuffer {
+private:
+    std::vector<char> storage;
+    size_t readPos;
+    size_t writePos;
+
+public:
+    explicit ReceiveBuffer(size_t initialCapacity = 4096);
+
+    // Makes room for at least `minFree` bytes and returns the write pointer.
+    char* prepareWrite(size_t minFree);
+    size_t writableBytes() const { return storage.size() - writePos; }
+    void commitWrite(size_t bytes) { writePos += bytes; }
+
+    size_t readableBytes() const { return writePos - readPos; }
+    // The bytes not yet taken as frames, e.g. to pass a connection on
+    const char* unread() const { return storage.data() + readPos; }
+
+    // Extracts the next complete frame. Returns 1 when a frame is available
+    // (payload points into the buffer and stays valid until the next
+    // prepareWrite()), 0 when more bytes are needed, and -1 when the stream
+    // carries a frame larger than FRAME_MAX_PAYLOAD.
+    int nextFrame(FrameHeader& header, const char*& payload);
+
+    void clear() { readPos = writePos = 0; }
+    size_t capacity() const { return storage.size(); }
+};
+
+// Response frames bound for one connection, written together by flush() with
+// a single sendmsg() instead of one syscall per frame. Small payloads are
+// copied into one contiguous buffer; a large one can be passed to flush() and
+// is sent from where it is, after everything queued before it.
+class FrameBatch {
+private:
+    std::string pending;
+    size_t frames;
+
+public:
+    FrameBatch() : frames(0) {}
+
+    void append(uint16_t opcode, uint32_t requestId, const char* payload, size_t length) {
+        encodeFrame(opcode, requestId, payload, length, pending);
+        frames++;
+    }
+
+    bool empty() const { return frames == 0; }
+    size_t frameCount() const { return frames; }
+    size_t byteCount() const { return pending.size(); }
+    // The encoded frames, for callers that write them themselves
+    const std::string& encoded() const { return pending; }
+    void clear() { pending.clear(); frames = 0; }
+
+    // Writes every queued frame and clears the batch, even on failure
+    bool flush(int sock);
+    // Same, with one more frame whose payload is not copied
+    bool flush(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length);
+    // Same, where that frame's payload continues with `fileLength` bytes of
+    // `fd` from `fileOffset`, sent with sendfile()
+    bool flush(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length,
+               int fd, uint64_t fileOffset, size_t fileLength);
+};
+
+// Writes every byte described by `iov` (which is consumed), resuming after
+// partial writes and waiting out EAGAIN on non-blocking sockets. `flags` are
+// added to each sendmsg(), e.g. MSG_MORE when more data follows at once.
+bool sendVector(int sock, struct iovec* iov, size_t count, int flags = 0);
+
+// Sends `length` bytes of `fd` from `offset` with sendfile(), the same way
+bool sendFileRange(int sock, int fd, uint64_t offset, size_t length);
+
+// Non-waiting forms for event loops: one write of as much as the socket
+// takes. They return the bytes written, 0 when it is full, or -1 on an error
+// (including a file that shrank); `iov` is left as it was.
+ssize_t sendVectorNow(int sock, const struct iovec* iov, size_t count, int flags = 0);
+ssize_t sendFileNow(int sock, int fd, uint64_t offset, size_t length);
+
+// Blocking helpers used by SocketClient and SocketServer. On non-blocking
+// sockets sendFrame() waits for writability instead of dropping the remainder.
+bool sendFrame(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length);
+bool recvFrame(int sock, ReceiveBuffer& buffer, FrameHeader& header, std::string& payload);
@@ -0,0 +1,66 @@
+#pragma once
+#include "string_view.hpp"
+#include "latency_histogram.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <stdint.h>
+
+// Buckets per limiter; keys hash onto them, so a power of two
+#define RATE_LIMIT_BUCKETS 1024
+
+// Token-bucket rate limiter keyed by client, safe for any number of threads.
+//
+// Each bucket holds a single word, the time its next token becomes available
+// (GCRA, the "virtual scheduling" form of a token bucket). A request takes a
+// token with one CAS: tokens refill continuously at `perSecond` with
+// nanosecond granularity and up to `burst` can be taken at once. There is no
+// periodic reset and no lock. Keys that hash to the same bucket share its
+// budget; with RATE_LIMIT_BUCKETS buckets that is rare for realistic client
+// counts and only ever makes a limit stricter.
+class TokenBucketLimiter {
+private:
+    // One cache line per bucket so clients on different cores don't contend
+    struct alignas(64) Bucket {
+        std::atomic<uint64_t> nextTokenAt;
+        Bucket() : nextTokenAt(0) {}
+    };
+
+    Bucket buckets[RATE_LIMIT_BUCKETS];
+    uint64_t interval;   // Nanoseconds per token
+    uint64_t tolerance;  // How far ahead of now the schedule may run: (burst - 1) tokens
+
+    static size_t bucketFor(StringView key) {
+        // FNV-1a
+        uint64_t hash = 1469598103934665603ULL;
+        for (size_t i = 0; i < key.size(); ++i) {
+            hash ^= static_cast<unsigned char>(key[i]);
+            hash *= 1099511628211ULL;
+        }
+        return static_cast<size_t>(hash ^ (hash >> 32)) & (RATE_LIMIT_BUCKETS - 1);
+    }
+
+public:
+    TokenBucketLimiter(uint64_t perSecond, uint64_t burst) {
+        if (perSecond == 0 || burst == 0) {
+            throw std::runtime_error("Rate limiter needs a positive rate and burst");
+        }
+        interval = 1000000000ULL / perSecond;
+        if (interval == 0) interval = 1;
+        tolerance = (burst - 1) * interval;
+    }
+
+    // Takes one token from `key`'s bucket; false when it is empty
+    bool tryAcquire(StringView key, uint64_t now = monotonicNanos()) {
+        std::atomic<uint64_t>& slot = buckets[bucketFor(key)].nextTokenAt;
+        uint64_t scheduled = slot.load(std::memory_order_relaxed);
+        while (true) {
+            if (scheduled > now + tolerance) {
+                return false;
+            }
+            uint64_t next = (scheduled > now ? scheduled : now) + interval;
+            if (slot.compare_exchange_weak(scheduled, next, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+};
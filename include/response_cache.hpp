@@ -0,0 +1,153 @@
+#pragma once
+#include "command.hpp"
+#include "response_writer.hpp"
+#include "service_registry.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+// Lock shards; keys hash onto them, so a power of two
+#define RESPONSE_CACHE_SHARDS 16
+// Default bound on cached bytes (keys, replies and bookkeeping) over all shards
+#define RESPONSE_CACHE_MAX_BYTES (16 * 1024 * 1024)
+// Longer replies are rebuilt each time rather than cached
+#define RESPONSE_CACHE_MAX_REPLY (16 * 1024)
+
+// Writes the key a command's arguments are cached under into `key`, so
+// different spellings of one argument (paths, say) share an entry
+typedef void (*CacheKeyFunction)(StringView args, std::string& key);
+
+// Replies to idempotent commands, so repeats skip the service. Entries are
+// keyed by the command after its token, i.e. the name and the arguments
+// exactly as sent, since replies such as ECHO's depend on the spacing, unless
+// the command has a key function (READ keys on the resolved path). Only
+// commands opted in with cacheCommand() are cached, and ERROR replies never
+// are. Safe to share between threads.
+//
+// Each shard is bounded in bytes and evicts with CLOCK: a hit only sets the
+// entry's reference bit, and the hand passes over referenced entries once
+// before evicting them. Entries also leave when their command's TTL runs
+// out or when a service invalidates them (WRITE drops the READ of its path,
+// a CAL assignment drops every CAL result).
+class ResponseCache {
+public:
+    // Handed out by a miss and passed back to store(), so a reply computed
+    // while its command was being invalidated is not stored
+    struct Ticket {
+        size_t policy;
+        uint64_t hash;
+        uint64_t generation;
+        uint64_t invalidations;
+        // The computed key for commands with a key function, so store()
+        // doesn't run it again
+        std::string key;
+        bool keyed;
+
+        Ticket() : policy(CommandTable::npos), hash(0), generation(0), invalidations(0), keyed(false) {}
+        bool storable() const { return policy != CommandTable::npos; }
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t entries;
+        uint64_t bytes;
+    };
+
+private:
+    struct Policy {
+        uint64_t ttlNanos;  // 0 never expires
+        CacheKeyFunction keyFunction;  // Null keys on the arguments as sent
+        // Bumped by invalidateCommand(); older entries are stale
+        std::atomic<uint64_t> generation;
+
+        explicit Policy(uint64_t ttl) : ttlNanos(ttl), keyFunction(nullptr), generation(0) {}
+    };
+
+    struct Entry {
+        std::string key;  // "<name> <args>"
+        std::string reply;
+        uint64_t hash;
+        uint64_t expiresAt;  // Monotonic nanoseconds; 0 never
+        uint64_t generation;
+        size_t policy;
+        size_t service;
+        bool referenced;  // CLOCK bit, set by hits
+        bool live;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::vector<Entry> slots;
+        std::vector<size_t> freeSlots;
+        // By key hash; a different key with the same hash just replaces it
+        std::unordered_map<uint64_t, size_t> index;
+        size_t hand;
+        size_t bytes;
+        // Bumped by invalidate(), failing the tickets of stores in flight
+        uint64_t invalidations;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+
+        Shard() : hand(0), bytes(0), invalidations(0), hits(0), misses(0), evictions(0) {}
+    };
+
+    CommandTable commands;  // Cached command name -> policy
+    std::vector<std::unique_ptr<Policy>> policies;
+    Shard shards[RESPONSE_CACHE_SHARDS];
+    size_t shardLimit;
+
+    static uint64_t hashKey(StringView name, StringView args);
+    static bool sameKey(const Entry& entry, StringView name, StringView args);
+    static size_t entryCost(size_t keyLength, size_t replyLength);
+
+    // The arguments `policy` keys on: `args` itself, or their key in a
+    // per-thread buffer that stays valid until the next call
+    StringView keyArgs(size_t policy, StringView args) const;
+
+    Shard& shardFor(uint64_t hash) { return shards[(hash ^ (hash >> 32)) & (RESPONSE_CACHE_SHARDS - 1)]; }
+    // The live entry for the key in `shard`, or null; drops it if stale
+    Entry* findLocked(Shard& shard, uint64_t hash, StringView name, StringView args, size_t policy);
+    void eraseLocked(Shard& shard, size_t slot);
+    void evictOneLocked(Shard& shard);
+
+public:
+    explicit ResponseCache(size_t byteLimit = RESPONSE_CACHE_MAX_BYTES);
+    ResponseCache(const ResponseCache&) = delete;
+    ResponseCache& operator=(const ResponseCache&) = delete;
+
+    // Opts command `name` in; its replies expire `ttlNanos` after being
+    // stored, or never when 0. Call before the cache is shared with servers.
+    void cacheCommand(const std::string& name, uint64_t ttlNanos);
+    bool caches(StringView name) const { return commands.find(name) != CommandTable::npos; }
+    // Keys `name` on `function` of its arguments, invalidate() included; a
+    // no-op unless `name` is cached. Also call before the cache is shared.
+    void setKeyFunction(StringView name, CacheKeyFunction function);
+
+    // On a hit appends the cached reply to `response`, sets `service` to the
+    // index of the service that produced it and returns true. A miss on a
+    // cached command fills `ticket` for store().
+    bool lookup(const Command& command, ResponseWriter& response, size_t& service, Ticket& ticket);
+    // Caches the reply `service` wrote for `command`, unless it is an error,
+    // too long, ends in a file tail, or was invalidated since the lookup
+    void store(const Ticket& ticket, const Command& command, size_t service, const ResponseWriter& response);
+    // Whether `request` would hit, without counting a hit; lets servers
+    // answer it on the thread that read it instead of queueing it. Always
+    // false for commands with a key function: computing their key may block
+    // (READ's realpath()), so they go to the service's executor, whose
+    // lookup() still hits.
+    bool contains(StringView request);
+
+    // Drops the reply to `name` with `args` (or the same key), e.g. READ of a path
+    void invalidate(StringView name, StringView args);
+    // Drops every reply to `name`
+    void invalidateCommand(StringView name);
+
+    Stats stats();
+};
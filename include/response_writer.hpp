@@ -0,0 +1,123 @@
+#pragma once
+#include "string_view.hpp"
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <unistd.h>
+#include <cerrno>
+
+// Bytes of an open file that a response ends with. Servers that support it
+// send them with sendfile() rather than copying them into the response.
+struct FileRegion {
+    int fd;
+    uint64_t offset;
+    size_t length;
+    // Keeps `fd` open until the reply has been sent
+    std::shared_ptr<const void> owner;
+
+    FileRegion() : fd(-1), offset(0), length(0) {}
+};
+
+// Accumulates a response into caller-provided storage. Responses that outgrow
+// the storage spill into a std::string, so services never truncate; the common
+// small response costs no allocation. Callers that process many requests can
+// pass their own spill string so its capacity is reused between responses.
+class ResponseWriter {
+private:
+    char* buffer;
+    size_t capacity;
+    size_t used;
+    std::string ownOverflow;
+    std::string* overflow;
+    bool spilled;
+    bool fileTailAllowed;
+    FileRegion tail;
+
+public:
+    ResponseWriter(char* storage, size_t storageCapacity, std::string* spillStorage = nullptr)
+        : buffer(storage), capacity(storageCapacity), used(0),
+          overflow(spillStorage ? spillStorage : &ownOverflow), spilled(false), fileTailAllowed(false) {}
+
+    ResponseWriter(const ResponseWriter&) = delete;
+    ResponseWriter& operator=(const ResponseWriter&) = delete;
+
+    void append(const char* data, size_t length) {
+        if (!spilled && used + length <= capacity) {
+            memcpy(buffer + used, data, length);
+            used += length;
+            return;
+        }
+        if (!spilled) {
+            overflow->reserve((used + length) * 2);
+            overflow->assign(buffer, used);
+            spilled = true;
+        }
+        overflow->append(data, length);
+    }
+
+    void append(StringView text) { append(text.data(), text.size()); }
+    void append(char c) { append(&c, 1); }
+
+    void assign(StringView text) {
+        clear();
+        append(text);
+    }
+
+    void clear() {
+        used = 0;
+        if (spilled) {
+            overflow->clear();
+            spilled = false;
+        }
+        tail = FileRegion();
+    }
+
+    // data()/size()/view() cover the bytes appended so far, never a file tail
+    const char* data() const { return spilled ? overflow->data() : buffer; }
+    size_t size() const { return spilled ? overflow->size() : used; }
+    bool empty() const { return size() == 0 && tail.length == 0; }
+    StringView view() const { return StringView(data(), size()); }
+
+    // Servers that can send a file tail themselves opt in per response
+    void allowFileTail() { fileTailAllowed = true; }
+    bool acceptsFileTail() const { return fileTailAllowed; }
+
+    // Ends the response with `region`. Without allowFileTail() the bytes are
+    // read into the response instead. Nothing may be appended afterwards.
+    bool appendFile(const FileRegion& region) {
+        tail = region;
+        return fileTailAllowed || inlineFileTail();
+    }
+
+    bool hasFileTail() const { return tail.length > 0; }
+    const FileRegion& fileTail() const { return tail; }
+
+    // Reads the file tail into the response, for code that needs every byte
+    // in memory. Returns false (dropping the tail) if the read fails.
+    bool inlineFileTail() {
+        FileRegion region = tail;
+        tail = FileRegion();
+        return appendFileCopy(region);
+    }
+
+    // Appends the bytes of `region` with pread(), never as a tail. Returns
+    // false if the read fails or the file ends early.
+    bool appendFileCopy(FileRegion region) {
+        char chunk[8192];
+        while (region.length > 0) {
+            size_t want = region.length < sizeof(chunk) ? region.length : sizeof(chunk);
+            ssize_t got = pread(region.fd, chunk, want, static_cast<off_t>(region.offset));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return false;
+            append(chunk, static_cast<size_t>(got));
+            region.offset += got;
+            region.length -= got;
+        }
+        return true;
+    }
+
+    // True once the response no longer fits the caller's storage
+    bool hasSpilled() const { return spilled; }
+};
@@ -1,7 +1,11 @@
 #pragma once
 #include "interfaces.hpp"
+#include "protocol.hpp"
+#include "service_registry.hpp"
+#include "interceptor_chain.hpp"
 #include <memory>
 #include <mutex>
+#include <chrono>
 #include <vector>
 #include <thread>
 #include <atomic>
@@ -10,16 +14,73 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+// Connection handling defaults; each can be changed before start()
+#define SERVER_WORKER_THREADS 32
+#define SERVER_LISTEN_BACKLOG SOMAXCONN
+#define SERVER_MAX_CONNECTIONS 1024
+// Descriptors kept free for stdio, the listener, logs and files the
+// services open (the file cache alone holds up to 64); maxConnections is
+// clamped so connections can't use them up
+#define SERVER_RESERVED_FDS 128
+// Pause before accepting again when out of descriptors or memory
+#define SERVER_ACCEPT_BACKOFF_MS 100
+// Unsent replies past which a connection's requests are no longer read
+#define SERVER_MAX_OUTBOUND_BYTES (4 * 1024 * 1024)
+
+// A worker thread and the connections it multiplexes with poll(). The
+// acceptor hands it sockets through `incoming` and wakes it on `wakeFd`.
+struct SocketWorker {
+    std::thread thread;
+    int wakeFd;  // eventfd
+    std::mutex mutex;
+    std::vector<int> incoming;
+    // Connections owned, incoming ones included
+    std::atomic<size_t> connections;
+    
+    SocketWorker() : wakeFd(-1), connections(0) {}
+};
+
+// Server with a fixed pool of worker threads. Each accepted socket goes to
+// the worker with the fewest connections, which polls all of its sockets
+// and answers requests in turn, so an idle client holds a slot rather than
+// a thread. Sockets are non-blocking and replies the socket can't take yet
+// wait in the connection's outbound buffer, so a client that doesn't read
+// stalls only itself: past SERVER_MAX_OUTBOUND_BYTES its requests stay
+// unread until it catches up. Beyond maxConnections new clients get
+// "ERROR: Server busy" and are closed, so thread count and memory stay bounded.
 class SocketServer {
 private:
+    // One client connection, owned by its worker
+    struct Connection {
+        int fd;
+        ReceiveBuffer buffer;
+        // Encoded replies, sent from `outgoingSent` on
+        std::string outgoing;
+        size_t outgoingSent;
+        std::chrono::steady_clock::time_point lastActivity;
+        
+        Connection(int socket, std::chrono::steady_clock::time_point now)
+            : fd(socket), outgoingSent(0), lastActivity(now) {}
+        size_t unsent() const { return outgoing.size() - outgoingSent; }
+    };
+
     static SocketServer* instance;
     static std::mutex mutex;
     
     int serverSocket;
     std::atomic<bool> running;
-    std::vector<std::thread> workerThreads;
-    std::vector<std::unique_ptr<IService>> services;
-    std::vector<std::unique_ptr<IInterceptor>> interceptors;
+    std::vector<std::unique_ptr<SocketWorker>> workers;
+    ServiceRegistry services;
+    // Prototype chain; every worker runs its own clone when it can
+    InterceptorChain interceptors;
+    
+    size_t workerCount;
+    int backlog;
+    size_t maxConnections;
+    int idleTimeoutSeconds;
+    
+    // Connections open across all workers
+    std::atomic<size_t> connectionCount;
     
     SocketServer();
     ~SocketServer();
@@ -27,8 +88,15 @@ private:
     SocketServer& operator=(const SocketServer&) = delete;
     
     void acceptConnections();
-    void handleClient(int clientSocket);
-    std::string processRequest(const std::string& request);
+    bool admitConnection(int clientSocket);
+    void workerThread(SocketWorker* worker);
+    // Handles the poll() events of one connection: sends queued replies,
+    // reads what the socket has and answers complete requests until the
+    // outbound buffer is full; false once the connection should close
+    bool serveConnection(Connection& connection, short events, InterceptorChain& chain);
+    // Sends what it can of the outbound buffer without blocking; false on an error
+    bool flushConnection(Connection& connection);
+    std::string processRequest(const std::string& request, InterceptorChain& chain);
 
 public:
     static SocketServer* getInstance();
@@ -36,4 +104,12 @@ public:
     void stop();
     void addService(std::unique_ptr<IService> service);
     void addInterceptor(std::unique_ptr<IInterceptor> interceptor);
+    
+    // Must be called before start()
+    void setWorkerThreads(size_t count) { workerCount = count > 0 ? count : 1; }
+    void setBacklog(int size) { backlog = size; }
+    // Lowered at start() if RLIMIT_NOFILE can't accommodate it
+    void setMaxConnections(size_t limit) { maxConnections = limit; }
+    // Closes connections that neither send nor take data for this long; 0 keeps them open
+    void setIdleTimeout(int seconds) { idleTimeoutSeconds = seconds; }
 }; 
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+#include "interfaces.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Flat open-addressing hash table from command name to the index of the
+// owning service.
+// Built once at registration time; lookups hash the name once and usually
+// resolve on the first probe, independent of how many services exist.
+class CommandTable {
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string name;
+        size_t service;
+        
+        Entry() : hash(0), service(npos) {}
+    };
+    
+    std::vector<Entry> entries;
+    size_t count;
+    
+    void grow();
+    
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+    
+    CommandTable();
+    
+    static uint64_t hashName(StringView name);
+    
+    // Returns false if the name is already registered
+    bool insert(const std::string& name, size_t service);
+    // Service index for `name`, or npos
+    size_t find(StringView name) const;
+    size_t size() const { return count; }
+};
+
+// Owns a server's services and routes parsed commands to them
+class ServiceRegistry {
+private:
+    std::vector<std::unique_ptr<IService>> services;
+    CommandTable commands;
+    // Services that registered no commands, probed in order as a fallback
+    std::vector<size_t> fallback;
+    
+    size_t route(StringView request) const;
+    
+public:
+    static const size_t npos = CommandTable::npos;
+    
+    // Registers the service's commands; throws if a command is already owned
+    void add(std::unique_ptr<IService> service);
+    
+    // Runs the request through the owning service. Returns false (leaving
+    // `response` untouched) when no service handles it. `handledBy` receives
+    // the registration index of the service that did, which is the same in
+    // every clone of this registry.
+    bool dispatch(StringView request, ResponseWriter& response, size_t* handledBy = nullptr);
+    
+    // Execution class of the service that would handle `request`
+    ExecutionClass classify(StringView request) const;
+    
+    // Copies every service via IService::clone(); throws if one can't be cloned
+    void cloneInto(ServiceRegistry& target) const;
+    
+    size_t size() const { return services.size(); }
+    // Display name for reports: the service's commands joined with '/'
+    std::string serviceName(size_t index) const;
+    // The same naming for a service registered at `index` with `commands`
+    static std::string displayName(const std::vector<std::string>& commands, size_t index);
+};
@@ -1,35 +1,100 @@
 #pragma once
 #include "interfaces.hpp"
+#include "expression.hpp"
+#include "file_cache.hpp"
+#include "file_upload.hpp"
+#include "response_cache.hpp"
 #include <string>
-#include <map>
+#include <memory>
+#include <vector>
 
 class EchoService : public IService {
 public:
+    using IService::processRequest;
+    
     void initialize() override;
     void cleanup() override;
     std::string processRequest(const std::string& request) override;
+    std::vector<std::string> getCommands() const override;
+    bool processCommand(const Command& command, ResponseWriter& response) override;
+    ExecutionClass getExecutionClass() const override { return ExecutionClass::Inline; }
+    std::unique_ptr<IService> clone() const override;
 };
 
+// CAL <expression> evaluates arithmetic over numbers and variables, and
+// CAL <name> = <expression> also assigns the result to <name>. See
+// CompiledExpression for the grammar.
 class CalculatorService : public IService {
 private:
-    std::map<std::string, double> variables;
+    // Shared by clones, so every thread sees the same variables and reuses
+    // the expressions the others compiled
+    std::shared_ptr<ExpressionEngine> engine;
+    // Cached CAL results, dropped on every assignment; may be null
+    std::shared_ptr<ResponseCache> responses;
     
 public:
+    using IService::processRequest;
+    
+    CalculatorService() : engine(std::make_shared<ExpressionEngine>()) {}
+    
+    void setResponseCache(std::shared_ptr<ResponseCache> cache) { responses = std::move(cache); }
+    
     void initialize() override;
     void cleanup() override;
     std::string processRequest(const std::string& request) override;
-    
-private:
-    double evaluateExpression(const std::string& expression);
+    std::vector<std::string> getCommands() const override;
+    bool processCommand(const Command& command, ResponseWriter& response) override;
+    ExecutionClass getExecutionClass() const override { return ExecutionClass::Inline; }
+    std::unique_ptr<IService> clone() const override;
 };
 
+// READ replies at least this large are sent with sendfile() by servers that
+// support it; smaller ones are copied out of the mapping
+#define FILE_SENDFILE_THRESHOLD (16 * 1024)
+
+// Files are written whole with
+//   WRITE <filename> <content>
+// or streamed in chunks through an upload handle:
+//   WRITE_OPEN <filename>                  -> SUCCESS: Upload <handle>
+//   WRITE_CHUNK <handle> <offset> <data>   -> SUCCESS: <bytes received> bytes
+//   WRITE_CLOSE <handle> [<size>]          -> SUCCESS: File written (<size> bytes)
+//   WRITE_ABORT <handle>
+// Chunks may be pipelined; each is placed at its offset, and the file only
+// replaces <filename> once WRITE_CLOSE finds every byte up to <size>.
 class FileService : public IService {
+private:
+    // Shared by clones, so every reactor and pool thread sees the same files
+    std::shared_ptr<FileCache> cache;
+    std::shared_ptr<UploadTable> uploads;
+    // Cached READ replies, dropped as their files are written; may be null
+    std::shared_ptr<ResponseCache> responses;
+    
 public:
+    using IService::processRequest;
+    
+    FileService() : cache(std::make_shared<FileCache>()), uploads(std::make_shared<UploadTable>()) {}
+    explicit FileService(std::shared_ptr<FileCache> fileCache)
+        : cache(std::move(fileCache)), uploads(std::make_shared<UploadTable>()) {}
+    
+    FileCache& getCache() { return *cache; }
+    // Only writes made through this service invalidate cached READs; give READ
+    // a TTL if files also change behind the server's back. READs are keyed
+    // on the resolved path, so every spelling of a file shares one entry.
+    void setResponseCache(std::shared_ptr<ResponseCache> cache);
+    // Applies to WRITE and to uploads opened afterwards
+    void setSyncPolicy(FileSyncPolicy policy) { uploads->setSyncPolicy(policy); }
+    
     void initialize() override;
     void cleanup() override;
     std::string processRequest(const std::string& request) override;
+    std::vector<std::string> getCommands() const override;
+    bool processCommand(const Command& command, ResponseWriter& response) override;
+    // Cache misses open and map files, and a mapped read can page-fault on disk
+    ExecutionClass getExecutionClass() const override { return ExecutionClass::Blocking; }
+    std::unique_ptr<IService> clone() const override;
     
 private:
-    std::string readFile(const std::string& filename);
-    bool writeFile(const std::string& filename, const std::string& content);
+    void readFile(const std::string& filename, ResponseWriter& response);
+    bool writeFile(const std::string& filename, StringView content);
+    void processUpload(const Command& command, ResponseWriter& response);
 }; 
\ No newline at end of file
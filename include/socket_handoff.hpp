@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+// Most fds one handoff message carries
+#define HANDOFF_MAX_FDS 64
+// Longest payload a handoff message carries: a connection's unread partial frame
+#define HANDOFF_MAX_PAYLOAD (2 * 1024 * 1024)
+// How long either side waits on the other before giving up
+#define HANDOFF_TIMEOUT_MS 10000
+
+// Hot restart: a running server passes its sockets to the process replacing
+// it over a Unix stream socket, as SCM_RIGHTS ancillary data, so listen
+// queues and open connections survive the restart. Messages are a 12-byte
+// header (kind, fd count, payload length, in host order) and the payload;
+// the fds ride on the header.
+enum HandoffKind : uint32_t {
+    HANDOFF_TAKEOVER = 1,   // successor -> server; payload "1" also asks for connections
+    HANDOFF_LISTENERS = 2,  // server -> successor; one fd per listening socket
+    HANDOFF_CONNECTION = 3  // server -> successor; one client fd, payload its unparsed bytes
+};
+
+struct HandoffMessage {
+    uint32_t kind;
+    std::vector<int> fds;  // Owned by the receiver
+    std::string payload;
+
+    HandoffMessage() : kind(0) {}
+};
+
+// Binds `path` for successors, replacing a stale socket file; only the
+// owning user may connect. Throws on failure.
+int listenHandoffSocket(const std::string& path);
+// Accepts a successor on a listener from listenHandoffSocket(); -1 on failure
+int acceptHandoffSocket(int listener);
+// Connects to the server listening at `path`; -1 when there is none
+int connectHandoffSocket(const std::string& path);
+
+bool sendHandoffMessage(int sock, uint32_t kind, const int* fds, size_t fdCount, const char* payload, size_t length);
+// False on EOF, an error, a timeout or a malformed message; fds received
+// with a message that fails are closed
+bool recvHandoffMessage(int sock, HandoffMessage& message);
@@ -0,0 +1,245 @@
+#pragma once
+#include "interfaces.hpp"
+#include "service_registry.hpp"
+#include "response_cache.hpp"
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Request pipeline whose interceptors and services are fixed at compile time:
+//
+//   StaticPipeline<AuthenticationInterceptor, EchoService, CalculatorService>
+//
+// Stages deriving from IInterceptor run in the order they are listed
+// (getPriority() is not consulted); stages deriving from IService are routed
+// to by command name, numbered in the order listed. Every call into a stage
+// is qualified with its concrete type, so none of them goes through the
+// vtable and the compiler is free to inline the whole path. The server pays
+// one virtual call per request, into process().
+template<typename... Stages>
+class StaticPipeline final : public IRequestPipeline {
+private:
+    template<typename T>
+    static constexpr bool isInterceptor() { return std::is_base_of<IInterceptor, T>::value; }
+    template<typename T>
+    static constexpr bool isService() { return std::is_base_of<IService, T>::value; }
+
+    static_assert(sizeof...(Stages) > 0, "StaticPipeline needs at least one stage");
+    static_assert(((isInterceptor<Stages>() || isService<Stages>()) && ...),
+                  "StaticPipeline stages must be interceptors or services");
+
+    static constexpr size_t SERVICE_COUNT = (static_cast<size_t>(isService<Stages>()) + ...);
+
+    using Sequence = std::index_sequence_for<Stages...>;
+
+    template<size_t I>
+    using StageAt = typename std::tuple_element<I, std::tuple<Stages...>>::type;
+
+    // Index of the service at stage I among the services
+    template<size_t I>
+    static constexpr size_t serviceIndex() {
+        constexpr bool services[] = {isService<Stages>()...};
+        size_t index = 0;
+        for (size_t i = 0; i < I; ++i) {
+            if (services[i]) index++;
+        }
+        return index;
+    }
+
+    std::tuple<Stages...> stages;
+    CommandTable commands;
+    // Looked up once at construction so routing makes no calls into services
+    std::array<ExecutionClass, SERVICE_COUNT> executionClasses;
+    std::array<std::string, SERVICE_COUNT> names;
+    // Services that registered no commands, probed in order as a fallback
+    std::array<bool, SERVICE_COUNT> fallback;
+    bool hasFallback;
+    // Shared by clones; null when replies aren't cached
+    std::shared_ptr<ResponseCache> responses;
+
+    template<size_t... I>
+    void registerServices(std::index_sequence<I...>) { (registerStage<I>(), ...); }
+
+    template<size_t I>
+    void registerStage() {
+        using Stage = StageAt<I>;
+        if constexpr (isService<Stage>()) {
+            Stage& service = std::get<I>(stages);
+            constexpr size_t index = serviceIndex<I>();
+            service.Stage::initialize();
+            std::vector<std::string> commandNames = service.Stage::getCommands();
+            for (const auto& name : commandNames) {
+                if (!commands.insert(name, index)) {
+                    throw std::runtime_error("Command already registered: " + name);
+                }
+            }
+            executionClasses[index] = service.Stage::getExecutionClass();
+            names[index] = ServiceRegistry::displayName(commandNames, index);
+            fallback[index] = commandNames.empty();
+            hasFallback = hasFallback || commandNames.empty();
+        }
+    }
+
+    template<size_t... I>
+    bool admitAll(StringView request, std::index_sequence<I...>) {
+        return (admitStage<I>(request) && ...);
+    }
+
+    template<size_t I>
+    bool admitStage(StringView request) {
+        using Stage = StageAt<I>;
+        if constexpr (isInterceptor<Stage>()) {
+            return std::get<I>(stages).Stage::admit(request);
+        }
+        return true;
+    }
+
+    template<size_t... I>
+    bool preProcessAll(StringView request, RequestContext& context, std::index_sequence<I...>) {
+        return (preProcessStage<I>(request, context) && ...);
+    }
+
+    template<size_t I>
+    bool preProcessStage(StringView request, RequestContext& context) {
+        using Stage = StageAt<I>;
+        if constexpr (isInterceptor<Stage>()) {
+            return std::get<I>(stages).Stage::preProcess(request, context);
+        }
+        return true;
+    }
+
+    template<size_t... I>
+    void postProcessAll(StringView request, ResponseWriter& response, RequestContext& context,
+                        std::index_sequence<I...>) {
+        (postProcessStage<I>(request, response, context), ...);
+    }
+
+    template<size_t I>
+    void postProcessStage(StringView request, ResponseWriter& response, RequestContext& context) {
+        using Stage = StageAt<I>;
+        if constexpr (isInterceptor<Stage>()) {
+            std::get<I>(stages).Stage::postProcess(request, response, context);
+        }
+    }
+
+    // Unrolls to a compare per service; stops at the owner
+    template<size_t... I>
+    bool runOwner(size_t owner, const Command& command, ResponseWriter& response, std::index_sequence<I...>) {
+        bool handled = false;
+        (void)(ownerStage<I>(owner, command, response, handled) || ...);
+        return handled;
+    }
+
+    template<size_t I>
+    bool ownerStage(size_t owner, const Command& command, ResponseWriter& response, bool& handled) {
+        using Stage = StageAt<I>;
+        if constexpr (isService<Stage>()) {
+            if (owner == serviceIndex<I>()) {
+                handled = std::get<I>(stages).Stage::processCommand(command, response);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<size_t... I>
+    size_t probeFallback(StringView request, ResponseWriter& response, std::index_sequence<I...>) {
+        size_t handler = ServiceRegistry::npos;
+        (void)(fallbackStage<I>(request, response, handler) || ...);
+        return handler;
+    }
+
+    template<size_t I>
+    bool fallbackStage(StringView request, ResponseWriter& response, size_t& handler) {
+        using Stage = StageAt<I>;
+        if constexpr (isService<Stage>()) {
+            constexpr size_t index = serviceIndex<I>();
+            if (fallback[index] && std::get<I>(stages).Stage::processRequest(request, response)) {
+                handler = index;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t dispatch(StringView request, ResponseWriter& response, const RequestContext& context) {
+        if (context.hasCommand) {
+            size_t owner = commands.find(context.command.name);
+            if (owner != ServiceRegistry::npos) {
+                if (!runOwner(owner, context.command, response, Sequence())) {
+                    return ServiceRegistry::npos;
+                }
+                return owner;
+            }
+        }
+        if (!hasFallback) {
+            return ServiceRegistry::npos;
+        }
+        return probeFallback(request, response, Sequence());
+    }
+
+public:
+    // Default-constructs every stage
+    StaticPipeline() : hasFallback(false) { registerServices(Sequence()); }
+
+    // Takes configured stages, e.g. an AuthenticationInterceptor with its tokens
+    explicit StaticPipeline(Stages... configured) : stages(std::move(configured)...), hasFallback(false) {
+        registerServices(Sequence());
+    }
+
+    // The stage of type Stage, e.g. to rotate an AuthenticationInterceptor's tokens
+    template<typename Stage>
+    Stage& get() { return std::get<Stage>(stages); }
+
+    // Cached replies skip their service; interceptors still run on hits
+    void setResponseCache(std::shared_ptr<ResponseCache> cache) { responses = std::move(cache); }
+
+    bool admit(StringView request) override { return admitAll(request, Sequence()); }
+
+    ExecutionClass classify(StringView request) const override {
+        Command command;
+        if (parseCommand(request, command)) {
+            size_t owner = commands.find(command.name);
+            if (owner != ServiceRegistry::npos) {
+                return executionClasses[owner];
+            }
+        }
+        // Same rule as ServiceRegistry::classify()
+        return hasFallback ? ExecutionClass::Worker : ExecutionClass::Inline;
+    }
+
+    size_t process(StringView request, ResponseWriter& response, RequestContext& context) override {
+        if (!preProcessAll(request, context, Sequence())) {
+            response.append("ERROR: Request rejected by interceptor");
+            return ServiceRegistry::npos;
+        }
+
+        size_t handler = ServiceRegistry::npos;
+        ResponseCache::Ticket ticket;
+        if (!responses || !context.hasCommand || !responses->lookup(context.command, response, handler, ticket)) {
+            handler = dispatch(request, response, context);
+            if (handler == ServiceRegistry::npos) {
+                response.assign("ERROR: No service available to handle request");
+            } else if (ticket.storable()) {
+                responses->store(ticket, context.command, handler, response);
+            }
+        }
+
+        postProcessAll(request, response, context, Sequence());
+        return handler;
+    }
+
+    size_t serviceCount() const override { return SERVICE_COUNT; }
+    std::string serviceName(size_t index) const override { return names[index]; }
+
+    // Copies every stage; interceptor copies share what their copy
+    // constructors share (token stores, rate buckets)
+    std::unique_ptr<IRequestPipeline> clone() const override {
+        return std::unique_ptr<IRequestPipeline>(new StaticPipeline(*this));
+    }
+};
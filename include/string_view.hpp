@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstddef>
+#include <ostream>
+
+// Non-owning view over a character range, used on the request hot path to
+// avoid copying payloads out of receive buffers
+typedef std::string_view StringView;
+
+inline bool startsWith(StringView text, StringView prefix) {
+    return text.size() >= prefix.size() && memcmp(text.data(), prefix.data(), prefix.size()) == 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+
+// Hashed timer wheel owned by one thread. Entries are filed in the slot of
+// their deadline and only looked at when the wheel's hand reaches that slot,
+// so scheduling is O(1) and an idle wheel costs one comparison per advance().
+//
+// Deadlines are never moved. The callback given to advance() decides what a
+// due entry means: it returns 0 to drop the entry, or a later deadline to
+// re-file it. Idle timeouts use this to avoid touching the wheel on every
+// request: activity only updates a timestamp, and an entry coming due either
+// finds the connection idle or is re-filed at last activity + timeout.
+// Deadlines beyond the wheel's span land in the farthest slot and are re-filed
+// from there.
+template<typename Entry>
+class TimerWheel {
+private:
+    struct Timer {
+        Entry entry;
+        uint64_t deadline;
+    };
+
+    std::vector<std::vector<Timer>> slots;
+    std::vector<Timer> due;
+    uint64_t tickNanos;
+    uint64_t tick;  // Next tick to process, in slot tick % slots.size()
+    size_t count;
+
+    uint64_t tickOf(uint64_t when) const { return when / tickNanos; }
+
+public:
+    TimerWheel(size_t slotCount, uint64_t tickLength)
+        : slots(slotCount), tickNanos(tickLength), tick(0), count(0) {}
+
+    // Sets the starting point; entries due before `now` fire on the next advance()
+    void reset(uint64_t now) {
+        for (auto& slot : slots) slot.clear();
+        tick = tickOf(now);
+        count = 0;
+    }
+
+    void schedule(const Entry& entry, uint64_t deadline) {
+        uint64_t target = tickOf(deadline);
+        if (target < tick) target = tick;
+        if (target - tick >= slots.size()) target = tick + slots.size() - 1;
+        slots[target % slots.size()].push_back(Timer{entry, deadline});
+        count++;
+    }
+
+    size_t size() const { return count; }
+
+    // Runs `onDue(entry, now)` for every entry whose deadline has passed.
+    // It returns 0 to drop the entry or a new deadline to keep it.
+    template<typename OnDue>
+    void advance(uint64_t now, OnDue onDue) {
+        uint64_t last = tickOf(now);
+        if (count == 0) {
+            tick = last + 1;
+            return;
+        }
+        while (tick <= last) {
+            // Moving the hand first keeps re-filed entries out of this slot
+            std::vector<Timer>& slot = slots[tick % slots.size()];
+            tick++;
+            if (slot.empty()) continue;
+            due.swap(slot);
+            for (const Timer& timer : due) {
+                count--;
+                if (timer.deadline > now) {
+                    schedule(timer.entry, timer.deadline);
+                    continue;
+                }
+                uint64_t next = onDue(timer.entry, now);
+                if (next != 0) {
+                    schedule(timer.entry, next);
+                }
+            }
+            due.clear();
+        }
+    }
+};
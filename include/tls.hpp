@@ -0,0 +1,128 @@
+#pragma once
+#include "protocol.hpp"
+#include <string>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdint.h>
+
+// TLS for HFTServer and SocketClient, over OpenSSL when built with
+// HFT_HAVE_OPENSSL. With kernel offload (kTLS) the kernel takes over the
+// record layer once the handshake is done: the socket then carries plaintext
+// for send(), recv(), writev() and sendfile(), and OpenSSL is out of the
+// data path. Without it, records go through SSL_read()/SSL_write().
+
+// Largest plaintext in one TLS record
+#define TLS_MAX_RECORD_PAYLOAD 16384
+
+struct TlsConfig {
+    std::string certFile;    // PEM certificate chain; servers need one
+    std::string keyFile;     // PEM private key for certFile
+    std::string caFile;      // PEM CAs peers are verified against. Servers
+                             // with one require client certificates; clients
+                             // without one use the system store.
+    std::string serverName;  // Clients: name the server's certificate must
+                             // carry; empty checks the address connected to
+    bool verifyPeer;         // Clients: false skips server verification
+    bool kernelOffload;      // Hand the record layer to the kernel after the handshake
+
+    TlsConfig() : verifyPeer(true), kernelOffload(true) {}
+};
+
+enum class TlsStatus {
+    Done,
+    WantRead,   // Waiting for the peer
+    WantWrite,  // Waiting for room in the socket
+    Failed
+};
+
+// Certificates, settings and resumable sessions shared by every connection
+// of one server or client. Thread-safe.
+class TlsContext {
+private:
+    struct ssl_ctx_st* ctx;
+    bool serverSide;
+    TlsConfig config;
+    // Clients: the latest session for each peer, so reconnecting resumes it
+    std::mutex sessionsMutex;
+    std::unordered_map<std::string, struct ssl_session_st*> sessions;
+
+    TlsContext(bool server, const TlsConfig& settings);
+    static int onNewSession(struct ssl_st* ssl, struct ssl_session_st* session);
+
+    friend class TlsSession;
+
+public:
+    // Throw std::runtime_error with OpenSSL's reason when setup fails
+    static std::shared_ptr<TlsContext> createServer(const TlsConfig& config);
+    static std::shared_ptr<TlsContext> createClient(const TlsConfig& config);
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    bool isServer() const { return serverSide; }
+    bool kernelOffload() const { return config.kernelOffload; }
+};
+
+// One connection's TLS state. The handshake runs on blocking or non-blocking
+// sockets; on non-blocking ones, call handshake() again when the socket is
+// ready the way it asked. Not thread-safe: callers serialize reads and writes.
+class TlsSession {
+private:
+    TlsContext& context;
+    struct ssl_st* ssl;
+    std::string peer;
+    std::string failure;
+
+    ssize_t fail(int result);
+
+    friend class TlsContext;
+
+public:
+    // `peer` ("host:port") keys client session resumption and, without a
+    // configured server name, is the address the certificate is checked against
+    TlsSession(TlsContext& tlsContext, int sock, const std::string& peerName = "");
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    TlsStatus handshake();
+    // Why the handshake or the last read or write failed
+    const std::string& error() const { return failure; }
+
+    bool resumed() const;
+    // Whether the kernel now encrypts sends and decrypts receives
+    bool sendOffloaded() const;
+    bool recvOffloaded() const;
+    bool offloaded() const { return sendOffloaded() && recvOffloaded(); }
+    // "TLSv1.2 ECDHE-RSA-AES128-GCM-SHA256"
+    std::string description() const;
+    // Bytes each record adds to its plaintext: header, explicit nonce, tag
+    size_t recordOverhead() const;
+
+    // recv() contract: bytes read, 0 once the peer has closed, or -1 with
+    // errno EAGAIN when nothing is available
+    ssize_t readNow(char* dest, size_t length);
+    // sendVectorNow()/sendFileNow() contract: bytes written, 0 when the
+    // socket is full, -1 on an error. After a 0 or a short count the next
+    // write must start with the bytes that were not written. The iovecs are
+    // written as one stream of records of up to TLS_MAX_RECORD_PAYLOAD bytes.
+    ssize_t writeNow(const struct iovec* iov, size_t count);
+    ssize_t writeFileNow(int fd, uint64_t offset, size_t length);
+};
+
+// Whether this kernel offers TLS offload (the "tls" TCP upper layer)
+bool kernelTlsAvailable(std::string& error);
+
+// Records writeNow() or writeFileNow() uses for `bytes` of plaintext
+inline uint64_t tlsRecordCount(uint64_t bytes) {
+    return (bytes + TLS_MAX_RECORD_PAYLOAD - 1) / TLS_MAX_RECORD_PAYLOAD;
+}
+
+// Blocking sendFrame()/recvFrame() over a TLS session
+bool sendFrame(TlsSession& session, uint16_t opcode, uint32_t requestId, const char* payload, size_t length);
+bool recvFrame(TlsSession& session, ReceiveBuffer& buffer, FrameHeader& header, std::string& payload);
@@ -0,0 +1,137 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <string>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// How idle consumers wait for work
+//   Spin   - busy-poll forever; lowest latency, burns a core per thread (isolated cores)
+//   Hybrid - spin with a pause instruction, then yield, then park on a futex (shared hosts)
+//   Block  - park on the futex as soon as there is no work
+enum class WaitMode {
+    Spin,
+    Hybrid,
+    Block
+};
+
+struct WaitStrategyConfig {
+    WaitMode mode;
+    uint32_t spinIterations;
+    uint32_t yieldIterations;
+    uint32_t parkTimeoutMicros;
+
+    WaitStrategyConfig() : mode(WaitMode::Hybrid), spinIterations(4000), yieldIterations(64), parkTimeoutMicros(1000) {}
+    explicit WaitStrategyConfig(WaitMode m) : WaitStrategyConfig() { mode = m; }
+};
+
+inline bool parseWaitMode(const std::string& name, WaitMode& mode) {
+    if (name == "spin") { mode = WaitMode::Spin; return true; }
+    if (name == "hybrid") { mode = WaitMode::Hybrid; return true; }
+    if (name == "block") { mode = WaitMode::Block; return true; }
+    return false;
+}
+
+inline const char* waitModeName(WaitMode mode) {
+    switch (mode) {
+        case WaitMode::Spin: return "spin";
+        case WaitMode::Hybrid: return "hybrid";
+        case WaitMode::Block: return "block";
+    }
+    return "unknown";
+}
+
+// Tells the CPU we're in a spin loop (saves power, frees the sibling hyperthread)
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Spin-then-park waiting shared by all consumers of one queue. Producers call
+// notify() after publishing work; it costs a single load unless a consumer is
+// actually parked.
+class WaitStrategy {
+private:
+    WaitStrategyConfig config;
+    std::atomic<uint32_t> epoch;
+    std::atomic<uint32_t> sleepers;
+
+    void futexWait(uint32_t expected) {
+        struct timespec timeout;
+        timeout.tv_sec = config.parkTimeoutMicros / 1000000;
+        timeout.tv_nsec = (config.parkTimeoutMicros % 1000000) * 1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+    }
+
+    void futexWake(int count) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+public:
+    WaitStrategy() : epoch(0), sleepers(0) {}
+
+    void configure(const WaitStrategyConfig& newConfig) { config = newConfig; }
+    const WaitStrategyConfig& getConfig() const { return config; }
+
+    // Called by a consumer that found no work. `idleRounds` counts consecutive
+    // empty polls and must be reset by the caller once work arrives. `hasWork`
+    // is re-checked after announcing the park so a concurrent notify() is
+    // never missed.
+    template<typename Predicate>
+    void idle(uint32_t& idleRounds, Predicate hasWork) {
+        uint32_t round = idleRounds++;
+
+        if (config.mode == WaitMode::Spin) {
+            cpuRelax();
+            return;
+        }
+
+        if (config.mode == WaitMode::Hybrid) {
+            if (round < config.spinIterations) {
+                cpuRelax();
+                return;
+            }
+            if (round < config.spinIterations + config.yieldIterations) {
+                std::this_thread::yield();
+                return;
+            }
+        }
+
+        uint32_t observed = epoch.load(std::memory_order_seq_cst);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasWork()) {
+            futexWait(observed);
+        }
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    void notify() {
+        // Pairs with the fence in idle(): either the consumer sees the new
+        // work or we see it registered as a sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) > 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(1);
+        }
+    }
+
+    void notifyAll() {
+        epoch.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(INT32_MAX);
+    }
+
+    // epoll_wait timeout for reactor loops: poll without blocking while
+    // spinning, fall back to a short blocking wait once idle long enough
+    int pollTimeoutMillis(uint32_t idleRounds) const {
+        if (config.mode == WaitMode::Spin) return 0;
+        if (config.mode == WaitMode::Hybrid && idleRounds < config.spinIterations) return 0;
+        return 1;
+    }
+};
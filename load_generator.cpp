@@ -0,0 +1,347 @@
+#include "../include/async_client.hpp"
+#include "../include/latency_histogram.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+
+// Open-loop load generator. Requests leave on a fixed schedule at the target
+// rate whether or not earlier ones have been answered, and each latency is
+// measured from when the request was due to be sent, not from when it was.
+// A server that stalls therefore shows the queueing it causes instead of
+// silently slowing the generator down (coordinated omission).
+
+struct LoadConfig {
+    std::string serverIp;
+    int serverPort;
+    std::string request;
+    std::string label;
+    std::string jsonPath;
+    size_t connections;
+    double durationSeconds;    // Per rate step
+    double drainSeconds;       // Time allowed for stragglers after a step
+    double rate;               // Fixed rate; 0 sweeps instead
+    double sweepStart;
+    double sweepFactor;
+    double sweepMax;
+    uint64_t sloP99Nanos;      // A sweep stops at the first step above this
+
+    LoadConfig()
+        : serverIp("127.0.0.1"), serverPort(8080), request("TOKEN:secret123 ECHO ping"),
+          jsonPath("load_results.json"), connections(4), durationSeconds(10), drainSeconds(2), rate(0),
+          sweepStart(1000), sweepFactor(2), sweepMax(1000000), sloP99Nanos(1000000) {}
+};
+
+// Results of one rate step. Each connection's replies are recorded by its
+// event loop thread alone, so every histogram and counter has one writer.
+struct StepResult {
+    double targetRate;
+    std::vector<std::unique_ptr<LatencyHistogram>> histograms;
+    std::vector<std::unique_ptr<SingleWriterCounter>> completed;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> sent;
+    std::atomic<uint64_t> maxSendLag;   // How far the generator itself fell behind
+    double elapsedSeconds;
+
+    StepResult(double rate, size_t connections)
+        : targetRate(rate), errors(0), sent(0), maxSendLag(0), elapsedSeconds(0) {
+        for (size_t i = 0; i < connections; ++i) {
+            histograms.emplace_back(new LatencyHistogram());
+            completed.emplace_back(new SingleWriterCounter());
+        }
+    }
+
+    LatencyHistogram merged() const {
+        LatencyHistogram total;
+        for (const auto& histogram : histograms) {
+            total.merge(*histogram);
+        }
+        return total;
+    }
+
+    uint64_t completedCount() const {
+        uint64_t total = 0;
+        for (const auto& counter : completed) {
+            total += counter->load();
+        }
+        return total;
+    }
+};
+
+static std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+class LoadGenerator {
+private:
+    LoadConfig config;
+    std::vector<std::unique_ptr<AsyncSocketClient>> clients;
+    // Kept until exit: replies that straggle past a step still land in it
+    std::vector<std::unique_ptr<StepResult>> steps;
+
+    // Sleeps until close to `deadline`, then yields until it passes
+    static void waitUntil(uint64_t deadline) {
+        while (true) {
+            uint64_t now = monotonicNanos();
+            if (now >= deadline) return;
+            uint64_t remaining = deadline - now;
+            if (remaining > 200000) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(remaining - 100000));
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void sender(StepResult* step, size_t index, uint64_t start, uint64_t interval, uint64_t count) {
+        AsyncSocketClient& client = *clients[index];
+        LatencyHistogram* histogram = step->histograms[index].get();
+        SingleWriterCounter* completed = step->completed[index].get();
+        uint64_t lag = 0;
+
+        // Connections take turns, so together they keep one even schedule
+        for (uint64_t i = index; i < count; i += clients.size()) {
+            uint64_t intended = start + i * interval;
+            waitUntil(intended);
+            uint64_t now = monotonicNanos();
+            if (now - intended > lag) lag = now - intended;
+
+            step->sent.fetch_add(1, std::memory_order_relaxed);
+            client.sendRequest(config.request, [step, histogram, completed, intended](const std::string& response) {
+                if (response.compare(0, 6, "ERROR:") == 0) {
+                    step->errors.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                histogram->record(monotonicNanos() - intended);
+                completed->add(1);
+            });
+        }
+
+        uint64_t seen = step->maxSendLag.load();
+        while (lag > seen && !step->maxSendLag.compare_exchange_weak(seen, lag)) {}
+    }
+
+    StepResult* runStep(double rate) {
+        steps.emplace_back(new StepResult(rate, clients.size()));
+        StepResult* step = steps.back().get();
+
+        uint64_t interval = static_cast<uint64_t>(1e9 / rate);
+        if (interval == 0) interval = 1;
+        uint64_t count = static_cast<uint64_t>(rate * config.durationSeconds);
+        // A little slack so every sender is waiting when the schedule starts
+        uint64_t start = monotonicNanos() + 10000000;
+
+        std::vector<std::thread> senders;
+        for (size_t i = 0; i < clients.size(); ++i) {
+            senders.emplace_back(&LoadGenerator::sender, this, step, i, start, interval, count);
+        }
+        for (auto& thread : senders) {
+            thread.join();
+        }
+
+        uint64_t deadline = monotonicNanos() + static_cast<uint64_t>(config.drainSeconds * 1e9);
+        while (monotonicNanos() < deadline &&
+               step->completedCount() + step->errors.load() < step->sent.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        step->elapsedSeconds = (monotonicNanos() - start) / 1e9;
+        return step;
+    }
+
+    bool saturated(const StepResult& step) const {
+        LatencyHistogram latency = step.merged();
+        uint64_t sent = step.sent.load();
+        uint64_t completed = step.completedCount();
+        double achieved = completed / step.elapsedSeconds;
+        return achieved < step.targetRate * 0.9 ||
+               (sent - completed) * 100 > sent ||   // More than 1% failed or unanswered
+               latency.percentile(99) > config.sloP99Nanos;
+    }
+
+    void printStep(const StepResult& step) const {
+        LatencyHistogram latency = step.merged();
+        std::cout << "  target " << step.targetRate << " req/s: achieved "
+                  << static_cast<uint64_t>(step.completedCount() / step.elapsedSeconds) << " req/s, p50 "
+                  << latency.percentile(50) / 1000 << " us, p99 " << latency.percentile(99) / 1000
+                  << " us, p99.9 " << latency.percentile(99.9) / 1000 << " us, max "
+                  << latency.max() / 1000 << " us, errors " << step.errors.load()
+                  << (saturated(step) ? "  [saturated]" : "") << std::endl;
+    }
+
+    std::string stepJson(const StepResult& step) const {
+        LatencyHistogram latency = step.merged();
+        uint64_t sent = step.sent.load();
+        uint64_t completed = step.completedCount();
+        uint64_t errors = step.errors.load();
+        uint64_t settled = completed + errors;
+        std::ostringstream out;
+        out << "    {\"target_rate\": " << step.targetRate
+            << ", \"achieved_rate\": " << completed / step.elapsedSeconds
+            << ", \"sent\": " << sent
+            << ", \"completed\": " << completed
+            << ", \"errors\": " << errors
+            << ", \"incomplete\": " << (sent > settled ? sent - settled : 0)
+            << ", \"max_send_lag_ns\": " << step.maxSendLag.load()
+            << ", \"saturated\": " << (saturated(step) ? "true" : "false")
+            << ",\n     \"latency_ns\": {\"mean\": " << latency.mean()
+            << ", \"p50\": " << latency.percentile(50)
+            << ", \"p90\": " << latency.percentile(90)
+            << ", \"p99\": " << latency.percentile(99)
+            << ", \"p99.9\": " << latency.percentile(99.9)
+            << ", \"p99.99\": " << latency.percentile(99.99)
+            << ", \"max\": " << latency.max() << "}}";
+        return out.str();
+    }
+
+public:
+    explicit LoadGenerator(const LoadConfig& loadConfig) : config(loadConfig) {}
+
+    bool connect() {
+        for (size_t i = 0; i < config.connections; ++i) {
+            std::unique_ptr<AsyncSocketClient> client(new AsyncSocketClient(config.serverIp, config.serverPort));
+            if (!client->connect()) {
+                return false;
+            }
+            clients.push_back(std::move(client));
+        }
+        return true;
+    }
+
+    void run() {
+        double sustained = 0;
+        if (config.rate > 0) {
+            StepResult* step = runStep(config.rate);
+            printStep(*step);
+            if (!saturated(*step)) sustained = step->targetRate;
+        } else {
+            for (double rate = config.sweepStart; rate <= config.sweepMax; rate *= config.sweepFactor) {
+                StepResult* step = runStep(rate);
+                printStep(*step);
+                if (saturated(*step)) break;
+                sustained = rate;
+            }
+        }
+
+        for (auto& client : clients) {
+            client->disconnect();
+        }
+
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"tool\": \"load_generator\",\n"
+             << "  \"server\": \"" << jsonEscape(config.serverIp) << ":" << config.serverPort << "\",\n"
+             << "  \"label\": \"" << jsonEscape(config.label) << "\",\n"
+             << "  \"request\": \"" << jsonEscape(config.request) << "\",\n"
+             << "  \"connections\": " << config.connections << ",\n"
+             << "  \"step_seconds\": " << config.durationSeconds << ",\n"
+             << "  \"slo_p99_ns\": " << config.sloP99Nanos << ",\n"
+             << "  \"max_sustained_rate\": " << sustained << ",\n"
+             << "  \"steps\": [\n";
+        for (size_t i = 0; i < steps.size(); ++i) {
+            json << stepJson(*steps[i]) << (i + 1 < steps.size() ? ",\n" : "\n");
+        }
+        json << "  ]\n}\n";
+
+        std::ofstream file(config.jsonPath);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Failed to write " << config.jsonPath << std::endl;
+            return;
+        }
+        std::cout << "Max sustained rate: " << sustained << " req/s" << std::endl;
+        std::cout << "Results written to " << config.jsonPath << std::endl;
+    }
+};
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <server_ip> <port> [options]" << std::endl;
+    std::cerr << "  --rate <req/s>          Run one step at a fixed rate instead of sweeping" << std::endl;
+    std::cerr << "  --sweep <start>:<factor>:<max>  Rates to sweep (default 1000:2:1000000)" << std::endl;
+    std::cerr << "  --duration <seconds>    Length of each step (default 10)" << std::endl;
+    std::cerr << "  --drain <seconds>       Wait for stragglers after a step (default 2)" << std::endl;
+    std::cerr << "  --connections <n>       Connections to spread the schedule over (default 4)" << std::endl;
+    std::cerr << "  --slo-p99-us <us>       p99 above which a step counts as saturated (default 1000)" << std::endl;
+    std::cerr << "  --request <text>        Request to send (default \"TOKEN:secret123 ECHO ping\")" << std::endl;
+    std::cerr << "  --label <text>          Free-form description stored in the JSON" << std::endl;
+    std::cerr << "  --json <path>           Where to write the JSON results (default load_results.json)" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    LoadConfig config;
+    config.serverIp = argv[1];
+    config.serverPort = std::stoi(argv[2]);
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--rate") {
+            config.rate = std::stod(value);
+        } else if (arg == "--sweep") {
+            if (sscanf(value.c_str(), "%lf:%lf:%lf", &config.sweepStart, &config.sweepFactor, &config.sweepMax) != 3 ||
+                config.sweepStart <= 0 || config.sweepFactor <= 1) {
+                std::cerr << "Invalid sweep: " << value << std::endl;
+                return 1;
+            }
+        } else if (arg == "--duration") {
+            config.durationSeconds = std::stod(value);
+        } else if (arg == "--drain") {
+            config.drainSeconds = std::stod(value);
+        } else if (arg == "--connections") {
+            config.connections = static_cast<size_t>(std::stoul(value));
+        } else if (arg == "--slo-p99-us") {
+            config.sloP99Nanos = static_cast<uint64_t>(std::stod(value) * 1000);
+        } else if (arg == "--request") {
+            config.request = value;
+        } else if (arg == "--label") {
+            config.label = value;
+        } else if (arg == "--json") {
+            config.jsonPath = value;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.connections == 0 || config.durationSeconds <= 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    LoadGenerator generator(config);
+    if (!generator.connect()) {
+        std::cerr << "Failed to connect to " << config.serverIp << ":" << config.serverPort << std::endl;
+        return 1;
+    }
+    generator.run();
+    return 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+echo "Open-Loop Load Comparison: server vs hft_server"
+echo "==============================================="
+
+# Extra load_generator options, e.g. LOAD_OPTIONS="--duration 5 --slo-p99-us 500" ./load_generator.sh
+LOAD_OPTIONS=${LOAD_OPTIONS:-}
+RESULTS_DIR=${RESULTS_DIR:-results}
+
+if [ ! -f "./bin/server" ] || [ ! -f "./bin/hft_server" ] || [ ! -f "./bin/load_generator" ]; then
+    echo "Error: Executables not found. Please run ./build.sh first."
+    exit 1
+fi
+
+# Kill any existing server processes
+echo "Stopping any existing servers..."
+pkill -f "hft_server" 2>/dev/null
+pkill -f "bin/server" 2>/dev/null
+sleep 2
+
+mkdir -p "$RESULTS_DIR"
+
+for SERVER in server hft_server; do
+    echo ""
+    echo "Starting $SERVER..."
+    ./bin/$SERVER 8080 > "$RESULTS_DIR/$SERVER.log" 2>&1 &
+    SERVER_PID=$!
+    sleep 3
+
+    if ! kill -0 $SERVER_PID 2>/dev/null; then
+        echo "Error: $SERVER failed to start"
+        exit 1
+    fi
+
+    echo "Sweeping request rate against $SERVER..."
+    ./bin/load_generator 127.0.0.1 8080 --label "$SERVER" --json "$RESULTS_DIR/$SERVER.json" $LOAD_OPTIONS
+
+    kill $SERVER_PID 2>/dev/null
+    wait $SERVER_PID 2>/dev/null
+done
+
+echo ""
+echo "Results: $RESULTS_DIR/server.json $RESULTS_DIR/hft_server.json"
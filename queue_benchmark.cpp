@@ -0,0 +1,145 @@
+#include "../include/lock_free_queue.hpp"
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <iomanip>
+#include <algorithm>
+#include <string>
+
+// Microbenchmark for LockFreeQueue across producer/consumer counts.
+// Each item carries its enqueue timestamp so consumers can sample the
+// enqueue-to-dequeue latency; a checksum verifies nothing is lost or duplicated.
+
+struct QueueItem {
+    uint64_t value;
+    uint64_t enqueueNs;
+    QueueItem() : value(0), enqueueNs(0) {}
+    QueueItem(uint64_t v, uint64_t ts) : value(v), enqueueNs(ts) {}
+};
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class QueueBenchmark {
+private:
+    size_t queueCapacity;
+    uint64_t itemsPerProducer;
+
+public:
+    QueueBenchmark(size_t capacity, uint64_t items) : queueCapacity(capacity), itemsPerProducer(items) {}
+
+    bool run(int numProducers, int numConsumers) {
+        LockFreeQueue<QueueItem> queue(queueCapacity);
+        const uint64_t totalItems = itemsPerProducer * numProducers;
+
+        std::atomic<bool> go{false};
+        std::atomic<uint64_t> consumed{0};
+        std::atomic<uint64_t> checksum{0};
+        std::atomic<uint64_t> fullCount{0};
+        std::atomic<uint64_t> enqueueNsTotal{0};
+        std::atomic<uint64_t> dequeueNsTotal{0};
+        std::vector<std::vector<uint64_t>> samples(numConsumers);
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < numProducers; ++p) {
+            threads.emplace_back([&, p]() {
+                while (!go.load()) {}
+                uint64_t base = static_cast<uint64_t>(p) * itemsPerProducer;
+                uint64_t spent = 0;
+                uint64_t rejected = 0;
+                for (uint64_t i = 0; i < itemsPerProducer; ++i) {
+                    uint64_t start = nowNs();
+                    while (!queue.enqueue(QueueItem(base + i + 1, start))) {
+                        rejected++;
+                    }
+                    spent += nowNs() - start;
+                }
+                enqueueNsTotal += spent;
+                fullCount += rejected;
+            });
+        }
+
+        for (int c = 0; c < numConsumers; ++c) {
+            threads.emplace_back([&, c]() {
+                while (!go.load()) {}
+                std::vector<uint64_t>& mySamples = samples[c];
+                mySamples.reserve(totalItems / numConsumers / 16 + 1);
+                uint64_t localSum = 0;
+                uint64_t localCount = 0;
+                uint64_t spent = 0;
+                QueueItem item;
+                while (consumed.load(std::memory_order_relaxed) < totalItems) {
+                    uint64_t start = nowNs();
+                    if (queue.dequeue(item)) {
+                        uint64_t end = nowNs();
+                        spent += end - start;
+                        localSum += item.value;
+                        if ((++localCount & 15) == 0) {
+                            mySamples.push_back(end - item.enqueueNs);
+                        }
+                        consumed.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                checksum += localSum;
+                dequeueNsTotal += spent;
+            });
+        }
+
+        auto startTime = std::chrono::steady_clock::now();
+        go = true;
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - startTime).count();
+
+        std::vector<uint64_t> all;
+        for (auto& s : samples) {
+            all.insert(all.end(), s.begin(), s.end());
+        }
+        std::sort(all.begin(), all.end());
+
+        uint64_t expected = totalItems * (totalItems + 1) / 2;
+        bool ok = consumed.load() == totalItems && checksum.load() == expected;
+
+        std::cout << std::fixed << std::setprecision(2);
+        std::cout << "  " << std::setw(2) << numProducers << "P x " << std::setw(2) << numConsumers << "C"
+                  << "  ops/sec: " << std::setw(12) << (totalItems * 1e9 / totalTime)
+                  << "  enq: " << std::setw(7) << (double)enqueueNsTotal.load() / totalItems << " ns"
+                  << "  deq: " << std::setw(7) << (double)dequeueNsTotal.load() / totalItems << " ns";
+        if (!all.empty()) {
+            std::cout << "  transit p50: " << all[all.size() / 2] << " ns"
+                      << "  p99: " << all[static_cast<size_t>(all.size() * 0.99)] << " ns";
+        }
+        std::cout << "  full: " << fullCount.load()
+                  << (ok ? "  [OK]" : "  [LOST/DUPLICATED ITEMS]") << std::endl;
+        return ok;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    uint64_t itemsPerProducer = 200000;
+    size_t capacity = 65536;
+
+    if (argc > 1) itemsPerProducer = std::stoull(argv[1]);
+    if (argc > 2) capacity = std::stoul(argv[2]);
+
+    std::cout << "LockFreeQueue Microbenchmark" << std::endl;
+    std::cout << "============================" << std::endl;
+    std::cout << "Items per producer: " << itemsPerProducer << ", capacity: " << capacity << std::endl;
+
+    QueueBenchmark benchmark(capacity, itemsPerProducer);
+    const int configs[][2] = {{1, 1}, {1, 4}, {1, 16}, {2, 2}, {4, 4}, {8, 8}, {4, 16}, {16, 16}};
+
+    bool allOk = true;
+    for (const auto& config : configs) {
+        allOk = benchmark.run(config[0], config[1]) && allOk;
+    }
+
+    std::cout << (allOk ? "All runs consistent" : "Consistency check FAILED") << std::endl;
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,395 @@
+#include "../include/async_client.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Compact the outgoing buffer once this much of it has been sent
+#define ASYNC_CLIENT_COMPACT_BYTES (64 * 1024)
+
+AsyncSocketClient::AsyncSocketClient(const std::string& ip, int port, size_t inFlightLimit)
+    : serverIp(ip), serverPort(port), clientSocket(-1), epollFd(-1), wakeFd(-1),
+      connected(false), stopping(false), maxInFlight(inFlightLimit), nextRequestId(1),
+      requestTimeoutNanos(0), outgoingSent(0), watchingWritable(false), receiveBuffer(64 * 1024) {}
+
+AsyncSocketClient::~AsyncSocketClient() {
+    disconnect();
+}
+
+bool AsyncSocketClient::connect() {
+    disconnect();
+
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        std::cerr << "Failed to create client socket" << std::endl;
+        return false;
+    }
+
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(serverPort);
+    if (inet_pton(AF_INET, serverIp.c_str(), &serverAddr.sin_addr) <= 0) {
+        std::cerr << "Invalid address" << std::endl;
+        close(sock);
+        return false;
+    }
+    if (::connect(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        std::cerr << "Connection failed" << std::endl;
+        close(sock);
+        return false;
+    }
+
+    // Requests are written as soon as they are submitted; Nagle would hold
+    // back every one sent while an earlier reply is outstanding
+    int noDelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    int wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll < 0 || wake < 0) {
+        std::cerr << "Failed to create event loop: " << strerror(errno) << std::endl;
+        if (epoll >= 0) close(epoll);
+        if (wake >= 0) close(wake);
+        close(sock);
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = sock;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, sock, &event);
+    event.data.fd = wake;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event);
+
+    {
+        // Submitters racing a reconnect read these under the same lock
+        std::lock_guard<std::mutex> lock(sendMutex);
+        clientSocket = sock;
+        epollFd = epoll;
+        wakeFd = wake;
+    }
+    watchingWritable = false;
+    stopping = false;
+    connected.store(true, std::memory_order_release);
+    loop = std::thread(&AsyncSocketClient::eventLoop, this);
+
+    std::cout << "Connected to server " << serverIp << ":" << serverPort << std::endl;
+    return true;
+}
+
+void AsyncSocketClient::disconnect() {
+    connected.store(false, std::memory_order_release);
+    if (loop.joinable()) {
+        stopping = true;
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written; // Suppress unused result warning; a full counter still wakes the loop
+        loop.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        if (clientSocket >= 0) {
+            close(clientSocket);
+            clientSocket = -1;
+        }
+        outgoing.clear();
+        outgoingSent = 0;
+        // Submitters touch wakeFd under this lock too
+        if (epollFd >= 0) {
+            close(epollFd);
+            epollFd = -1;
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+            wakeFd = -1;
+        }
+    }
+    receiveBuffer.clear();
+    failAll("ERROR: Connection closed");
+}
+
+bool AsyncSocketClient::sendRequest(const std::string& request, Callback callback) {
+    const char* error = nullptr;
+    if (!trySendRequest(request, callback, error)) {
+        callback(error);
+        return false;
+    }
+    return true;
+}
+
+bool AsyncSocketClient::trySendRequest(const std::string& request, Callback& callback, const char*& error) {
+    if (!isConnected()) {
+        error = "ERROR: Not connected to server";
+        return false;
+    }
+
+    std::string processedRequest = request;
+    if (!interceptors.empty()) {
+        std::lock_guard<std::mutex> lock(interceptorMutex);
+        if (!interceptors.preProcess(processedRequest)) {
+            error = "ERROR: Request rejected by interceptor";
+            return false;
+        }
+    }
+
+    uint32_t requestId = 0;
+    const char* refused = nullptr;
+    bool armTimer = false;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        // Checked under the lock so failAll() can't miss a request
+        if (!isConnected()) {
+            refused = "ERROR: Not connected to server";
+        } else if (pending.size() >= maxInFlight) {
+            refused = "ERROR: Too many requests in flight";
+        } else {
+            // After a wrap, skip 0 (connection-level errors) and ids still waiting
+            do {
+                requestId = nextRequestId++;
+            } while (requestId == 0 || pending.count(requestId) != 0);
+
+            Pending& entry = pending[requestId];
+            entry.callback = std::move(callback);
+            if (!interceptors.empty()) {
+                entry.request = processedRequest;
+            }
+            entry.deadline = 0;
+            if (requestTimeoutNanos) {
+                entry.deadline = monotonicNanos() + requestTimeoutNanos;
+                // The loop may be sleeping without a timeout; later deadlines
+                // are never earlier than this one
+                armTimer = deadlines.empty();
+                deadlines.push_back(Deadline{entry.deadline, requestId});
+            }
+        }
+    }
+    if (refused) {
+        error = refused;
+        return false;
+    }
+
+    // Registered before it is written, so the reply always finds its entry
+    std::lock_guard<std::mutex> lock(sendMutex);
+    bool idle = outgoingSent == outgoing.size();
+    encodeFrame(FRAME_OP_REQUEST, requestId, processedRequest.data(), processedRequest.size(), outgoing);
+    bool wake = armTimer;
+    if (idle) {
+        // A socket error also shows up as EPOLLERR; the loop fails the requests
+        flushLocked();
+        // The socket is full; have the loop finish when it drains
+        wake = wake || outgoingSent != outgoing.size();
+    }
+    if (wake && wakeFd >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written; // Suppress unused result warning
+    }
+    return true;
+}
+
+std::future<std::string> AsyncSocketClient::sendRequest(const std::string& request) {
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    sendRequest(request, [promise](const std::string& response) { promise->set_value(response); });
+    return result;
+}
+
+size_t AsyncSocketClient::inFlight() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return pending.size();
+}
+
+void AsyncSocketClient::addInterceptor(std::unique_ptr<IInterceptor> interceptor) {
+    std::lock_guard<std::mutex> lock(interceptorMutex);
+    interceptors.add(std::move(interceptor));
+}
+
+bool AsyncSocketClient::flushLocked() {
+    if (clientSocket < 0) {
+        return false;
+    }
+    while (outgoingSent < outgoing.size()) {
+        ssize_t sent = send(clientSocket, outgoing.data() + outgoingSent, outgoing.size() - outgoingSent,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            outgoingSent += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+
+    if (outgoingSent == outgoing.size()) {
+        outgoing.clear();
+        outgoingSent = 0;
+    } else if (outgoingSent >= ASYNC_CLIENT_COMPACT_BYTES) {
+        outgoing.erase(0, outgoingSent);
+        outgoingSent = 0;
+    }
+    return true;
+}
+
+void AsyncSocketClient::eventLoop() {
+    struct epoll_event events[8];
+    bool lost = false;
+
+    while (!stopping && !lost) {
+        int ready = epoll_wait(epollFd, events, 8, nextTimeoutMillis());
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            lost = true;
+            break;
+        }
+
+        for (int i = 0; i < ready && !lost; ++i) {
+            bool wake = events[i].data.fd == wakeFd;
+            if (wake) {
+                uint64_t count;
+                ssize_t got = read(wakeFd, &count, sizeof(count));
+                (void)got; // Suppress unused result warning
+                if (stopping) break;
+            }
+
+            // Watch for room while requests are waiting, and stop once they're out
+            if (wake || (events[i].events & EPOLLOUT)) {
+                std::lock_guard<std::mutex> lock(sendMutex);
+                if (!wake && !flushLocked()) {
+                    lost = true;
+                    break;
+                }
+                bool waiting = outgoingSent != outgoing.size();
+                if (waiting != watchingWritable) {
+                    struct epoll_event event;
+                    memset(&event, 0, sizeof(event));
+                    event.events = waiting ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+                    event.data.fd = clientSocket;
+                    epoll_ctl(epollFd, EPOLL_CTL_MOD, clientSocket, &event);
+                    watchingWritable = waiting;
+                }
+            }
+
+            if (!wake && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                if (events[i].events & EPOLLERR) {
+                    lost = true;
+                } else {
+                    readResponses();
+                    lost = !isConnected();
+                }
+            }
+        }
+
+        if (requestTimeoutNanos && !lost) {
+            expireRequests();
+        }
+    }
+
+    if (lost) {
+        connected.store(false, std::memory_order_release);
+        failAll("ERROR: Connection closed");
+    }
+}
+
+void AsyncSocketClient::readResponses() {
+    char* space = receiveBuffer.prepareWrite(16 * 1024);
+    ssize_t received = recv(clientSocket, space, receiveBuffer.writableBytes(), 0);
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (received <= 0) {
+        connected.store(false, std::memory_order_release);
+        return;
+    }
+    receiveBuffer.commitWrite(static_cast<size_t>(received));
+
+    FrameHeader header;
+    const char* payload;
+    int status;
+    while ((status = receiveBuffer.nextFrame(header, payload)) == 1) {
+        complete(header.requestId, payload, header.length);
+    }
+    if (status < 0) {
+        // Oversized frame: the stream can't be resynchronised
+        connected.store(false, std::memory_order_release);
+    }
+}
+
+void AsyncSocketClient::complete(uint32_t requestId, const char* payload, size_t length) {
+    Pending entry;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        auto it = pending.find(requestId);
+        if (it == pending.end()) {
+            // Connection-level errors (id 0) precede a close that fails everything
+            return;
+        }
+        entry = std::move(it->second);
+        pending.erase(it);
+    }
+
+    std::string response(payload, length);
+    if (!interceptors.empty()) {
+        std::lock_guard<std::mutex> lock(interceptorMutex);
+        interceptors.postProcess(entry.request, response);
+    }
+    entry.callback(response);
+}
+
+void AsyncSocketClient::failAll(const std::string& error) {
+    std::unordered_map<uint32_t, Pending> failed;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        failed.swap(pending);
+        deadlines.clear();
+    }
+    for (auto& entry : failed) {
+        entry.second.callback(error);
+    }
+}
+
+int AsyncSocketClient::nextTimeoutMillis() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    if (deadlines.empty()) {
+        return -1;
+    }
+    uint64_t now = monotonicNanos();
+    uint64_t at = deadlines.front().at;
+    if (at <= now) {
+        return 0;
+    }
+    // Rounded up so the loop never wakes just before the deadline
+    return static_cast<int>((at - now + 999999) / 1000000);
+}
+
+void AsyncSocketClient::expireRequests() {
+    std::vector<Pending> expired;
+    {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        uint64_t now = monotonicNanos();
+        while (!deadlines.empty() && deadlines.front().at <= now) {
+            Deadline due = deadlines.front();
+            deadlines.pop_front();
+            // Answered requests left their entries behind; a reused id has a later deadline
+            auto it = pending.find(due.requestId);
+            if (it != pending.end() && it->second.deadline == due.at) {
+                expired.push_back(std::move(it->second));
+                pending.erase(it);
+            }
+        }
+    }
+    for (Pending& entry : expired) {
+        entry.callback("ERROR: Request timed out");
+    }
+}
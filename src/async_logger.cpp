@@ -0,0 +1,163 @@
+#include "../include/async_logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+
+static const char* const levelNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+static void writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result <= 0) return;
+        written += static_cast<size_t>(result);
+    }
+}
+
+static void stopAtExit() {
+    AsyncLogger::getInstance().stop();
+}
+
+AsyncLogger::AsyncLogger() : running(true), outputFd(STDOUT_FILENO), reportedDrops(0) {
+    drainThread = std::thread(&AsyncLogger::drainLoop, this);
+}
+
+AsyncLogger& AsyncLogger::getInstance() {
+    // Never destroyed: threads still running during exit may keep logging
+    // into their rings after the final drain
+    static AsyncLogger* instance = nullptr;
+    static std::once_flag created;
+    std::call_once(created, [] {
+        instance = new AsyncLogger();
+        std::atexit(stopAtExit);
+    });
+    return *instance;
+}
+
+LogRing& AsyncLogger::threadRing() {
+    // Allocated by the thread that logs into it, registered once
+    static thread_local LogRing* ring = nullptr;
+    if (!ring) {
+        std::unique_ptr<LogRing> created(new LogRing());
+        ring = created.get();
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(std::move(created));
+    }
+    return *ring;
+}
+
+uint64_t AsyncLogger::droppedCount() {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    uint64_t dropped = 0;
+    for (const auto& ring : rings) {
+        dropped += ring->dropped.load();
+    }
+    return dropped;
+}
+
+void AsyncLogger::stop() {
+    if (!running.exchange(false)) return;
+    if (drainThread.joinable()) {
+        drainThread.join();
+    }
+}
+
+void AsyncLogger::drainLoop() {
+    std::string out;
+    while (running.load(std::memory_order_relaxed)) {
+        if (drainOnce(out) == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(LOG_DRAIN_IDLE_MICROS));
+        }
+    }
+    // Final pass for whatever was logged before stop()
+    while (drainOnce(out) > 0) {}
+}
+
+size_t AsyncLogger::drainOnce(std::string& out) {
+    std::vector<LogRing*> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (const auto& ring : rings) {
+            snapshot.push_back(ring.get());
+        }
+    }
+
+    out.clear();
+    size_t drained = 0;
+    uint64_t dropped = 0;
+    for (LogRing* ring : snapshot) {
+        uint64_t head = ring->head.load(std::memory_order_relaxed);
+        uint64_t tail = ring->tail.load(std::memory_order_acquire);
+        for (; head != tail; ++head) {
+            formatRecord(ring->slots[head & (LOG_RING_SIZE - 1)], out);
+            drained++;
+        }
+        ring->head.store(head, std::memory_order_release);
+        dropped += ring->dropped.load();
+    }
+
+    if (dropped > reportedDrops) {
+        char line[96];
+        snprintf(line, sizeof(line), "[LOG] %llu records dropped (rings full)\n",
+                 static_cast<unsigned long long>(dropped - reportedDrops));
+        out += line;
+        reportedDrops = dropped;
+    }
+
+    if (!out.empty()) {
+        // One write per pass, however many records it covered
+        writeAll(outputFd, out);
+    }
+    return drained;
+}
+
+void AsyncLogger::formatRecord(const LogRecord& record, std::string& out) {
+    time_t seconds = static_cast<time_t>(record.timestamp / 1000000000ULL);
+    unsigned long micros = static_cast<unsigned long>(record.timestamp % 1000000000ULL / 1000);
+    struct tm local;
+    localtime_r(&seconds, &local);
+    char prefix[64];
+    size_t length = strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(prefix + length, sizeof(prefix) - length, ".%06lu %s ", micros,
+             levelNames[record.level <= LOG_LEVEL_ERROR ? record.level : LOG_LEVEL_ERROR]);
+    out += prefix;
+
+    const char* arg = record.args;
+    unsigned remaining = record.argCount;
+    for (const char* p = record.format; *p; ++p) {
+        if (p[0] != '{' || p[1] != '}' || remaining == 0) {
+            out += *p;
+            continue;
+        }
+        ++p;
+        --remaining;
+
+        char number[32];
+        uint8_t type = static_cast<uint8_t>(*arg++);
+        if (type == LOG_ARG_STRING) {
+            uint16_t size;
+            memcpy(&size, arg, sizeof(size));
+            out.append(arg + sizeof(size), size);
+            arg += sizeof(size) + size;
+            continue;
+        }
+        if (type == LOG_ARG_INT) {
+            int64_t value;
+            memcpy(&value, arg, sizeof(value));
+            snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+        } else if (type == LOG_ARG_UINT) {
+            uint64_t value;
+            memcpy(&value, arg, sizeof(value));
+            snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(value));
+        } else {
+            double value;
+            memcpy(&value, arg, sizeof(value));
+            snprintf(number, sizeof(number), "%g", value);
+        }
+        arg += 8;
+        out += number;
+    }
+    out += '\n';
+}
@@ -1,10 +1,10 @@
 #include "../include/client.hpp"
 #include <iostream>
 #include <cstring>
-#include <algorithm>
+#include <netinet/tcp.h>
 
 SocketClient::SocketClient(const std::string& ip, int port) 
-    : clientSocket(-1), serverIp(ip), serverPort(port) {}
+    : clientSocket(-1), serverIp(ip), serverPort(port), nextRequestId(1) {}
 
 SocketClient::~SocketClient() {
     disconnect();
@@ -32,14 +32,29 @@ bool SocketClient::connect() {
     }
     
     std::cout << "Connected to server " << serverIp << ":" << serverPort << std::endl;
+    if (tls) {
+        // Records are written whole; Nagle would hold the next one for an ACK
+        int opt = 1;
+        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+        session.reset(new TlsSession(*tls, clientSocket, serverIp + ":" + std::to_string(serverPort)));
+        if (session->handshake() != TlsStatus::Done) {
+            std::cerr << "TLS handshake failed: " << session->error() << std::endl;
+            disconnect();
+            return false;
+        }
+        std::cout << "TLS: " << session->description() << (session->resumed() ? ", resumed" : "")
+                  << (session->offloaded() ? ", kernel offload" : "") << std::endl;
+    }
     return true;
 }
 
 void SocketClient::disconnect() {
+    session.reset();
     if (clientSocket >= 0) {
         close(clientSocket);
         clientSocket = -1;
     }
+    receiveBuffer.clear();
 }
 
 std::string SocketClient::sendRequest(const std::string& request) {
@@ -49,42 +64,36 @@ std::string SocketClient::sendRequest(const std::string& request) {
     
     std::string processedRequest = request;
     
-    // Execute pre-processing interceptors
-    std::sort(interceptors.begin(), interceptors.end(), 
-              [](const std::unique_ptr<IInterceptor>& a, const std::unique_ptr<IInterceptor>& b) {
-                  return a->getPriority() < b->getPriority();
-              });
-    
-    for (auto& interceptor : interceptors) {
-        if (!interceptor->preProcess(processedRequest)) {
-            return "ERROR: Request rejected by interceptor";
-        }
+    // Execute pre-processing interceptors (kept in priority order by addInterceptor)
+    if (!interceptors.preProcess(processedRequest)) {
+        return "ERROR: Request rejected by interceptor";
     }
     
-    // Send request
-    if (send(clientSocket, processedRequest.c_str(), processedRequest.length(), 0) < 0) {
+    // Send request as a single frame
+    uint32_t requestId = nextRequestId++;
+    bool sent = session ? sendFrame(*session, FRAME_OP_REQUEST, requestId, processedRequest.data(), processedRequest.length())
+                        : sendFrame(clientSocket, FRAME_OP_REQUEST, requestId, processedRequest.data(), processedRequest.length());
+    if (!sent) {
         return "ERROR: Failed to send request";
     }
     
-    // Receive response
-    char buffer[1024];
-    memset(buffer, 0, sizeof(buffer));
-    int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
-    
-    if (bytesRead <= 0) {
-        return "ERROR: Failed to receive response";
-    }
-    
-    std::string response(buffer);
+    // Receive the matching response frame, skipping replies to abandoned requests
+    FrameHeader header;
+    std::string response;
+    do {
+        bool received = session ? recvFrame(*session, receiveBuffer, header, response)
+                                : recvFrame(clientSocket, receiveBuffer, header, response);
+        if (!received) {
+            return "ERROR: Failed to receive response";
+        }
+    } while (header.requestId != requestId);
     
     // Execute post-processing interceptors
-    for (auto& interceptor : interceptors) {
-        interceptor->postProcess(processedRequest, response);
-    }
+    interceptors.postProcess(processedRequest, response);
     
     return response;
 }
 
 void SocketClient::addInterceptor(std::unique_ptr<IInterceptor> interceptor) {
-    interceptors.push_back(std::move(interceptor));
+    interceptors.add(std::move(interceptor));
 } 
\ No newline at end of file
@@ -57,22 +57,47 @@ int main(int argc, char* argv[]) {
     std::string serverIp = "127.0.0.1";
     int serverPort = 8080;
     bool interactive = false;
+    bool useTls = false;
+    TlsConfig tlsConfig;
     
-    // Parse command line arguments
+    // Parse command line arguments: [ip] [port] [--interactive] [--tls]
+    // [--tls-ca FILE] [--tls-name NAME] [--tls-insecure]
     if (argc > 1) {
         serverIp = argv[1];
     }
     if (argc > 2) {
         serverPort = std::stoi(argv[2]);
     }
-    if (argc > 3 && std::string(argv[3]) == "--interactive") {
-        interactive = true;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--interactive") {
+            interactive = true;
+        } else if (arg == "--tls") {
+            useTls = true;
+        } else if (arg == "--tls-ca" && i + 1 < argc) {
+            useTls = true;
+            tlsConfig.caFile = argv[++i];
+        } else if (arg == "--tls-name" && i + 1 < argc) {
+            useTls = true;
+            tlsConfig.serverName = argv[++i];
+        } else if (arg == "--tls-insecure") {
+            useTls = true;
+            tlsConfig.verifyPeer = false;
+        }
     }
     
     std::cout << "Socket Client with Interceptor Architecture" << std::endl;
     std::cout << "===========================================" << std::endl;
     
     SocketClient client(serverIp, serverPort);
+    if (useTls) {
+        try {
+            client.setTls(TlsContext::createClient(tlsConfig));
+        } catch (const std::exception& e) {
+            std::cerr << "[ERROR] " << e.what() << std::endl;
+            return 1;
+        }
+    }
     
     // Add interceptors
     std::cout << "[SETUP] Adding client interceptors..." << std::endl;
@@ -0,0 +1,269 @@
+#include "../include/client_pool.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+static uint64_t monotonicMillis() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+bool PoolEndpoint::parse(const std::string& text, PoolEndpoint& endpoint) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == text.size()) {
+        return false;
+    }
+    char* end = nullptr;
+    long port = strtol(text.c_str() + colon + 1, &end, 10);
+    if (*end != '\0' || port <= 0 || port > 65535) {
+        return false;
+    }
+    endpoint.ip = text.substr(0, colon);
+    endpoint.port = static_cast<int>(port);
+    return true;
+}
+
+bool PoolEndpoint::parseList(const std::string& text, std::vector<PoolEndpoint>& endpoints) {
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        PoolEndpoint endpoint;
+        if (!parse(text.substr(start, comma - start), endpoint)) {
+            return false;
+        }
+        endpoints.push_back(endpoint);
+        start = comma + 1;
+    }
+    return true;
+}
+
+SocketClientPool::SocketClientPool(const std::vector<PoolEndpoint>& servers, size_t connectionsPerEndpoint,
+                                   size_t inFlightLimit)
+    : endpoints(servers), nextStart(0), reconnects(0), ejections(0), running(false) {
+    if (endpoints.empty() || connectionsPerEndpoint == 0) {
+        throw std::runtime_error("SocketClientPool needs at least one endpoint and connection");
+    }
+    for (const PoolEndpoint& endpoint : endpoints) {
+        for (size_t i = 0; i < connectionsPerEndpoint; ++i) {
+            std::unique_ptr<Connection> connection(new Connection());
+            connection->endpoint = endpoint;
+            connection->client.reset(new AsyncSocketClient(endpoint.ip, endpoint.port, inFlightLimit));
+            connections.push_back(std::move(connection));
+        }
+    }
+}
+
+SocketClientPool::~SocketClientPool() {
+    stop();
+}
+
+size_t SocketClientPool::start() {
+    size_t up = 0;
+    uint64_t now = monotonicMillis();
+    for (auto& connection : connections) {
+        connection->wasConnected = connection->client->connect();
+        if (connection->wasConnected) {
+            up++;
+        } else {
+            connection->retryAt = now + connection->backoff;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(healthMutex);
+        running = true;
+    }
+    healthThread = std::thread(&SocketClientPool::healthLoop, this);
+    return up;
+}
+
+void SocketClientPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(healthMutex);
+        running = false;
+    }
+    healthCondition.notify_all();
+    if (healthThread.joinable()) {
+        healthThread.join();
+    }
+    for (auto& connection : connections) {
+        connection->client->disconnect();
+    }
+}
+
+void SocketClientPool::healthLoop() {
+    std::unique_lock<std::mutex> lock(healthMutex);
+    while (running) {
+        healthCondition.wait_for(lock, std::chrono::milliseconds(POOL_HEALTH_INTERVAL_MS), [this] { return !running; });
+        if (!running) break;
+        lock.unlock();
+
+        // Requests already skip a connection that is down or ejected; this
+        // closes the ejected ones and brings them all back
+        for (auto& connection : connections) {
+            uint64_t now = monotonicMillis();
+            if (connection->wasConnected && connection->ejected.load(std::memory_order_relaxed)) {
+                eject(*connection, now);
+            } else if (connection->client->isConnected()) {
+                if (connection->probation && connection->answered.load(std::memory_order_relaxed)) {
+                    connection->probation = false;
+                    connection->backoff = POOL_RECONNECT_MIN_MS;
+                }
+                continue;
+            }
+            if (connection->wasConnected) {
+                std::cerr << "[POOL] Lost connection to " << connection->endpoint.ip << ":"
+                          << connection->endpoint.port << std::endl;
+                connection->wasConnected = false;
+                connection->backoff = POOL_RECONNECT_MIN_MS;
+                connection->retryAt = now;
+            }
+            if (now < connection->retryAt) {
+                continue;
+            }
+
+            connection->failures.store(0, std::memory_order_relaxed);
+            connection->answered.store(false, std::memory_order_relaxed);
+            if (connection->client->connect()) {
+                connection->wasConnected = true;
+                // After an ejection the backoff resets only once the server answers
+                if (!connection->probation) {
+                    connection->backoff = POOL_RECONNECT_MIN_MS;
+                }
+                connection->ejected.store(false, std::memory_order_release);
+                reconnects.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                connection->retryAt = now + connection->backoff;
+                connection->backoff = connection->backoff * 2 < POOL_RECONNECT_MAX_MS ? connection->backoff * 2
+                                                                                      : POOL_RECONNECT_MAX_MS;
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+void SocketClientPool::eject(Connection& connection, uint64_t now) {
+    std::cerr << "[POOL] Ejecting " << connection.endpoint.ip << ":" << connection.endpoint.port << " after "
+              << POOL_EJECT_AFTER_FAILURES << " failed requests" << std::endl;
+    // Fails what it still has outstanding with "ERROR: Connection closed"
+    connection.client->disconnect();
+    connection.wasConnected = false;
+    connection.probation = true;
+    connection.retryAt = now + connection.backoff;
+    connection.backoff = connection.backoff * 2 < POOL_RECONNECT_MAX_MS ? connection.backoff * 2 : POOL_RECONNECT_MAX_MS;
+    ejections.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t SocketClientPool::pick() {
+    size_t count = connections.size();
+    // Start somewhere new each time so equally loaded connections share the work
+    size_t start = static_cast<size_t>(nextStart.fetch_add(1, std::memory_order_relaxed) % count);
+    size_t best = count;
+    uint32_t bestLoad = UINT32_MAX;
+    for (size_t i = 0; i < count; ++i) {
+        size_t index = (start + i) % count;
+        Connection& connection = *connections[index];
+        if (!connection.usable()) {
+            continue;
+        }
+        uint32_t load = connection.outstanding.load(std::memory_order_relaxed);
+        if (load < bestLoad) {
+            best = index;
+            bestLoad = load;
+            if (load == 0) break;
+        }
+    }
+    return best;
+}
+
+static bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Releases the connection's slot and tracks its health before handing the
+// reply on. A struct rather than a lambda so a failed send can retarget it
+// at another connection.
+struct SocketClientPool::Completion {
+    Connection* connection;
+    Callback callback;
+
+    void operator()(const std::string& response) const {
+        connection->outstanding.fetch_sub(1, std::memory_order_relaxed);
+        if (startsWith(response, "ERROR: Request timed out") || startsWith(response, "ERROR: Server busy")) {
+            if (connection->failures.fetch_add(1, std::memory_order_relaxed) + 1 >= POOL_EJECT_AFTER_FAILURES) {
+                // Closing it here would join the loop thread this runs on
+                connection->ejected.store(true, std::memory_order_relaxed);
+            }
+        } else if (!startsWith(response, "ERROR: Connection closed")) {
+            // Any other reply, errors included, means the server is keeping up
+            if (connection->failures.load(std::memory_order_relaxed) != 0) {
+                connection->failures.store(0, std::memory_order_relaxed);
+            }
+            if (!connection->answered.load(std::memory_order_relaxed)) {
+                connection->answered.store(true, std::memory_order_relaxed);
+            }
+        }
+        callback(response);
+    }
+};
+
+bool SocketClientPool::sendRequest(const std::string& request, Callback callback) {
+    Callback completion = Completion{nullptr, std::move(callback)};
+    Completion* target = completion.target<Completion>();
+    const char* error = "ERROR: No server available";
+
+    // The least-loaded connection first; if it went down since, any other.
+    // trySendRequest() leaves `completion` in place when it fails.
+    size_t first = pick();
+    for (size_t attempt = 0; first < connections.size() && attempt < connections.size(); ++attempt) {
+        Connection& connection = *connections[(first + attempt) % connections.size()];
+        if (attempt > 0 && !connection.usable()) {
+            continue;
+        }
+
+        target->connection = &connection;
+        connection.outstanding.fetch_add(1, std::memory_order_relaxed);
+        if (connection.client->trySendRequest(request, completion, error)) {
+            return true;
+        }
+        connection.outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    target->callback(error);
+    return false;
+}
+
+std::future<std::string> SocketClientPool::sendRequest(const std::string& request) {
+    std::shared_ptr<std::promise<std::string>> promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+    sendRequest(request, [promise](const std::string& response) { promise->set_value(response); });
+    return result;
+}
+
+size_t SocketClientPool::healthyConnections() const {
+    size_t up = 0;
+    for (const auto& connection : connections) {
+        if (connection->usable()) up++;
+    }
+    return up;
+}
+
+void SocketClientPool::setRequestTimeout(uint32_t milliseconds) {
+    for (auto& connection : connections) {
+        connection->client->setRequestTimeout(milliseconds);
+    }
+}
+
+void SocketClientPool::addInterceptor(std::unique_ptr<IInterceptor> interceptor) {
+    for (auto& connection : connections) {
+        std::unique_ptr<IInterceptor> copy = interceptor->clone();
+        if (!copy) {
+            throw std::runtime_error("Pool interceptors must implement clone()");
+        }
+        connection->client->addInterceptor(std::move(copy));
+    }
+}
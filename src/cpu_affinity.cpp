@@ -0,0 +1,111 @@
+#include "../include/cpu_affinity.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool parseCpuList(const std::string& text, std::vector<int>& cpus) {
+    std::vector<int> parsed;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        if (comma == std::string::npos) comma = text.size();
+        std::string range = text.substr(start, comma - start);
+
+        char* end = nullptr;
+        long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (end == range.c_str() || first < 0) {
+            return false;
+        }
+        if (*end == '-') {
+            const char* second = end + 1;
+            last = strtol(second, &end, 10);
+            if (end == second || last < first) {
+                return false;
+            }
+        }
+        if (*end != '\0' || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            parsed.push_back(static_cast<int>(cpu));
+        }
+        start = comma + 1;
+    }
+    cpus.swap(parsed);
+    return true;
+}
+
+std::string formatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        // Collapse runs of consecutive cores back into ranges
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        if (!text.empty()) text += ",";
+        text += std::to_string(cpus[i]);
+        if (j > i) text += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return text;
+}
+
+int cpuNumaNode(int cpu) {
+    // Each CPU's sysfs directory links to its node as "node<N>"
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return -1;
+    }
+    int node = -1;
+    while (struct dirent* entry = readdir(dir)) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+std::string numaNodesOf(const std::vector<int>& cpus) {
+    std::set<int> nodes;
+    for (int cpu : cpus) {
+        int node = cpuNumaNode(cpu);
+        if (node < 0) return "";
+        nodes.insert(node);
+    }
+    std::string text;
+    for (int node : nodes) {
+        if (!text.empty()) text += ",";
+        text += std::to_string(node);
+    }
+    return text;
+}
+
+bool pinCurrentThread(int cpu) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+bool setRealtimePriority(int priority) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+void nameCurrentThread(const std::string& name) {
+    // The main thread's name is the process name ps and pkill match on
+    if (getpid() == static_cast<pid_t>(syscall(SYS_gettid))) {
+        return;
+    }
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+}
@@ -0,0 +1,438 @@
+#include "../include/expression.hpp"
+#include <charconv>
+#include <cmath>
+#include <stdexcept>
+
+uint32_t VariableTable::slotFor(StringView name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key(name.data(), name.size());
+    auto it = index.find(key);
+    if (it != index.end()) {
+        return it->second;
+    }
+    if (names.size() >= CALC_MAX_VARIABLES) {
+        throw std::runtime_error("Too many variables");
+    }
+    uint32_t slot = static_cast<uint32_t>(names.size());
+    names.push_back(key);
+    index[key] = slot;
+    return slot;
+}
+
+bool VariableTable::find(StringView name, uint32_t& slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(std::string(name.data(), name.size()));
+    if (it == index.end()) {
+        return false;
+    }
+    slot = it->second;
+    return true;
+}
+
+std::string VariableTable::nameOf(uint32_t slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slot < names.size() ? names[slot] : std::string();
+}
+
+static bool isNameStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isNameChar(char c) {
+    return isNameStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Recursive descent over a shape, emitting bytecode as it goes
+class ExpressionCompiler {
+private:
+    StringView shape;
+    size_t pos;
+    VariableTable& variables;
+    CompiledExpression& program;
+    size_t depth;      // Operands on the stack at this point of the program
+    size_t nesting;
+
+    char peek() const { return pos < shape.size() ? shape[pos] : '\0'; }
+
+    [[noreturn]] void unexpected() const {
+        if (pos >= shape.size()) {
+            throw std::runtime_error("Unexpected end of expression");
+        }
+        // A space only ever separates two operands; name the second
+        char c = shape[pos] == ' ' ? shape[pos + 1] : shape[pos];
+        if (c == '#') {
+            throw std::runtime_error("Unexpected number");
+        }
+        if (isNameChar(c)) {
+            throw std::runtime_error("Unexpected name");
+        }
+        throw std::runtime_error(std::string("Unexpected character '") + c + "'");
+    }
+
+    void expect(char c) {
+        if (peek() != c) {
+            unexpected();
+        }
+        pos++;
+    }
+
+    StringView name() {
+        size_t start = pos;
+        while (isNameChar(peek())) pos++;
+        return shape.substr(start, pos - start);
+    }
+
+    void emit(CompiledExpression::Opcode op, uint32_t operand = 0) {
+        program.code.push_back(CompiledExpression::Instruction{op, operand});
+    }
+
+    void push(CompiledExpression::Opcode op, uint32_t operand) {
+        if (++depth > CALC_MAX_STACK) {
+            throw std::runtime_error("Expression too complex");
+        }
+        emit(op, operand);
+    }
+
+    // Binary operators take two operands and leave one
+    void combine(CompiledExpression::Opcode op) {
+        depth--;
+        emit(op);
+    }
+
+    void enter() {
+        if (++nesting > CALC_MAX_DEPTH) {
+            throw std::runtime_error("Expression nested too deeply");
+        }
+    }
+
+    void sum() {
+        product();
+        while (peek() == '+' || peek() == '-') {
+            CompiledExpression::Opcode op = peek() == '+' ? CompiledExpression::OP_ADD : CompiledExpression::OP_SUBTRACT;
+            pos++;
+            product();
+            combine(op);
+        }
+    }
+
+    void product() {
+        unary();
+        while (peek() == '*' || peek() == '/' || peek() == '%') {
+            CompiledExpression::Opcode op = peek() == '*' ? CompiledExpression::OP_MULTIPLY :
+                                            peek() == '/' ? CompiledExpression::OP_DIVIDE : CompiledExpression::OP_MODULO;
+            pos++;
+            unary();
+            combine(op);
+        }
+    }
+
+    void unary() {
+        if (peek() == '-' || peek() == '+') {
+            bool negate = peek() == '-';
+            pos++;
+            enter();
+            unary();
+            nesting--;
+            if (negate) emit(CompiledExpression::OP_NEGATE);
+            return;
+        }
+        power();
+    }
+
+    void power() {
+        primary();
+        if (peek() == '^') {
+            // Right associative, and binds tighter than a unary minus on its left
+            pos++;
+            enter();
+            unary();
+            nesting--;
+            combine(CompiledExpression::OP_POWER);
+        }
+    }
+
+    void call(StringView function) {
+        struct Builtin {
+            const char* name;
+            CompiledExpression::Opcode op;
+            size_t arguments;
+        };
+        static const Builtin builtins[] = {
+            {"abs", CompiledExpression::OP_ABS, 1},   {"sqrt", CompiledExpression::OP_SQRT, 1},
+            {"exp", CompiledExpression::OP_EXP, 1},   {"log", CompiledExpression::OP_LOG, 1},
+            {"min", CompiledExpression::OP_MIN, 2},   {"max", CompiledExpression::OP_MAX, 2},
+            {"pow", CompiledExpression::OP_POWER, 2}
+        };
+        const Builtin* builtin = nullptr;
+        for (const Builtin& candidate : builtins) {
+            if (function == candidate.name) {
+                builtin = &candidate;
+                break;
+            }
+        }
+        if (!builtin) {
+            throw std::runtime_error("Unknown function: " + std::string(function.data(), function.size()));
+        }
+
+        expect('(');
+        enter();
+        size_t arguments = 0;
+        while (true) {
+            sum();
+            arguments++;
+            if (peek() != ',') break;
+            pos++;
+        }
+        expect(')');
+        nesting--;
+        if (arguments != builtin->arguments) {
+            throw std::runtime_error("Function " + std::string(builtin->name) + " takes " +
+                                     std::to_string(builtin->arguments) +
+                                     (builtin->arguments == 1 ? " argument" : " arguments"));
+        }
+        depth -= arguments - 1;
+        emit(builtin->op);
+    }
+
+    void primary() {
+        char c = peek();
+        if (c == '#') {
+            pos++;
+            push(CompiledExpression::OP_CONSTANT, static_cast<uint32_t>(program.constants++));
+        } else if (isNameStart(c)) {
+            StringView identifier = name();
+            if (peek() == '(') {
+                call(identifier);
+            } else {
+                // Failing here keeps the program out of the cache until the
+                // variable exists
+                uint32_t slot;
+                if (!variables.find(identifier, slot)) {
+                    throw std::runtime_error("Unknown variable: " + std::string(identifier.data(), identifier.size()));
+                }
+                push(CompiledExpression::OP_LOAD, slot);
+            }
+        } else if (c == '(') {
+            pos++;
+            enter();
+            sum();
+            expect(')');
+            nesting--;
+        } else {
+            unexpected();
+        }
+    }
+
+public:
+    ExpressionCompiler(StringView text, VariableTable& table, CompiledExpression& target)
+        : shape(text), pos(0), variables(table), program(target), depth(0), nesting(0) {}
+
+    void statement() {
+        if (shape.empty()) {
+            throw std::runtime_error("Empty expression");
+        }
+
+        // name '=' ... assigns; anything else starting with a name is a sum
+        StringView target;
+        if (isNameStart(peek())) {
+            size_t start = pos;
+            StringView identifier = name();
+            if (peek() == '=') {
+                target = identifier;
+                pos++;
+            } else {
+                pos = start;
+            }
+        }
+
+        sum();
+        if (pos != shape.size()) {
+            unexpected();
+        }
+        // Allocated last, so an expression that fails to compile takes no slot
+        if (!target.empty()) {
+            emit(CompiledExpression::OP_STORE, variables.slotFor(target));
+        }
+    }
+};
+
+std::shared_ptr<const CompiledExpression> CompiledExpression::compile(StringView shape, VariableTable& variables) {
+    std::shared_ptr<CompiledExpression> program(new CompiledExpression());
+    program->shape.assign(shape.data(), shape.size());
+    ExpressionCompiler compiler(StringView(program->shape), variables, *program);
+    compiler.statement();
+    program->code.shrink_to_fit();
+    return program;
+}
+
+double CompiledExpression::evaluate(const double* literals, VariableTable& variables) const {
+    // The compiler bounded the depth, so the stack can live on ours
+    double stack[CALC_MAX_STACK];
+    size_t top = 0;
+
+    for (const Instruction& instruction : code) {
+        switch (instruction.op) {
+            case OP_CONSTANT:
+                stack[top++] = literals[instruction.operand];
+                break;
+            case OP_LOAD:
+                if (!variables.get(instruction.operand, stack[top])) {
+                    throw std::runtime_error("Unknown variable: " + variables.nameOf(instruction.operand));
+                }
+                top++;
+                break;
+            case OP_STORE:
+                variables.set(instruction.operand, stack[top - 1]);
+                break;
+            case OP_ADD:
+                top--;
+                stack[top - 1] += stack[top];
+                break;
+            case OP_SUBTRACT:
+                top--;
+                stack[top - 1] -= stack[top];
+                break;
+            case OP_MULTIPLY:
+                top--;
+                stack[top - 1] *= stack[top];
+                break;
+            case OP_DIVIDE:
+                top--;
+                if (stack[top] == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                stack[top - 1] /= stack[top];
+                break;
+            case OP_MODULO:
+                top--;
+                if (stack[top] == 0) {
+                    throw std::runtime_error("Division by zero");
+                }
+                stack[top - 1] = std::fmod(stack[top - 1], stack[top]);
+                break;
+            case OP_POWER:
+                top--;
+                stack[top - 1] = std::pow(stack[top - 1], stack[top]);
+                break;
+            case OP_NEGATE:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            case OP_ABS:
+                stack[top - 1] = std::fabs(stack[top - 1]);
+                break;
+            case OP_SQRT:
+                stack[top - 1] = std::sqrt(stack[top - 1]);
+                break;
+            case OP_EXP:
+                stack[top - 1] = std::exp(stack[top - 1]);
+                break;
+            case OP_LOG:
+                stack[top - 1] = std::log(stack[top - 1]);
+                break;
+            case OP_MIN:
+                top--;
+                if (stack[top] < stack[top - 1]) stack[top - 1] = stack[top];
+                break;
+            case OP_MAX:
+                top--;
+                if (stack[top] > stack[top - 1]) stack[top - 1] = stack[top];
+                break;
+        }
+    }
+    return stack[0];
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionEngine::lookup(StringView shape, uint64_t hash) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto it = cache.find(hash);
+    // A different shape with the same hash is compiled and replaces it
+    if (it != cache.end() && it->second->getShape() == shape) {
+        return it->second;
+    }
+    return nullptr;
+}
+
+double ExpressionEngine::evaluate(StringView expression) {
+    // Split the expression into its shape and its literals, on our stack
+    char shape[CALC_MAX_EXPRESSION];
+    size_t length = 0;
+    double literals[CALC_MAX_CONSTANTS];
+    size_t count = 0;
+    bool spaced = false;
+
+    const char* next = expression.begin();
+    const char* end = expression.end();
+    while (next < end) {
+        char c = *next;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            spaced = true;
+            next++;
+            continue;
+        }
+        if (c == '#') {
+            throw std::runtime_error("Unexpected character '#'");
+        }
+        bool number = isDigit(c) || (c == '.' && next + 1 < end && isDigit(next[1]));
+        if (length + 2 > sizeof(shape)) {
+            throw std::runtime_error("Expression too long");
+        }
+        // Keeps "a b" from reading as "ab"; the parser rejects the space
+        if (spaced && length > 0 && (number || isNameStart(c)) &&
+            (shape[length - 1] == '#' || isNameChar(shape[length - 1]))) {
+            shape[length++] = ' ';
+        }
+        spaced = false;
+
+        if (number) {
+            if (count == CALC_MAX_CONSTANTS) {
+                throw std::runtime_error("Too many numbers in expression");
+            }
+            std::from_chars_result parsed = std::from_chars(next, end, literals[count]);
+            if (parsed.ec != std::errc()) {
+                throw std::runtime_error("Number out of range");
+            }
+            count++;
+            next = parsed.ptr;
+            shape[length++] = '#';
+        } else if (isNameStart(c)) {
+            while (next < end && isNameChar(*next)) {
+                if (length + 1 > sizeof(shape)) {
+                    throw std::runtime_error("Expression too long");
+                }
+                shape[length++] = *next++;
+            }
+        } else {
+            shape[length++] = c;
+            next++;
+        }
+    }
+
+    StringView key(shape, length);
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(shape[i]);
+        hash *= 1099511628211ULL;
+    }
+
+    std::shared_ptr<const CompiledExpression> program = lookup(key, hash);
+    if (!program) {
+        program = CompiledExpression::compile(key, variables);
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (cache.size() >= CALC_CACHE_CAPACITY && cache.find(hash) == cache.end()) {
+            // Shapes are few in practice; losing an arbitrary one only costs a recompile
+            cache.erase(cache.begin());
+        }
+        cache[hash] = program;
+    }
+    return program->evaluate(literals, variables);
+}
+
+size_t ExpressionEngine::cachedShapes() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return cache.size();
+}
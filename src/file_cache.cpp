@@ -0,0 +1,122 @@
+#include "../include/file_cache.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), length);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+std::shared_ptr<const MappedFile> MappedFile::open(const std::string& path, std::string& error) {
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file->fd < 0) {
+        error = strerror(errno);
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(file->fd, &info) != 0) {
+        error = strerror(errno);
+        return nullptr;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        error = "Not a regular file";
+        return nullptr;
+    }
+
+    file->length = static_cast<size_t>(info.st_size);
+    file->device = info.st_dev;
+    file->inode = info.st_ino;
+    file->modified = info.st_mtim;
+    // mmap() refuses empty ranges; an empty file simply has no mapping
+    if (file->length > 0) {
+        void* mapped = mmap(nullptr, file->length, PROT_READ, MAP_SHARED, file->fd, 0);
+        if (mapped == MAP_FAILED) {
+            error = strerror(errno);
+            return nullptr;
+        }
+        file->mapping = static_cast<const char*>(mapped);
+    }
+    return file;
+}
+
+bool MappedFile::matches(const struct stat& info) const {
+    return info.st_ino == inode && info.st_dev == device &&
+           static_cast<size_t>(info.st_size) == length &&
+           info.st_mtim.tv_sec == modified.tv_sec && info.st_mtim.tv_nsec == modified.tv_nsec;
+}
+
+FileCache::FileCache(size_t fileLimit, size_t byteLimit)
+    : maxFiles(fileLimit), maxBytes(byteLimit), cachedBytes(0), hits(0), misses(0) {}
+
+void FileCache::eraseLocked(std::list<Entry>::iterator entry) {
+    cachedBytes -= entry->file->size();
+    index.erase(entry->path);
+    entries.erase(entry);
+}
+
+std::shared_ptr<const MappedFile> FileCache::get(const std::string& path, std::string& error) {
+    struct stat info;
+    bool found = stat(path.c_str(), &info) == 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = index.find(path);
+        if (cached != index.end()) {
+            if (found && cached->second->file->matches(info)) {
+                hits++;
+                entries.splice(entries.begin(), entries, cached->second);
+                return cached->second->file;
+            }
+            // Changed or gone since it was mapped
+            eraseLocked(cached->second);
+        }
+        misses++;
+    }
+
+    // Map outside the lock so a slow disk doesn't stall hits on other files
+    std::shared_ptr<const MappedFile> file = MappedFile::open(path, error);
+    if (!file || file->size() > maxBytes) {
+        return file;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto raced = index.find(path);
+    if (raced != index.end()) {
+        // Another thread mapped it meanwhile; ours replaces it
+        eraseLocked(raced->second);
+    }
+    entries.push_front(Entry{path, file});
+    index[path] = entries.begin();
+    cachedBytes += file->size();
+    while (entries.size() > 1 && (entries.size() > maxFiles || cachedBytes > maxBytes)) {
+        eraseLocked(std::prev(entries.end()));
+    }
+    return file;
+}
+
+void FileCache::invalidate(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto cached = index.find(path);
+    if (cached != index.end()) {
+        eraseLocked(cached->second);
+    }
+}
+
+uint64_t FileCache::hitCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t FileCache::missCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
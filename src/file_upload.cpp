@@ -0,0 +1,320 @@
+#include "../include/file_upload.hpp"
+#include "../include/async_logger.hpp"
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint64_t monotonicSeconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+BufferedFileWriter::BufferedFileWriter(const std::string& targetPath, FileSyncPolicy syncPolicy)
+    : path(targetPath), temporary(targetPath + ".XXXXXX"), fd(-1), policy(syncPolicy), direct(false),
+      failed(false), buffer(nullptr), buffered(0), bufferOffset(0), contiguous(0), end(0) {
+    // Aligned so the buffer can be handed to O_DIRECT as is
+    void* memory = nullptr;
+    if (posix_memalign(&memory, UPLOAD_DIRECT_ALIGNMENT, UPLOAD_BUFFER_SIZE) != 0) {
+        temporary.clear();
+        return;
+    }
+    buffer = static_cast<char*>(memory);
+
+    fd = mkstemp(&temporary[0]);
+    if (fd < 0) {
+        temporary.clear();
+        return;
+    }
+    fchmod(fd, 0644);
+
+    if (policy == FileSyncPolicy::Direct && !setDirect(true)) {
+        LOG_WARN("[FILE] O_DIRECT not supported for {}, using fdatasync()", path);
+        policy = FileSyncPolicy::Data;
+    }
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+    discard();
+    free(buffer);
+}
+
+bool BufferedFileWriter::setDirect(bool enabled) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = enabled ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    if (fcntl(fd, F_SETFL, flags) != 0) {
+        return false;
+    }
+    direct = enabled;
+    return true;
+}
+
+bool BufferedFileWriter::writeAt(const char* data, size_t length, uint64_t offset) {
+    if (policy == FileSyncPolicy::Direct) {
+        // O_DIRECT only takes whole aligned blocks; anything else goes
+        // through the page cache and is covered by the fdatasync() at commit
+        bool aligned = reinterpret_cast<uintptr_t>(data) % UPLOAD_DIRECT_ALIGNMENT == 0 &&
+                       length % UPLOAD_DIRECT_ALIGNMENT == 0 && offset % UPLOAD_DIRECT_ALIGNMENT == 0;
+        if (aligned != direct && !setDirect(aligned)) {
+            failed = true;
+            return false;
+        }
+    }
+
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            failed = true;
+            return false;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool BufferedFileWriter::flush(bool all) {
+    size_t length = buffered;
+    if (!all && policy == FileSyncPolicy::Direct) {
+        // Keep a partial block back so the next write can stay direct
+        length -= length % UPLOAD_DIRECT_ALIGNMENT;
+    }
+    if (length > 0 && !writeAt(buffer, length, bufferOffset)) {
+        return false;
+    }
+    memmove(buffer, buffer + length, buffered - length);
+    buffered -= length;
+    bufferOffset += length;
+    return true;
+}
+
+bool BufferedFileWriter::write(uint64_t offset, StringView data) {
+    if (failed || fd < 0) {
+        return false;
+    }
+
+    if (!data.empty()) {
+        if (offset != bufferOffset + buffered) {
+            // Not a continuation of the buffer: write it out and start over here
+            if (!flush(true)) {
+                return false;
+            }
+            bufferOffset = offset;
+        }
+
+        const char* next = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            if (buffered == UPLOAD_BUFFER_SIZE && !flush(false)) {
+                return false;
+            }
+            size_t take = UPLOAD_BUFFER_SIZE - buffered;
+            if (take > left) take = left;
+            memcpy(buffer + buffered, next, take);
+            buffered += take;
+            next += take;
+            left -= take;
+        }
+    }
+
+    uint64_t chunkEnd = offset + data.size();
+    if (chunkEnd > end) {
+        end = chunkEnd;
+    }
+    if (offset <= contiguous) {
+        if (chunkEnd > contiguous) contiguous = chunkEnd;
+    } else {
+        uint64_t& known = extents[offset];
+        if (chunkEnd > known) known = chunkEnd;
+    }
+    // Chunks that arrived early join once the gap before them is filled
+    while (!extents.empty() && extents.begin()->first <= contiguous) {
+        if (extents.begin()->second > contiguous) contiguous = extents.begin()->second;
+        extents.erase(extents.begin());
+    }
+    return true;
+}
+
+bool BufferedFileWriter::commit() {
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = !failed && flush(true);
+    if (ok && policy != FileSyncPolicy::None) {
+        ok = fdatasync(fd) == 0;
+    }
+    ok = close(fd) == 0 && ok;
+    fd = -1;
+
+    if (ok && rename(temporary.c_str(), path.c_str()) == 0) {
+        temporary.clear();
+        return true;
+    }
+    discard();
+    return false;
+}
+
+void BufferedFileWriter::discard() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (!temporary.empty()) {
+        unlink(temporary.c_str());
+        temporary.clear();
+    }
+}
+
+void UploadTable::setSyncPolicy(FileSyncPolicy syncPolicy) {
+    std::lock_guard<std::mutex> lock(mutex);
+    policy = syncPolicy;
+}
+
+FileSyncPolicy UploadTable::getSyncPolicy() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return policy;
+}
+
+std::shared_ptr<UploadTable::Upload> UploadTable::find(uint64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = uploads.find(handle);
+    return it == uploads.end() ? nullptr : it->second;
+}
+
+void UploadTable::remove(uint64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uploads.erase(handle);
+}
+
+void UploadTable::reapIdleLocked(uint64_t now) {
+    for (auto it = uploads.begin(); it != uploads.end();) {
+        uint64_t lastActive = it->second->lastActive.load();
+        if (now > lastActive && now - lastActive > UPLOAD_IDLE_TIMEOUT_SECONDS) {
+            LOG_WARN("[FILE] Discarding idle upload {} to {}", it->first, it->second->path);
+            it = uploads.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint64_t UploadTable::open(const std::string& path, std::string& error) {
+    uint64_t now = monotonicSeconds();
+    FileSyncPolicy syncPolicy;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reapIdleLocked(now);
+        if (uploads.size() >= UPLOAD_MAX_OPEN) {
+            error = "Too many open uploads";
+            return 0;
+        }
+        syncPolicy = policy;
+    }
+
+    // Create the file outside the lock; it touches the disk
+    std::shared_ptr<Upload> upload = std::make_shared<Upload>();
+    upload->path = path;
+    upload->lastActive = now;
+    upload->writer.reset(new BufferedFileWriter(path, syncPolicy));
+    if (!upload->writer->isOpen()) {
+        error = "Could not create file " + path;
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (uploads.size() >= UPLOAD_MAX_OPEN) {
+        error = "Too many open uploads";
+        return 0;
+    }
+    uint64_t handle = nextHandle++;
+    uploads[handle] = upload;
+    return handle;
+}
+
+bool UploadTable::write(uint64_t handle, uint64_t offset, StringView data, uint64_t& received, std::string& error) {
+    std::shared_ptr<Upload> upload = find(handle);
+    if (!upload) {
+        error = "Unknown upload";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(upload->mutex);
+    if (!upload->writer) {
+        error = "Unknown upload";
+        return false;
+    }
+    upload->lastActive = monotonicSeconds();
+    if (offset > UPLOAD_MAX_SIZE || data.size() > UPLOAD_MAX_SIZE - offset) {
+        error = "Upload too large";
+        return false;
+    }
+    if (!upload->writer->write(offset, data)) {
+        upload->writer.reset();
+        remove(handle);
+        error = "Write failed, upload discarded";
+        return false;
+    }
+    received = upload->writer->received();
+    return true;
+}
+
+bool UploadTable::close(uint64_t handle, uint64_t size, uint64_t& written, std::string& path,
+                        std::string& error) {
+    std::shared_ptr<Upload> upload = find(handle);
+    if (!upload) {
+        error = "Unknown upload";
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(upload->mutex);
+    if (!upload->writer) {
+        error = "Unknown upload";
+        return false;
+    }
+    BufferedFileWriter& writer = *upload->writer;
+    uint64_t expected = size == UINT64_MAX ? writer.extent() : size;
+    if (writer.extent() > expected) {
+        upload->writer.reset();
+        remove(handle);
+        error = "Upload longer than declared size, discarded";
+        return false;
+    }
+    if (writer.received() < expected) {
+        // Chunks may still be in flight; the client can close again later
+        upload->lastActive = monotonicSeconds();
+        error = "Upload incomplete: " + std::to_string(writer.received()) + " of " +
+                std::to_string(expected) + " bytes";
+        return false;
+    }
+
+    bool committed = writer.commit();
+    upload->writer.reset();
+    remove(handle);
+    if (!committed) {
+        error = "Failed to write file " + upload->path;
+        return false;
+    }
+    written = expected;
+    path = upload->path;
+    return true;
+}
+
+bool UploadTable::abort(uint64_t handle) {
+    std::shared_ptr<Upload> upload = find(handle);
+    if (!upload) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(upload->mutex);
+    bool open = upload->writer != nullptr;
+    upload->writer.reset();
+    remove(handle);
+    return open;
+}
@@ -1,14 +1,33 @@
 #include "../include/hft_server.hpp"
+#include "../include/async_logger.hpp"
+#include "../include/cpu_affinity.hpp"
 #include <iostream>
-#include <algorithm>
 #include <signal.h>
 #include <mutex>
+#include <cerrno>
+#include <stdexcept>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 
 HFTServer* HFTServer::instance = nullptr;
 std::mutex HFTServer::mutex;
 
-HFTServer::HFTServer() : serverSocket(-1), epollFd(-1), running(false), 
-                         requestQueue(50000), responseBuffers(HFT_THREAD_POOL_SIZE * 2) {
+HFTServer::HFTServer() : serverSocket(-1), epollFd(-1), running(false),
+                         workers("worker", HFT_THREAD_POOL_SIZE, HFT_QUEUE_DEPTH),
+                         blockingPool("blocking", HFT_BLOCKING_POOL_SIZE, HFT_BLOCKING_QUEUE_DEPTH),
+                         idleTimeoutNanos(0), sendBatching(true), engine(HFTEngine::Epoll), reactorCount(0),
+                         adminPort(0), stopRequest(0), controlFd(-1), draining(false),
+                         drainTimeoutMillis(HFT_DRAIN_TIMEOUT_MS), handoffListener(-1), successorChannel(-1),
+                         handOffConnections(false), drainedCleanly(false), predecessorChannel(-1),
+                         nextAdoptionLoop(0) {
+    controlFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (controlFd == -1) {
+        throw std::runtime_error("Failed to create control eventfd");
+    }
+    blockingPool.waitStrategy.configure(WaitStrategyConfig(WaitMode::Block));
     startTime = std::chrono::high_resolution_clock::now();
 }
 
@@ -24,74 +43,171 @@ HFTServer* HFTServer::getInstance() {
     return instance;
 }
 
+HFTConnectionTable::HFTConnectionTable() : pageCount(0), highest(-1) {
+    // One slot per fd the process may open; an unlimited limit gets 4M
+    size_t fds = 1 << 22;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < fds) {
+        fds = static_cast<size_t>(limit.rlim_cur);
+    }
+    pageCount = (fds + HFT_CONNECTION_PAGE_SIZE - 1) / HFT_CONNECTION_PAGE_SIZE;
+    pages.reset(new std::atomic<HFTConnection*>[pageCount]);
+    for (size_t i = 0; i < pageCount; ++i) {
+        pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+HFTConnectionTable::~HFTConnectionTable() {
+    for (size_t i = 0; i < pageCount; ++i) {
+        delete[] pages[i].load(std::memory_order_relaxed);
+    }
+}
+
+HFTConnection* HFTConnectionTable::acquire(int fd) {
+    if (fd < 0 || static_cast<size_t>(fd) / HFT_CONNECTION_PAGE_SIZE >= pageCount) {
+        return nullptr;
+    }
+    std::atomic<HFTConnection*>& slot = pages[static_cast<size_t>(fd) / HFT_CONNECTION_PAGE_SIZE];
+    HFTConnection* page = slot.load(std::memory_order_acquire);
+    if (!page) {
+        // Reactors accept concurrently; the loser of the race frees its page
+        HFTConnection* created = new HFTConnection[HFT_CONNECTION_PAGE_SIZE];
+        if (slot.compare_exchange_strong(page, created, std::memory_order_acq_rel)) {
+            page = created;
+        } else {
+            delete[] created;
+        }
+    }
+    int current = highest.load(std::memory_order_relaxed);
+    while (fd > current && !highest.compare_exchange_weak(current, fd, std::memory_order_acq_rel)) {
+    }
+    return &page[static_cast<size_t>(fd) % HFT_CONNECTION_PAGE_SIZE];
+}
+
 void HFTServer::setNonBlocking(int sock) {
     int flags = fcntl(sock, F_GETFL, 0);
     fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 }
 
-void HFTServer::setupEpoll() {
-    epollFd = epoll_create1(0);
-    if (epollFd == -1) {
+int HFTServer::createEpoll(int listenSocket) {
+    int fd = epoll_create1(0);
+    if (fd == -1) {
         throw std::runtime_error("Failed to create epoll instance");
     }
     
     struct epoll_event event;
     event.events = EPOLLIN;
-    event.data.fd = serverSocket;
+    event.data.fd = listenSocket;
     
-    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, serverSocket, &event) == -1) {
+    if (epoll_ctl(fd, EPOLL_CTL_ADD, listenSocket, &event) == -1) {
+        close(fd);
         throw std::runtime_error("Failed to add server socket to epoll");
     }
+    return fd;
 }
 
-void HFTServer::start(int port) {
-    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    if (serverSocket == -1) {
+int HFTServer::createListenSocket(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1) {
         throw std::runtime_error("Failed to create socket");
     }
     
     // Set socket options for HFT
     int opt = 1;
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
     
     // Set TCP_NODELAY for low latency
-    setsockopt(serverSocket, IPPROTO_TCP, 1, &opt, sizeof(opt)); // TCP_NODELAY = 1
+    setsockopt(sock, IPPROTO_TCP, 1, &opt, sizeof(opt)); // TCP_NODELAY = 1
     
     // Set send/receive buffer sizes
     int bufferSize = 65536;
-    setsockopt(serverSocket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
-    setsockopt(serverSocket, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
     
     sockaddr_in serverAddr;
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(port);
     
-    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
+    if (bind(sock, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == -1) {
+        close(sock);
         throw std::runtime_error("Failed to bind socket");
     }
     
-    if (listen(serverSocket, SOMAXCONN) == -1) {
+    if (listen(sock, SOMAXCONN) == -1) {
+        close(sock);
         throw std::runtime_error("Failed to listen on socket");
     }
     
-    setNonBlocking(serverSocket);
-    setupEpoll();
+    setNonBlocking(sock);
+    return sock;
+}
+
+void HFTServer::start(int port) {
+    std::string error;
+    if (engine == HFTEngine::IoUring && !ioUringAvailable(error)) {
+        throw std::runtime_error("io_uring engine unavailable: " + error);
+    }
+    if (tlsContext) {
+        bool kernel = tlsContext->kernelOffload() && kernelTlsAvailable(error);
+        if (!tlsContext->kernelOffload()) {
+            error = "kernel offload turned off";
+        }
+        // Ring receives hand the loop raw socket bytes, so OpenSSL can't sit in between
+        if (engine == HFTEngine::IoUring && !kernel) {
+            throw std::runtime_error("io_uring engine needs kernel TLS: " + error);
+        }
+        std::cout << "TLS " << (kernel ? "records handled by the kernel" : "records encrypted in user space: " + error)
+                  << std::endl;
+    }
+    
+    if (reactorCount > 0) {
+        startReactors(port);
+        return;
+    }
+    
+    serverSocket = listenerFor(port, 0);
+    releaseInheritedListeners(1);
+    if (engine == HFTEngine::Epoll) {
+        epollFd = createEpoll(serverSocket);
+    }
     
     running = true;
-    std::cout << "HFT Server started on port " << port << std::endl;
+    std::cout << "HFT Server started on port " << port << " (" << engineName(engine) << ")" << std::endl;
     
     // Start worker threads
-    for (int i = 0; i < HFT_THREAD_POOL_SIZE; ++i) {
-        workerThreads.emplace_back(&HFTServer::workerThread, this);
-    }
+    startExecutor(workers);
+    startExecutor(blockingPool);
+    startAdmin();
+    startControl();
     
-    acceptConnections();
+    placeThread(threadConfig.acceptorCpus, 0, true, "acceptor");
+    if (engine == HFTEngine::IoUring) {
+        uringLoop(serverSocket, nullptr);
+    } else {
+        acceptConnections();
+    }
 }
 
 void HFTServer::stop() {
     running = false;
+    requestStop(HFTStopMode::Immediate);
+    if (controlThread.joinable() && controlThread.get_id() != std::this_thread::get_id()) {
+        controlThread.join();
+    }
+    if (admin) {
+        admin->stop();
+        admin.reset();
+    }
+    
+    // Reactors close their own sockets on the way out; the shard running on
+    // the caller's thread (if any) is skipped here and exits on its own
+    for (auto& shard : shards) {
+        if (shard->thread.joinable() && shard->thread.get_id() != std::this_thread::get_id()) {
+            shard->thread.join();
+        }
+    }
     
     if (epollFd != -1) {
         close(epollFd);
@@ -103,150 +219,1811 @@ void HFTServer::stop() {
         serverSocket = -1;
     }
     
-    for (auto& thread : workerThreads) {
-        if (thread.joinable()) {
-            thread.join();
-        }
+    stopExecutor(workers);
+    stopExecutor(blockingPool);
+    
+    if (handoffListener != -1) {
+        // Still ours: no successor has taken the path over
+        close(handoffListener);
+        unlink(handoffPath.c_str());
+        handoffListener = -1;
+    }
+    // The successor sees EOF once every connection has been passed
+    if (successorChannel != -1) {
+        close(successorChannel);
+        successorChannel = -1;
+    }
+    if (predecessorChannel != -1) {
+        close(predecessorChannel);
+        predecessorChannel = -1;
     }
-    workerThreads.clear();
     
     std::cout << "HFT Server stopped" << std::endl;
 }
 
+void HFTServer::requestStop(HFTStopMode mode) {
+    int requested = static_cast<int>(mode);
+    int current = stopRequest.load();
+    while (current < requested && !stopRequest.compare_exchange_weak(current, requested)) {
+    }
+    // write() and atomics only, so signal handlers can call this
+    uint64_t one = 1;
+    ssize_t written = write(controlFd, &one, sizeof(one));
+    (void)written;
+}
+
+void HFTServer::startControl() {
+    if (!handoffPath.empty()) {
+        handoffListener = listenHandoffSocket(handoffPath);
+    }
+    // A stop requested before start() is acted on straight away
+    controlThread = std::thread(&HFTServer::controlLoop, this);
+}
+
+std::vector<HFTLoopState*> HFTServer::eventLoops() {
+    std::vector<HFTLoopState*> loops;
+    if (shards.empty()) {
+        loops.push_back(&acceptorLoop);
+    }
+    for (auto& shard : shards) {
+        loops.push_back(&shard->loop);
+    }
+    return loops;
+}
+
+void HFTServer::controlLoop() {
+    nameThread("control");
+    while (running) {
+        struct pollfd fds[3];
+        nfds_t count = 0;
+        fds[count++] = pollfd{controlFd, POLLIN, 0};
+        if (handoffListener != -1) {
+            fds[count++] = pollfd{handoffListener, POLLIN, 0};
+        }
+        if (predecessorChannel != -1) {
+            fds[count++] = pollfd{predecessorChannel, POLLIN, 0};
+        }
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Control thread poll failed: {}", strerror(errno));
+            return;
+        }
+        
+        uint64_t wakeups;
+        while (read(controlFd, &wakeups, sizeof(wakeups)) > 0) {
+        }
+        if (getStopRequest() != HFTStopMode::None) {
+            if (running && getStopRequest() == HFTStopMode::Drain) {
+                drain();
+            }
+            running = false;
+            return;
+        }
+        
+        for (nfds_t i = 1; i < count; ++i) {
+            if (fds[i].revents == 0) continue;
+            if (fds[i].fd == handoffListener) {
+                int channel = acceptHandoffSocket(handoffListener);
+                if (channel != -1 && handOver(channel)) {
+                    running = false;
+                    return;
+                }
+            } else if (fds[i].fd == predecessorChannel) {
+                receiveHandoff();
+            }
+        }
+    }
+}
+
+bool HFTServer::handOver(int channel) {
+    HandoffMessage request;
+    if (!recvHandoffMessage(channel, request) || request.kind != HANDOFF_TAKEOVER) {
+        for (int fd : request.fds) close(fd);
+        LOG_WARN("Ignoring a malformed takeover request on {}", handoffPath);
+        close(channel);
+        return false;
+    }
+    for (int fd : request.fds) close(fd);
+    
+    std::vector<int> listeners;
+    if (serverSocket != -1) {
+        listeners.push_back(serverSocket);
+    }
+    for (auto& shard : shards) {
+        listeners.push_back(shard->listenSocket);
+    }
+    if (!sendHandoffMessage(channel, HANDOFF_LISTENERS, listeners.data(), listeners.size(), nullptr, 0)) {
+        LOG_WARN("Failed to pass listeners to the successor on {}", handoffPath);
+        close(channel);
+        return false;
+    }
+    
+    // The path now belongs to the successor, which may bind it again
+    close(handoffListener);
+    handoffListener = -1;
+    {
+        std::lock_guard<std::mutex> lock(handoffMutex);
+        successorChannel = channel;
+        handOffConnections = request.payload == "1";
+    }
+    std::cout << "Handed " << listeners.size() << " listener(s) to the successor; draining" << std::endl;
+    drainedCleanly = drain();
+    return true;
+}
+
+void HFTServer::receiveHandoff() {
+    HandoffMessage message;
+    if (!recvHandoffMessage(predecessorChannel, message)) {
+        // EOF: the predecessor has passed everything it is going to
+        close(predecessorChannel);
+        predecessorChannel = -1;
+        return;
+    }
+    if (message.kind != HANDOFF_CONNECTION || message.fds.size() != 1) {
+        for (int fd : message.fds) close(fd);
+        return;
+    }
+    
+    std::vector<HFTLoopState*> loops = eventLoops();
+    HFTLoopState& loop = *loops[nextAdoptionLoop++ % loops.size()];
+    std::lock_guard<std::mutex> lock(loop.waitersMutex);
+    loop.adoptions.push_back(HFTLoopState::Adoption{message.fds[0], std::move(message.payload)});
+    loop.hasAdoptions.store(true, std::memory_order_release);
+}
+
+// Waits up to `deadline` for `done`, checking every millisecond; false if the
+// deadline passed or an immediate stop cut the wait short
+template<typename Predicate>
+static bool waitUntil(const std::atomic<int>& stopRequest, uint64_t deadline, Predicate done) {
+    while (!done()) {
+        if (monotonicNanos() >= deadline || stopRequest.load() == static_cast<int>(HFTStopMode::Immediate)) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+bool HFTServer::drain() {
+    uint64_t startedAt = monotonicNanos();
+    uint64_t deadline = startedAt + static_cast<uint64_t>(drainTimeoutMillis) * 1000000ULL;
+    std::vector<HFTLoopState*> loops = eventLoops();
+    
+    // 1. Loops stop accepting and reading; what they have read is queued or answered
+    draining = true;
+    bool drained = waitUntil(stopRequest, deadline, [&loops]() {
+        for (HFTLoopState* loop : loops) {
+            if (!loop->quiesced.load()) return false;
+        }
+        return true;
+    });
+    
+    // 2. Executors run their queues dry and write the replies
+    HFTExecutor* executors[] = {&workers, &blockingPool};
+    for (HFTExecutor* executor : executors) {
+        executor->draining = true;
+        executor->waitStrategy.notifyAll();
+    }
+    drained = drained && waitUntil(stopRequest, deadline, [&executors]() {
+        return executors[0]->liveThreads.load() == 0 && executors[1]->liveThreads.load() == 0;
+    });
+    
+    // 3. Replies queued behind slow readers go out
+    drained = drained && waitUntil(stopRequest, deadline, [this]() {
+        for (int fd = 0; fd <= connectionTable.highestFd(); ++fd) {
+            HFTConnection* connection = connectionTable.find(fd);
+            if (connection && connection->hasOutbound.load()) return false;
+        }
+        return true;
+    });
+    
+    uint64_t elapsedMillis = (monotonicNanos() - startedAt) / 1000000ULL;
+    if (drained) {
+        std::cout << "Drained in " << elapsedMillis << " ms" << std::endl;
+    } else {
+        std::cout << "Drain cut short after " << elapsedMillis << " ms; closing with work outstanding" << std::endl;
+    }
+    return drained;
+}
+
+size_t HFTServer::takeOver(const std::string& path, bool connections) {
+    int channel = connectHandoffSocket(path);
+    if (channel == -1) {
+        throw std::runtime_error("No server to take over at " + path);
+    }
+    HandoffMessage reply;
+    if (!sendHandoffMessage(channel, HANDOFF_TAKEOVER, nullptr, 0, connections ? "1" : "0", 1) ||
+        !recvHandoffMessage(channel, reply) || reply.kind != HANDOFF_LISTENERS) {
+        for (int fd : reply.fds) close(fd);
+        close(channel);
+        throw std::runtime_error("Server at " + path + " did not hand over its listeners");
+    }
+    inheritedListeners = reply.fds;
+    if (connections) {
+        // Connections follow once the old server has drained
+        predecessorChannel = channel;
+    } else {
+        close(channel);
+    }
+    return inheritedListeners.size();
+}
+
+int HFTServer::listenerFor(int port, size_t index) {
+    if (index < inheritedListeners.size() && inheritedListeners[index] != -1) {
+        int sock = inheritedListeners[index];
+        inheritedListeners[index] = -1;
+        sockaddr_in addr;
+        socklen_t length = sizeof(addr);
+        if (getsockname(sock, (struct sockaddr*)&addr, &length) == 0 && addr.sin_family == AF_INET &&
+            ntohs(addr.sin_port) == port) {
+            setNonBlocking(sock);
+            return sock;
+        }
+        LOG_WARN("Taken-over listener {} is not on port {}; binding a new one", index, port);
+        close(sock);
+    }
+    return createListenSocket(port);
+}
+
+void HFTServer::releaseInheritedListeners(size_t used) {
+    for (size_t i = used; i < inheritedListeners.size(); ++i) {
+        if (inheritedListeners[i] != -1) {
+            // Connections waiting in its accept queue are lost
+            LOG_WARN("Closing taken-over listener {}: this server runs {} listener(s)", i, used);
+            close(inheritedListeners[i]);
+        }
+    }
+    inheritedListeners.clear();
+}
+
+int HFTServer::acceptClient(int listenSocket, int pollFd, HFTLoopState& loop) {
+    sockaddr_in clientAddr;
+    socklen_t clientAddrLen = sizeof(clientAddr);
+    int clientSocket = accept(listenSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
+    
+    if (clientSocket == -1) {
+        return -1;
+    }
+    
+    setNonBlocking(clientSocket);
+    
+    // Set TCP_NODELAY for client socket
+    int opt = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, 1, &opt, sizeof(opt)); // TCP_NODELAY = 1
+    applyBusyPoll(clientSocket);
+    
+    HFTConnection* connection = openConnection(loop, clientSocket);
+    if (!connection) {
+        close(clientSocket);
+        return -1;
+    }
+    getThreadMetrics().connectionsOpened.add(1);
+    if (tlsContext) {
+        // The first reads and writes belong to the handshake
+        connection->tls.reset(new TlsSession(*tlsContext, clientSocket));
+        connection->handshaking = true;
+    }
+    
+    // Edge triggered; EPOLLOUT only matters while replies are queued
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = clientSocket;
+    
+    if (epoll_ctl(pollFd, EPOLL_CTL_ADD, clientSocket, &event) == -1) {
+        closeConnection(-1, clientSocket, *connection);
+        return -1;
+    }
+    
+    char clientIP[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, INET_ADDRSTRLEN);
+    LOG_INFO("New HFT connection from {}", clientIP);
+    return clientSocket;
+}
+
 void HFTServer::acceptConnections() {
     struct epoll_event events[HFT_MAX_EVENTS];
+    uint32_t idleRounds = 0;
+    int pollFd = epollFd;
+    acceptorLoop.idleTimers.reset(monotonicNanos());
+    
+    std::vector<HFTLoopState::Adoption> adopted;
     
     while (running) {
-        int numEvents = epoll_wait(epollFd, events, HFT_MAX_EVENTS, 1);
+        if (draining) {
+            quiesceEpoll(acceptorLoop, pollFd, serverSocket);
+        }
+        if (acceptorLoop.hasAdoptions.load(std::memory_order_acquire)) {
+            takeAdoptions(acceptorLoop, adopted);
+            for (HFTLoopState::Adoption& adoption : adopted) {
+                adoptEpoll(acceptorLoop, pollFd, adoption);
+            }
+            adopted.clear();
+        }
+        
+        int numEvents = epoll_wait(pollFd, events, HFT_MAX_EVENTS, workers.waitStrategy.pollTimeoutMillis(idleRounds));
+        idleRounds = numEvents > 0 ? 0 : idleRounds + 1;
+        uint64_t busyFrom = numEvents > 0 ? monotonicNanos() : 0;
         
         for (int i = 0; i < numEvents; ++i) {
             if (events[i].data.fd == serverSocket) {
                 // Accept new connection
-                sockaddr_in clientAddr;
-                socklen_t clientAddrLen = sizeof(clientAddr);
-                int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
-                
-                if (clientSocket != -1) {
-                    setNonBlocking(clientSocket);
-                    
-                    // Set TCP_NODELAY for client socket
-                    int opt = 1;
-                    setsockopt(clientSocket, IPPROTO_TCP, 1, &opt, sizeof(opt)); // TCP_NODELAY = 1
-                    
-                    struct epoll_event event;
-                    event.events = EPOLLIN | EPOLLET; // Edge triggered
-                    event.data.fd = clientSocket;
-                    
-                    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) != -1) {
-                        char clientIP[INET_ADDRSTRLEN];
-                        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, INET_ADDRSTRLEN);
-                        std::cout << "New HFT connection from " << clientIP << std::endl;
-                    } else {
-                        close(clientSocket);
-                    }
-                }
+                acceptClient(serverSocket, pollFd, acceptorLoop);
             } else {
                 // Handle client data
-                handleClient(events[i].data.fd);
+                handleClient(nullptr, acceptorLoop, pollFd, events[i].data.fd, events[i].events);
             }
         }
+        if (numEvents > 0) {
+            getThreadMetrics().busyNanos.add(monotonicNanos() - busyFrom);
+        }
+        reapIdle(acceptorLoop);
     }
+    closeAll(acceptorLoop);
 }
 
-void HFTServer::handleClient(int clientSocket) {
-    char buffer[HFT_BUFFER_SIZE];
-    ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+template<typename FrameHandler>
+bool HFTServer::drainSocket(int clientSocket, HFTConnection& connection, FrameHandler onFrame) {
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    ReceiveBuffer& buffer = connection.buffer;
     
-    if (bytesRead > 0) {
-        buffer[bytesRead] = '\0';
-        std::string request(buffer);
+    // Edge-triggered: drain the socket until EAGAIN, handing off every complete frame
+    while (true) {
+        char* dest = buffer.prepareWrite(HFT_BUFFER_SIZE);
+        ssize_t bytesRead;
+        if (connection.tls) {
+            // OpenSSL's state is shared with whoever is writing a reply
+            std::lock_guard<std::mutex> lock(connection.sendMutex);
+            bytesRead = connection.tls->readNow(dest, buffer.writableBytes());
+        } else {
+            bytesRead = recv(clientSocket, dest, buffer.writableBytes(), MSG_DONTWAIT);
+        }
         
-        // Add to lock-free queue for processing
-        requestQueue.enqueue(std::make_pair(clientSocket, request));
-    } else if (bytesRead == 0) {
-        // Client disconnected
-        epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
-        close(clientSocket);
+        if (bytesRead > 0) {
+            buffer.commitWrite(bytesRead);
+            metrics.bytesReceived.add(static_cast<uint64_t>(bytesRead));
+            // One timestamp per read; every frame in it arrived together
+            uint64_t receivedAt = monotonicNanos();
+            connection.lastActivity = receivedAt;
+            
+            FrameHeader header;
+            const char* payload = nullptr;
+            int status;
+            uint64_t frames = 0;
+            while ((status = buffer.nextFrame(header, payload)) > 0) {
+                onFrame(header, payload, receivedAt);
+                frames++;
+            }
+            metrics.recvCalls.add(1);
+            metrics.framesReceived.add(frames);
+            if (status < 0) {
+                // Oversized frame: the stream can't be resynchronized
+                return false;
+            }
+        } else if (bytesRead == 0) {
+            // Client disconnected
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
     }
 }
 
-void HFTServer::workerThread() {
-    std::pair<int, std::string> request;
+void HFTServer::handleClient(HFTReactorShard* shard, HFTLoopState& loop, int pollFd, int clientSocket,
+                             uint32_t events) {
+    HFTConnection* connection = connectionTable.find(clientSocket);
+    if (!connection || !connection->open || connection->loop != &loop) {
+        return; // Closed earlier in this batch of events
+    }
+    
+    if (connection->handshaking) {
+        TlsStatus status = continueHandshake(clientSocket, *connection);
+        if (status == TlsStatus::Failed) {
+            closeConnection(pollFd, clientSocket, *connection);
+            return;
+        }
+        if (status != TlsStatus::Done) {
+            return;
+        }
+        // Edge-triggered: requests sent behind the handshake won't raise another event
+        events |= EPOLLIN;
+    }
+    
+    // Replies a slow reader left queued go out ahead of new ones
+    if ((events & EPOLLOUT) && connection->hasOutbound.load()) {
+        drainOutbound(*connection, clientSocket);
+    }
+    
+    bool open = true;
+    // Once quiesced for a drain, unread requests stay in the socket for
+    // whoever serves the connection next
+    if ((events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) && !loop.quiesced.load(std::memory_order_relaxed)) {
+        HFTConnectionRef client(clientSocket, connection->generation);
+        open = drainSocket(clientSocket, *connection, [this, shard, &client](const FrameHeader& header, const char* payload, uint64_t receivedAt) {
+            handleFrame(shard, client, header, payload, receivedAt);
+        });
+        
+        // Everything answered inline during this read goes out in one write
+        flushResponses(getSendBatch());
+    }
+    
+    if (!open || (events & (EPOLLHUP | EPOLLERR)) || connection->failed.load()) {
+        closeConnection(pollFd, clientSocket, *connection);
+    }
+}
+
+void HFTServer::handleFrame(HFTReactorShard* shard, const HFTConnectionRef& client, const FrameHeader& header,
+                            const char* payload, uint64_t receivedAt) {
+    if (header.opcode != FRAME_OP_REQUEST) {
+        sendResponse(client, FRAME_OP_ERROR, header.requestId, "ERROR: Unexpected frame opcode");
+        return;
+    }
+    
+    // The request is viewed straight out of the receive buffer
+    StringView request(payload, header.length);
+    HFTHandlers handlers = handlersFor(shard);
+    
+    // Admission (rate limits) runs here, so overload is shed before it is queued
+    if (!handlers.admit(request)) {
+        rejectedRequests++;
+        sendResponse(client, FRAME_OP_ERROR, header.requestId, "ERROR: Rate limit exceeded");
+        return;
+    }
+    
+    HFTExecutor* executor = executorFor(handlers.classify(request));
+    // A cached reply costs a copy, not a blocking read: answer it here rather
+    // than queue it. If it is evicted in between, this thread runs the service.
+    // Commands whose key needs syscalls (READ) never match here.
+    if (executor && responseCache && responseCache->contains(request)) {
+        executor = nullptr;
+    }
+    if (executor) {
+        submit(*executor, client, header.requestId, request, receivedAt);
+        return;
+    }
+    
+    // Non-blocking service: answer now and skip the queue hop
+    uint64_t startedAt = monotonicNanos();
+    getThreadMetrics().stages[HFT_STAGE_RECEIVE].record(startedAt - receivedAt);
+    execute(handlers, client, header.requestId, request, receivedAt, startedAt);
+}
+
+HFTHandlers HFTServer::handlersFor(HFTReactorShard* shard) {
+    if (shard) {
+        return HFTHandlers{shard->pipeline.get(), &shard->interceptors, &shard->services, responseCache.get()};
+    }
+    return HFTHandlers{pipeline.get(), &interceptors, &services, responseCache.get()};
+}
+
+HFTConnection* HFTServer::openConnection(HFTLoopState& loop, int clientSocket) {
+    HFTConnection* connection = connectionTable.acquire(clientSocket);
+    if (!connection) {
+        LOG_WARN("No connection slot for fd {}", clientSocket);
+        return nullptr;
+    }
+    
+    uint64_t now = monotonicNanos();
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(connection->sendMutex);
+        generation = ++connection->generation;
+        connection->open = true;
+        connection->loop = &loop;
+        connection->writeArmed = false;
+        connection->failed.store(false);
+        connection->hasOutbound.store(false);
+        connection->tls.reset();
+        connection->tlsRecordOverhead = 0;
+    }
+    connection->handshaking = false;
+    connection->buffer.clear();
+    connection->lastActivity = now;
+    if (idleTimeoutNanos > 0) {
+        loop.idleTimers.schedule(HFTConnectionRef(clientSocket, generation), now + idleTimeoutNanos);
+    }
+    return connection;
+}
+
+void HFTServer::closeConnection(int pollFd, int clientSocket, HFTConnection& connection) {
+    if (pollFd != -1) {
+        epoll_ctl(pollFd, EPOLL_CTL_DEL, clientSocket, nullptr);
+    }
+    {
+        // Replies still being written finish first; later ones see it closed
+        std::lock_guard<std::mutex> lock(connection.sendMutex);
+        connection.open = false;
+        connection.outbound.clear();
+        connection.outboundHead = 0;
+        connection.outboundBytes = 0;
+        connection.hasOutbound.store(false);
+        if (connection.writeArmed || (engine == HFTEngine::IoUring && connection.handshaking)) {
+            // Completes the poll still armed on the ring before the fd goes
+            shutdown(clientSocket, SHUT_RDWR);
+            connection.writeArmed = false;
+        }
+        connection.tls.reset();
+        connection.tlsRecordOverhead = 0;
+    }
+    connection.handshaking = false;
+    if (connection.buffer.capacity() > HFT_SPILL_RETAIN_SIZE) {
+        connection.buffer = ReceiveBuffer(0);
+    } else {
+        connection.buffer.clear();
+    }
+    close(clientSocket);
+    getThreadMetrics().connectionsClosed.add(1);
+}
+
+void HFTServer::closeAll(HFTLoopState& loop) {
+    // Only a drain that finished leaves connections with nothing in flight
+    bool handOff = drainedCleanly.load();
+    size_t passed = 0;
+    for (int fd = 0; fd <= connectionTable.highestFd(); ++fd) {
+        HFTConnection* connection = connectionTable.find(fd);
+        if (connection && connection->open && connection->loop == &loop) {
+            if (handOff && passConnection(fd, *connection)) {
+                passed++;
+            }
+            closeConnection(-1, fd, *connection);
+        }
+    }
+    if (passed > 0) {
+        LOG_INFO("Passed {} connections to the successor", passed);
+    }
+}
+
+bool HFTServer::passConnection(int clientSocket, HFTConnection& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection.sendMutex);
+        // Records OpenSSL handles can't continue in another process; the kernel's can
+        if (connection.failed.load() || connection.hasOutbound.load() || connection.writeArmed || connection.tls) {
+            return false;
+        }
+    }
+    std::lock_guard<std::mutex> lock(handoffMutex);
+    if (successorChannel == -1 || !handOffConnections) {
+        return false;
+    }
+    // The successor gets its own reference; closing ours leaves the socket open
+    const ReceiveBuffer& buffer = connection.buffer;
+    if (!sendHandoffMessage(successorChannel, HANDOFF_CONNECTION, &clientSocket, 1, buffer.unread(),
+                            buffer.readableBytes())) {
+        LOG_WARN("Successor stopped taking connections; closing the rest");
+        handOffConnections = false;
+        return false;
+    }
+    return true;
+}
+
+TlsStatus HFTServer::continueHandshake(int clientSocket, HFTConnection& connection) {
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    TlsSession& session = *connection.tls;
+    TlsStatus status = session.handshake();
+    if (status == TlsStatus::Done && !session.offloaded() && engine == HFTEngine::IoUring) {
+        metrics.tlsHandshakeFailures.add(1);
+        LOG_WARN("Closing fd {}: the kernel did not take over {}", clientSocket, session.description());
+        return TlsStatus::Failed;
+    }
+    if (status == TlsStatus::Failed) {
+        metrics.tlsHandshakeFailures.add(1);
+        LOG_INFO("TLS handshake failed on fd {}: {}", clientSocket, session.error());
+        return status;
+    }
+    if (status != TlsStatus::Done) {
+        return status;
+    }
+    
+    // Nothing has been read yet, so the last activity is still the accept
+    metrics.tlsHandshake.record(monotonicNanos() - connection.lastActivity);
+    metrics.tlsHandshakes.add(1);
+    if (session.resumed()) {
+        metrics.tlsResumed.add(1);
+    }
+    connection.handshaking = false;
+    connection.tlsRecordOverhead = static_cast<uint32_t>(session.recordOverhead());
+    if (session.offloaded()) {
+        // The kernel holds the keys: reads, writev() and sendfile() go straight to the socket
+        metrics.tlsOffloaded.add(1);
+        std::lock_guard<std::mutex> lock(connection.sendMutex);
+        connection.tls.reset();
+    }
+    return status;
+}
+
+void HFTServer::takeAdoptions(HFTLoopState& loop, std::vector<HFTLoopState::Adoption>& adopted) {
+    std::lock_guard<std::mutex> lock(loop.waitersMutex);
+    adopted.swap(loop.adoptions);
+    loop.hasAdoptions.store(false, std::memory_order_relaxed);
+}
+
+HFTConnection* HFTServer::adoptConnection(HFTLoopState& loop, HFTLoopState::Adoption& adoption) {
+    setNonBlocking(adoption.fd);
+    applyBusyPoll(adoption.fd);
+    HFTConnection* connection = openConnection(loop, adoption.fd);
+    if (!connection) {
+        close(adoption.fd);
+        return nullptr;
+    }
+    // The partial request the predecessor had read; the rest is in the socket
+    if (!adoption.buffered.empty()) {
+        char* dest = connection->buffer.prepareWrite(adoption.buffered.size());
+        memcpy(dest, adoption.buffered.data(), adoption.buffered.size());
+        connection->buffer.commitWrite(adoption.buffered.size());
+    }
+    getThreadMetrics().connectionsOpened.add(1);
+    return connection;
+}
+
+void HFTServer::adoptEpoll(HFTLoopState& loop, int pollFd, HFTLoopState::Adoption& adoption) {
+    HFTConnection* connection = adoptConnection(loop, adoption);
+    if (!connection) {
+        return;
+    }
+    // Registering reports data already waiting, so nothing sent meanwhile is missed
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = adoption.fd;
+    if (epoll_ctl(pollFd, EPOLL_CTL_ADD, adoption.fd, &event) == -1) {
+        closeConnection(-1, adoption.fd, *connection);
+    }
+}
+
+void HFTServer::quiesceEpoll(HFTLoopState& loop, int pollFd, int listenSocket) {
+    if (loop.quiesced.load(std::memory_order_relaxed)) {
+        return;
+    }
+    // The listener may now be shared with a successor, which accepts from here on
+    epoll_ctl(pollFd, EPOLL_CTL_DEL, listenSocket, nullptr);
+    loop.quiesced.store(true);
+}
+
+void HFTServer::reapIdle(HFTLoopState& loop) {
+    if (idleTimeoutNanos == 0) {
+        return;
+    }
+    loop.idleTimers.advance(monotonicNanos(), [this, &loop](const HFTConnectionRef& client, uint64_t now) -> uint64_t {
+        HFTConnection* connection = connectionTable.find(client.fd);
+        if (!connection || !connection->open || connection->loop != &loop ||
+            connection->generation != client.generation) {
+            return 0; // Closed, or the fd belongs to a newer client with its own timer
+        }
+        uint64_t idleUntil = connection->lastActivity + idleTimeoutNanos;
+        if (idleUntil > now) {
+            return idleUntil;
+        }
+        // The loop sees the hangup and closes it the usual way
+        shutdown(client.fd, SHUT_RDWR);
+        getThreadMetrics().connectionsReaped.add(1);
+        return 0;
+    });
+}
+
+// Stops all writes to a broken connection and wakes its owner to close it.
+// Called with the connection's send lock held.
+static void failConnection(HFTConnection& connection, int clientSocket) {
+    connection.failed.store(true);
+    connection.outbound.clear();
+    connection.outboundHead = 0;
+    connection.outboundBytes = 0;
+    connection.hasOutbound.store(false);
+    shutdown(clientSocket, SHUT_RDWR);
+}
+
+// Writes through OpenSSL while it handles the connection's records, straight
+// to the socket otherwise. Called with the connection's send lock held.
+static ssize_t writeVector(HFTConnection& connection, int clientSocket, const struct iovec* iov, size_t count,
+                           int flags) {
+    if (connection.tls) {
+        return connection.tls->writeNow(iov, count);
+    }
+    return sendVectorNow(clientSocket, iov, count, flags);
+}
+
+static ssize_t writeFile(HFTConnection& connection, int clientSocket, int fd, uint64_t offset, size_t length) {
+    if (connection.tls) {
+        return connection.tls->writeFileNow(fd, offset, length);
+    }
+    return sendFileNow(clientSocket, fd, offset, length);
+}
+
+bool HFTServer::writeReply(const HFTConnectionRef& client, struct iovec* iov, size_t count, const FileRegion* file) {
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    HFTConnection* connection = connectionTable.find(client.fd);
+    if (!connection) {
+        metrics.repliesDropped.add(1);
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(connection->sendMutex);
+    if (!connection->open || connection->generation != client.generation || connection->failed.load()) {
+        // The client went away; the fd may already be someone else's
+        metrics.repliesDropped.add(1);
+        return false;
+    }
+    // Set before the socket can fill, so an EPOLLOUT edge can't be missed
+    connection->hasOutbound.store(true);
+    
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += iov[i].iov_len;
+    }
+    size_t fileLength = file ? file->length : 0;
+    if (connection->tlsRecordOverhead > 0) {
+        // The frames share records; a file starts records of its own
+        uint64_t records = tlsRecordCount(total) + tlsRecordCount(fileLength);
+        metrics.tlsRecordOverhead.add(records * connection->tlsRecordOverhead);
+    }
+    size_t written = 0;
+    size_t fileWritten = 0;
+    if (connection->outboundHead == connection->outbound.size()) {
+        // Nothing queued ahead of it: write what the socket takes now
+        ssize_t sent = writeVector(*connection, client.fd, iov, count, fileLength > 0 ? MSG_MORE : 0);
+        if (sent >= 0 && static_cast<size_t>(sent) == total && fileLength > 0) {
+            ssize_t fileSent = writeFile(*connection, client.fd, file->fd, file->offset, fileLength);
+            if (fileSent < 0) {
+                sent = -1;
+            } else {
+                fileWritten = static_cast<size_t>(fileSent);
+            }
+        }
+        if (sent < 0) {
+            failConnection(*connection, client.fd);
+            metrics.repliesDropped.add(1);
+            return false;
+        }
+        written = static_cast<size_t>(sent);
+        if (written == total && fileWritten == fileLength) {
+            connection->hasOutbound.store(false);
+            return true;
+        }
+    }
+    
+    // Queue the rest for the owner to write when the socket drains
+    HFTOutboundChunk chunk;
+    size_t skip = written;
+    for (size_t i = 0; i < count; ++i) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        chunk.bytes.append(static_cast<const char*>(iov[i].iov_base) + skip, iov[i].iov_len - skip);
+        skip = 0;
+    }
+    if (fileLength > 0) {
+        chunk.file = *file;
+        chunk.file.offset += fileWritten;
+        chunk.file.length -= fileWritten;
+    }
+    connection->outboundBytes += chunk.bytes.size() + chunk.file.length;
+    connection->outbound.push_back(std::move(chunk));
+    metrics.writesDeferred.add(1);
+    
+    if (connection->outboundBytes > HFT_MAX_OUTBOUND_BYTES) {
+        // The client isn't reading its replies; stop buffering for it
+        LOG_WARN("Dropping connection {}: {} bytes of replies unread", client.fd, connection->outboundBytes);
+        failConnection(*connection, client.fd);
+        metrics.repliesDropped.add(1);
+        return false;
+    }
+    if (engine == HFTEngine::IoUring && !connection->writeArmed) {
+        // Rings only poll on their own thread: ask the owner to arm POLLOUT
+        connection->writeArmed = true;
+        HFTLoopState& loop = *connection->loop;
+        std::lock_guard<std::mutex> waitersLock(loop.waitersMutex);
+        loop.writeWaiters.push_back(client);
+        loop.hasWriteWaiters.store(true, std::memory_order_release);
+    }
+    return true;
+}
+
+bool HFTServer::drainOutbound(HFTConnection& connection, int clientSocket) {
+    std::lock_guard<std::mutex> lock(connection.sendMutex);
+    bool pending = false;
+    while (connection.outboundHead < connection.outbound.size()) {
+        HFTOutboundChunk& chunk = connection.outbound[connection.outboundHead];
+        if (chunk.sent < chunk.bytes.size()) {
+            struct iovec iov;
+            iov.iov_base = &chunk.bytes[chunk.sent];
+            iov.iov_len = chunk.bytes.size() - chunk.sent;
+            ssize_t sent = writeVector(connection, clientSocket, &iov, 1, chunk.file.length > 0 ? MSG_MORE : 0);
+            if (sent < 0) {
+                failConnection(connection, clientSocket);
+                return false;
+            }
+            chunk.sent += static_cast<size_t>(sent);
+            connection.outboundBytes -= static_cast<size_t>(sent);
+            if (chunk.sent < chunk.bytes.size()) {
+                pending = true;
+                break;
+            }
+        }
+        if (chunk.file.length > 0) {
+            ssize_t sent = writeFile(connection, clientSocket, chunk.file.fd, chunk.file.offset, chunk.file.length);
+            if (sent < 0) {
+                failConnection(connection, clientSocket);
+                return false;
+            }
+            chunk.file.offset += static_cast<uint64_t>(sent);
+            chunk.file.length -= static_cast<size_t>(sent);
+            connection.outboundBytes -= static_cast<size_t>(sent);
+            if (chunk.file.length > 0) {
+                pending = true;
+                break;
+            }
+        }
+        // Frees the bytes and lets go of the file as soon as each is sent
+        chunk = HFTOutboundChunk();
+        connection.outboundHead++;
+    }
+    
+    if (!pending) {
+        connection.outbound.clear();
+        connection.outboundHead = 0;
+        connection.hasOutbound.store(false);
+    }
+    connection.writeArmed = pending;
+    return pending;
+}
+
+void HFTServer::sendResponse(const HFTConnectionRef& client, uint16_t opcode, uint32_t requestId, StringView response) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(response.length())), header);
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = FRAME_HEADER_SIZE;
+    iov[1].iov_base = const_cast<char*>(response.data());
+    iov[1].iov_len = response.length();
+    if (!writeReply(client, iov, 2, nullptr)) {
+        return;
+    }
+    
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    metrics.writeCalls.add(1);
+    metrics.framesSent.add(1);
+    metrics.bytesSent.add(FRAME_HEADER_SIZE + response.length());
+}
+
+void HFTServer::queueResponse(HFTSendBatch& batch, const HFTConnectionRef& client, uint32_t requestId,
+                              StringView response, uint64_t receivedAt, uint64_t processedAt, const FileRegion* file) {
+    if (batch.client != client) {
+        flushResponses(batch);
+        batch.client = client;
+    }
+    
+    HFTSendBatch::Pending reply;
+    reply.receivedAt = receivedAt;
+    reply.processedAt = processedAt;
+    batch.pending.push_back(reply);
+    
+    if (file || response.size() > FRAME_BATCH_COPY_LIMIT) {
+        // Too big to copy: write it straight from the arena (or the file)
+        // behind the others
+        flushResponses(batch, &response, requestId, file);
+        return;
+    }
+    
+    batch.frames.append(FRAME_OP_RESPONSE, requestId, response.data(), response.size());
+    if (!sendBatching || batch.pending.size() >= HFT_SEND_BATCH || batch.frames.byteCount() >= HFT_SEND_BATCH_BYTES) {
+        flushResponses(batch);
+    }
+}
+
+void HFTServer::flushResponses(HFTSendBatch& batch, const StringView* trailing, uint32_t trailingId,
+                               const FileRegion* trailingFile) {
+    if (batch.pending.empty()) {
+        return;
+    }
+    
+    // Queued frames, then the trailing frame's header and payload
+    char header[FRAME_HEADER_SIZE];
+    struct iovec iov[3];
+    size_t count = 0;
+    const std::string& queued = batch.frames.encoded();
+    uint64_t bytes = queued.size();
+    if (!queued.empty()) {
+        iov[count].iov_base = const_cast<char*>(queued.data());
+        iov[count++].iov_len = queued.size();
+    }
+    if (trailing) {
+        size_t length = trailing->size() + (trailingFile ? trailingFile->length : 0);
+        encodeFrameHeader(FrameHeader(FRAME_OP_RESPONSE, trailingId, static_cast<uint32_t>(length)), header);
+        iov[count].iov_base = header;
+        iov[count++].iov_len = FRAME_HEADER_SIZE;
+        iov[count].iov_base = const_cast<char*>(trailing->data());
+        iov[count++].iov_len = trailing->size();
+        bytes += FRAME_HEADER_SIZE + length;
+    }
+    bool written = writeReply(batch.client, iov, count, trailingFile);
+    batch.frames.clear();
+    uint64_t sentAt = monotonicNanos();
+    
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    if (written) {
+        metrics.writeCalls.add(1);
+        metrics.framesSent.add(batch.pending.size());
+        metrics.bytesSent.add(bytes);
+    }
+    for (const auto& reply : batch.pending) {
+        metrics.stages[HFT_STAGE_SEND].record(sentAt - reply.processedAt);
+        metrics.stages[HFT_STAGE_TOTAL].record(sentAt - reply.receivedAt);
+    }
+    batch.pending.clear();
+}
+
+HFTExecutor* HFTServer::executorFor(ExecutionClass executionClass) {
+    switch (executionClass) {
+        case ExecutionClass::Inline:
+            return nullptr;
+        case ExecutionClass::Worker:
+            // Reactors have no worker pool and run CPU-bound work themselves
+            return workers.queue ? &workers : nullptr;
+        case ExecutionClass::Blocking:
+            return &blockingPool;
+    }
+    return nullptr;
+}
+
+void HFTServer::submit(HFTExecutor& executor, const HFTConnectionRef& client, uint32_t requestId, StringView request,
+                       uint64_t receivedAt) {
+    uint64_t enqueuedAt = monotonicNanos();
+    if (!executor.queue->enqueue(HFTRequest(client.fd, client.generation, requestId, request.data(), request.size(),
+                                            receivedAt, enqueuedAt))) {
+        // Queue full: shed load now instead of letting latency grow unbounded
+        rejectedRequests++;
+        sendResponse(client, FRAME_OP_ERROR, requestId, "ERROR: Server busy");
+        return;
+    }
+    executor.waitStrategy.notify();
+    getThreadMetrics().stages[HFT_STAGE_RECEIVE].record(enqueuedAt - receivedAt);
+}
+
+void HFTServer::execute(HFTHandlers& handlers, const HFTConnectionRef& client, uint32_t requestId, StringView request,
+                        uint64_t receivedAt, uint64_t startedAt) {
+    HFTResponseBuffer& arena = getResponseBuffer();
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    
+    ResponseWriter response(arena.data, sizeof(arena.data), &arena.spill);
+    // Large file reads are sent from the page cache rather than the arena
+    response.allowFileTail();
+    RequestContext context(request, startedAt);
+    context.receivedAt = receivedAt;
+    context.clientSocket = client.fd;
+    context.requestId = requestId;
+    size_t handler = runPipeline(handlers, request, response, context);
+    uint64_t processedAt = monotonicNanos();
+    
+    metrics.stages[HFT_STAGE_SERVICE].record(processedAt - startedAt);
+    if (handler < metrics.services.size()) {
+        metrics.services[handler].record(processedAt - startedAt);
+        if (startsWith(response.view(), "ERROR")) {
+            metrics.serviceErrors[handler].add(1);
+        }
+    } else {
+        metrics.unhandled.add(1);
+    }
+    
+    // Send and total stages are recorded when the batch is written
+    queueResponse(getSendBatch(), client, requestId, response.view(), receivedAt, processedAt,
+                  response.hasFileTail() ? &response.fileTail() : nullptr);
+    arena.reset();
+}
+
+void HFTServer::startExecutor(HFTExecutor& executor) {
+    executor.queue.reset(new LockFreeQueue<HFTRequest>(executor.queueDepth));
+    executor.draining = false;
+    executor.liveThreads = executor.threadCount;
+    for (int i = 0; i < executor.threadCount; ++i) {
+        HFTHandlers handlers = handlersFor(nullptr);
+        if (pipeline) {
+            executor.pipelines.push_back(pipeline->clone());
+            handlers.pipeline = executor.pipelines.back().get();
+        } else {
+            std::unique_ptr<InterceptorChain> chain(new InterceptorChain());
+            if (interceptors.cloneInto(*chain)) {
+                handlers.chain = chain.get();
+                executor.chains.push_back(std::move(chain));
+            }
+        }
+        executor.threads.emplace_back(&HFTServer::workerThread, this, &executor, i, handlers);
+    }
+}
+
+void HFTServer::stopExecutor(HFTExecutor& executor) {
+    executor.waitStrategy.notifyAll();
+    for (auto& thread : executor.threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    executor.threads.clear();
+    executor.chains.clear();
+    executor.pipelines.clear();
+}
+
+void HFTServer::setExecutorLimits(ExecutionClass executionClass, int threads, size_t queueDepth) {
+    HFTExecutor& executor = executionClass == ExecutionClass::Blocking ? blockingPool : workers;
+    if (executionClass == ExecutionClass::Inline || threads <= 0 || queueDepth == 0) {
+        throw std::runtime_error("Executor limits need a queued class, threads and a queue depth");
+    }
+    executor.threadCount = threads;
+    executor.queueDepth = queueDepth;
+}
+
+void HFTServer::workerThread(HFTExecutor* executor, int index, HFTHandlers handlers) {
+    HFTRequest request;
+    HFTSendBatch& batch = getSendBatch();
+    uint32_t idleRounds = 0;
+    bool blocking = executor == &blockingPool;
+    placeThread(blocking ? threadConfig.blockingCpus : threadConfig.workerCpus, index, !blocking,
+                std::string(executor->name) + " " + std::to_string(index));
+    HFTThreadMetrics& metrics = getThreadMetrics();
     
     while (running) {
-        if (requestQueue.dequeue(request)) {
-            auto startTime = std::chrono::high_resolution_clock::now();
-            
-            std::string response = processRequest(request.second);
-            
-            auto endTime = std::chrono::high_resolution_clock::now();
-            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count();
-            
-            totalRequests++;
-            totalLatency += latency;
-            
-            // Send response
-            send(request.first, response.c_str(), response.length(), MSG_NOSIGNAL);
+        if (executor->queue->dequeue(request)) {
+            idleRounds = 0;
+            uint64_t startedAt = monotonicNanos();
+            metrics.stages[HFT_STAGE_QUEUE_WAIT].record(startedAt - request.enqueuedAt);
+            execute(handlers, HFTConnectionRef(request.clientSocket, request.generation), request.requestId,
+                    request.payload(),
+                    request.receivedAt, startedAt);
+            metrics.busyNanos.add(monotonicNanos() - startedAt);
+        } else if (!batch.pending.empty()) {
+            // Out of work: write what has accumulated before waiting
+            flushResponses(batch);
+        } else if (executor->draining) {
+            break; // Drained: the loops have stopped reading, so nothing more comes
         } else {
-            // Brief sleep to prevent busy waiting
-            std::this_thread::sleep_for(std::chrono::microseconds(1));
+            executor->waitStrategy.idle(idleRounds, [this, executor]() {
+                return executor->queue->size() > 0 || !running || executor->draining;
+            });
         }
     }
+    flushResponses(batch);
+    executor->liveThreads--;
 }
 
-std::string HFTServer::processRequest(const std::string& request) {
-    std::string processedRequest = request;
+void HFTServer::startReactors(int port) {
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    if (cores <= 0) cores = 1;
     
-    // Execute pre-processing interceptors (optimized order)
-    for (auto& interceptor : interceptors) {
-        if (!interceptor->preProcess(processedRequest)) {
-            return "ERROR: Request rejected by interceptor";
+    for (int i = 0; i < reactorCount; ++i) {
+        const std::vector<int>& cpus = threadConfig.reactorCpus;
+        int cpu = cpus.empty() ? i % cores : cpus[static_cast<size_t>(i) % cpus.size()];
+        std::unique_ptr<HFTReactorShard> shard(new HFTReactorShard(i, cpu));
+        shard->listenSocket = listenerFor(port, static_cast<size_t>(i));
+        if (threadConfig.incomingCpu &&
+            setsockopt(shard->listenSocket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) != 0) {
+            LOG_WARN("Failed to set SO_INCOMING_CPU {} on reactor {}", cpu, i);
+        }
+        if (engine == HFTEngine::Epoll) {
+            shard->epollFd = createEpoll(shard->listenSocket);
+        }
+        
+        if (pipeline) {
+            shard->pipeline = pipeline->clone();
+        } else {
+            services.cloneInto(shard->services);
+            if (!interceptors.cloneInto(shard->interceptors)) {
+                throw std::runtime_error("Reactor mode requires interceptors that implement clone()");
+            }
         }
+        shards.push_back(std::move(shard));
     }
+    releaseInheritedListeners(shards.size());
+    
+    running = true;
+    std::cout << "HFT Server started on port " << port << " with " << reactorCount << " reactors ("
+              << engineName(engine) << ")" << std::endl;
+    
+    // Blocking services still need somewhere to run that isn't a reactor
+    startExecutor(blockingPool);
+    startAdmin();
+    startControl();
+    
+    for (size_t i = 1; i < shards.size(); ++i) {
+        shards[i]->thread = std::thread(&HFTServer::reactorLoop, this, shards[i].get());
+    }
+    
+    // Shard 0 runs on the calling thread so start() keeps blocking as before
+    reactorLoop(shards[0].get());
+}
+
+void HFTServer::reactorLoop(HFTReactorShard* shard) {
+    placeThread(std::vector<int>{shard->cpu}, 0, true, "reactor " + std::to_string(shard->id));
     
-    // Find appropriate service
-    std::string response;
-    for (auto& service : services) {
-        response = service->processRequest(processedRequest);
-        if (!response.empty()) {
-            break;
+    if (engine == HFTEngine::IoUring) {
+        uringLoop(shard->listenSocket, shard);
+    } else {
+        epollReactorLoop(shard);
+    }
+    
+    if (shard->epollFd != -1) close(shard->epollFd);
+    close(shard->listenSocket);
+    shard->epollFd = -1;
+    shard->listenSocket = -1;
+}
+
+void HFTServer::epollReactorLoop(HFTReactorShard* shard) {
+    struct epoll_event events[HFT_MAX_EVENTS];
+    uint32_t idleRounds = 0;
+    shard->loop.idleTimers.reset(monotonicNanos());
+    std::vector<HFTLoopState::Adoption> adopted;
+    
+    while (running) {
+        if (draining) {
+            quiesceEpoll(shard->loop, shard->epollFd, shard->listenSocket);
+        }
+        if (shard->loop.hasAdoptions.load(std::memory_order_acquire)) {
+            takeAdoptions(shard->loop, adopted);
+            for (HFTLoopState::Adoption& adoption : adopted) {
+                adoptEpoll(shard->loop, shard->epollFd, adoption);
+            }
+            adopted.clear();
+        }
+        
+        int numEvents = epoll_wait(shard->epollFd, events, HFT_MAX_EVENTS, workers.waitStrategy.pollTimeoutMillis(idleRounds));
+        idleRounds = numEvents > 0 ? 0 : idleRounds + 1;
+        uint64_t busyFrom = numEvents > 0 ? monotonicNanos() : 0;
+        
+        for (int i = 0; i < numEvents; ++i) {
+            int clientSocket = events[i].data.fd;
+            if (clientSocket == shard->listenSocket) {
+                acceptClient(shard->listenSocket, shard->epollFd, shard->loop);
+                continue;
+            }
+            
+            // Requests are processed inline and their replies written in one
+            // batch once the socket is drained. Writes still take the
+            // connection's send lock because the blocking pool may be
+            // answering an offloaded request on it.
+            handleClient(shard, shard->loop, shard->epollFd, clientSocket, events[i].events);
         }
+        if (numEvents > 0) {
+            getThreadMetrics().busyNanos.add(monotonicNanos() - busyFrom);
+        }
+        reapIdle(shard->loop);
+    }
+    closeAll(shard->loop);
+}
+
+#ifdef HFT_HAVE_IO_URING
+// Completion tags: operation in the high 32 bits, file descriptor in the low 32
+static const uint64_t HFT_URING_ACCEPT = 1;
+static const uint64_t HFT_URING_RECV = 2;
+static const uint64_t HFT_URING_POLLOUT = 3;
+static const uint64_t HFT_URING_HANDSHAKE = 4;
+
+static uint64_t uringTag(uint64_t operation, int fd) {
+    return (operation << 32) | static_cast<uint32_t>(fd);
+}
+
+static void armAccept(IoUring& ring, int listenSocket) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        ring.submitAndWait(0, 0);
+        sqe = ring.getSqe();
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenSocket;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = uringTag(HFT_URING_ACCEPT, listenSocket);
+}
+
+static void armRecv(IoUring& ring, ProvidedBufferPool& buffers, int clientSocket) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        ring.submitAndWait(0, 0);
+        sqe = ring.getSqe();
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = clientSocket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers.group();
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = uringTag(HFT_URING_RECV, clientSocket);
+}
+
+// One-shot: reports once the socket has room for queued replies
+static void armPollOut(IoUring& ring, int clientSocket) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        ring.submitAndWait(0, 0);
+        sqe = ring.getSqe();
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = clientSocket;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = uringTag(HFT_URING_POLLOUT, clientSocket);
+}
+
+// One-shot: reports once a TLS handshake can go on
+static void armHandshake(IoUring& ring, int clientSocket, TlsStatus status) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        ring.submitAndWait(0, 0);
+        sqe = ring.getSqe();
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = clientSocket;
+    sqe->poll32_events = status == TlsStatus::WantWrite ? POLLOUT : POLLIN;
+    sqe->user_data = uringTag(HFT_URING_HANDSHAKE, clientSocket);
+}
+
+// Ends the operation tagged `tag`; its own completion carries tag 0 and is ignored
+static void armCancel(IoUring& ring, uint64_t tag) {
+    struct io_uring_sqe* sqe = ring.getSqe();
+    if (!sqe) {
+        ring.submitAndWait(0, 0);
+        sqe = ring.getSqe();
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag;
+    sqe->user_data = 0;
+}
+
+bool HFTServer::ioUringAvailable(std::string& error) {
+    ProvidedBufferPool buffers;
+    IoUring ring;
+    return ring.init(8, error) && buffers.init(ring, 0, 8, 64, error);
+}
+
+void HFTServer::uringLoop(int listenSocket, HFTReactorShard* shard) {
+    // Declared first so the ring goes away before the buffers the kernel holds
+    ProvidedBufferPool buffers;
+    IoUring ring;
+    std::string error;
+    if (!ring.init(HFT_URING_ENTRIES, error) || !buffers.init(ring, 0, HFT_URING_BUFFERS, HFT_BUFFER_SIZE, error)) {
+        LOG_ERROR("io_uring engine failed to start: {}", error);
+        return;
     }
     
-    if (response.empty()) {
-        response = "ERROR: No service available to handle request";
+    HFTLoopState& loop = shard ? shard->loop : acceptorLoop;
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    std::vector<HFTConnectionRef> waiters;
+    std::vector<HFTLoopState::Adoption> adopted;
+    loop.idleTimers.reset(monotonicNanos());
+    armAccept(ring, listenSocket);
+    uint32_t idleRounds = 0;
+    // Multishot operations in flight, so a drain knows when reading has stopped
+    bool acceptArmed = true;
+    size_t armedRecvs = 0;
+    bool cancelled = false;
+    auto startRecv = [&](int clientSocket) {
+        armRecv(ring, buffers, clientSocket);
+        armedRecvs++;
+    };
+    // Receives start once the kernel holds the connection's keys
+    auto stepHandshake = [&](int clientSocket, HFTConnection& connection) {
+        TlsStatus status = continueHandshake(clientSocket, connection);
+        if (status == TlsStatus::Failed) {
+            closeConnection(-1, clientSocket, connection);
+        } else if (status != TlsStatus::Done) {
+            armHandshake(ring, clientSocket, status);
+        } else if (!draining) {
+            startRecv(clientSocket);
+        }
+    };
+    
+    while (running) {
+        if (draining && !cancelled) {
+            // Stop accepting and reading; each operation ends with a final completion
+            armCancel(ring, uringTag(HFT_URING_ACCEPT, listenSocket));
+            for (int fd = 0; fd <= connectionTable.highestFd(); ++fd) {
+                HFTConnection* connection = connectionTable.find(fd);
+                if (connection && connection->open && connection->loop == &loop) {
+                    armCancel(ring, uringTag(HFT_URING_RECV, fd));
+                }
+            }
+            cancelled = true;
+        }
+        if (cancelled && !acceptArmed && armedRecvs == 0 && !loop.quiesced.load(std::memory_order_relaxed)) {
+            loop.quiesced.store(true);
+        }
+        if (loop.hasAdoptions.load(std::memory_order_acquire)) {
+            takeAdoptions(loop, adopted);
+            for (HFTLoopState::Adoption& adoption : adopted) {
+                if (adoptConnection(loop, adoption)) {
+                    startRecv(adoption.fd);
+                }
+            }
+            adopted.clear();
+        }
+        if (loop.hasWriteWaiters.load(std::memory_order_acquire)) {
+            {
+                std::lock_guard<std::mutex> lock(loop.waitersMutex);
+                waiters.swap(loop.writeWaiters);
+                loop.hasWriteWaiters.store(false, std::memory_order_relaxed);
+            }
+            for (const HFTConnectionRef& client : waiters) {
+                HFTConnection* connection = connectionTable.find(client.fd);
+                if (connection && connection->open && connection->generation == client.generation) {
+                    armPollOut(ring, client.fd);
+                }
+            }
+            waiters.clear();
+        }
+        
+        int timeout = workers.waitStrategy.pollTimeoutMillis(idleRounds);
+        ring.submitAndWait(timeout > 0 ? 1 : 0, timeout);
+        uint64_t busyFrom = monotonicNanos();
+        
+        unsigned completions = ring.drainCompletions([&](const struct io_uring_cqe& cqe) {
+            uint64_t operation = cqe.user_data >> 32;
+            int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+            bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+            
+            if (operation == 0) {
+                return; // Buffer recycle; the buffer stays out of rotation if it failed
+            }
+            if (operation == HFT_URING_ACCEPT) {
+                if (cqe.res >= 0) {
+                    int opt = 1;
+                    setsockopt(cqe.res, IPPROTO_TCP, 1, &opt, sizeof(opt)); // TCP_NODELAY = 1
+                    applyBusyPoll(cqe.res);
+                    HFTConnection* connection = openConnection(loop, cqe.res);
+                    if (connection) {
+                        metrics.connectionsOpened.add(1);
+                        if (tlsContext) {
+                            connection->tls.reset(new TlsSession(*tlsContext, cqe.res));
+                            connection->handshaking = true;
+                            stepHandshake(cqe.res, *connection);
+                        } else if (!draining) {
+                            // Accepted as a drain began: left unread like the rest
+                            startRecv(cqe.res);
+                        }
+                    } else {
+                        close(cqe.res);
+                    }
+                }
+                if (!more) {
+                    acceptArmed = running && !draining;
+                    if (acceptArmed) {
+                        armAccept(ring, listenSocket);
+                    }
+                }
+                return;
+            }
+            
+            HFTConnection* connection = connectionTable.find(fd);
+            bool open = connection && connection->open && connection->loop == &loop;
+            if (operation == HFT_URING_POLLOUT) {
+                // Stale completions find nothing queued, or a closed connection
+                if (open && drainOutbound(*connection, fd)) {
+                    armPollOut(ring, fd);
+                }
+                return;
+            }
+            if (operation == HFT_URING_HANDSHAKE) {
+                if (open && connection->handshaking) {
+                    stepHandshake(fd, *connection);
+                }
+                return;
+            }
+            
+            if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                uint16_t bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                bool reading = open && !connection->failed.load();
+                if (reading) {
+                    // Frames may straddle buffers, so append to the connection's
+                    // receive buffer and hand the provided buffer straight back
+                    ReceiveBuffer& buffer = connection->buffer;
+                    memcpy(buffer.prepareWrite(cqe.res), buffers.buffer(bufferId), cqe.res);
+                    buffer.commitWrite(cqe.res);
+                }
+                buffers.recycle(bufferId);
+                metrics.bytesReceived.add(static_cast<uint64_t>(cqe.res));
+                
+                if (reading) {
+                    uint64_t receivedAt = monotonicNanos();
+                    connection->lastActivity = receivedAt;
+                    HFTConnectionRef client(fd, connection->generation);
+                    FrameHeader header;
+                    const char* payload = nullptr;
+                    int status;
+                    uint64_t frames = 0;
+                    while ((status = connection->buffer.nextFrame(header, payload)) > 0) {
+                        handleFrame(shard, client, header, payload, receivedAt);
+                        frames++;
+                    }
+                    metrics.recvCalls.add(1);
+                    metrics.framesReceived.add(frames);
+                    flushResponses(getSendBatch());
+                    
+                    if (status < 0) {
+                        // Oversized frame: stop reading; the final completion closes it
+                        connection->failed.store(true);
+                        shutdown(fd, SHUT_RDWR);
+                    }
+                }
+            }
+            
+            if (!more) {
+                armedRecvs--;
+            }
+            if (!more && open) {
+                // The multishot receive ended: out of buffers, EOF, an error, or
+                // cancelled by a drain, which leaves the rest in the socket
+                bool healthy = (cqe.res == -ENOBUFS || cqe.res == -ECANCELED || cqe.res > 0) &&
+                               !connection->failed.load();
+                if (healthy && draining && running) {
+                    return;
+                }
+                if (healthy && cqe.res != -ECANCELED && running) {
+                    startRecv(fd);
+                } else {
+                    closeConnection(-1, fd, *connection);
+                }
+            }
+        });
+        
+        idleRounds = completions > 0 ? 0 : idleRounds + 1;
+        if (completions > 0) {
+            metrics.busyNanos.add(monotonicNanos() - busyFrom);
+        }
+        reapIdle(loop);
+    }
+    closeAll(loop);
+}
+#else
+bool HFTServer::ioUringAvailable(std::string& error) {
+    error = "built without io_uring support (HFT_HAVE_IO_URING)";
+    return false;
+}
+
+void HFTServer::uringLoop(int listenSocket, HFTReactorShard* shard) {
+    (void)listenSocket;
+    (void)shard;
+}
+#endif
+
+size_t HFTServer::runPipeline(HFTHandlers& handlers, StringView request, ResponseWriter& response,
+                              RequestContext& context) {
+    if (handlers.pipeline) {
+        return handlers.pipeline->process(request, response, context);
     }
     
-    // Execute post-processing interceptors
-    for (auto& interceptor : interceptors) {
-        interceptor->postProcess(processedRequest, response);
+    // Execute pre-processing interceptors (priority order fixed at startup)
+    if (!handlers.chain->preProcess(request, context)) {
+        response.append("ERROR: Request rejected by interceptor");
+        return ServiceRegistry::npos;
+    }
+    
+    // Replies cached for an identical earlier command skip the service
+    size_t handler = ServiceRegistry::npos;
+    ResponseCache::Ticket ticket;
+    if (handlers.cache && context.hasCommand && handlers.cache->lookup(context.command, response, handler, ticket)) {
+        handlers.chain->postProcess(request, response, context);
+        return handler;
     }
     
-    return response;
+    // Route by command name through the dispatch table
+    if (!handlers.services->dispatch(request, response, &handler)) {
+        response.assign("ERROR: No service available to handle request");
+    } else if (ticket.storable()) {
+        handlers.cache->store(ticket, context.command, handler, response);
+    }
+    
+    // Execute post-processing interceptors
+    handlers.chain->postProcess(request, response, context);
+    return handler;
 }
 
 void HFTServer::addService(std::unique_ptr<IService> service) {
     service->initialize();
-    services.push_back(std::move(service));
+    services.add(std::move(service));
 }
 
 void HFTServer::addInterceptor(std::unique_ptr<IInterceptor> interceptor) {
-    interceptors.push_back(std::move(interceptor));
-    
-    // Sort interceptors by priority for optimal processing order
-    std::sort(interceptors.begin(), interceptors.end(),
-              [](const std::unique_ptr<IInterceptor>& a, const std::unique_ptr<IInterceptor>& b) {
-                  return a->getPriority() < b->getPriority();
-              });
+    // Kept in priority order as it is added
+    interceptors.add(std::move(interceptor));
+}
+
+HFTResponseBuffer& HFTServer::getResponseBuffer() {
+    // One arena per worker/reactor thread, on the heap rather than in TLS:
+    // glibc zeroes a new thread's TLS from the creating thread, which would
+    // put the pages on the creator's NUMA node instead of the user's
+    static thread_local std::unique_ptr<HFTResponseBuffer> buffer;
+    if (!buffer) {
+        buffer.reset(new HFTResponseBuffer());
+    }
+    return *buffer;
+}
+
+HFTSendBatch& HFTServer::getSendBatch() {
+    static thread_local HFTSendBatch batch;
+    return batch;
+}
+
+HFTThreadMetrics& HFTServer::getThreadMetrics() {
+    // Allocated by the thread that records into it, like the response arena
+    static thread_local HFTThreadMetrics* metrics = nullptr;
+    if (!metrics) {
+        std::unique_ptr<HFTThreadMetrics> created(new HFTThreadMetrics(serviceCount()));
+        metrics = created.get();
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        threadMetrics.push_back(std::move(created));
+    }
+    return *metrics;
+}
+
+size_t HFTServer::serviceCount() const {
+    return pipeline ? pipeline->serviceCount() : services.size();
+}
+
+uint64_t HFTServer::getTotalRequests() const {
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    uint64_t requests = 0;
+    for (const auto& metrics : threadMetrics) {
+        requests += metrics->stages[HFT_STAGE_TOTAL].count();
+    }
+    return requests;
+}
+
+uint64_t HFTServer::getAverageLatency() const {
+    LatencyHistogram service;
+    {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        for (const auto& metrics : threadMetrics) {
+            service.merge(metrics->stages[HFT_STAGE_SERVICE]);
+        }
+    }
+    return service.mean() / 1000;
 }
 
-HFTResponseBuffer* HFTServer::getResponseBuffer() {
-    size_t index = bufferIndex.fetch_add(1) % responseBuffers.size();
-    return &responseBuffers[index];
+HFTLatencyReport HFTServer::getLatencyReport() const {
+    HFTLatencyReport report;
+    for (size_t i = 0; i < serviceCount(); ++i) {
+        report.serviceNames.push_back(pipeline ? pipeline->serviceName(i) : services.serviceName(i));
+    }
+    report.services.resize(serviceCount());
+    report.serviceErrors.resize(serviceCount());
+    
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    for (const auto& metrics : threadMetrics) {
+        for (int stage = 0; stage < HFT_STAGE_COUNT; ++stage) {
+            report.stages[stage].merge(metrics->stages[stage]);
+        }
+        for (size_t i = 0; i < metrics->services.size() && i < report.services.size(); ++i) {
+            report.services[i].merge(metrics->services[i]);
+            report.serviceErrors[i] += metrics->serviceErrors[i].load();
+        }
+        report.unhandled += metrics->unhandled.load();
+        report.recvCalls += metrics->recvCalls.load();
+        report.framesReceived += metrics->framesReceived.load();
+        report.writeCalls += metrics->writeCalls.load();
+        report.framesSent += metrics->framesSent.load();
+        report.bytesReceived += metrics->bytesReceived.load();
+        report.bytesSent += metrics->bytesSent.load();
+        report.connectionsOpened += metrics->connectionsOpened.load();
+        report.connectionsClosed += metrics->connectionsClosed.load();
+        report.connectionsReaped += metrics->connectionsReaped.load();
+        report.repliesDropped += metrics->repliesDropped.load();
+        report.writesDeferred += metrics->writesDeferred.load();
+        report.tlsHandshake.merge(metrics->tlsHandshake);
+        report.tlsHandshakes += metrics->tlsHandshakes.load();
+        report.tlsResumed += metrics->tlsResumed.load();
+        report.tlsHandshakeFailures += metrics->tlsHandshakeFailures.load();
+        report.tlsOffloaded += metrics->tlsOffloaded.load();
+        report.tlsRecordOverhead += metrics->tlsRecordOverhead.load();
+    }
+    return report;
 }
 
 void HFTServer::resetMetrics() {
-    totalRequests = 0;
-    totalLatency = 0;
+    {
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        for (auto& metrics : threadMetrics) {
+            for (auto& stage : metrics->stages) {
+                stage.reset();
+            }
+            for (auto& service : metrics->services) {
+                service.reset();
+            }
+            for (auto& errors : metrics->serviceErrors) {
+                errors.reset();
+            }
+            metrics->unhandled.reset();
+            metrics->recvCalls.reset();
+            metrics->framesReceived.reset();
+            metrics->writeCalls.reset();
+            metrics->framesSent.reset();
+            metrics->bytesReceived.reset();
+            metrics->bytesSent.reset();
+            metrics->repliesDropped.reset();
+            metrics->writesDeferred.reset();
+            metrics->tlsHandshake.reset();
+            metrics->tlsHandshakes.reset();
+            metrics->tlsResumed.reset();
+            metrics->tlsHandshakeFailures.reset();
+            metrics->tlsOffloaded.reset();
+            metrics->tlsRecordOverhead.reset();
+            metrics->busyNanos.reset();
+            metrics->busySince.store(monotonicNanos(), std::memory_order_relaxed);
+            // Connection counts are kept so the open count stays right
+        }
+    }
+    rejectedRequests = 0;
     startTime = std::chrono::high_resolution_clock::now();
-} 
\ No newline at end of file
+}
+
+void HFTServer::placeThread(const std::vector<int>& cpus, int index, bool realtime, const std::string& name) {
+    if (!cpus.empty()) {
+        int cpu = cpus[static_cast<size_t>(index) % cpus.size()];
+        if (!pinCurrentThread(cpu)) {
+            LOG_WARN("Failed to pin {} to CPU {}", name, cpu);
+        }
+    }
+    if (realtime && threadConfig.realtimePriority > 0 && !setRealtimePriority(threadConfig.realtimePriority)) {
+        LOG_WARN("Failed to give {} SCHED_FIFO priority {}", name, threadConfig.realtimePriority);
+    }
+    nameCurrentThread("hft " + name);
+    nameThread(name);
+    
+    // Fault in the thread's own state from its final core, so first-touch
+    // places it on that core's NUMA node
+    HFTResponseBuffer& arena = getResponseBuffer();
+    memset(arena.data, 0, sizeof(arena.data));
+    getSendBatch();
+}
+
+void HFTServer::applyBusyPoll(int clientSocket) {
+    int micros = threadConfig.busyPollMicros;
+    if (micros > 0 && setsockopt(clientSocket, SOL_SOCKET, SO_BUSY_POLL, &micros, sizeof(micros)) != 0) {
+        // Raising it above net.core.busy_read needs CAP_NET_ADMIN
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true)) {
+            LOG_WARN("Failed to set SO_BUSY_POLL {}us: {}", micros, strerror(errno));
+        }
+    }
+}
+
+void HFTServer::nameThread(const std::string& name) {
+    HFTThreadMetrics& metrics = getThreadMetrics();
+    std::lock_guard<std::mutex> lock(metricsMutex);
+    metrics.name = name;
+}
+
+void HFTServer::startAdmin() {
+    if (adminPort <= 0 || admin) {
+        return;
+    }
+    admin.reset(new MetricsEndpoint(adminAddress, adminPort, [this]() { return renderMetrics(); }));
+    admin->start();
+    std::cout << "HFT metrics on http://" << adminAddress << ":" << adminPort << "/metrics" << std::endl;
+}
+
+// Quantiles every latency summary reports, as fractions and as labels
+static const double HFT_METRIC_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+static const char* const HFT_METRIC_QUANTILE_LABELS[] = {"0.5", "0.9", "0.99", "0.999"};
+
+// A null `label` leaves the summary unlabeled
+static void addLatencySummary(MetricsText& out, const std::string& name, const char* label, const std::string& value,
+                              const LatencyHistogram& histogram) {
+    for (size_t i = 0; i < sizeof(HFT_METRIC_QUANTILES) / sizeof(HFT_METRIC_QUANTILES[0]); ++i) {
+        double seconds = histogram.percentile(HFT_METRIC_QUANTILES[i] * 100.0) / 1e9;
+        if (label) {
+            out.sample(name.c_str(), seconds, label, value, "quantile", HFT_METRIC_QUANTILE_LABELS[i]);
+        } else {
+            out.sample(name.c_str(), seconds, "quantile", HFT_METRIC_QUANTILE_LABELS[i]);
+        }
+    }
+    out.sample((name + "_sum").c_str(), histogram.totalNanos() / 1e9, label, value);
+    out.sample((name + "_count").c_str(), static_cast<double>(histogram.count()), label, value);
+}
+
+std::string HFTServer::renderMetrics() const {
+    HFTLatencyReport report = getLatencyReport();
+    MetricsText out;
+    
+    out.header("hft_requests_total", "Requests handled, by service", "counter");
+    for (size_t i = 0; i < report.services.size(); ++i) {
+        out.sample("hft_requests_total", static_cast<double>(report.services[i].count()), "service", report.serviceNames[i]);
+    }
+    out.header("hft_request_errors_total", "Requests a service answered with an ERROR reply", "counter");
+    for (size_t i = 0; i < report.serviceErrors.size(); ++i) {
+        out.sample("hft_request_errors_total", static_cast<double>(report.serviceErrors[i]), "service", report.serviceNames[i]);
+    }
+    out.header("hft_unhandled_requests_total", "Requests refused by an interceptor or naming no known command", "counter");
+    out.sample("hft_unhandled_requests_total", static_cast<double>(report.unhandled));
+    out.header("hft_rejected_requests_total", "Requests shed by admission control or a full queue", "counter");
+    out.sample("hft_rejected_requests_total", static_cast<double>(getRejectedRequests()));
+    
+    out.header("hft_service_latency_seconds", "Interceptor and service time, by service", "summary");
+    for (size_t i = 0; i < report.services.size(); ++i) {
+        addLatencySummary(out, "hft_service_latency_seconds", "service", report.serviceNames[i], report.services[i]);
+    }
+    out.header("hft_stage_latency_seconds", "Time requests spend in each stage, from recv() to reply", "summary");
+    for (int stage = 0; stage < HFT_STAGE_COUNT; ++stage) {
+        addLatencySummary(out, "hft_stage_latency_seconds", "stage", hftStageName(stage), report.stages[stage]);
+    }
+    
+    // Queue sizes are approximate while producers and consumers are running
+    const HFTExecutor* executors[] = {&workers, &blockingPool};
+    out.header("hft_queue_depth", "Requests waiting for a pool thread", "gauge");
+    for (const HFTExecutor* executor : executors) {
+        if (executor->queue) {
+            out.sample("hft_queue_depth", static_cast<double>(executor->queue->size()), "executor", executor->name);
+        }
+    }
+    out.header("hft_queue_capacity", "Requests a pool queues before refusing more", "gauge");
+    for (const HFTExecutor* executor : executors) {
+        if (executor->queue) {
+            out.sample("hft_queue_capacity", static_cast<double>(executor->queue->capacity()), "executor", executor->name);
+        }
+    }
+    
+    {
+        uint64_t now = monotonicNanos();
+        std::lock_guard<std::mutex> lock(metricsMutex);
+        out.header("hft_thread_busy_seconds_total", "Time each thread spent handling work rather than waiting", "counter");
+        for (const auto& metrics : threadMetrics) {
+            out.sample("hft_thread_busy_seconds_total", metrics->busyNanos.load() / 1e9, "thread", metrics->name);
+        }
+        out.header("hft_thread_utilization", "Busy fraction of each thread since it started or metrics were reset", "gauge");
+        for (const auto& metrics : threadMetrics) {
+            uint64_t since = metrics->busySince.load(std::memory_order_relaxed);
+            double elapsed = now > since ? static_cast<double>(now - since) : 0;
+            out.sample("hft_thread_utilization", elapsed > 0 ? metrics->busyNanos.load() / elapsed : 0, "thread",
+                       metrics->name);
+        }
+    }
+    
+    uint64_t open = report.connectionsOpened > report.connectionsClosed ? report.connectionsOpened - report.connectionsClosed : 0;
+    out.header("hft_open_connections", "Client connections currently open", "gauge");
+    out.sample("hft_open_connections", static_cast<double>(open));
+    out.header("hft_connections_accepted_total", "Client connections accepted", "counter");
+    out.sample("hft_connections_accepted_total", static_cast<double>(report.connectionsOpened));
+    out.header("hft_connections_reaped_total", "Connections closed by the idle timeout", "counter");
+    out.sample("hft_connections_reaped_total", static_cast<double>(report.connectionsReaped));
+    
+    out.header("hft_received_bytes_total", "Bytes read from clients", "counter");
+    out.sample("hft_received_bytes_total", static_cast<double>(report.bytesReceived));
+    out.header("hft_sent_bytes_total", "Bytes written to clients, framing and sendfile() included", "counter");
+    out.sample("hft_sent_bytes_total", static_cast<double>(report.bytesSent));
+    out.header("hft_received_frames_total", "Request frames read", "counter");
+    out.sample("hft_received_frames_total", static_cast<double>(report.framesReceived));
+    out.header("hft_sent_frames_total", "Reply frames written", "counter");
+    out.sample("hft_sent_frames_total", static_cast<double>(report.framesSent));
+    out.header("hft_recv_calls_total", "Reads that returned data", "counter");
+    out.sample("hft_recv_calls_total", static_cast<double>(report.recvCalls));
+    out.header("hft_write_calls_total", "Batched reply writes", "counter");
+    out.sample("hft_write_calls_total", static_cast<double>(report.writeCalls));
+    out.header("hft_deferred_writes_total", "Replies queued because the client's socket was full", "counter");
+    out.sample("hft_deferred_writes_total", static_cast<double>(report.writesDeferred));
+    out.header("hft_dropped_replies_total", "Replies for connections that were closed, failed or reused", "counter");
+    out.sample("hft_dropped_replies_total", static_cast<double>(report.repliesDropped));
+    
+    if (responseCache) {
+        ResponseCache::Stats cache = responseCache->stats();
+        out.header("hft_response_cache_hits_total", "Requests answered from the response cache", "counter");
+        out.sample("hft_response_cache_hits_total", static_cast<double>(cache.hits));
+        out.header("hft_response_cache_misses_total", "Cacheable requests their service had to answer", "counter");
+        out.sample("hft_response_cache_misses_total", static_cast<double>(cache.misses));
+        out.header("hft_response_cache_evictions_total", "Replies evicted to stay within the size bound", "counter");
+        out.sample("hft_response_cache_evictions_total", static_cast<double>(cache.evictions));
+        out.header("hft_response_cache_entries", "Replies held, stale ones included until reclaimed", "gauge");
+        out.sample("hft_response_cache_entries", static_cast<double>(cache.entries));
+        out.header("hft_response_cache_bytes", "Bytes held by the response cache", "gauge");
+        out.sample("hft_response_cache_bytes", static_cast<double>(cache.bytes));
+    }
+    
+    if (tlsContext) {
+        out.header("hft_tls_handshakes_total", "TLS handshakes, by how they ended", "counter");
+        out.sample("hft_tls_handshakes_total", static_cast<double>(report.tlsHandshakes - report.tlsResumed), "result", "full");
+        out.sample("hft_tls_handshakes_total", static_cast<double>(report.tlsResumed), "result", "resumed");
+        out.sample("hft_tls_handshakes_total", static_cast<double>(report.tlsHandshakeFailures), "result", "failed");
+        out.header("hft_tls_handshake_seconds", "Time from accept to a completed TLS handshake", "summary");
+        addLatencySummary(out, "hft_tls_handshake_seconds", nullptr, "", report.tlsHandshake);
+        out.header("hft_tls_offloaded_connections_total", "TLS connections whose records the kernel took over", "counter");
+        out.sample("hft_tls_offloaded_connections_total", static_cast<double>(report.tlsOffloaded));
+        out.header("hft_tls_record_overhead_bytes_total", "Estimated bytes TLS records added to replies", "counter");
+        out.sample("hft_tls_record_overhead_bytes_total", static_cast<double>(report.tlsRecordOverhead));
+    }
+    
+    out.header("hft_log_records_dropped_total", "Log records lost to full logger rings", "counter");
+    out.sample("hft_log_records_dropped_total", static_cast<double>(AsyncLogger::getInstance().droppedCount()));
+    return out.str();
+}
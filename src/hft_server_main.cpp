@@ -1,49 +1,420 @@
 #include "../include/hft_server.hpp"
 #include "../include/services.hpp"
 #include "../include/interceptors.hpp"
+#include "../include/static_pipeline.hpp"
+#include "../include/async_logger.hpp"
+#include "../include/cpu_affinity.hpp"
 #include <iostream>
+#include <fstream>
 #include <signal.h>
 #include <chrono>
 #include <thread>
+#include <string>
+#include <iomanip>
+#include <limits>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <unistd.h>
 
 HFTServer* g_server = nullptr;
 
+// The first signal drains, a second one stops at once. Only async-signal-safe
+// calls here; start() returns and main() shuts down.
 void signalHandler(int signum) {
-    std::cout << "\nReceived signal " << signum << ". Shutting down HFT server..." << std::endl;
+    (void)signum;
+    static const char message[] = "\nShutting down HFT server (signal again to skip the drain)...\n";
+    ssize_t written = write(STDOUT_FILENO, message, sizeof(message) - 1);
+    (void)written;
     if (g_server) {
-        g_server->stop();
+        bool first = g_server->getStopRequest() == HFTStopMode::None;
+        g_server->requestStop(first ? HFTStopMode::Drain : HFTStopMode::Immediate);
     }
-    exit(0);
 }
 
-void printPerformanceStats(const HFTServer* server) {
-    auto requests = server->getTotalRequests();
-    auto avgLatency = server->getAverageLatency();
+static void printLatencyRow(const std::string& name, const LatencyHistogram& histogram) {
+    std::cout << "  " << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(2)
+              << " n=" << std::setw(10) << histogram.count()
+              << "  p50=" << std::setw(9) << histogram.percentile(50.0) / 1000.0
+              << "  p99=" << std::setw(9) << histogram.percentile(99.0) / 1000.0
+              << "  p99.9=" << std::setw(9) << histogram.percentile(99.9) / 1000.0
+              << "  max=" << std::setw(9) << histogram.max() / 1000.0 << " μs" << std::endl;
+}
+
+// Throughput is measured over the interval since the previous report, whose
+// count and time are carried in `lastRequests` and `lastTime`
+void printPerformanceStats(const HFTServer* server, uint64_t& lastRequests,
+                           std::chrono::steady_clock::time_point& lastTime) {
+    HFTLatencyReport report = server->getLatencyReport();
+    uint64_t requests = report.stages[HFT_STAGE_TOTAL].count();
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastTime).count();
+    uint64_t interval = requests >= lastRequests ? requests - lastRequests : requests;
+    lastRequests = requests;
+    lastTime = now;
     
     std::cout << "\n=== HFT Performance Statistics ===" << std::endl;
     std::cout << "Total Requests: " << requests << std::endl;
-    std::cout << "Average Latency: " << avgLatency << " μs" << std::endl;
+    std::cout << "Rejected Requests: " << server->getRejectedRequests() << std::endl;
+    std::cout << "Open Connections: " << report.connectionsOpened - report.connectionsClosed << std::endl;
+    std::cout << "Bytes In/Out: " << report.bytesReceived << " / " << report.bytesSent << std::endl;
+    if (report.tlsHandshakes + report.tlsHandshakeFailures > 0) {
+        std::cout << "TLS Handshakes: " << report.tlsHandshakes << " (" << report.tlsResumed << " resumed, "
+                  << report.tlsHandshakeFailures << " failed, " << report.tlsOffloaded << " offloaded)" << std::endl;
+    }
+    std::cout << "Dropped Log Records: " << AsyncLogger::getInstance().droppedCount() << std::endl;
+    std::cout << "Requests/sec: " << static_cast<uint64_t>(seconds > 0 ? interval / seconds : 0) << std::endl;
+    if (report.recvCalls > 0 && report.writeCalls > 0) {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Frames per recv: " << static_cast<double>(report.framesReceived) / report.recvCalls
+                  << " (" << report.recvCalls << " calls)" << std::endl
+                  << "Frames per write: " << static_cast<double>(report.framesSent) / report.writeCalls
+                  << " (" << report.writeCalls << " calls)" << std::endl;
+    }
     if (requests > 0) {
-        auto now = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
-        std::cout << "Requests/sec: " << (requests / std::max(1ULL, static_cast<unsigned long long>(duration))) << std::endl;
+        std::cout << "Latency by stage:" << std::endl;
+        for (int stage = 0; stage < HFT_STAGE_COUNT; ++stage) {
+            if (report.stages[stage].count() > 0) {
+                printLatencyRow(hftStageName(stage), report.stages[stage]);
+            }
+        }
+        std::cout << "Service time by service:" << std::endl;
+        for (size_t i = 0; i < report.services.size(); ++i) {
+            if (report.services[i].count() > 0) {
+                printLatencyRow(report.serviceNames[i], report.services[i]);
+            }
+        }
     }
     std::cout << "=================================" << std::endl;
 }
 
+// Reads `key value` (or `key = value`) lines as the arguments `--key value`,
+// so a file holds the same settings as the command line; a key on its own is
+// a flag. Blank lines and # comments are skipped.
+static bool readConfigFile(const std::string& path, std::vector<std::string>& args) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos) continue;
+        size_t end = line.find_first_of(" \t\r=", start);
+        args.push_back("--" + line.substr(start, end - start));
+        if (end == std::string::npos) continue;
+        
+        size_t value = line.find_first_not_of(" \t\r=", end);
+        if (value != std::string::npos) {
+            size_t last = line.find_last_not_of(" \t\r");
+            args.push_back(line.substr(value, last + 1 - value));
+        }
+    }
+    return true;
+}
+
+// Parses all of `text` as a decimal number no larger than `max`
+static bool parseNumber(const std::string& text, uint64_t max, uint64_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    value = 0;
+    for (char digit : text) {
+        uint64_t next = static_cast<uint64_t>(digit - '0');
+        if (value > (max - next) / 10) {
+            return false;
+        }
+        value = value * 10 + next;
+    }
+    return true;
+}
+
+template<typename T>
+static bool parseNumberOption(const std::string& name, const std::string& text, T& value,
+                              uint64_t max = static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+    uint64_t parsed;
+    if (!parseNumber(text, max, parsed)) {
+        std::cerr << "Invalid value for " << name << ": " << text << std::endl;
+        return false;
+    }
+    value = static_cast<T>(parsed);
+    return true;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [port | --port N] [--reactors N] [--wait spin|hybrid|block] [--spin N]\n"
+              << "    [--workers N] [--queue-depth N] [--blocking-threads N] [--blocking-depth N]\n"
+              << "    [--no-batch] [--engine epoll|io_uring] [--rate-limit PER_SEC] [--burst N]\n"
+              << "    [--pipeline dynamic|static] [--fsync none|data|direct]\n"
+              << "    [--admin-port N] [--admin-address ADDR]\n"
+              << "    [--acceptor-cpu N] [--worker-cpus LIST] [--blocking-cpus LIST]\n"
+              << "    [--reactor-cpus LIST] [--sched-fifo PRIO] [--busy-poll USEC]\n"
+              << "    [--incoming-cpu] [--config FILE]\n"
+              << "    [--cache CMD[:TTL_MS],...] [--cache-bytes N] [--idle-timeout SECONDS]\n"
+              << "    [--drain-timeout MS] [--handoff-socket PATH]\n"
+              << "    [--take-over PATH [--take-connections]]\n"
+              << "    [--tls-cert FILE --tls-key FILE [--tls-ca FILE] [--no-ktls]]" << std::endl;
+}
+
+static bool parseCpuOption(const std::string& name, const std::string& value, std::vector<int>& cpus) {
+    if (!parseCpuList(value, cpus)) {
+        std::cerr << "Invalid CPU list for " << name << ": " << value << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Opts in the commands of a spec like "ECHO,CAL,READ:500", where a number
+// after the colon is the TTL in milliseconds; none caches until invalidated
+static bool parseCacheSpec(const std::string& spec, ResponseCache& cache, std::string& summary) {
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == std::string::npos) comma = spec.size();
+        std::string item = spec.substr(start, comma - start);
+        start = comma + 1;
+        
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        uint64_t ttlMillis = 0;
+        if (colon != std::string::npos) {
+            std::string ttl = item.substr(colon + 1);
+            if (!parseNumber(ttl, std::numeric_limits<uint64_t>::max() / 1000000ULL, ttlMillis)) {
+                return false;
+            }
+        }
+        if (name.empty() || cache.caches(StringView(name))) {
+            return false;
+        }
+        cache.cacheCommand(name, ttlMillis * 1000000ULL);
+        if (!summary.empty()) summary += ", ";
+        summary += name;
+        if (ttlMillis > 0) summary += " (" + std::to_string(ttlMillis) + " ms)";
+    }
+    return true;
+}
+
+static void printCpuPlacement(const char* role, const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return;
+    }
+    std::cout << role << " CPUs: " << formatCpuList(cpus);
+    std::string nodes = numaNodesOf(cpus);
+    if (!nodes.empty()) {
+        std::cout << " (NUMA node " << nodes << ")";
+    }
+    std::cout << std::endl;
+}
+
 int main(int argc, char* argv[]) {
     int port = 8080;
+    int reactors = 0;
+    int workerThreads = HFT_THREAD_POOL_SIZE;
+    size_t queueDepth = HFT_QUEUE_DEPTH;
+    int blockingThreads = HFT_BLOCKING_POOL_SIZE;
+    size_t blockingDepth = HFT_BLOCKING_QUEUE_DEPTH;
+    bool sendBatching = true;
+    HFTEngine engine = HFTEngine::Epoll;
+    uint64_t rateLimit = 0;
+    uint64_t rateBurst = 0;
+    bool staticPipeline = false;
+    FileSyncPolicy syncPolicy = FileSyncPolicy::None;
+    std::string adminAddress = "127.0.0.1";
+    int adminPort = 0;
     
-    if (argc > 1) {
-        port = std::stoi(argv[1]);
+    WaitStrategyConfig waitConfig;
+    HFTThreadConfig threadConfig;
+    std::string cacheSpec;
+    size_t cacheBytes = RESPONSE_CACHE_MAX_BYTES;
+    int idleTimeout = 0;
+    int drainTimeout = HFT_DRAIN_TIMEOUT_MS;
+    std::string handoffPath;
+    std::string takeOverPath;
+    bool takeConnections = false;
+    TlsConfig tlsConfig;
+    
+    // Options are listed in printUsage(). A config file's settings take its
+    // place in the argument list, so options after --config override it.
+    std::vector<std::string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        std::string arg = args[i];
+        if (arg == "--config" && i + 1 < args.size()) {
+            std::string path = args[i + 1];
+            std::vector<std::string> settings;
+            if (!readConfigFile(path, settings)) {
+                std::cerr << "Cannot read config file: " << path << std::endl;
+                return 1;
+            }
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            args.insert(args.begin() + i, settings.begin(), settings.end());
+            --i;
+        } else if (arg == "--port" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], port, 65535)) return 1;
+        } else if (arg == "--acceptor-cpu" && i + 1 < args.size()) {
+            if (!parseCpuOption(arg, args[++i], threadConfig.acceptorCpus)) return 1;
+        } else if (arg == "--worker-cpus" && i + 1 < args.size()) {
+            if (!parseCpuOption(arg, args[++i], threadConfig.workerCpus)) return 1;
+        } else if (arg == "--blocking-cpus" && i + 1 < args.size()) {
+            if (!parseCpuOption(arg, args[++i], threadConfig.blockingCpus)) return 1;
+        } else if (arg == "--reactor-cpus" && i + 1 < args.size()) {
+            if (!parseCpuOption(arg, args[++i], threadConfig.reactorCpus)) return 1;
+        } else if (arg == "--sched-fifo" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], threadConfig.realtimePriority)) return 1;
+        } else if (arg == "--busy-poll" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], threadConfig.busyPollMicros)) return 1;
+        } else if (arg == "--cache" && i + 1 < args.size()) {
+            cacheSpec = args[++i];
+        } else if (arg == "--cache-bytes" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], cacheBytes)) return 1;
+        } else if (arg == "--idle-timeout" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], idleTimeout)) return 1;
+        } else if (arg == "--drain-timeout" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], drainTimeout)) return 1;
+        } else if (arg == "--handoff-socket" && i + 1 < args.size()) {
+            handoffPath = args[++i];
+        } else if (arg == "--take-over" && i + 1 < args.size()) {
+            takeOverPath = args[++i];
+        } else if (arg == "--take-connections") {
+            takeConnections = true;
+        } else if (arg == "--tls-cert" && i + 1 < args.size()) {
+            tlsConfig.certFile = args[++i];
+        } else if (arg == "--tls-key" && i + 1 < args.size()) {
+            tlsConfig.keyFile = args[++i];
+        } else if (arg == "--tls-ca" && i + 1 < args.size()) {
+            tlsConfig.caFile = args[++i];
+        } else if (arg == "--no-ktls") {
+            tlsConfig.kernelOffload = false;
+        } else if (arg == "--incoming-cpu") {
+            threadConfig.incomingCpu = true;
+        } else if (arg == "--reactors" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], reactors)) return 1;
+        } else if (arg == "--wait" && i + 1 < args.size()) {
+            if (!parseWaitMode(args[++i], waitConfig.mode)) {
+                std::cerr << "Unknown wait strategy: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--spin" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], waitConfig.spinIterations)) return 1;
+        } else if (arg == "--workers" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], workerThreads)) return 1;
+        } else if (arg == "--queue-depth" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], queueDepth)) return 1;
+        } else if (arg == "--blocking-threads" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], blockingThreads)) return 1;
+        } else if (arg == "--blocking-depth" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], blockingDepth)) return 1;
+        } else if (arg == "--no-batch") {
+            sendBatching = false;
+        } else if (arg == "--engine" && i + 1 < args.size()) {
+            if (!parseEngine(args[++i], engine)) {
+                std::cerr << "Unknown engine: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--rate-limit" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], rateLimit)) return 1;
+        } else if (arg == "--burst" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], rateBurst)) return 1;
+        } else if (arg == "--pipeline" && i + 1 < args.size()) {
+            std::string mode = args[++i];
+            if (mode != "static" && mode != "dynamic") {
+                std::cerr << "Unknown pipeline: " << mode << std::endl;
+                return 1;
+            }
+            staticPipeline = mode == "static";
+        } else if (arg == "--fsync" && i + 1 < args.size()) {
+            if (!parseSyncPolicy(args[++i], syncPolicy)) {
+                std::cerr << "Unknown fsync policy: " << args[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "--admin-port" && i + 1 < args.size()) {
+            if (!parseNumberOption(arg, args[++i], adminPort, 65535)) return 1;
+        } else if (arg == "--admin-address" && i + 1 < args.size()) {
+            adminAddress = args[++i];
+        } else if (arg == "--help" || arg == "-h") {
+            printUsage(argv[0]);
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-') {
+            if (!parseNumberOption("port", arg, port, 65535)) return 1;
+        } else {
+            std::cerr << "Unknown option or missing value: " << arg << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
+    std::shared_ptr<ResponseCache> responses;
+    std::string cachedCommands;
+    if (!cacheSpec.empty()) {
+        try {
+            responses = std::make_shared<ResponseCache>(cacheBytes);
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid --cache-bytes: " << e.what() << std::endl;
+            return 1;
+        }
+        if (!parseCacheSpec(cacheSpec, *responses, cachedCommands)) {
+            std::cerr << "Invalid cache spec: " << cacheSpec << std::endl;
+            return 1;
+        }
     }
     
     std::cout << "Starting HFT-Optimized Socket Server" << std::endl;
     std::cout << "====================================" << std::endl;
     std::cout << "Port: " << port << std::endl;
-    std::cout << "Thread Pool Size: " << HFT_THREAD_POOL_SIZE << std::endl;
+    if (reactors > 0) {
+        std::cout << "Mode: " << reactors << " shard-per-core reactors" << std::endl;
+    } else {
+        std::cout << "Thread Pool Size: " << workerThreads << " (queue " << queueDepth << ")" << std::endl;
+    }
+    std::cout << "Blocking Pool Size: " << blockingThreads << " (queue " << blockingDepth << ")" << std::endl;
+    std::cout << "Wait Strategy: " << waitModeName(waitConfig.mode);
+    if (waitConfig.mode == WaitMode::Hybrid) {
+        std::cout << " (spin " << waitConfig.spinIterations << ", yield " << waitConfig.yieldIterations << ")";
+    }
+    std::cout << std::endl;
+    std::cout << "I/O Engine: " << engineName(engine) << std::endl;
+    if (rateLimit > 0) {
+        std::cout << "Rate Limit: " << rateLimit << "/s per token (burst " << (rateBurst ? rateBurst : rateLimit) << ")" << std::endl;
+    }
+    std::cout << "Pipeline: " << (staticPipeline ? "static" : "dynamic") << std::endl;
+    std::cout << "File Sync: " << syncPolicyName(syncPolicy) << std::endl;
+    std::cout << "Send Batching: " << (sendBatching ? "on" : "off") << std::endl;
+    if (responses) {
+        std::cout << "Response Cache: " << cachedCommands << " in " << cacheBytes << " bytes" << std::endl;
+    }
+    if (idleTimeout > 0) {
+        std::cout << "Idle Timeout: " << idleTimeout << " s" << std::endl;
+    }
+    std::cout << "Drain Timeout: " << drainTimeout << " ms" << std::endl;
+    if (!handoffPath.empty()) {
+        std::cout << "Handoff Socket: " << handoffPath << std::endl;
+    }
+    if (!takeOverPath.empty()) {
+        std::cout << "Taking Over: " << takeOverPath << (takeConnections ? " (with connections)" : "") << std::endl;
+    }
+    if (!tlsConfig.certFile.empty()) {
+        std::cout << "TLS: " << tlsConfig.certFile << (tlsConfig.caFile.empty() ? "" : ", client certificates required")
+                  << ", kernel offload " << (tlsConfig.kernelOffload ? "on" : "off") << std::endl;
+    }
+    if (adminPort > 0) {
+        std::cout << "Metrics Endpoint: " << adminAddress << ":" << adminPort << std::endl;
+    }
     std::cout << "Buffer Size: " << HFT_BUFFER_SIZE << " bytes" << std::endl;
     std::cout << "Max Events: " << HFT_MAX_EVENTS << std::endl;
+    printCpuPlacement("Acceptor", threadConfig.acceptorCpus);
+    printCpuPlacement("Worker", threadConfig.workerCpus);
+    printCpuPlacement("Blocking", threadConfig.blockingCpus);
+    printCpuPlacement("Reactor", threadConfig.reactorCpus);
+    if (threadConfig.realtimePriority > 0) {
+        std::cout << "SCHED_FIFO Priority: " << threadConfig.realtimePriority << std::endl;
+    }
+    if (threadConfig.busyPollMicros > 0) {
+        std::cout << "Busy Poll: " << threadConfig.busyPollMicros << " us" << std::endl;
+    }
+    if (threadConfig.incomingCpu) {
+        std::cout << "SO_INCOMING_CPU: on" << std::endl;
+    }
     
     // Set up signal handling
     signal(SIGINT, signalHandler);
@@ -51,37 +422,117 @@ int main(int argc, char* argv[]) {
     
     try {
         g_server = HFTServer::getInstance();
+        g_server->setReactorCount(reactors);
+        g_server->setWaitStrategy(waitConfig);
+        g_server->setExecutorLimits(ExecutionClass::Worker, workerThreads, queueDepth);
+        g_server->setExecutorLimits(ExecutionClass::Blocking, blockingThreads, blockingDepth);
+        g_server->setSendBatching(sendBatching);
+        g_server->setIdleTimeout(idleTimeout);
+        g_server->setDrainTimeout(drainTimeout);
+        g_server->setHandoffPath(handoffPath);
+        g_server->setEngine(engine);
+        g_server->setThreadConfig(threadConfig);
+        if (adminPort > 0) {
+            g_server->setAdminEndpoint(adminAddress, adminPort);
+        }
+        if (!tlsConfig.certFile.empty()) {
+            g_server->setTls(TlsContext::createServer(tlsConfig));
+        }
         
-        // Add services
-        std::cout << "\n[SETUP] Adding services..." << std::endl;
-        g_server->addService(std::unique_ptr<EchoService>(new EchoService()));
-        g_server->addService(std::unique_ptr<CalculatorService>(new CalculatorService()));
-        g_server->addService(std::unique_ptr<FileService>(new FileService()));
+        FileService files;
+        files.setSyncPolicy(syncPolicy);
+        CalculatorService calculator;
+        if (responses) {
+            g_server->setResponseCache(responses);
+            files.setResponseCache(responses);
+            calculator.setResponseCache(responses);
+        }
         
-        // Add interceptors (minimal for HFT)
-        std::cout << "[SETUP] Adding interceptors..." << std::endl;
-        // Note: Removed logging and rate limiting for HFT performance
-        g_server->addInterceptor(std::unique_ptr<AuthenticationInterceptor>(new AuthenticationInterceptor("secret123")));
+        if (staticPipeline) {
+            // Same services and interceptors, compiled into one pipeline
+            std::cout << "\n[SETUP] Building static pipeline..." << std::endl;
+            if (rateLimit > 0) {
+                typedef StaticPipeline<AuthenticationInterceptor, RateLimitingInterceptor,
+                                       EchoService, CalculatorService, FileService> Pipeline;
+                AuthenticationInterceptor auth("secret123");
+                std::unique_ptr<Pipeline> built(new Pipeline(
+                    auth, RateLimitingInterceptor(rateLimit, rateBurst, auth.tokenStore()),
+                    EchoService(), calculator, files));
+                built->setResponseCache(responses);
+                g_server->setPipeline(std::move(built));
+            } else {
+                typedef StaticPipeline<AuthenticationInterceptor, EchoService, CalculatorService, FileService> Pipeline;
+                std::unique_ptr<Pipeline> built(new Pipeline(
+                    AuthenticationInterceptor("secret123"), EchoService(), calculator, files));
+                built->setResponseCache(responses);
+                g_server->setPipeline(std::move(built));
+            }
+        } else {
+            // Add services
+            std::cout << "\n[SETUP] Adding services..." << std::endl;
+            g_server->addService(std::unique_ptr<EchoService>(new EchoService()));
+            g_server->addService(std::unique_ptr<CalculatorService>(new CalculatorService(calculator)));
+            g_server->addService(std::unique_ptr<FileService>(new FileService(files)));
+            
+            // Add interceptors (minimal for HFT)
+            std::cout << "[SETUP] Adding interceptors..." << std::endl;
+            // Note: Removed logging for HFT performance; rate limiting is opt-in
+            std::unique_ptr<AuthenticationInterceptor> auth(new AuthenticationInterceptor("secret123"));
+            std::shared_ptr<AuthTokenStore> validTokens = auth->tokenStore();
+            g_server->addInterceptor(std::move(auth));
+            if (rateLimit > 0) {
+                g_server->addInterceptor(std::unique_ptr<RateLimitingInterceptor>(new RateLimitingInterceptor(rateLimit, rateBurst, validTokens)));
+            }
+        }
         
         std::cout << "\n[INFO] Available commands:" << std::endl;
         std::cout << "  TOKEN:secret123 ECHO <message>     - Echo service" << std::endl;
         std::cout << "  TOKEN:secret123 CAL <expression>   - Calculator service" << std::endl;
         std::cout << "  TOKEN:secret123 READ <filename>    - File read service" << std::endl;
         std::cout << "  TOKEN:secret123 WRITE <filename> <content> - File write service" << std::endl;
+        std::cout << "  TOKEN:secret123 WRITE_OPEN <filename>, WRITE_CHUNK <handle> <offset> <data>," << std::endl;
+        std::cout << "                  WRITE_CLOSE <handle> [size] - Streaming upload" << std::endl;
         
         std::cout << "\n[INFO] HFT Server will start on port " << port << std::endl;
         std::cout << "[INFO] Press Ctrl+C to stop the server" << std::endl;
         
         // Start performance monitoring thread
+        std::mutex monitorMutex;
+        std::condition_variable monitorWake;
+        bool monitorDone = false;
+        uint64_t lastRequests = 0;
+        auto lastTime = std::chrono::steady_clock::now();
         std::thread monitorThread([&]() {
-            while (true) {
-                std::this_thread::sleep_for(std::chrono::seconds(10));
-                printPerformanceStats(g_server);
+            std::unique_lock<std::mutex> lock(monitorMutex);
+            while (!monitorWake.wait_for(lock, std::chrono::seconds(10), [&]() { return monitorDone; })) {
+                printPerformanceStats(g_server, lastRequests, lastTime);
             }
         });
         
-        // Start the server
-        g_server->start(port);
+        // Start the server, last, once the old one's listeners are ours
+        std::string failure;
+        try {
+            if (!takeOverPath.empty()) {
+                size_t listeners = g_server->takeOver(takeOverPath, takeConnections);
+                std::cout << "[SETUP] Took over " << listeners << " listener(s) from " << takeOverPath << std::endl;
+            }
+            g_server->start(port);
+        } catch (const std::exception& e) {
+            failure = e.what();
+        }
+        g_server->stop();
+        
+        {
+            std::lock_guard<std::mutex> lock(monitorMutex);
+            monitorDone = true;
+        }
+        monitorWake.notify_all();
+        monitorThread.join();
+        if (!failure.empty()) {
+            std::cerr << "Error: " << failure << std::endl;
+            return 1;
+        }
+        printPerformanceStats(g_server, lastRequests, lastTime);
         
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,64 @@
+#include "../include/interceptor_chain.hpp"
+#include <algorithm>
+
+void InterceptorChain::add(std::unique_ptr<IInterceptor> interceptor) {
+    int priority = interceptor->getPriority();
+    auto position = std::upper_bound(interceptors.begin(), interceptors.end(), priority,
+                                     [](int value, const std::unique_ptr<IInterceptor>& existing) {
+                                         return value < existing->getPriority();
+                                     });
+    interceptors.insert(position, std::move(interceptor));
+}
+
+bool InterceptorChain::cloneInto(InterceptorChain& copy) const {
+    copy.interceptors.clear();
+    for (const auto& interceptor : interceptors) {
+        std::unique_ptr<IInterceptor> clone = interceptor->clone();
+        if (!clone) {
+            copy.interceptors.clear();
+            return false;
+        }
+        // Already in order
+        copy.interceptors.push_back(std::move(clone));
+    }
+    return true;
+}
+
+bool InterceptorChain::admit(StringView request) {
+    for (const auto& interceptor : interceptors) {
+        if (!interceptor->admit(request)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InterceptorChain::preProcess(StringView request, RequestContext& context) {
+    for (const auto& interceptor : interceptors) {
+        if (!interceptor->preProcess(request, context)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void InterceptorChain::postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
+    for (const auto& interceptor : interceptors) {
+        interceptor->postProcess(request, response, context);
+    }
+}
+
+bool InterceptorChain::preProcess(std::string& request) {
+    for (const auto& interceptor : interceptors) {
+        if (!interceptor->preProcess(request)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void InterceptorChain::postProcess(const std::string& request, std::string& response) {
+    for (const auto& interceptor : interceptors) {
+        interceptor->postProcess(request, response);
+    }
+}
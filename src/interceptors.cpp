@@ -1,38 +1,111 @@
 #include "../include/interceptors.hpp"
-#include <regex>
+#include "../include/async_logger.hpp"
 #include <chrono>
 
 bool LoggingInterceptor::preProcess(std::string& request) {
-    startTime = std::chrono::steady_clock::now();
-    std::cout << "[LOG] Processing request: " << request << std::endl;
+    startTime = monotonicNanos();
+    LOG_INFO("[LOG] Processing request: {}", request);
     return true;
 }
 
 void LoggingInterceptor::postProcess(const std::string& request, std::string& response) {
     (void)request; // Suppress unused parameter warning
-    auto endTime = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
-    std::cout << "[LOG] Request completed in " << duration.count() << "ms" << std::endl;
-    std::cout << "[LOG] Response: " << response << std::endl;
+    LOG_INFO("[LOG] Request completed in {}us, response: {}", (monotonicNanos() - startTime) / 1000, response);
 }
 
-bool AuthenticationInterceptor::preProcess(std::string& request) {
-    // Simple token validation
-    std::regex tokenRegex("TOKEN:([^\\s]+)");
-    std::smatch match;
-    
-    if (std::regex_search(request, match, tokenRegex)) {
-        std::string token = match[1];
-        if (token == validToken) {
-            // std::cout << "[AUTH] Authentication successful" << std::endl; // Disabled for HFT
-            return true;
+bool LoggingInterceptor::preProcess(StringView request, RequestContext& context) {
+    (void)context; // Suppress unused parameter warning
+    LOG_INFO("[LOG] Processing request: {}", request);
+    return true;
+}
+
+void LoggingInterceptor::postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
+    (void)request; // Suppress unused parameter warning
+    LOG_INFO("[LOG] Request completed in {}us, response: {}", (monotonicNanos() - context.startedAt) / 1000, response.view());
+}
+
+// Versions are unique across stores, so a thread's cache can never mistake a
+// new store at a recycled address for the one it cached
+static std::atomic<uint64_t> nextTokenVersion(1);
+
+AuthTokenSet::AuthTokenSet(const std::vector<std::string>& validTokens) : maxLength(0) {
+    for (const std::string& token : validTokens) {
+        if (token.empty()) continue;
+        tokens.push_back(token);
+        if (token.size() > maxLength) maxLength = token.size();
+    }
+}
+
+bool AuthTokenSet::contains(StringView token) const {
+    // Every candidate is compared over maxLength bytes with no early exit;
+    // bytes past either end compare as mismatches via the length check
+    unsigned char matched = 0;
+    for (const std::string& valid : tokens) {
+        unsigned char diff = static_cast<unsigned char>(valid.size() != token.size());
+        for (size_t i = 0; i < maxLength; ++i) {
+            unsigned char a = i < valid.size() ? static_cast<unsigned char>(valid[i]) : 0;
+            unsigned char b = i < token.size() ? static_cast<unsigned char>(token[i]) : 0;
+            diff |= a ^ b;
         }
+        matched |= static_cast<unsigned char>(diff == 0);
+    }
+    return matched != 0;
+}
+
+AuthTokenStore::AuthTokenStore(const std::vector<std::string>& tokens)
+    : version(nextTokenVersion.fetch_add(1)), current(std::make_shared<AuthTokenSet>(tokens)) {}
+
+void AuthTokenStore::rotate(const std::vector<std::string>& tokens) {
+    std::shared_ptr<const AuthTokenSet> next = std::make_shared<AuthTokenSet>(tokens);
+    std::lock_guard<std::mutex> lock(mutex);
+    current = next;
+    version.store(nextTokenVersion.fetch_add(1), std::memory_order_release);
+}
+
+std::shared_ptr<const AuthTokenSet> AuthTokenStore::snapshot(uint64_t& snapshotVersion) {
+    std::lock_guard<std::mutex> lock(mutex);
+    snapshotVersion = version.load(std::memory_order_relaxed);
+    return current;
+}
+
+const AuthTokenSet& AuthTokenStore::tokens() {
+    // One cached set per thread, shared by every store; the unique versions
+    // make a switch between stores a plain cache miss
+    static thread_local uint64_t cachedVersion = 0;
+    static thread_local std::shared_ptr<const AuthTokenSet> cachedTokens;
+    if (cachedVersion != currentVersion()) {
+        cachedTokens = snapshot(cachedVersion);
+    }
+    return *cachedTokens;
+}
+
+AuthenticationInterceptor::AuthenticationInterceptor(const std::string& token)
+    : store(std::make_shared<AuthTokenStore>(std::vector<std::string>(1, token))) {}
+
+AuthenticationInterceptor::AuthenticationInterceptor(const std::vector<std::string>& tokens)
+    : store(std::make_shared<AuthTokenStore>(tokens)) {}
+
+bool AuthenticationInterceptor::accepts(const Command& command, bool parsed) const {
+    // The token is the TOKEN:<token> prefix parsed in place; no copies
+    if (parsed && !command.token.empty() && store->tokens().contains(command.token)) {
+        return true;
     }
     
-    std::cout << "[AUTH] Authentication failed" << std::endl;
+    LOG_WARN("[AUTH] Authentication failed");
     return false;
 }
 
+bool AuthenticationInterceptor::preProcess(std::string& request) {
+    Command command;
+    bool parsed = parseCommand(StringView(request), command);
+    return accepts(command, parsed);
+}
+
+bool AuthenticationInterceptor::preProcess(StringView request, RequestContext& context) {
+    (void)request; // Suppress unused parameter warning
+    return accepts(context.command, context.hasCommand);
+}
+
 void AuthenticationInterceptor::postProcess(const std::string& request, std::string& response) {
     (void)request; // Suppress unused parameter warning
     (void)response; // Suppress unused parameter warning
@@ -40,63 +113,92 @@ void AuthenticationInterceptor::postProcess(const std::string& request, std::str
     // Disabled for HFT performance
 }
 
-bool RateLimitingInterceptor::preProcess(std::string& request) {
+void AuthenticationInterceptor::postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
     (void)request; // Suppress unused parameter warning
-    auto now = std::chrono::steady_clock::now();
-    auto timeSinceReset = std::chrono::duration_cast<std::chrono::seconds>(now - lastReset);
-    
-    // Reset counter every minute
-    if (timeSinceReset.count() >= 60) {
-        currentRequests = 0;
-        lastReset = now;
-    }
-    
-    if (currentRequests >= maxRequests) {
-        std::cout << "[RATE] Rate limit exceeded (" << currentRequests << "/" << maxRequests << ")" << std::endl;
-        return false;
+    (void)response; // Suppress unused parameter warning
+    (void)context; // Suppress unused parameter warning
+}
+
+bool RateLimitingInterceptor::admit(StringView request) {
+    // Only a valid token gets its own bucket; anything else is charged to the
+    // shared unauthenticated one, keyed by the empty string
+    Command command;
+    StringView client;
+    if (tokens && parseCommand(request, command) && !command.token.empty() &&
+        tokens->tokens().contains(command.token)) {
+        client = command.token;
     }
-    
-    currentRequests++;
-    std::cout << "[RATE] Request allowed (" << currentRequests << "/" << maxRequests << ")" << std::endl;
+    return limiter->tryAcquire(client);
+}
+
+bool RateLimitingInterceptor::preProcess(std::string& request) {
+    (void)request; // Suppress unused parameter warning
+    // Requests are charged once, in admit()
+    return true;
+}
+
+bool RateLimitingInterceptor::preProcess(StringView request, RequestContext& context) {
+    (void)request; // Suppress unused parameter warning
+    (void)context; // Suppress unused parameter warning
     return true;
 }
 
 void RateLimitingInterceptor::postProcess(const std::string& request, std::string& response) {
     (void)request; // Suppress unused parameter warning
     (void)response; // Suppress unused parameter warning
-    // Can add rate limiting related response headers here
-    std::cout << "[RATE] Rate limiting post-processing completed" << std::endl;
+}
+
+void RateLimitingInterceptor::postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
+    (void)request; // Suppress unused parameter warning
+    (void)response; // Suppress unused parameter warning
+    (void)context; // Suppress unused parameter warning
 }
 
 bool ValidationInterceptor::preProcess(std::string& request) {
+    Command command;
+    bool parsed = parseCommand(StringView(request), command);
+    return validate(StringView(request), command, parsed);
+}
+
+bool ValidationInterceptor::preProcess(StringView request, RequestContext& context) {
+    return validate(request, context.command, context.hasCommand);
+}
+
+bool ValidationInterceptor::validate(StringView request, const Command& command, bool parsed) {
     // Basic request validation
     if (request.empty()) {
-        std::cout << "[VALID] Request is empty" << std::endl;
+        LOG_WARN("[VALID] Request is empty");
         return false;
     }
     
-    if (request.length() > 1000) {
-        std::cout << "[VALID] Request too long" << std::endl;
+    // Upload chunks carry file data and get a larger allowance
+    size_t limit = parsed && command.name == "WRITE_CHUNK" ? VALIDATION_MAX_CHUNK_SIZE : VALIDATION_MAX_REQUEST_SIZE;
+    if (request.length() > limit) {
+        LOG_WARN("[VALID] Request too long ({} bytes)", request.length());
         return false;
     }
     
-    // Check for basic command structure (commands come after TOKEN:)
-    std::vector<std::string> validCommands = {"ECHO", "CAL", "READ", "WRITE"};
+    // The command must be the first word after the optional TOKEN: prefix;
+    // a command name appearing elsewhere in the payload doesn't count
+    static const char* const validCommands[] = {"ECHO", "CAL", "READ", "WRITE",
+                                                "WRITE_OPEN", "WRITE_CHUNK", "WRITE_CLOSE", "WRITE_ABORT"};
     bool hasValidCommand = false;
     
-    for (const auto& cmd : validCommands) {
-        if (request.find(cmd) != std::string::npos) {
-            hasValidCommand = true;
-            break;
+    if (parsed) {
+        for (const char* cmd : validCommands) {
+            if (command.name == cmd) {
+                hasValidCommand = true;
+                break;
+            }
         }
     }
     
     if (!hasValidCommand) {
-        std::cout << "[VALID] No valid command found in request" << std::endl;
+        LOG_WARN("[VALID] No valid command found in request");
         return false;
     }
     
-    std::cout << "[VALID] Request validation passed" << std::endl;
+    LOG_DEBUG("[VALID] Request validation passed");
     return true;
 }
 
@@ -107,5 +209,15 @@ void ValidationInterceptor::postProcess(const std::string& request, std::string&
         response = "ERROR: Empty response";
     }
     
-    std::cout << "[VALID] Response validation completed" << std::endl;
-} 
\ No newline at end of file
+    LOG_DEBUG("[VALID] Response validation completed");
+}
+
+void ValidationInterceptor::postProcess(StringView request, ResponseWriter& response, RequestContext& context) {
+    (void)request; // Suppress unused parameter warning
+    (void)context; // Suppress unused parameter warning
+    if (response.empty()) {
+        response.assign("ERROR: Empty response");
+    }
+    
+    LOG_DEBUG("[VALID] Response validation completed");
+}
@@ -0,0 +1,176 @@
+#include "../include/io_uring.hpp"
+#ifdef HFT_HAVE_IO_URING
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+IoUring::IoUring()
+    : ringFd(-1), featureFlags(0), sqRing(MAP_FAILED), sqRingSize(0), cqRing(MAP_FAILED), cqRingSize(0),
+      sqes(nullptr), sqesSize(0), sqHead(nullptr), sqTail(nullptr), sqMask(0), sqArray(nullptr),
+      sqEntries(0), localTail(0), cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr) {}
+
+IoUring::~IoUring() {
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+    if (ringFd != -1) close(ringFd);
+}
+
+bool IoUring::init(unsigned entries, std::string& error) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Completions are only reaped by this thread, so skip the interrupts
+    // the kernel would otherwise send to run them promptly
+    params.flags = IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    ringFd = ioUringSetup(entries, &params);
+    if (ringFd < 0 && errno == EINVAL) {
+        memset(&params, 0, sizeof(params));
+        ringFd = ioUringSetup(entries, &params);
+    }
+    if (ringFd < 0) {
+        error = std::string("io_uring_setup failed: ") + strerror(errno);
+        return false;
+    }
+
+    featureFlags = params.features;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        error = "kernel io_uring lacks single mmap / extended wait arguments";
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+    cqRingSize = sqRingSize;
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        error = std::string("mmap of io_uring rings failed: ") + strerror(errno);
+        return false;
+    }
+    cqRing = sqRing;
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqeMemory = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED) {
+        error = std::string("mmap of io_uring entries failed: ") + strerror(errno);
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqeMemory);
+
+    char* sq = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    localTail = *sqTail;
+
+    char* cq = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (localTail - head >= sqEntries) {
+        return nullptr;
+    }
+    unsigned index = localTail & sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    localTail++;
+    return sqe;
+}
+
+int IoUring::submitAndWait(unsigned waitFor, int timeoutMillis) {
+    unsigned toSubmit = localTail - *sqTail;
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+
+    // GETEVENTS even when not waiting: it runs the deferred work that posts
+    // network completions to our queue
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    if (waitFor == 0 || timeoutMillis < 0) {
+        return ioUringEnter(ringFd, toSubmit, waitFor, flags, nullptr, _NSIG / 8);
+    }
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = timeoutMillis / 1000;
+    timeout.tv_nsec = static_cast<long long>(timeoutMillis % 1000) * 1000000;
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    return ioUringEnter(ringFd, toSubmit, waitFor, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+int IoUring::registerBuffers(unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, count));
+}
+
+ProvidedBufferPool::ProvidedBufferPool()
+    : ring(nullptr), storage(nullptr), count(0), bufferSize(0), groupId(0), recycleFlags(0) {}
+
+ProvidedBufferPool::~ProvidedBufferPool() {
+    delete[] storage;
+}
+
+bool ProvidedBufferPool::provide(uint16_t firstId, unsigned buffers, uint8_t flags, uint64_t userData) {
+    struct io_uring_sqe* sqe = ring->getSqe();
+    if (!sqe) {
+        ring->submitAndWait(0, 0);
+        sqe = ring->getSqe();
+        if (!sqe) return false;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(buffers);
+    sqe->addr = reinterpret_cast<uint64_t>(storage + static_cast<size_t>(firstId) * bufferSize);
+    sqe->len = bufferSize;
+    sqe->off = firstId;
+    sqe->buf_group = groupId;
+    sqe->flags = flags;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool ProvidedBufferPool::init(IoUring& owner, uint16_t group, unsigned bufferCount, unsigned size, std::string& error) {
+    ring = &owner;
+    groupId = group;
+    count = bufferCount;
+    bufferSize = size;
+    recycleFlags = ring->hasFeature(IORING_FEAT_CQE_SKIP) ? IOSQE_CQE_SKIP_SUCCESS : 0;
+    storage = new char[static_cast<size_t>(count) * bufferSize];
+
+    if (!provide(0, count, 0, 0) || ring->submitAndWait(1, -1) < 0) {
+        error = std::string("providing receive buffers failed: ") + strerror(errno);
+        return false;
+    }
+    int result = 0;
+    ring->drainCompletions([&](const struct io_uring_cqe& cqe) { result = cqe.res; });
+    if (result < 0) {
+        error = std::string("providing receive buffers failed: ") + strerror(-result);
+        return false;
+    }
+    return true;
+}
+
+void ProvidedBufferPool::recycle(uint16_t id) {
+    provide(id, 1, recycleFlags, 0);
+}
+#endif
@@ -0,0 +1,151 @@
+#include "../include/metrics_endpoint.hpp"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+void MetricsText::appendLabelValue(std::string& out, const std::string& value) {
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+}
+
+void MetricsText::header(const char* name, const char* help, const char* type) {
+    text += "# HELP ";
+    text += name;
+    text += ' ';
+    text += help;
+    text += "\n# TYPE ";
+    text += name;
+    text += ' ';
+    text += type;
+    text += '\n';
+}
+
+void MetricsText::sample(const char* name, double value, const char* labelName, const std::string& labelValue,
+                         const char* secondName, const std::string& secondValue) {
+    text += name;
+    if (labelName) {
+        text += '{';
+        text += labelName;
+        text += "=\"";
+        appendLabelValue(text, labelValue);
+        text += '"';
+        if (secondName) {
+            text += ',';
+            text += secondName;
+            text += "=\"";
+            appendLabelValue(text, secondValue);
+            text += '"';
+        }
+        text += '}';
+    }
+    // Counters print as integers; 15 digits keeps them exact up to 10^15
+    char number[32];
+    snprintf(number, sizeof(number), " %.15g\n", value);
+    text += number;
+}
+
+MetricsEndpoint::MetricsEndpoint(const std::string& bindAddress, int bindPort, Renderer renderer)
+    : address(bindAddress), port(bindPort), render(std::move(renderer)), listenSocket(-1), running(false) {}
+
+MetricsEndpoint::~MetricsEndpoint() {
+    stop();
+}
+
+void MetricsEndpoint::start() {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+        throw std::runtime_error("Invalid metrics address: " + address);
+    }
+
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket == -1) {
+        throw std::runtime_error("Failed to create metrics socket");
+    }
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listenSocket, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(listenSocket, 16) == -1) {
+        close(listenSocket);
+        listenSocket = -1;
+        throw std::runtime_error("Failed to bind metrics endpoint to " + address + ":" + std::to_string(port));
+    }
+
+    running = true;
+    thread = std::thread(&MetricsEndpoint::serve, this);
+}
+
+void MetricsEndpoint::stop() {
+    running = false;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    if (listenSocket != -1) {
+        close(listenSocket);
+        listenSocket = -1;
+    }
+}
+
+void MetricsEndpoint::serve() {
+    while (running) {
+        // Wake up now and then to notice stop()
+        struct pollfd ready;
+        ready.fd = listenSocket;
+        ready.events = POLLIN;
+        if (poll(&ready, 1, 100) <= 0) {
+            continue;
+        }
+        int clientSocket = accept(listenSocket, nullptr, nullptr);
+        if (clientSocket == -1) {
+            continue;
+        }
+        answer(clientSocket);
+        close(clientSocket);
+    }
+}
+
+void MetricsEndpoint::answer(int clientSocket) {
+    // Read the request head so the client doesn't see a reset, but don't
+    // wait on a scraper that never finishes sending one
+    struct timeval timeout;
+    timeout.tv_sec = METRICS_READ_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (METRICS_READ_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(clientSocket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string head;
+    char buffer[1024];
+    while (head.size() < METRICS_MAX_REQUEST && head.find("\r\n\r\n") == std::string::npos &&
+           head.find("\n\n") == std::string::npos) {
+        ssize_t bytesRead = recv(clientSocket, buffer, sizeof(buffer), 0);
+        if (bytesRead <= 0) break;
+        head.append(buffer, static_cast<size_t>(bytesRead));
+    }
+
+    std::string body = render();
+    std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                           std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+    response += body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t written = send(clientSocket, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (written <= 0) break;
+        sent += static_cast<size_t>(written);
+    }
+}
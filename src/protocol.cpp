@@ -0,0 +1,262 @@
+#include "../include/protocol.hpp"
+#include <cstring>
+#include <cerrno>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+
+void encodeFrameHeader(const FrameHeader& header, char* out) {
+    uint32_t length = htonl(header.length);
+    uint16_t opcode = htons(header.opcode);
+    uint16_t flags = htons(header.flags);
+    uint32_t requestId = htonl(header.requestId);
+    memcpy(out, &length, 4);
+    memcpy(out + 4, &opcode, 2);
+    memcpy(out + 6, &flags, 2);
+    memcpy(out + 8, &requestId, 4);
+}
+
+void decodeFrameHeader(const char* in, FrameHeader& header) {
+    uint32_t length;
+    uint16_t opcode;
+    uint16_t flags;
+    uint32_t requestId;
+    memcpy(&length, in, 4);
+    memcpy(&opcode, in + 4, 2);
+    memcpy(&flags, in + 6, 2);
+    memcpy(&requestId, in + 8, 4);
+    header.length = ntohl(length);
+    header.opcode = ntohs(opcode);
+    header.flags = ntohs(flags);
+    header.requestId = ntohl(requestId);
+}
+
+void encodeFrame(uint16_t opcode, uint32_t requestId, const char* payload, size_t length, std::string& out) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(length)), header);
+    out.append(header, FRAME_HEADER_SIZE);
+    out.append(payload, length);
+}
+
+ReceiveBuffer::ReceiveBuffer(size_t initialCapacity)
+    : storage(initialCapacity), readPos(0), writePos(0) {}
+
+char* ReceiveBuffer::prepareWrite(size_t minFree) {
+    if (readPos == writePos) {
+        readPos = writePos = 0;
+    }
+    if (storage.size() - writePos < minFree) {
+        // Slide the unread bytes to the front before growing
+        size_t unread = writePos - readPos;
+        if (readPos > 0) {
+            memmove(storage.data(), storage.data() + readPos, unread);
+            readPos = 0;
+            writePos = unread;
+        }
+        if (storage.size() - writePos < minFree) {
+            storage.resize(writePos + minFree);
+        }
+    }
+    return storage.data() + writePos;
+}
+
+int ReceiveBuffer::nextFrame(FrameHeader& header, const char*& payload) {
+    if (readableBytes() < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+
+    decodeFrameHeader(storage.data() + readPos, header);
+    if (header.length > FRAME_MAX_PAYLOAD) {
+        return -1;
+    }
+    if (readableBytes() < FRAME_HEADER_SIZE + header.length) {
+        return 0;
+    }
+
+    payload = storage.data() + readPos + FRAME_HEADER_SIZE;
+    readPos += FRAME_HEADER_SIZE + header.length;
+    return 1;
+}
+
+static bool waitWritable(int sock) {
+    struct pollfd pfd;
+    pfd.fd = sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 1000) > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL));
+}
+
+bool sendVector(int sock, struct iovec* iov, size_t count, int flags) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    size_t remaining = 0;
+    for (size_t i = 0; i < count; ++i) {
+        remaining += iov[i].iov_len;
+    }
+
+    while (remaining > 0) {
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL | flags);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(sock)) continue;
+            return false;
+        }
+
+        remaining -= sent;
+        // Advance the iovec past what the kernel accepted
+        while (sent > 0 && msg.msg_iovlen > 0) {
+            size_t chunk = msg.msg_iov[0].iov_len;
+            if (static_cast<size_t>(sent) >= chunk) {
+                sent -= chunk;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov[0].iov_base = static_cast<char*>(msg.msg_iov[0].iov_base) + sent;
+                msg.msg_iov[0].iov_len -= sent;
+                sent = 0;
+            }
+        }
+    }
+    return true;
+}
+
+ssize_t sendVectorNow(int sock, const struct iovec* iov, size_t count, int flags) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = count;
+
+    for (;;) {
+        ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL | MSG_DONTWAIT | flags);
+        if (sent >= 0) return sent;
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+ssize_t sendFileNow(int sock, int fd, uint64_t offset, size_t length) {
+    off_t position = static_cast<off_t>(offset);
+    for (;;) {
+        ssize_t sent = sendfile(sock, fd, &position, length);
+        if (sent > 0) return sent;
+        if (sent == 0) return length == 0 ? 0 : -1;  // The file shrank
+        if (errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+}
+
+bool sendFileRange(int sock, int fd, uint64_t offset, size_t length) {
+    off_t position = static_cast<off_t>(offset);
+    while (length > 0) {
+        ssize_t sent = sendfile(sock, fd, &position, length);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(sock)) continue;
+            return false;
+        }
+        if (sent == 0) {
+            // The file shrank underneath us; the frame can't be completed
+            return false;
+        }
+        length -= sent;
+    }
+    return true;
+}
+
+bool sendFrame(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(length)), header);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = FRAME_HEADER_SIZE;
+    iov[1].iov_base = const_cast<char*>(payload);
+    iov[1].iov_len = length;
+    return sendVector(sock, iov, 2);
+}
+
+bool FrameBatch::flush(int sock) {
+    if (frames == 0) return true;
+
+    struct iovec iov[1];
+    iov[0].iov_base = &pending[0];
+    iov[0].iov_len = pending.size();
+    bool sent = sendVector(sock, iov, 1);
+    clear();
+    return sent;
+}
+
+bool FrameBatch::flush(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(length)), header);
+
+    struct iovec iov[3];
+    size_t count = 0;
+    if (!pending.empty()) {
+        iov[count].iov_base = &pending[0];
+        iov[count].iov_len = pending.size();
+        count++;
+    }
+    iov[count].iov_base = header;
+    iov[count].iov_len = FRAME_HEADER_SIZE;
+    count++;
+    iov[count].iov_base = const_cast<char*>(payload);
+    iov[count].iov_len = length;
+    count++;
+
+    bool sent = sendVector(sock, iov, count);
+    clear();
+    return sent;
+}
+
+bool FrameBatch::flush(int sock, uint16_t opcode, uint32_t requestId, const char* payload, size_t length,
+                       int fd, uint64_t fileOffset, size_t fileLength) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(length + fileLength)), header);
+
+    struct iovec iov[3];
+    size_t count = 0;
+    if (!pending.empty()) {
+        iov[count].iov_base = &pending[0];
+        iov[count].iov_len = pending.size();
+        count++;
+    }
+    iov[count].iov_base = header;
+    iov[count].iov_len = FRAME_HEADER_SIZE;
+    count++;
+    iov[count].iov_base = const_cast<char*>(payload);
+    iov[count].iov_len = length;
+    count++;
+
+    // MSG_MORE lets the header share a segment with the start of the file
+    bool sent = sendVector(sock, iov, count, MSG_MORE);
+    if (sent && !sendFileRange(sock, fd, fileOffset, fileLength)) {
+        // The header promised bytes that won't arrive; close rather than
+        // leave the peer parsing the next frame out of the wrong offset
+        shutdown(sock, SHUT_RDWR);
+        sent = false;
+    }
+    clear();
+    return sent;
+}
+
+bool recvFrame(int sock, ReceiveBuffer& buffer, FrameHeader& header, std::string& payload) {
+    const char* data = nullptr;
+    int status;
+    while ((status = buffer.nextFrame(header, data)) == 0) {
+        char* dest = buffer.prepareWrite(4096);
+        ssize_t bytesRead = recv(sock, dest, buffer.writableBytes(), 0);
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) return false;
+        buffer.commitWrite(bytesRead);
+    }
+    if (status < 0) return false;
+
+    payload.assign(data, header.length);
+    return true;
+}
@@ -0,0 +1,254 @@
+#include "../include/response_cache.hpp"
+#include "../include/latency_histogram.hpp"
+#include <cstring>
+#include <stdexcept>
+
+ResponseCache::ResponseCache(size_t byteLimit) : shardLimit(byteLimit / RESPONSE_CACHE_SHARDS) {
+    if (shardLimit == 0) {
+        throw std::runtime_error("Response cache needs at least one byte per shard");
+    }
+}
+
+void ResponseCache::cacheCommand(const std::string& name, uint64_t ttlNanos) {
+    if (!commands.insert(name, policies.size())) {
+        throw std::runtime_error("Command already cached: " + name);
+    }
+    policies.push_back(std::unique_ptr<Policy>(new Policy(ttlNanos)));
+}
+
+void ResponseCache::setKeyFunction(StringView name, CacheKeyFunction function) {
+    size_t policy = commands.find(name);
+    if (policy != CommandTable::npos) {
+        policies[policy]->keyFunction = function;
+    }
+}
+
+StringView ResponseCache::keyArgs(size_t policy, StringView args) const {
+    CacheKeyFunction function = policies[policy]->keyFunction;
+    if (!function) {
+        return args;
+    }
+    static thread_local std::string key;
+    key.clear();
+    function(args, key);
+    return StringView(key);
+}
+
+uint64_t ResponseCache::hashKey(StringView name, StringView args) {
+    // FNV-1a over "<name> <args>", without building the key
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name.size(); ++i) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+    hash ^= static_cast<unsigned char>(' ');
+    hash *= 1099511628211ULL;
+    for (size_t i = 0; i < args.size(); ++i) {
+        hash ^= static_cast<unsigned char>(args[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool ResponseCache::sameKey(const Entry& entry, StringView name, StringView args) {
+    return entry.key.size() == name.size() + 1 + args.size() &&
+           memcmp(entry.key.data(), name.data(), name.size()) == 0 &&
+           memcmp(entry.key.data() + name.size() + 1, args.data(), args.size()) == 0;
+}
+
+size_t ResponseCache::entryCost(size_t keyLength, size_t replyLength) {
+    // Counts the slot and index node too, so many tiny replies stay bounded
+    return sizeof(Entry) + 32 + keyLength + replyLength;
+}
+
+ResponseCache::Entry* ResponseCache::findLocked(Shard& shard, uint64_t hash, StringView name, StringView args,
+                                                size_t policy) {
+    auto found = shard.index.find(hash);
+    if (found == shard.index.end()) {
+        return nullptr;
+    }
+    Entry& entry = shard.slots[found->second];
+    if (!sameKey(entry, name, args)) {
+        return nullptr;
+    }
+    if (entry.generation != policies[policy]->generation.load(std::memory_order_acquire) ||
+        (entry.expiresAt != 0 && monotonicNanos() >= entry.expiresAt)) {
+        eraseLocked(shard, found->second);
+        return nullptr;
+    }
+    return &entry;
+}
+
+void ResponseCache::eraseLocked(Shard& shard, size_t slot) {
+    Entry& entry = shard.slots[slot];
+    shard.index.erase(entry.hash);
+    shard.bytes -= entryCost(entry.key.size(), entry.reply.size());
+    entry.live = false;
+    entry.referenced = false;
+    std::string().swap(entry.key);
+    std::string().swap(entry.reply);
+    shard.freeSlots.push_back(slot);
+}
+
+void ResponseCache::evictOneLocked(Shard& shard) {
+    // Only called while the shard holds bytes, so some slot is live and the
+    // hand stops within two sweeps
+    for (;;) {
+        if (shard.hand >= shard.slots.size()) {
+            shard.hand = 0;
+        }
+        Entry& entry = shard.slots[shard.hand];
+        size_t slot = shard.hand++;
+        if (!entry.live) {
+            continue;
+        }
+        if (entry.referenced) {
+            entry.referenced = false;
+            continue;
+        }
+        eraseLocked(shard, slot);
+        shard.evictions++;
+        return;
+    }
+}
+
+bool ResponseCache::lookup(const Command& command, ResponseWriter& response, size_t& service, Ticket& ticket) {
+    ticket = Ticket();
+    size_t policy = commands.find(command.name);
+    if (policy == CommandTable::npos) {
+        return false;
+    }
+    StringView args = keyArgs(policy, command.args);
+    uint64_t hash = hashKey(command.name, args);
+    Shard& shard = shardFor(hash);
+    // Read before the entry, so an invalidation after this point fails the ticket
+    uint64_t generation = policies[policy]->generation.load(std::memory_order_acquire);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Entry* entry = findLocked(shard, hash, command.name, args, policy);
+    if (entry) {
+        entry->referenced = true;
+        shard.hits++;
+        response.append(entry->reply.data(), entry->reply.size());
+        service = entry->service;
+        return true;
+    }
+    shard.misses++;
+    if (policies[policy]->keyFunction) {
+        ticket.key.assign(args.data(), args.size());
+        ticket.keyed = true;
+    }
+    ticket.policy = policy;
+    ticket.hash = hash;
+    ticket.generation = generation;
+    ticket.invalidations = shard.invalidations;
+    return false;
+}
+
+void ResponseCache::store(const Ticket& ticket, const Command& command, size_t service, const ResponseWriter& response) {
+    if (!ticket.storable() || response.hasFileTail() || response.size() > RESPONSE_CACHE_MAX_REPLY ||
+        startsWith(response.view(), "ERROR")) {
+        return;
+    }
+    StringView args = ticket.keyed ? StringView(ticket.key) : command.args;
+    size_t cost = entryCost(command.name.size() + 1 + args.size(), response.size());
+    if (cost > shardLimit) {
+        return;
+    }
+    const Policy& policy = *policies[ticket.policy];
+    uint64_t ttl = policy.ttlNanos;
+    Shard& shard = shardFor(ticket.hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // The service may have invalidated its own command, as a CAL assignment
+    // does, or another thread invalidated the entry while this reply was built
+    if (policy.generation.load(std::memory_order_acquire) != ticket.generation ||
+        shard.invalidations != ticket.invalidations) {
+        return;
+    }
+    auto existing = shard.index.find(ticket.hash);
+    if (existing != shard.index.end()) {
+        eraseLocked(shard, existing->second);
+    }
+    while (shard.bytes + cost > shardLimit) {
+        evictOneLocked(shard);
+    }
+
+    size_t slot;
+    if (!shard.freeSlots.empty()) {
+        slot = shard.freeSlots.back();
+        shard.freeSlots.pop_back();
+    } else {
+        slot = shard.slots.size();
+        shard.slots.push_back(Entry());
+    }
+    Entry& entry = shard.slots[slot];
+    entry.key.reserve(command.name.size() + 1 + args.size());
+    entry.key.assign(command.name.data(), command.name.size());
+    entry.key += ' ';
+    entry.key.append(args.data(), args.size());
+    entry.reply.assign(response.data(), response.size());
+    entry.hash = ticket.hash;
+    entry.expiresAt = ttl ? monotonicNanos() + ttl : 0;
+    entry.generation = ticket.generation;
+    entry.policy = ticket.policy;
+    entry.service = service;
+    // Starts unreferenced, so entries that never hit go first
+    entry.referenced = false;
+    entry.live = true;
+    shard.index[ticket.hash] = slot;
+    shard.bytes += cost;
+}
+
+bool ResponseCache::contains(StringView request) {
+    Command command;
+    if (!parseCommand(request, command)) {
+        return false;
+    }
+    size_t policy = commands.find(command.name);
+    if (policy == CommandTable::npos || policies[policy]->keyFunction) {
+        return false;
+    }
+    StringView args = command.args;
+    uint64_t hash = hashKey(command.name, args);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return findLocked(shard, hash, command.name, args, policy) != nullptr;
+}
+
+void ResponseCache::invalidate(StringView name, StringView sent) {
+    size_t policy = commands.find(name);
+    if (policy == CommandTable::npos) {
+        return;
+    }
+    StringView args = keyArgs(policy, sent);
+    uint64_t hash = hashKey(name, args);
+    Shard& shard = shardFor(hash);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.invalidations++;
+    auto found = shard.index.find(hash);
+    if (found != shard.index.end() && sameKey(shard.slots[found->second], name, args)) {
+        eraseLocked(shard, found->second);
+    }
+}
+
+void ResponseCache::invalidateCommand(StringView name) {
+    // Stale entries are dropped as lookups or the CLOCK hand reach them
+    size_t policy = commands.find(name);
+    if (policy != CommandTable::npos) {
+        policies[policy]->generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+ResponseCache::Stats ResponseCache::stats() {
+    Stats total = Stats();
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total.hits += shard.hits;
+        total.misses += shard.misses;
+        total.evictions += shard.evictions;
+        total.entries += shard.index.size();
+        total.bytes += shard.bytes;
+    }
+    return total;
+}
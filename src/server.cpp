@@ -1,13 +1,21 @@
 #include "../include/server.hpp"
+#include "../include/async_logger.hpp"
 #include <iostream>
-#include <algorithm>
 #include <cstring>
+#include <cerrno>
 #include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
 
 SocketServer* SocketServer::instance = nullptr;
 std::mutex SocketServer::mutex;
 
-SocketServer::SocketServer() : serverSocket(-1), running(false) {}
+SocketServer::SocketServer()
+    : serverSocket(-1), running(false), workerCount(SERVER_WORKER_THREADS),
+      backlog(SERVER_LISTEN_BACKLOG), maxConnections(SERVER_MAX_CONNECTIONS), idleTimeoutSeconds(0),
+      connectionCount(0) {}
 
 SocketServer::~SocketServer() {
     stop();
@@ -41,12 +49,36 @@ void SocketServer::start(int port) {
         throw std::runtime_error("Failed to bind socket");
     }
     
-    if (listen(serverSocket, 10) < 0) {
+    if (listen(serverSocket, backlog) < 0) {
         throw std::runtime_error("Failed to listen on socket");
     }
     
+    // Past the descriptor limit accept() fails rather than the limit
+    // turning clients away with "Server busy"
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        size_t reserved = SERVER_RESERVED_FDS + workerCount;
+        size_t available = limit.rlim_cur > reserved ? static_cast<size_t>(limit.rlim_cur) - reserved : 1;
+        if (maxConnections > available) {
+            LOG_WARN("Lowering max connections from {} to {} to fit RLIMIT_NOFILE ({})",
+                     maxConnections, available, static_cast<size_t>(limit.rlim_cur));
+            maxConnections = available;
+        }
+    }
+    
     running = true;
-    std::cout << "Server started on port " << port << std::endl;
+    for (size_t i = 0; i < workerCount; ++i) {
+        std::unique_ptr<SocketWorker> worker(new SocketWorker());
+        worker->wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (worker->wakeFd < 0) {
+            stop();
+            throw std::runtime_error("Failed to create worker eventfd");
+        }
+        worker->thread = std::thread(&SocketServer::workerThread, this, worker.get());
+        workers.push_back(std::move(worker));
+    }
+    std::cout << "Server started on port " << port << " with " << workerCount
+              << " workers (max " << maxConnections << " connections)" << std::endl;
     
     acceptConnections();
 }
@@ -56,75 +88,275 @@ void SocketServer::stop() {
     
     running = false;
     if (serverSocket >= 0) {
+        // shutdown() wakes a thread blocked in accept(); close() alone does not
+        shutdown(serverSocket, SHUT_RDWR);
         close(serverSocket);
         serverSocket = -1;
     }
     
-    for (auto& thread : workerThreads) {
-        if (thread.joinable()) {
-            thread.join();
+    // Workers close their own connections on the way out
+    uint64_t wake = 1;
+    for (auto& worker : workers) {
+        if (write(worker->wakeFd, &wake, sizeof(wake)) < 0) {
+            LOG_WARN("Failed to wake a worker: {}", strerror(errno));
+        }
+    }
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
         }
+        close(worker->wakeFd);
     }
-    workerThreads.clear();
+    workers.clear();
     
     std::cout << "Server stopped" << std::endl;
 }
 
 void SocketServer::acceptConnections() {
+    bool backingOff = false;
     while (running) {
         sockaddr_in clientAddr;
         socklen_t clientLen = sizeof(clientAddr);
         
         int clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientLen);
         if (clientSocket < 0) {
-            if (running) {
-                std::cerr << "Failed to accept connection" << std::endl;
+            if (!running || errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // The pending connection stays queued; retrying at once would
+                // only spin until a descriptor or memory frees up
+                if (!backingOff) {
+                    LOG_WARN("Pausing accept(): {}", strerror(errno));
+                    backingOff = true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(SERVER_ACCEPT_BACKOFF_MS));
+                continue;
             }
+            LOG_ERROR("Failed to accept connection: {}", strerror(errno));
             continue;
         }
+        if (backingOff) {
+            LOG_INFO("Accepting connections again");
+            backingOff = false;
+        }
         
-        std::cout << "New connection from " << inet_ntoa(clientAddr.sin_addr) << std::endl;
-        workerThreads.emplace_back(&SocketServer::handleClient, this, clientSocket);
+        if (!admitConnection(clientSocket)) {
+            static const std::string busy = "ERROR: Server busy";
+            sendFrame(clientSocket, FRAME_OP_ERROR, 0, busy.data(), busy.length());
+            close(clientSocket);
+            LOG_WARN("Rejected connection from {}: server busy", inet_ntoa(clientAddr.sin_addr));
+            continue;
+        }
+        LOG_INFO("New connection from {}", inet_ntoa(clientAddr.sin_addr));
     }
 }
 
-void SocketServer::handleClient(int clientSocket) {
-    char buffer[1024];
+bool SocketServer::admitConnection(int clientSocket) {
+    if (!running || workers.empty()) {
+        return false;
+    }
+    if (connectionCount.fetch_add(1) >= maxConnections) {
+        connectionCount.fetch_sub(1);
+        return false;
+    }
+    // Least loaded worker; a count may be stale by a connection, which is fine
+    SocketWorker* target = workers[0].get();
+    for (auto& worker : workers) {
+        if (worker->connections.load() < target->connections.load()) {
+            target = worker.get();
+        }
+    }
+    // Replies are queued rather than waited out, so one client that stops
+    // reading can't block the others on its worker
+    fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL) | O_NONBLOCK);
+    target->connections.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(target->mutex);
+        target->incoming.push_back(clientSocket);
+    }
+    uint64_t wake = 1;
+    if (write(target->wakeFd, &wake, sizeof(wake)) < 0) {
+        LOG_WARN("Failed to wake a worker: {}", strerror(errno));
+    }
+    return true;
+}
+
+void SocketServer::workerThread(SocketWorker* worker) {
+    // Stateful interceptors get a private copy per worker; ones that can't be
+    // cloned are shared as before
+    InterceptorChain local;
+    InterceptorChain& chain = interceptors.cloneInto(local) ? local : interceptors;
+    
+    std::vector<Connection> connections;
+    std::vector<struct pollfd> fds;
+    std::vector<int> incoming;
+    std::chrono::seconds idleTimeout(idleTimeoutSeconds);
+    
     while (running) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+        // The eventfd first, then one entry per connection in order
+        fds.clear();
+        fds.push_back({worker->wakeFd, POLLIN, 0});
+        int timeout = -1;
+        auto now = std::chrono::steady_clock::now();
+        for (const Connection& connection : connections) {
+            // Reading stops while too many replies are waiting for the client
+            short events = connection.unsent() < SERVER_MAX_OUTBOUND_BYTES ? POLLIN : 0;
+            if (connection.unsent() > 0) events |= POLLOUT;
+            fds.push_back({connection.fd, events, 0});
+            if (idleTimeoutSeconds > 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    connection.lastActivity + idleTimeout - now).count();
+                int wait = left > 0 ? static_cast<int>(left) + 1 : 0;
+                timeout = timeout < 0 || wait < timeout ? wait : timeout;
+            }
+        }
         
-        if (bytesRead <= 0) break;
+        int ready = poll(fds.data(), fds.size(), timeout);
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("Worker poll failed: {}", strerror(errno));
+            break;
+        }
         
-        std::string request(buffer);
-        std::string response = processRequest(request);
+        // Backwards, so a removal only moves an already handled connection
+        now = std::chrono::steady_clock::now();
+        for (size_t i = connections.size(); i-- > 0;) {
+            Connection& connection = connections[i];
+            bool open = true;
+            if (ready > 0 && fds[i + 1].revents != 0) {
+                open = serveConnection(connection, fds[i + 1].revents, chain);
+            } else if (idleTimeoutSeconds > 0 && now - connection.lastActivity >= idleTimeout) {
+                open = false;
+            }
+            if (!open) {
+                close(connection.fd);
+                connections[i] = std::move(connections.back());
+                connections.pop_back();
+                worker->connections.fetch_sub(1);
+                connectionCount.fetch_sub(1);
+            }
+        }
         
-        send(clientSocket, response.c_str(), response.length(), 0);
+        if (ready > 0 && fds[0].revents != 0) {
+            uint64_t wakes;
+            if (read(worker->wakeFd, &wakes, sizeof(wakes)) < 0 && errno != EAGAIN) {
+                LOG_WARN("Failed to read a worker wakeup: {}", strerror(errno));
+            }
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                incoming.swap(worker->incoming);
+            }
+            for (int clientSocket : incoming) {
+                connections.push_back(Connection(clientSocket, now));
+            }
+            incoming.clear();
+        }
     }
     
-    close(clientSocket);
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    for (int clientSocket : worker->incoming) {
+        close(clientSocket);
+    }
+    worker->incoming.clear();
+    for (const Connection& connection : connections) {
+        close(connection.fd);
+    }
+    connectionCount.fetch_sub(worker->connections.exchange(0));
 }
 
-std::string SocketServer::processRequest(const std::string& request) {
-    std::string processedRequest = request;
+bool SocketServer::serveConnection(Connection& connection, short events, InterceptorChain& chain) {
+    auto now = std::chrono::steady_clock::now();
+    if (events & POLLOUT) {
+        size_t before = connection.unsent();
+        if (!flushConnection(connection)) {
+            return false;
+        }
+        if (connection.unsent() != before) connection.lastActivity = now;
+    }
     
-    // Execute pre-processing interceptors
-    std::sort(interceptors.begin(), interceptors.end(), 
-              [](const std::unique_ptr<IInterceptor>& a, const std::unique_ptr<IInterceptor>& b) {
-                  return a->getPriority() < b->getPriority();
-              });
+    ReceiveBuffer& buffer = connection.buffer;
+    if (events & POLLIN) {
+        char* dest = buffer.prepareWrite(4096);
+        ssize_t bytesRead = recv(connection.fd, dest, buffer.writableBytes(), MSG_DONTWAIT);
+        if (bytesRead == 0) {
+            return false;
+        }
+        if (bytesRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return false;
+        }
+        if (bytesRead > 0) {
+            buffer.commitWrite(static_cast<size_t>(bytesRead));
+            connection.lastActivity = now;
+        }
+    } else if (events & (POLLERR | POLLHUP | POLLNVAL)) {
+        return false;
+    }
     
-    for (auto& interceptor : interceptors) {
-        if (!interceptor->preProcess(processedRequest)) {
-            return "ERROR: Request rejected by interceptor";
+    // Requests already buffered are answered too, so a client that caught
+    // up gets the rest of its pipeline without sending more
+    FrameHeader header;
+    const char* payload = nullptr;
+    int status = 0;
+    while (connection.unsent() < SERVER_MAX_OUTBOUND_BYTES && (status = buffer.nextFrame(header, payload)) > 0) {
+        if (header.opcode != FRAME_OP_REQUEST) {
+            static const std::string error = "ERROR: Unexpected frame opcode";
+            encodeFrame(FRAME_OP_ERROR, header.requestId, error.data(), error.length(), connection.outgoing);
+            continue;
+        }
+        
+        std::string request(payload, header.length);
+        std::string response = processRequest(request, chain);
+        encodeFrame(FRAME_OP_RESPONSE, header.requestId, response.data(), response.length(), connection.outgoing);
+    }
+    // Negative for an oversized frame: the stream can't be resynchronized
+    if (status < 0) {
+        return false;
+    }
+    return flushConnection(connection);
+}
+
+bool SocketServer::flushConnection(Connection& connection) {
+    while (connection.unsent() > 0) {
+        ssize_t sent = send(connection.fd, connection.outgoing.data() + connection.outgoingSent, connection.unsent(),
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0) {
+            connection.outgoingSent += static_cast<size_t>(sent);
+            continue;
         }
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        return false;
+    }
+    
+    if (connection.unsent() == 0) {
+        connection.outgoing.clear();
+        connection.outgoingSent = 0;
+    } else if (connection.outgoingSent >= 64 * 1024) {
+        // Compact now and then rather than after every partial write
+        connection.outgoing.erase(0, connection.outgoingSent);
+        connection.outgoingSent = 0;
+    }
+    return true;
+}
+
+std::string SocketServer::processRequest(const std::string& request, InterceptorChain& chain) {
+    if (!chain.admit(StringView(request))) {
+        return "ERROR: Rate limit exceeded";
+    }
+    
+    std::string processedRequest = request;
+    
+    // Execute pre-processing interceptors
+    if (!chain.preProcess(processedRequest)) {
+        return "ERROR: Request rejected by interceptor";
     }
     
     // Process request
+    char storage[256];
+    ResponseWriter writer(storage, sizeof(storage));
     std::string response;
-    for (auto& service : services) {
-        response = service->processRequest(processedRequest);
-        if (!response.empty()) break;
+    if (services.dispatch(StringView(processedRequest), writer)) {
+        response.assign(writer.data(), writer.size());
     }
     
     if (response.empty()) {
@@ -132,18 +364,17 @@ std::string SocketServer::processRequest(const std::string& request) {
     }
     
     // Execute post-processing interceptors
-    for (auto& interceptor : interceptors) {
-        interceptor->postProcess(processedRequest, response);
-    }
+    chain.postProcess(processedRequest, response);
     
     return response;
 }
 
 void SocketServer::addService(std::unique_ptr<IService> service) {
     service->initialize();
-    services.push_back(std::move(service));
+    services.add(std::move(service));
 }
 
 void SocketServer::addInterceptor(std::unique_ptr<IInterceptor> interceptor) {
-    interceptors.push_back(std::move(interceptor));
-} 
\ No newline at end of file
+    // Kept in priority order as it is added, not sorted per request
+    interceptors.add(std::move(interceptor));
+}
@@ -16,11 +16,28 @@ void signalHandler(int signum) {
 
 int main(int argc, char* argv[]) {
     int port = 8080;
+    size_t workers = SERVER_WORKER_THREADS;
+    int backlog = SERVER_LISTEN_BACKLOG;
+    size_t maxConnections = SERVER_MAX_CONNECTIONS;
+    int idleTimeout = 0;
     
     // Parse command line arguments
+    // Usage: server [port] [--workers N] [--backlog N] [--max-connections N] [--idle-timeout SECONDS]
     if (argc > 1) {
         port = std::stoi(argv[1]);
     }
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--workers" && i + 1 < argc) {
+            workers = std::stoul(argv[++i]);
+        } else if (arg == "--backlog" && i + 1 < argc) {
+            backlog = std::stoi(argv[++i]);
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            maxConnections = std::stoul(argv[++i]);
+        } else if (arg == "--idle-timeout" && i + 1 < argc) {
+            idleTimeout = std::stoi(argv[++i]);
+        }
+    }
     
     // Set up signal handling
     signal(SIGINT, signalHandler);
@@ -32,6 +49,10 @@ int main(int argc, char* argv[]) {
         
         auto server = SocketServer::getInstance();
         g_server = server;
+        server->setWorkerThreads(workers);
+        server->setBacklog(backlog);
+        server->setMaxConnections(maxConnections);
+        server->setIdleTimeout(idleTimeout);
         
         // Add services
         std::cout << "\n[SETUP] Adding services..." << std::endl;
@@ -42,8 +63,10 @@ int main(int argc, char* argv[]) {
         // Add interceptors
         std::cout << "[SETUP] Adding interceptors..." << std::endl;
         server->addInterceptor(std::unique_ptr<LoggingInterceptor>(new LoggingInterceptor()));
-        server->addInterceptor(std::unique_ptr<AuthenticationInterceptor>(new AuthenticationInterceptor("secret123")));
-        server->addInterceptor(std::unique_ptr<RateLimitingInterceptor>(new RateLimitingInterceptor(10000)));
+        std::unique_ptr<AuthenticationInterceptor> auth(new AuthenticationInterceptor("secret123"));
+        std::shared_ptr<AuthTokenStore> validTokens = auth->tokenStore();
+        server->addInterceptor(std::move(auth));
+        server->addInterceptor(std::unique_ptr<RateLimitingInterceptor>(new RateLimitingInterceptor(10000, 0, validTokens)));
         server->addInterceptor(std::unique_ptr<ValidationInterceptor>(new ValidationInterceptor()));
         
         std::cout << "\n[INFO] Available commands:" << std::endl;
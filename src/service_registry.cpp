@@ -0,0 +1,143 @@
+#include "../include/service_registry.hpp"
+#include <stdexcept>
+
+CommandTable::CommandTable() : entries(16), count(0) {}
+
+uint64_t CommandTable::hashName(StringView name) {
+    // FNV-1a; command names are short so this is a handful of multiplies
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < name.size(); ++i) {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void CommandTable::grow() {
+    std::vector<Entry> old;
+    old.swap(entries);
+    entries.resize(old.size() * 2);
+    count = 0;
+    for (auto& entry : old) {
+        if (entry.service != npos) {
+            insert(entry.name, entry.service);
+        }
+    }
+}
+
+bool CommandTable::insert(const std::string& name, size_t service) {
+    // Keep the load factor at or below one half so probe chains stay short
+    if ((count + 1) * 2 > entries.size()) {
+        grow();
+    }
+    
+    uint64_t hash = hashName(name);
+    size_t mask = entries.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        Entry& entry = entries[i];
+        if (entry.service == npos) {
+            entry.hash = hash;
+            entry.name = name;
+            entry.service = service;
+            count++;
+            return true;
+        }
+        if (entry.hash == hash && entry.name == name) {
+            return false;
+        }
+    }
+}
+
+size_t CommandTable::find(StringView name) const {
+    uint64_t hash = hashName(name);
+    size_t mask = entries.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        const Entry& entry = entries[i];
+        if (entry.service == npos) {
+            return npos;
+        }
+        if (entry.hash == hash && StringView(entry.name) == name) {
+            return entry.service;
+        }
+    }
+}
+
+void ServiceRegistry::add(std::unique_ptr<IService> service) {
+    std::vector<std::string> names = service->getCommands();
+    // Check first so a rejected service leaves no dangling table entries
+    for (const auto& name : names) {
+        if (commands.find(name) != npos) {
+            throw std::runtime_error("Command already registered: " + name);
+        }
+    }
+    size_t index = services.size();
+    for (const auto& name : names) {
+        commands.insert(name, index);
+    }
+    if (names.empty()) {
+        fallback.push_back(index);
+    }
+    services.push_back(std::move(service));
+}
+
+size_t ServiceRegistry::route(StringView request) const {
+    Command command;
+    if (parseCommand(request, command)) {
+        return commands.find(command.name);
+    }
+    return npos;
+}
+
+bool ServiceRegistry::dispatch(StringView request, ResponseWriter& response, size_t* handledBy) {
+    Command command;
+    if (parseCommand(request, command)) {
+        size_t owner = commands.find(command.name);
+        if (owner != npos) {
+            if (handledBy) *handledBy = owner;
+            return services[owner]->processCommand(command, response);
+        }
+    }
+    
+    for (size_t index : fallback) {
+        if (services[index]->processRequest(request, response)) {
+            if (handledBy) *handledBy = index;
+            return true;
+        }
+    }
+    return false;
+}
+
+ExecutionClass ServiceRegistry::classify(StringView request) const {
+    size_t owner = route(request);
+    if (owner != npos) {
+        return services[owner]->getExecutionClass();
+    }
+    // Fallback services are unknown territory; with none, the request only
+    // earns an error reply, which is cheap enough to produce inline
+    return fallback.empty() ? ExecutionClass::Inline : ExecutionClass::Worker;
+}
+
+std::string ServiceRegistry::serviceName(size_t index) const {
+    return displayName(services[index]->getCommands(), index);
+}
+
+std::string ServiceRegistry::displayName(const std::vector<std::string>& names, size_t index) {
+    if (names.empty()) {
+        return "service" + std::to_string(index);
+    }
+    std::string joined = names[0];
+    for (size_t i = 1; i < names.size(); ++i) {
+        joined += "/" + names[i];
+    }
+    return joined;
+}
+
+void ServiceRegistry::cloneInto(ServiceRegistry& target) const {
+    for (const auto& service : services) {
+        std::unique_ptr<IService> copy = service->clone();
+        if (!copy) {
+            throw std::runtime_error("Service does not implement clone()");
+        }
+        target.add(std::move(copy));
+    }
+}
@@ -1,127 +1,278 @@
 #include "../include/services.hpp"
+#include "../include/protocol.hpp"
 #include <iostream>
-#include <sstream>
+#include <cstdio>
 #include <regex>
-#include <fstream>
 #include <filesystem>
+#include <climits>
+#include <cstdlib>
 
 void EchoService::initialize() {
     std::cout << "EchoService initialized" << std::endl;
 }
 
+std::unique_ptr<IService> EchoService::clone() const {
+    return std::unique_ptr<IService>(new EchoService(*this));
+}
+
 void EchoService::cleanup() {
     std::cout << "EchoService cleaned up" << std::endl;
 }
 
 std::string EchoService::processRequest(const std::string& request) {
-    if (request.find("ECHO") != std::string::npos) {
-        size_t echoPos = request.find("ECHO");
-        return "ECHO: " + request.substr(echoPos + 5);
-    }
-    return ""; // Don't handle this request
+    return processOwnCommand(request);
+}
+
+std::vector<std::string> EchoService::getCommands() const {
+    return std::vector<std::string>{"ECHO"};
+}
+
+bool EchoService::processCommand(const Command& command, ResponseWriter& response) {
+    response.append("ECHO: ", 6);
+    response.append(command.args);
+    return true;
 }
 
 void CalculatorService::initialize() {
     std::cout << "CalculatorService initialized" << std::endl;
 }
 
+std::unique_ptr<IService> CalculatorService::clone() const {
+    return std::unique_ptr<IService>(new CalculatorService(*this));
+}
+
 void CalculatorService::cleanup() {
     std::cout << "CalculatorService cleaned up" << std::endl;
 }
 
 std::string CalculatorService::processRequest(const std::string& request) {
-    if (request.find("CAL") != std::string::npos) {
-        size_t calPos = request.find("CAL");
-        std::string expression = request.substr(calPos + 4);
-        try {
-            double result = evaluateExpression(expression);
-            return "RESULT: " + std::to_string(result);
-        } catch (const std::exception& e) {
-            return "ERROR: " + std::string(e.what());
-        }
-    }
-    return ""; // Don't handle this request
+    return processOwnCommand(request);
+}
+
+std::vector<std::string> CalculatorService::getCommands() const {
+    return std::vector<std::string>{"CAL"};
 }
 
-double CalculatorService::evaluateExpression(const std::string& expression) {
-    std::istringstream iss(expression);
+bool CalculatorService::processCommand(const Command& command, ResponseWriter& response) {
     double result;
-    char op;
-    
-    iss >> result;
-    while (iss >> op >> result) {
-        // Simple expression evaluation - can be extended for more complex operations
-        switch (op) {
-            case '+':
-                // result is already the next number
-                break;
-            case '-':
-                result = -result;
-                break;
-            case '*':
-                // Would need to implement proper operator precedence
-                break;
-            case '/':
-                if (result == 0) {
-                    throw std::runtime_error("Division by zero");
-                }
-                // Would need to implement proper operator precedence
-                break;
-            default:
-                throw std::runtime_error("Unknown operator: " + std::string(1, op));
-        }
+    try {
+        result = engine->evaluate(command.args);
+    } catch (const std::exception& e) {
+        response.append("ERROR: ");
+        response.append(e.what());
+        return true;
     }
-    
-    return result;
+    // An assignment changes what other expressions evaluate to ('=' appears
+    // nowhere else in the grammar). Invalidating once it has landed also
+    // fails the store of this reply and of any computed with the old value.
+    if (responses && command.args.find('=') != StringView::npos) {
+        responses->invalidateCommand(command.name);
+    }
+    // Same format as std::to_string(), without building a string; %f of
+    // the largest double is a little over 300 characters
+    char text[512];
+    int length = snprintf(text, sizeof(text), "%f", result);
+    response.append("RESULT: ", 8);
+    response.append(text, static_cast<size_t>(length));
+    return true;
 }
 
 void FileService::initialize() {
     std::cout << "FileService initialized" << std::endl;
 }
 
+std::unique_ptr<IService> FileService::clone() const {
+    return std::unique_ptr<IService>(new FileService(*this));
+}
+
 void FileService::cleanup() {
     std::cout << "FileService cleaned up" << std::endl;
 }
 
 std::string FileService::processRequest(const std::string& request) {
-    if (request.find("READ") != std::string::npos) {
-        size_t readPos = request.find("READ");
-        std::string filename = request.substr(readPos + 5);
-        return "FILE_CONTENT: " + readFile(filename);
-    } else if (request.find("WRITE") != std::string::npos) {
-        size_t writePos = request.find("WRITE");
-        size_t spacePos = request.find(' ', writePos + 6);
-        if (spacePos != std::string::npos) {
-            std::string filename = request.substr(writePos + 6, spacePos - (writePos + 6));
-            std::string content = request.substr(spacePos + 1);
-            if (writeFile(filename, content)) {
-                return "SUCCESS: File written successfully";
-            } else {
-                return "ERROR: Failed to write file";
-            }
-        }
-        return "ERROR: Invalid write command format";
+    return processOwnCommand(request);
+}
+
+std::vector<std::string> FileService::getCommands() const {
+    return std::vector<std::string>{"READ", "WRITE", "WRITE_OPEN", "WRITE_CHUNK", "WRITE_CLOSE", "WRITE_ABORT"};
+}
+
+bool FileService::processCommand(const Command& command, ResponseWriter& response) {
+    if (command.name == "READ") {
+        readFile(std::string(command.args.data(), command.args.size()), response);
+        return true;
+    }
+    if (command.name != "WRITE") {
+        processUpload(command, response);
+        return true;
     }
-    return ""; // Don't handle this request
+    
+    // WRITE <filename> <content>
+    size_t spacePos = command.args.find(' ');
+    if (spacePos == StringView::npos) {
+        response.append("ERROR: Invalid write command format");
+        return true;
+    }
+    
+    std::string filename(command.args.data(), spacePos);
+    if (writeFile(filename, command.args.substr(spacePos + 1))) {
+        response.append("SUCCESS: File written successfully");
+    } else {
+        response.append("ERROR: Failed to write file");
+    }
+    return true;
 }
 
-std::string FileService::readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        return "ERROR: Could not open file " + filename;
+void FileService::readFile(const std::string& filename, ResponseWriter& response) {
+    static const char prefix[] = "FILE_CONTENT: ";
+    static const size_t prefixLength = sizeof(prefix) - 1;
+    
+    std::string error;
+    std::shared_ptr<const MappedFile> file = cache->get(filename, error);
+    if (!file) {
+        response.append("ERROR: Could not open file " + filename);
+        return;
+    }
+    if (file->size() > FRAME_MAX_PAYLOAD - prefixLength) {
+        // Clients drop frames this large, so say why instead of sending it
+        response.append("ERROR: File too large " + filename);
+        return;
     }
     
-    std::string content((std::istreambuf_iterator<char>(file)),
-                        std::istreambuf_iterator<char>());
-    return content;
+    FileRegion region;
+    region.fd = file->descriptor();
+    region.offset = 0;
+    region.length = file->size();
+    response.append(prefix, prefixLength);
+    if (file->size() >= FILE_SENDFILE_THRESHOLD && response.acceptsFileTail()) {
+        // The server writes the body straight from the page cache; the
+        // region holds the mapping (and so the descriptor) until then
+        region.owner = file;
+        response.appendFile(region);
+        return;
+    }
+    // Copied with pread() rather than out of the mapping: if the file was
+    // truncated in place since get(), this reads short instead of faulting
+    if (!response.appendFileCopy(region)) {
+        response.assign("ERROR: Could not read file " + filename);
+    }
 }
 
-bool FileService::writeFile(const std::string& filename, const std::string& content) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
+// READ's cache key: the file's real path, so "a.txt", "./a.txt" and its
+// absolute path are one entry that WRITE invalidates whichever it names.
+// Paths that don't resolve key as sent; their replies are errors, never cached.
+static void resolvedPathKey(StringView args, std::string& key) {
+    std::string path(args.data(), args.size());
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) {
+        key.assign(resolved);
+    } else {
+        key.swap(path);
+    }
+}
+
+void FileService::setResponseCache(std::shared_ptr<ResponseCache> cache) {
+    responses = std::move(cache);
+    if (responses) {
+        responses->setKeyFunction("READ", &resolvedPathKey);
+    }
+}
+
+bool FileService::writeFile(const std::string& filename, StringView content) {
+    // Written to a temporary and renamed over the target, so readers never
+    // see a partial file and mappings of the old contents stay valid
+    BufferedFileWriter writer(filename, uploads->getSyncPolicy());
+    if (!writer.write(0, content) || !writer.commit()) {
         return false;
     }
-    
-    file << content;
+    cache->invalidate(filename);
+    if (responses) {
+        responses->invalidate("READ", StringView(filename));
+    }
     return true;
-} 
\ No newline at end of file
+}
+
+// Splits the next space-separated number off the front of `args`
+static bool takeNumber(StringView& args, uint64_t& value) {
+    size_t pos = 0;
+    value = 0;
+    while (pos < args.size() && args[pos] >= '0' && args[pos] <= '9') {
+        uint64_t digit = static_cast<uint64_t>(args[pos] - '0');
+        if (value > (UINT64_MAX - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+        pos++;
+    }
+    if (pos == 0 || (pos < args.size() && args[pos] != ' ')) {
+        return false;
+    }
+    args = args.substr(pos < args.size() ? pos + 1 : pos);
+    return true;
+}
+
+void FileService::processUpload(const Command& command, ResponseWriter& response) {
+    std::string error;
+    
+    if (command.name == "WRITE_OPEN") {
+        if (command.args.empty()) {
+            response.append("ERROR: Invalid upload command format");
+            return;
+        }
+        uint64_t handle = uploads->open(std::string(command.args.data(), command.args.size()), error);
+        if (handle == 0) {
+            response.append("ERROR: " + error);
+            return;
+        }
+        response.append("SUCCESS: Upload " + std::to_string(handle));
+        return;
+    }
+    
+    StringView args = command.args;
+    uint64_t handle = 0;
+    if (!takeNumber(args, handle)) {
+        response.append("ERROR: Invalid upload command format");
+        return;
+    }
+    
+    if (command.name == "WRITE_CHUNK") {
+        // The data is everything after the offset, spaces and all
+        uint64_t offset = 0;
+        uint64_t received = 0;
+        if (!takeNumber(args, offset)) {
+            response.append("ERROR: Invalid upload command format");
+        } else if (uploads->write(handle, offset, args, received, error)) {
+            response.append("SUCCESS: " + std::to_string(received) + " bytes");
+        } else {
+            response.append("ERROR: " + error);
+        }
+        return;
+    }
+    
+    if (command.name == "WRITE_CLOSE") {
+        uint64_t size = UINT64_MAX;
+        uint64_t written = 0;
+        if (!args.empty() && !takeNumber(args, size)) {
+            response.append("ERROR: Invalid upload command format");
+            return;
+        }
+        std::string path;
+        if (!uploads->close(handle, size, written, path, error)) {
+            response.append("ERROR: " + error);
+            return;
+        }
+        cache->invalidate(path);
+        if (responses) {
+            responses->invalidate("READ", StringView(path));
+        }
+        response.append("SUCCESS: File written (" + std::to_string(written) + " bytes)");
+        return;
+    }
+    
+    // WRITE_ABORT
+    if (uploads->abort(handle)) {
+        response.append("SUCCESS: Upload aborted");
+    } else {
+        response.append("ERROR: Unknown upload");
+    }
+}
@@ -0,0 +1,198 @@
+#include "../include/socket_handoff.hpp"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define HANDOFF_HEADER_SIZE 12
+
+static bool handoffAddress(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+static void setHandoffTimeouts(int sock) {
+    struct timeval timeout;
+    timeout.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+int listenHandoffSocket(const std::string& path) {
+    sockaddr_un addr;
+    if (!handoffAddress(path, addr)) {
+        throw std::runtime_error("Invalid handoff socket path: " + path);
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        throw std::runtime_error("Failed to create handoff socket");
+    }
+
+    // Whatever is at the path belongs to a server that is gone or replaced
+    unlink(path.c_str());
+    // Created owner-only: whoever connects gets the server's sockets
+    mode_t previous = umask(077);
+    int bound = bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+    umask(previous);
+    if (bound == -1 || listen(sock, 4) == -1) {
+        close(sock);
+        throw std::runtime_error("Failed to listen on handoff socket " + path + ": " + strerror(errno));
+    }
+    return sock;
+}
+
+int acceptHandoffSocket(int listener) {
+    int sock = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+    if (sock != -1) {
+        setHandoffTimeouts(sock);
+    }
+    return sock;
+}
+
+int connectHandoffSocket(const std::string& path) {
+    sockaddr_un addr;
+    if (!handoffAddress(path, addr)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock == -1) {
+        return -1;
+    }
+    if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+    setHandoffTimeouts(sock);
+    return sock;
+}
+
+bool sendHandoffMessage(int sock, uint32_t kind, const int* fds, size_t fdCount, const char* payload, size_t length) {
+    if (fdCount > HANDOFF_MAX_FDS || length > HANDOFF_MAX_PAYLOAD) {
+        return false;
+    }
+    char header[HANDOFF_HEADER_SIZE];
+    uint32_t fields[3] = {kind, static_cast<uint32_t>(fdCount), static_cast<uint32_t>(length)};
+    memcpy(header, fields, sizeof(fields));
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = HANDOFF_HEADER_SIZE;
+    iov[1].iov_base = const_cast<char*>(payload);
+    iov[1].iov_len = length;
+
+    char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length > 0 ? 2 : 1;
+    if (fdCount > 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fdCount);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fdCount);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * fdCount);
+    }
+
+    // The fds go with the first write; a short write sends the rest without them
+    size_t total = HANDOFF_HEADER_SIZE + length;
+    size_t sent = 0;
+    while (sent < total) {
+        ssize_t written = sendmsg(sock, &msg, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += static_cast<size_t>(written);
+        msg.msg_control = nullptr;
+        msg.msg_controllen = 0;
+        while (written > 0 && msg.msg_iovlen > 0) {
+            size_t chunk = msg.msg_iov[0].iov_len;
+            if (static_cast<size_t>(written) >= chunk) {
+                written -= chunk;
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            } else {
+                msg.msg_iov[0].iov_base = static_cast<char*>(msg.msg_iov[0].iov_base) + written;
+                msg.msg_iov[0].iov_len -= written;
+                written = 0;
+            }
+        }
+    }
+    return true;
+}
+
+static void closeAll(std::vector<int>& fds) {
+    for (int fd : fds) {
+        close(fd);
+    }
+    fds.clear();
+}
+
+bool recvHandoffMessage(int sock, HandoffMessage& message) {
+    message = HandoffMessage();
+    char header[HANDOFF_HEADER_SIZE];
+    size_t received = 0;
+    bool truncated = false;
+    while (received < HANDOFF_HEADER_SIZE) {
+        struct iovec iov;
+        iov.iov_base = header + received;
+        iov.iov_len = HANDOFF_HEADER_SIZE - received;
+        char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t count = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) {
+            closeAll(message.fds);
+            return false;
+        }
+        truncated = truncated || (msg.msg_flags & MSG_CTRUNC) != 0;
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                size_t fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const int* fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                message.fds.insert(message.fds.end(), fds, fds + fdCount);
+            }
+        }
+        received += static_cast<size_t>(count);
+    }
+
+    uint32_t fields[3];
+    memcpy(fields, header, sizeof(fields));
+    message.kind = fields[0];
+    if (truncated || fields[1] != message.fds.size() || fields[2] > HANDOFF_MAX_PAYLOAD) {
+        closeAll(message.fds);
+        return false;
+    }
+
+    message.payload.resize(fields[2]);
+    received = 0;
+    while (received < message.payload.size()) {
+        ssize_t count = recv(sock, &message.payload[received], message.payload.size() - received, 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) {
+            closeAll(message.fds);
+            return false;
+        }
+        received += static_cast<size_t>(count);
+    }
+    return true;
+}
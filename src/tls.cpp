@@ -0,0 +1,503 @@
+#include "../include/tls.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#ifdef HFT_HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+static std::string sslReason(const char* what) {
+    std::string message = what;
+    unsigned long code = ERR_get_error();
+    if (code != 0) {
+        char text[256];
+        ERR_error_string_n(code, text, sizeof(text));
+        message += ": ";
+        message += text;
+    }
+    ERR_clear_error();
+    return message;
+}
+
+TlsContext::TlsContext(bool server, const TlsConfig& settings) : ctx(nullptr), serverSide(server), config(settings) {
+    ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+    if (!ctx) {
+        throw std::runtime_error(sslReason("Failed to create TLS context"));
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+#if OPENSSL_VERSION_NUMBER < 0x30200000L
+    // Before 3.2 OpenSSL only hands TLS 1.3 sends to the kernel, not receives
+    if (config.kernelOffload) {
+        SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION);
+    }
+#endif
+    // Only AEAD ciphers the kernel can take over
+    if (SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM:ECDHE+CHACHA20:!aNULL") != 1 ||
+        SSL_CTX_set_ciphersuites(ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:"
+                                      "TLS_CHACHA20_POLY1305_SHA256") != 1) {
+        SSL_CTX_free(ctx);
+        throw std::runtime_error(sslReason("Failed to set TLS ciphers"));
+    }
+
+    uint64_t options = SSL_OP_NO_COMPRESSION | SSL_OP_NO_RENEGOTIATION;
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // A peer that closes without close_notify is a plain EOF, as without TLS
+    options |= SSL_OP_IGNORE_UNEXPECTED_EOF;
+#endif
+#ifdef SSL_OP_ENABLE_KTLS
+    if (config.kernelOffload) {
+        options |= SSL_OP_ENABLE_KTLS;
+    }
+#endif
+    if (server) {
+        options |= SSL_OP_CIPHER_SERVER_PREFERENCE;
+    }
+    SSL_CTX_set_options(ctx, options);
+    // Non-blocking writes report each record as it goes out, and may be
+    // retried from a queue that has moved in memory
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+    if (server) {
+        if (config.certFile.empty() || config.keyFile.empty()) {
+            SSL_CTX_free(ctx);
+            throw std::runtime_error("A TLS server needs a certificate and a private key");
+        }
+        if (SSL_CTX_use_certificate_chain_file(ctx, config.certFile.c_str()) != 1 ||
+            SSL_CTX_use_PrivateKey_file(ctx, config.keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+            SSL_CTX_check_private_key(ctx) != 1) {
+            SSL_CTX_free(ctx);
+            throw std::runtime_error(sslReason(("Failed to load TLS certificate " + config.certFile).c_str()));
+        }
+        if (!config.caFile.empty()) {
+            if (SSL_CTX_load_verify_locations(ctx, config.caFile.c_str(), nullptr) != 1) {
+                SSL_CTX_free(ctx);
+                throw std::runtime_error(sslReason(("Failed to load TLS CAs " + config.caFile).c_str()));
+            }
+            SSL_CTX_set_client_CA_list(ctx, SSL_load_client_CA_file(config.caFile.c_str()));
+            SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
+        }
+        // Resumption: session tickets, and the server-side cache for clients
+        // that only offer a session ID
+        static const unsigned char sessionContext[] = "hft_server";
+        SSL_CTX_set_session_id_context(ctx, sessionContext, sizeof(sessionContext) - 1);
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    } else {
+        if (config.verifyPeer) {
+            bool loaded = config.caFile.empty() ? SSL_CTX_set_default_verify_paths(ctx) == 1
+                                                : SSL_CTX_load_verify_locations(ctx, config.caFile.c_str(), nullptr) == 1;
+            if (!loaded) {
+                SSL_CTX_free(ctx);
+                throw std::runtime_error(sslReason("Failed to load TLS CAs"));
+            }
+            SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+        }
+        // Sessions are kept per peer here rather than in OpenSSL's cache,
+        // which clients don't look up on their own
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, &TlsContext::onNewSession);
+    }
+}
+
+TlsContext::~TlsContext() {
+    for (auto& entry : sessions) {
+        SSL_SESSION_free(entry.second);
+    }
+    SSL_CTX_free(ctx);
+}
+
+std::shared_ptr<TlsContext> TlsContext::createServer(const TlsConfig& config) {
+    return std::shared_ptr<TlsContext>(new TlsContext(true, config));
+}
+
+std::shared_ptr<TlsContext> TlsContext::createClient(const TlsConfig& config) {
+    return std::shared_ptr<TlsContext>(new TlsContext(false, config));
+}
+
+int TlsContext::onNewSession(SSL* ssl, SSL_SESSION* session) {
+    TlsSession* owner = static_cast<TlsSession*>(SSL_get_app_data(ssl));
+    if (!owner || owner->peer.empty()) {
+        return 0;
+    }
+    TlsContext& context = owner->context;
+    std::lock_guard<std::mutex> lock(context.sessionsMutex);
+    SSL_SESSION*& slot = context.sessions[owner->peer];
+    if (slot) {
+        SSL_SESSION_free(slot);
+    }
+    slot = session;
+    return 1; // Keeps the reference OpenSSL passed in
+}
+
+TlsSession::TlsSession(TlsContext& tlsContext, int sock, const std::string& peerName)
+    : context(tlsContext), ssl(SSL_new(tlsContext.ctx)), peer(peerName) {
+    if (!ssl) {
+        failure = sslReason("Failed to create TLS session");
+        return;
+    }
+    SSL_set_fd(ssl, sock);
+    SSL_set_app_data(ssl, this);
+    if (context.serverSide) {
+        SSL_set_accept_state(ssl);
+        return;
+    }
+
+    SSL_set_connect_state(ssl);
+    std::string host = peer.substr(0, peer.rfind(':'));
+    const std::string& name = context.config.serverName;
+    if (!name.empty()) {
+        SSL_set_tlsext_host_name(ssl, name.c_str());
+        SSL_set1_host(ssl, name.c_str());
+    } else if (!host.empty()) {
+        unsigned char address[sizeof(struct in6_addr)];
+        bool literal = inet_pton(AF_INET, host.c_str(), address) == 1 || inet_pton(AF_INET6, host.c_str(), address) == 1;
+        if (literal) {
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str());
+        } else {
+            SSL_set_tlsext_host_name(ssl, host.c_str());
+            SSL_set1_host(ssl, host.c_str());
+        }
+    }
+    std::lock_guard<std::mutex> lock(context.sessionsMutex);
+    auto found = context.sessions.find(peer);
+    if (found != context.sessions.end()) {
+        SSL_set_session(ssl, found->second);
+    }
+}
+
+TlsSession::~TlsSession() {
+    // The socket stays open; its owner closes it
+    if (ssl) {
+        SSL_free(ssl);
+    }
+}
+
+ssize_t TlsSession::fail(int result) {
+    int saved = errno;
+    int code = SSL_get_error(ssl, result);
+    unsigned long reason = ERR_get_error();
+    if (reason != 0) {
+        char text[256];
+        ERR_error_string_n(reason, text, sizeof(text));
+        failure = text;
+    } else if (code == SSL_ERROR_SYSCALL && saved != 0) {
+        failure = strerror(saved);
+    } else {
+        failure = "connection closed during the TLS exchange";
+    }
+    ERR_clear_error();
+    errno = code == SSL_ERROR_SYSCALL && saved != 0 ? saved : EIO;
+    return -1;
+}
+
+TlsStatus TlsSession::handshake() {
+    if (!ssl) {
+        return TlsStatus::Failed;
+    }
+    int result = SSL_do_handshake(ssl);
+    if (result == 1) {
+        return TlsStatus::Done;
+    }
+    switch (SSL_get_error(ssl, result)) {
+        case SSL_ERROR_WANT_READ:
+            return TlsStatus::WantRead;
+        case SSL_ERROR_WANT_WRITE:
+            return TlsStatus::WantWrite;
+        default:
+            fail(result);
+            return TlsStatus::Failed;
+    }
+}
+
+bool TlsSession::resumed() const {
+    return ssl && SSL_session_reused(ssl) == 1;
+}
+
+bool TlsSession::sendOffloaded() const {
+#ifndef OPENSSL_NO_KTLS
+    return ssl && BIO_get_ktls_send(SSL_get_wbio(ssl));
+#else
+    return false;
+#endif
+}
+
+bool TlsSession::recvOffloaded() const {
+#ifndef OPENSSL_NO_KTLS
+    return ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl));
+#else
+    return false;
+#endif
+}
+
+std::string TlsSession::description() const {
+    if (!ssl) {
+        return "none";
+    }
+    return std::string(SSL_get_version(ssl)) + " " + SSL_get_cipher_name(ssl);
+}
+
+size_t TlsSession::recordOverhead() const {
+    if (!ssl) {
+        return 0;
+    }
+    // Header, then the tag; TLS 1.3 adds the inner content type, and
+    // TLS 1.2 AES-GCM an explicit nonce
+    if (SSL_version(ssl) >= TLS1_3_VERSION) {
+        return 5 + 1 + 16;
+    }
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+    if (cipher && SSL_CIPHER_get_cipher_nid(cipher) == NID_chacha20_poly1305) {
+        return 5 + 16;
+    }
+    return 5 + 8 + 16;
+}
+
+ssize_t TlsSession::readNow(char* dest, size_t length) {
+    int result = SSL_read(ssl, dest, length > INT_MAX ? INT_MAX : static_cast<int>(length));
+    if (result > 0) {
+        return result;
+    }
+    switch (SSL_get_error(ssl, result)) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        default:
+            return fail(result);
+    }
+}
+
+ssize_t TlsSession::writeNow(const struct iovec* iov, size_t count) {
+    // Replies come as a header and a payload: gather them into whole records,
+    // so a small frame is one record and one segment rather than two
+    static thread_local char record[TLS_MAX_RECORD_PAYLOAD];
+    size_t written = 0;
+    size_t index = 0;
+    size_t skip = 0;  // Bytes of iov[index] already written
+    while (index < count) {
+        const char* base = static_cast<const char*>(iov[index].iov_base);
+        size_t available = iov[index].iov_len - skip;
+        const char* data = base + skip;
+        size_t length = available < TLS_MAX_RECORD_PAYLOAD ? available : TLS_MAX_RECORD_PAYLOAD;
+        if (available < TLS_MAX_RECORD_PAYLOAD && index + 1 < count) {
+            // Each record is the next TLS_MAX_RECORD_PAYLOAD bytes however
+            // they are split, so a retry gathers the same bytes again
+            length = 0;
+            for (size_t i = index; i < count && length < TLS_MAX_RECORD_PAYLOAD; ++i) {
+                size_t offset = i == index ? skip : 0;
+                size_t take = iov[i].iov_len - offset;
+                if (take > TLS_MAX_RECORD_PAYLOAD - length) {
+                    take = TLS_MAX_RECORD_PAYLOAD - length;
+                }
+                memcpy(record + length, static_cast<const char*>(iov[i].iov_base) + offset, take);
+                length += take;
+            }
+            data = record;
+        }
+        if (length == 0) {
+            index++;
+            skip = 0;
+            continue;
+        }
+
+        int result = SSL_write(ssl, data, static_cast<int>(length));
+        if (result <= 0) {
+            int code = SSL_get_error(ssl, result);
+            if (code == SSL_ERROR_WANT_WRITE || code == SSL_ERROR_WANT_READ) {
+                // A record may be half sent; OpenSSL keeps it for the retry
+                return static_cast<ssize_t>(written);
+            }
+            return fail(result);
+        }
+        written += static_cast<size_t>(result);
+        size_t advance = static_cast<size_t>(result);
+        while (advance > 0) {
+            size_t take = iov[index].iov_len - skip < advance ? iov[index].iov_len - skip : advance;
+            skip += take;
+            advance -= take;
+            if (skip == iov[index].iov_len) {
+                index++;
+                skip = 0;
+            }
+        }
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t TlsSession::writeFileNow(int fd, uint64_t offset, size_t length) {
+    // No sendfile() through user-space TLS: read a record's worth at a time
+    static thread_local char chunk[TLS_MAX_RECORD_PAYLOAD];
+    size_t written = 0;
+    while (written < length) {
+        size_t wanted = length - written < sizeof(chunk) ? length - written : sizeof(chunk);
+        ssize_t bytes = pread(fd, chunk, wanted, static_cast<off_t>(offset + written));
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes <= 0) {
+            failure = "file shrank while being sent";
+            return -1;
+        }
+        struct iovec iov;
+        iov.iov_base = chunk;
+        iov.iov_len = static_cast<size_t>(bytes);
+        ssize_t sent = writeNow(&iov, 1);
+        if (sent < 0) {
+            return -1;
+        }
+        written += static_cast<size_t>(sent);
+        if (sent < bytes) {
+            break;
+        }
+    }
+    return static_cast<ssize_t>(written);
+}
+
+bool kernelTlsAvailable(std::string& error) {
+    // The "tls" upper layer can only be attached to a connected socket
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int server = -1;
+    bool available = false;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (listener != -1 && client != -1 && bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+        listen(listener, 1) == 0 && getsockname(listener, (struct sockaddr*)&addr, &length) == 0 &&
+        connect(client, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+        server = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        available = setsockopt(client, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+        if (!available) {
+            error = std::string("kernel TLS unavailable (") + strerror(errno) + "); load the tls module";
+        }
+    } else {
+        error = std::string("kernel TLS probe failed: ") + strerror(errno);
+    }
+    if (server != -1) close(server);
+    if (client != -1) close(client);
+    if (listener != -1) close(listener);
+    return available;
+}
+#else
+TlsContext::TlsContext(bool server, const TlsConfig& settings) : ctx(nullptr), serverSide(server), config(settings) {
+    throw std::runtime_error("TLS unavailable: built without OpenSSL (HFT_HAVE_OPENSSL)");
+}
+
+TlsContext::~TlsContext() {}
+
+std::shared_ptr<TlsContext> TlsContext::createServer(const TlsConfig& config) {
+    return std::shared_ptr<TlsContext>(new TlsContext(true, config));
+}
+
+std::shared_ptr<TlsContext> TlsContext::createClient(const TlsConfig& config) {
+    return std::shared_ptr<TlsContext>(new TlsContext(false, config));
+}
+
+int TlsContext::onNewSession(struct ssl_st* ssl, struct ssl_session_st* session) {
+    (void)ssl;
+    (void)session;
+    return 0;
+}
+
+// No context can be created, so no session ever is
+TlsSession::TlsSession(TlsContext& tlsContext, int sock, const std::string& peerName)
+    : context(tlsContext), ssl(nullptr), peer(peerName) {
+    (void)sock;
+}
+
+TlsSession::~TlsSession() {}
+
+ssize_t TlsSession::fail(int result) {
+    (void)result;
+    errno = EIO;
+    return -1;
+}
+
+TlsStatus TlsSession::handshake() { return TlsStatus::Failed; }
+bool TlsSession::resumed() const { return false; }
+bool TlsSession::sendOffloaded() const { return false; }
+bool TlsSession::recvOffloaded() const { return false; }
+std::string TlsSession::description() const { return "none"; }
+size_t TlsSession::recordOverhead() const { return 0; }
+
+ssize_t TlsSession::readNow(char* dest, size_t length) {
+    (void)dest;
+    (void)length;
+    return fail(0);
+}
+
+ssize_t TlsSession::writeNow(const struct iovec* iov, size_t count) {
+    (void)iov;
+    (void)count;
+    return fail(0);
+}
+
+ssize_t TlsSession::writeFileNow(int fd, uint64_t offset, size_t length) {
+    (void)fd;
+    (void)offset;
+    (void)length;
+    return fail(0);
+}
+
+bool kernelTlsAvailable(std::string& error) {
+    error = "built without OpenSSL (HFT_HAVE_OPENSSL)";
+    return false;
+}
+#endif
+
+bool sendFrame(TlsSession& session, uint16_t opcode, uint32_t requestId, const char* payload, size_t length) {
+    char header[FRAME_HEADER_SIZE];
+    encodeFrameHeader(FrameHeader(opcode, requestId, static_cast<uint32_t>(length)), header);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = FRAME_HEADER_SIZE;
+    iov[1].iov_base = const_cast<char*>(payload);
+    iov[1].iov_len = length;
+    size_t first = 0;
+    while (first < 2) {
+        ssize_t sent = session.writeNow(&iov[first], 2 - first);
+        if (sent < 0) return false;
+        // A blocking socket takes everything; this resumes after a signal
+        size_t advance = static_cast<size_t>(sent);
+        while (first < 2 && advance >= iov[first].iov_len) {
+            advance -= iov[first].iov_len;
+            first++;
+        }
+        if (first < 2) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + advance;
+            iov[first].iov_len -= advance;
+        }
+    }
+    return true;
+}
+
+bool recvFrame(TlsSession& session, ReceiveBuffer& buffer, FrameHeader& header, std::string& payload) {
+    const char* data = nullptr;
+    int status;
+    while ((status = buffer.nextFrame(header, data)) == 0) {
+        char* dest = buffer.prepareWrite(4096);
+        ssize_t bytesRead = session.readNow(dest, buffer.writableBytes());
+        if (bytesRead < 0 && errno == EINTR) continue;
+        if (bytesRead <= 0) return false;
+        buffer.commitWrite(bytesRead);
+    }
+    if (status < 0) return false;
+
+    payload.assign(data, header.length);
+    return true;
+}